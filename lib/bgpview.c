@@ -24,8 +24,10 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <arpa/inet.h>
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "config.h"
 
@@ -169,6 +171,89 @@ typedef struct bwv_peerinfo {
 KHASH_INIT(bwv_peerid_peerinfo, bgpstream_peer_id_t, bwv_peerinfo_t, 1,
            kh_int_hash_func, kh_int_hash_equal)
 
+/***** set of changed prefixes *****/
+
+KHASH_INIT(bwv_v4pfx_set, bgpstream_ipv4_pfx_t, char, 0,
+           bgpstream_ipv4_pfx_hash_val, bgpstream_ipv4_pfx_equal_val)
+
+KHASH_INIT(bwv_v6pfx_set, bgpstream_ipv6_pfx_t, char, 0,
+           bgpstream_ipv6_pfx_hash_val, bgpstream_ipv6_pfx_equal_val)
+
+/** Prefixes that have been touched since the view was last marked */
+typedef struct bwv_changes {
+
+  /** Set of changed v4 prefixes */
+  kh_bwv_v4pfx_set_t *v4pfxs;
+
+  /** Set of changed v6 prefixes */
+  kh_bwv_v6pfx_set_t *v6pfxs;
+
+  /** Time of the view when it was last marked */
+  uint32_t mark_time;
+
+  /** Set if the change sets are incomplete (e.g., the view was cleared) and
+      a full comparison is needed */
+  int incomplete;
+
+} bwv_changes_t;
+
+/***** sorted prefix index *****/
+
+/** A prefix in the sorted index (the address is in host order, and split in
+    two halves so v4 and v6 prefixes can be compared the same way) */
+typedef struct bwv_pfx_index_entry {
+
+  /** First 64 bits of the (masked) address */
+  uint64_t addr_hi;
+
+  /** Last 64 bits of the (masked) address */
+  uint64_t addr_lo;
+
+  /** Mask length */
+  uint8_t mask_len;
+
+  /** Slot of the prefix in the prefix table */
+  khiter_t k;
+
+} bwv_pfx_index_entry_t;
+
+/** Prefixes of one IP version, sorted by address and then mask length
+ *
+ * The index is built the first time it is needed, and then kept up to date:
+ * new prefixes are appended, and merged in when the index is next used, while
+ * garbage collected prefixes are dropped. Since the entries refer to table
+ * slots, it is rebuilt if the prefix table is rehashed.
+ */
+typedef struct bwv_pfx_index {
+
+  /** Sorted prefixes */
+  bwv_pfx_index_entry_t *entries;
+
+  /** Number of entries */
+  uint32_t entries_cnt;
+
+  /** Number of allocated entries */
+  uint32_t entries_alloc_cnt;
+
+  /** Number of entries (at the start of the array) that are sorted, the
+      others have been added since the index was last used */
+  uint32_t sorted_cnt;
+
+  /** Space used to sort the added entries before merging them */
+  bwv_pfx_index_entry_t *scratch;
+
+  /** Number of allocated scratch entries */
+  uint32_t scratch_alloc_cnt;
+
+  /** Mask lengths that are in the index (bit i is set if there may be a /i,
+      lengths are not cleared when prefixes are garbage collected) */
+  uint64_t lens[3];
+
+  /** Is the index up to date with the prefix table? */
+  int valid;
+
+} bwv_pfx_index_t;
+
 /************ bgpview ************/
 
 // TODO: documentation
@@ -238,6 +323,16 @@ struct bgpview {
    */
   int disable_extended;
 
+  /** Prefixes changed since the last mark (NULL if change tracking is not
+      enabled) */
+  bwv_changes_t *changes;
+
+  /** Sorted index of the v4 prefixes */
+  bwv_pfx_index_t v4idx;
+
+  /** Sorted index of the v6 prefixes */
+  bwv_pfx_index_t v6idx;
+
   uint8_t need_gc_v4pfxs;
   uint8_t need_gc_v6pfxs;
   uint8_t need_gc_peerinfo;
@@ -262,12 +357,23 @@ struct bgpview_iter {
   /** State mask used for prefix iteration */
   uint8_t pfx_state_mask;
 
+  /** Is the prefix iteration walking the sorted index? */
+  int pfx_sorted;
+  /** Position of the current pfx in the sorted index */
+  uint32_t pfx_sorted_pos;
+  /** End of the range of the sorted index being walked */
+  uint32_t pfx_sorted_end;
+  /** Smallest mask length of the prefixes in the range */
+  uint8_t pfx_sorted_min_len;
+
   /** Current pfx-peer */
   khiter_t pfx_peer_it;
   /** Is the pfx-peer iterator valid? */
   int pfx_peer_it_valid;
   /** State mask used for pfx-peer iteration */
   uint8_t pfx_peer_state_mask;
+  /** Peers the pfx-peer iteration is restricted to (NULL for all) */
+  const bgpview_peer_bitmap_t *pfx_peer_filter;
   /** AS Path Segment iterator */
   bgpstream_as_path_store_path_iter_t pfx_peer_path_it;
 
@@ -275,6 +381,13 @@ struct bgpview_iter {
   khiter_t peer_it;
   /** State mask used for peer iteration */
   uint8_t peer_state_mask;
+
+  /** The IP version of the changed-prefix set currently iterated */
+  bgpstream_addr_version_t changed_version_ptr;
+  /** IP version filter for changed-prefix iteration (0 for all) */
+  int changed_version_filter;
+  /** Current changed pfx */
+  khiter_t changed_it;
 };
 
 /* ========== PRIVATE FUNCTIONS ========== */
@@ -304,6 +417,35 @@ static void peerinfo_destroy_user(bgpview_t *view)
   }
 }
 
+/* record the prefix the iterator points at as changed since the last mark */
+static void pfx_mark_changed(bgpview_iter_t *iter)
+{
+  bwv_changes_t *ch = iter->view->changes;
+  int khret;
+
+  if (ch == NULL || ch->incomplete != 0) {
+    return;
+  }
+
+  switch (iter->version_ptr) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    kh_put(bwv_v4pfx_set, ch->v4pfxs, kh_key(iter->view->v4pfxs, iter->pfx_it),
+           &khret);
+    break;
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    kh_put(bwv_v6pfx_set, ch->v6pfxs, kh_key(iter->view->v6pfxs, iter->pfx_it),
+           &khret);
+    break;
+  default:
+    return;
+  }
+
+  if (khret < 0) {
+    /* out of memory, so we can no longer vouch for the change set */
+    ch->incomplete = 1;
+  }
+}
+
 static bwv_peerid_pfxinfo_t *peerid_pfxinfo_create(void)
 {
   bwv_peerid_pfxinfo_t *v;
@@ -353,6 +495,7 @@ static int peerid_pfxinfo_insert(bgpview_iter_t *iter,
   }
 
   peerinfo->as_path_id = path_id;
+  pfx_mark_changed(iter);
 
   if (peerinfo->state == BGPVIEW_FIELD_INVALID) {
     // did not already exist or was invalid
@@ -382,6 +525,7 @@ static int peerid_pfxinfo_insert(bgpview_iter_t *iter,
   iter->pfx_peer_it = k;
   iter->pfx_peer_it_valid = 1;
   iter->pfx_peer_state_mask = BGPVIEW_FIELD_ALL_VALID;
+  iter->pfx_peer_filter = NULL;
 
   return 0;
 }
@@ -439,14 +583,28 @@ static void peerid_pfxinfo_destroy(bgpview_t *view, bwv_peerid_pfxinfo_t *v)
          ? (kh_val((iter)->view->v6pfxs, (iter)->pfx_it))                      \
          : NULL)
 
+static void index_entry_set_v4(bwv_pfx_index_entry_t *e,
+                               bgpstream_ipv4_pfx_t *pfx);
+static void index_entry_set_v6(bwv_pfx_index_entry_t *e,
+                               bgpstream_ipv6_pfx_t *pfx);
+static void pfx_index_add(bwv_pfx_index_t *idx, bwv_pfx_index_entry_t *e);
+
 static int add_v4pfx(bgpview_iter_t *iter, bgpstream_ipv4_pfx_t *pfx)
 {
   bwv_peerid_pfxinfo_t *new_pfxpeerinfo;
+  bwv_pfx_index_entry_t e;
   khiter_t k;
   int khret;
 
+  /* a rehash of the table moves the prefixes the sorted index refers to */
+  if (iter->view->v4pfxs->n_occupied >= iter->view->v4pfxs->upper_bound) {
+    iter->view->v4idx.valid = 0;
+  }
   k = kh_put(bwv_v4pfx_peerid_pfxinfo, iter->view->v4pfxs, *pfx, &khret);
   if (khret > 0) {
+    index_entry_set_v4(&e, pfx);
+    e.k = k;
+    pfx_index_add(&iter->view->v4idx, &e);
     /* pfx didn't exist */
     if ((new_pfxpeerinfo = peerid_pfxinfo_create()) == NULL) {
       return -1;
@@ -475,11 +633,19 @@ static int add_v4pfx(bgpview_iter_t *iter, bgpstream_ipv4_pfx_t *pfx)
 static int add_v6pfx(bgpview_iter_t *iter, bgpstream_ipv6_pfx_t *pfx)
 {
   bwv_peerid_pfxinfo_t *new_pfxpeerinfo;
+  bwv_pfx_index_entry_t e;
   khiter_t k;
   int khret;
 
+  /* a rehash of the table moves the prefixes the sorted index refers to */
+  if (iter->view->v6pfxs->n_occupied >= iter->view->v6pfxs->upper_bound) {
+    iter->view->v6idx.valid = 0;
+  }
   k = kh_put(bwv_v6pfx_peerid_pfxinfo, iter->view->v6pfxs, *pfx, &khret);
   if (khret > 0) {
+    index_entry_set_v6(&e, pfx);
+    e.k = k;
+    pfx_index_add(&iter->view->v6idx, &e);
     /* pfx didn't exist */
     if ((new_pfxpeerinfo = peerid_pfxinfo_create()) == NULL) {
       return -1;
@@ -507,6 +673,9 @@ static int add_v6pfx(bgpview_iter_t *iter, bgpstream_ipv6_pfx_t *pfx)
 
 static int add_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx)
 {
+  /* the iterator is seeked to the prefix */
+  iter->pfx_sorted = 0;
+
   if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
     return add_v4pfx(iter, &pfx->bs_ipv4);
   } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
@@ -516,6 +685,234 @@ static int add_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx)
   return -1;
 }
 
+static void index_entry_set_v4(bwv_pfx_index_entry_t *e,
+                               bgpstream_ipv4_pfx_t *pfx)
+{
+  e->mask_len = pfx->mask_len;
+  e->addr_hi = (uint64_t)ntohl(pfx->address.addr.s_addr) << 32;
+  e->addr_hi &= e->mask_len == 0 ? 0 : ~(UINT64_MAX >> e->mask_len);
+  e->addr_lo = 0;
+}
+
+static void index_entry_set_v6(bwv_pfx_index_entry_t *e,
+                               bgpstream_ipv6_pfx_t *pfx)
+{
+  uint8_t *bytes = pfx->address.addr.s6_addr;
+  int b;
+
+  e->mask_len = pfx->mask_len;
+  e->addr_hi = 0;
+  e->addr_lo = 0;
+  for (b = 0; b < 8; b++) {
+    e->addr_hi |= (uint64_t)bytes[b] << (56 - 8 * b);
+    e->addr_lo |= (uint64_t)bytes[b + 8] << (56 - 8 * b);
+  }
+  if (e->mask_len < 64) {
+    e->addr_hi &= e->mask_len == 0 ? 0 : ~(UINT64_MAX >> e->mask_len);
+    e->addr_lo = 0;
+  } else if (e->mask_len < 128) {
+    e->addr_lo &= ~(UINT64_MAX >> (e->mask_len - 64));
+  }
+}
+
+static int index_entry_cmp(const void *a, const void *b)
+{
+  const bwv_pfx_index_entry_t *ea = a;
+  const bwv_pfx_index_entry_t *eb = b;
+
+  if (ea->addr_hi != eb->addr_hi) {
+    return ea->addr_hi < eb->addr_hi ? -1 : 1;
+  }
+  if (ea->addr_lo != eb->addr_lo) {
+    return ea->addr_lo < eb->addr_lo ? -1 : 1;
+  }
+  return (int)ea->mask_len - (int)eb->mask_len;
+}
+
+#define __pfx_index(view, version)                                             \
+  (((version) == BGPSTREAM_ADDR_VERSION_IPV4) ? &(view)->v4idx                 \
+                                              : &(view)->v6idx)
+
+#define INDEX_SET_LEN(idx, len)                                                \
+  do {                                                                         \
+    if ((len) <= 128) {                                                        \
+      (idx)->lens[(len) / 64] |= (uint64_t)1 << ((len) % 64);                  \
+    }                                                                          \
+  } while (0)
+
+#define INDEX_ADD_PFX_TABLE(idx, table, entry_set)                             \
+  do {                                                                         \
+    khiter_t __k;                                                              \
+    bwv_pfx_index_entry_t *__e;                                                \
+    for (__k = kh_begin(table); __k != kh_end(table); ++__k) {                 \
+      if (!kh_exist(table, __k)) {                                             \
+        continue;                                                              \
+      }                                                                        \
+      __e = &(idx)->entries[(idx)->entries_cnt++];                             \
+      entry_set(__e, &kh_key(table, __k));                                     \
+      __e->k = __k;                                                            \
+      INDEX_SET_LEN(idx, __e->mask_len);                                       \
+    }                                                                          \
+  } while (0)
+
+/* merge the entries added since the index was last used into the sorted
+   entries */
+static void pfx_index_merge(bwv_pfx_index_t *idx)
+{
+  uint32_t added_cnt = idx->entries_cnt - idx->sorted_cnt;
+  bwv_pfx_index_entry_t *scratch;
+  uint32_t i, j, out;
+
+  if (added_cnt > idx->scratch_alloc_cnt) {
+    if ((scratch = realloc(idx->scratch, sizeof(bwv_pfx_index_entry_t) *
+                                           added_cnt)) == NULL) {
+      /* sorting everything does not need any space */
+      qsort(idx->entries, idx->entries_cnt, sizeof(bwv_pfx_index_entry_t),
+            index_entry_cmp);
+      idx->sorted_cnt = idx->entries_cnt;
+      return;
+    }
+    idx->scratch = scratch;
+    idx->scratch_alloc_cnt = added_cnt;
+  }
+
+  memcpy(idx->scratch, &idx->entries[idx->sorted_cnt],
+         sizeof(bwv_pfx_index_entry_t) * added_cnt);
+  qsort(idx->scratch, added_cnt, sizeof(bwv_pfx_index_entry_t),
+        index_entry_cmp);
+
+  /* merge from the end, so each sorted entry is moved at most once */
+  i = idx->sorted_cnt;
+  j = added_cnt;
+  out = idx->entries_cnt;
+  while (j > 0) {
+    if (i > 0 && index_entry_cmp(&idx->entries[i - 1], &idx->scratch[j - 1]) >
+                   0) {
+      idx->entries[--out] = idx->entries[--i];
+    } else {
+      idx->entries[--out] = idx->scratch[--j];
+    }
+  }
+  idx->sorted_cnt = idx->entries_cnt;
+}
+
+/* add a new prefix to an index that is in use */
+static void pfx_index_add(bwv_pfx_index_t *idx, bwv_pfx_index_entry_t *e)
+{
+  bwv_pfx_index_entry_t *entries;
+  uint32_t alloc_cnt;
+
+  if (idx->valid == 0) {
+    return;
+  }
+
+  if (idx->entries_cnt == idx->entries_alloc_cnt) {
+    alloc_cnt = idx->entries_alloc_cnt == 0 ? 1024 : idx->entries_alloc_cnt * 2;
+    if ((entries = realloc(idx->entries, sizeof(bwv_pfx_index_entry_t) *
+                                           alloc_cnt)) == NULL) {
+      /* it will be rebuilt when it is next used */
+      idx->valid = 0;
+      return;
+    }
+    idx->entries = entries;
+    idx->entries_alloc_cnt = alloc_cnt;
+  }
+
+  idx->entries[idx->entries_cnt++] = *e;
+  INDEX_SET_LEN(idx, e->mask_len);
+}
+
+/* drop the entries of the prefixes that have been garbage collected */
+#define INDEX_COMPACT(idx, table)                                              \
+  do {                                                                         \
+    uint32_t __i, __j = 0, __sorted = 0;                                       \
+    for (__i = 0; __i < (idx)->entries_cnt; __i++) {                           \
+      if (!kh_exist(table, (idx)->entries[__i].k)) {                           \
+        continue;                                                              \
+      }                                                                        \
+      if (__i < (idx)->sorted_cnt) {                                           \
+        __sorted++;                                                            \
+      }                                                                        \
+      (idx)->entries[__j++] = (idx)->entries[__i];                             \
+    }                                                                          \
+    (idx)->entries_cnt = __j;                                                  \
+    (idx)->sorted_cnt = __sorted;                                              \
+  } while (0)
+
+/* get the sorted index of the given version, (re)building it if needed */
+static bwv_pfx_index_t *pfx_index_get(bgpview_t *view, int version)
+{
+  bwv_pfx_index_t *idx = __pfx_index(view, version);
+  uint32_t size;
+  bwv_pfx_index_entry_t *entries;
+
+  if (idx->valid != 0) {
+    if (idx->sorted_cnt < idx->entries_cnt) {
+      pfx_index_merge(idx);
+    }
+    return idx;
+  }
+
+  size = (version == BGPSTREAM_ADDR_VERSION_IPV4) ? kh_size(view->v4pfxs)
+                                                  : kh_size(view->v6pfxs);
+  if (size > idx->entries_alloc_cnt) {
+    if ((entries = realloc(idx->entries, sizeof(bwv_pfx_index_entry_t) *
+                                           size)) == NULL) {
+      fprintf(stderr, "ERROR: Could not allocate the sorted prefix index\n");
+      return NULL;
+    }
+    idx->entries = entries;
+    idx->entries_alloc_cnt = size;
+  }
+
+  idx->entries_cnt = 0;
+  memset(idx->lens, 0, sizeof(idx->lens));
+  if (version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    INDEX_ADD_PFX_TABLE(idx, view->v4pfxs, index_entry_set_v4);
+  } else {
+    INDEX_ADD_PFX_TABLE(idx, view->v6pfxs, index_entry_set_v6);
+  }
+  assert(idx->entries_cnt == size);
+
+  qsort(idx->entries, idx->entries_cnt, sizeof(bwv_pfx_index_entry_t),
+        index_entry_cmp);
+  idx->sorted_cnt = idx->entries_cnt;
+  idx->valid = 1;
+  return idx;
+}
+
+/* position of the first entry of the index that is not smaller than key */
+static uint32_t pfx_index_lower_bound(bwv_pfx_index_t *idx,
+                                      bwv_pfx_index_entry_t *key)
+{
+  uint32_t lo = 0;
+  uint32_t hi = idx->entries_cnt;
+  uint32_t mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (index_entry_cmp(&idx->entries[mid], key) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static void pfx_index_destroy(bwv_pfx_index_t *idx)
+{
+  free(idx->entries);
+  idx->entries = NULL;
+  idx->entries_cnt = 0;
+  idx->entries_alloc_cnt = 0;
+  idx->sorted_cnt = 0;
+  free(idx->scratch);
+  idx->scratch = NULL;
+  idx->scratch_alloc_cnt = 0;
+  idx->valid = 0;
+}
+
 /* ==================== ITERATOR FUNCTIONS ==================== */
 
 bgpview_iter_t *bgpview_iter_create(bgpview_t *view)
@@ -753,6 +1150,69 @@ bgpview_iter_pfx_peer_as_path_seg_next(bgpview_iter_t *iter)
   return __iter_pfx_peer_as_path_seg_next(iter);
 }
 
+/* Make sure that the given path ID is the one that the path store would hand
+ * out for the same path when looked up by value (see
+ * bgpview_iter_pfx_add_peer_by_id). Paths that start with the peer ASN are
+ * stored as "core" paths, so a non-core ID whose first hop is the peer ASN
+ * (e.g. inserted by a reader that did not know the peer ASN) is an alias of
+ * the core path and is replaced by it. */
+static int path_id_canonicalize(bgpview_iter_t *iter,
+                                bgpstream_as_path_store_path_id_t *path_id)
+{
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_store_path_iter_t pit;
+  bgpstream_as_path_seg_t *seg;
+  bgpstream_as_path_t *path;
+  bgpstream_as_path_store_path_id_t canon;
+  uint32_t peer_asn = __iter_peer_get_sig(iter)->peer_asnumber;
+
+  if ((spath = bgpstream_as_path_store_get_store_path(iter->view->pathstore,
+                                                      *path_id)) == NULL) {
+    fprintf(stderr, "ERROR: Invalid AS Path ID\n");
+    return -1;
+  }
+
+#ifndef BGPVIEW_VALIDATE_PATH_IDS
+  /* core paths are always canonical */
+  if (bgpstream_as_path_store_path_is_core(spath) != 0) {
+    return 0;
+  }
+
+  /* as are non-core paths that do not start with the peer ASN */
+  bgpstream_as_path_store_path_iter_reset(spath, &pit, peer_asn);
+  if ((seg = bgpstream_as_path_store_path_get_next_seg(&pit)) == NULL ||
+      seg->type != BGPSTREAM_AS_PATH_SEG_ASN ||
+      ((bgpstream_as_path_seg_asn_t *)seg)->asn != peer_asn) {
+    return 0;
+  }
+#else
+  (void)pit;
+  (void)seg;
+#endif
+
+  /* look the path up by value to find the canonical ID */
+  if ((path = bgpstream_as_path_store_path_get_path(spath, peer_asn)) == NULL) {
+    return -1;
+  }
+  if (bgpstream_as_path_store_get_path_id(iter->view->pathstore, path,
+                                          peer_asn, &canon) != 0) {
+    fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
+    bgpstream_as_path_destroy(path);
+    return -1;
+  }
+  bgpstream_as_path_destroy(path);
+
+#ifdef BGPVIEW_VALIDATE_PATH_IDS
+  if (memcmp(&canon, path_id, sizeof(canon)) != 0) {
+    fprintf(stderr, "WARN: Non-canonical AS Path ID for peer AS%u (core: %d)\n",
+            peer_asn, bgpstream_as_path_store_path_is_core(spath));
+  }
+#endif
+
+  *path_id = canon;
+  return 0;
+}
+
 int bgpview_iter_pfx_peer_set_as_path(bgpview_iter_t *iter,
                                       bgpstream_as_path_t *as_path)
 {
@@ -765,6 +1225,7 @@ int bgpview_iter_pfx_peer_set_as_path(bgpview_iter_t *iter,
     fprintf(stderr, "ERROR: Failed to get AS Path ID from store\n");
     return -1;
   }
+  pfx_mark_changed(iter);
 
   return 0;
 }
@@ -772,7 +1233,11 @@ int bgpview_iter_pfx_peer_set_as_path(bgpview_iter_t *iter,
 int bgpview_iter_pfx_peer_set_as_path_by_id(
   bgpview_iter_t *iter, bgpstream_as_path_store_path_id_t path_id)
 {
+  if (path_id_canonicalize(iter, &path_id) != 0) {
+    return -1;
+  }
   (__pfx_peer_field(iter, as_path_id)) = path_id;
+  pfx_mark_changed(iter);
   return 0;
 }
 
@@ -922,6 +1387,9 @@ int bgpview_iter_first_pfx(bgpview_iter_t *iter, int version,
   // moving pfx_it invalidates pfx_peer_it
   iter->pfx_peer_it_valid = 0;
 
+  // walk the table in hash order
+  iter->pfx_sorted = 0;
+
   if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
     iter->pfx_it = kh_begin(iter->view->v4pfxs);
     /* keep searching if this does not exist */
@@ -979,10 +1447,66 @@ int bgpview_iter_first_pfx(bgpview_iter_t *iter, int version,
     WHILE_NOT_MATCHED_PFX(iter, iter->view->v6pfxs);                           \
   } while (0)
 
+/* point the iterator at the first prefix in the range of the sorted index
+   (starting from the current position) that matches the state mask */
+static void sorted_scan(bgpview_iter_t *iter)
+{
+  bwv_pfx_index_t *idx = __pfx_index(iter->view, iter->version_ptr);
+  bwv_pfx_index_entry_t *e;
+  uint8_t state;
+
+  for (; iter->pfx_sorted_pos < iter->pfx_sorted_end;
+       iter->pfx_sorted_pos++) {
+    e = &idx->entries[iter->pfx_sorted_pos];
+    if (e->mask_len < iter->pfx_sorted_min_len) {
+      continue;
+    }
+    state = (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)
+              ? kh_val(iter->view->v4pfxs, e->k)->state
+              : kh_val(iter->view->v6pfxs, e->k)->state;
+    if (iter->pfx_state_mask & state) {
+      iter->pfx_it = e->k;
+      return;
+    }
+  }
+
+  iter->pfx_it = (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)
+                   ? kh_end(iter->view->v4pfxs)
+                   : kh_end(iter->view->v6pfxs);
+}
+
+/* walk the whole sorted index of the given version (it must be up to date) */
+static void sorted_first_version(bgpview_iter_t *iter, int version)
+{
+  bwv_pfx_index_t *idx = __pfx_index(iter->view, version);
+
+  assert(idx->valid != 0);
+  iter->version_ptr = version;
+  iter->pfx_sorted_pos = 0;
+  iter->pfx_sorted_end = idx->entries_cnt;
+  iter->pfx_sorted_min_len = 0;
+  sorted_scan(iter);
+}
+
+static void sorted_next(bgpview_iter_t *iter)
+{
+  iter->pfx_sorted_pos++;
+  sorted_scan(iter);
+
+  /* if no v4 pfx is left, but considering all versions... */
+  if (iter->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4 &&
+      iter->pfx_it == kh_end(iter->view->v4pfxs) &&
+      iter->version_filter == 0) {
+    sorted_first_version(iter, BGPSTREAM_ADDR_VERSION_IPV6);
+  }
+}
+
 #define __iter_next_pfx(iter)                                                  \
   do {                                                                         \
     (iter)->pfx_peer_it_valid = 0;                                             \
-    if ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {                  \
+    if ((iter)->pfx_sorted) {                                                  \
+      sorted_next(iter);                                                       \
+    } else if ((iter)->version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {           \
       __iter_next_pfx_v4(iter);                                                \
     } else {                                                                   \
       __iter_next_pfx_v6(iter);                                                \
@@ -1017,6 +1541,7 @@ int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
   iter->pfx_state_mask = state_mask;
   iter->pfx_peer_it_valid = 0;
   iter->pfx_peer_it = 0;
+  iter->pfx_sorted = 0;
 
   switch (pfx->address.version) {
   case BGPSTREAM_ADDR_VERSION_IPV4:
@@ -1053,6 +1578,169 @@ int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
   return 0;
 }
 
+int bgpview_iter_first_pfx_sorted(bgpview_iter_t *iter, int version,
+                                  uint8_t state_mask)
+{
+  // make sure the indexes we walk are up to date
+  if ((version == 0 || version == BGPSTREAM_ADDR_VERSION_IPV4) &&
+      pfx_index_get(iter->view, BGPSTREAM_ADDR_VERSION_IPV4) == NULL) {
+    return -1;
+  }
+  if ((version == 0 || version == BGPSTREAM_ADDR_VERSION_IPV6) &&
+      pfx_index_get(iter->view, BGPSTREAM_ADDR_VERSION_IPV6) == NULL) {
+    return -1;
+  }
+
+  iter->version_filter = version;
+  iter->pfx_state_mask = state_mask;
+  iter->pfx_peer_it_valid = 0;
+  iter->pfx_sorted = 1;
+
+  if (version == BGPSTREAM_ADDR_VERSION_IPV6) {
+    sorted_first_version(iter, BGPSTREAM_ADDR_VERSION_IPV6);
+    return __iter_has_more_pfx(iter);
+  }
+
+  sorted_first_version(iter, BGPSTREAM_ADDR_VERSION_IPV4);
+  if (__iter_has_more_pfx(iter) == 0 && version == 0) {
+    sorted_first_version(iter, BGPSTREAM_ADDR_VERSION_IPV6);
+  }
+  return __iter_has_more_pfx(iter);
+}
+
+int bgpview_iter_first_pfx_within(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                                  uint8_t state_mask)
+{
+  bwv_pfx_index_t *idx;
+  bwv_pfx_index_entry_t key;
+
+  if ((idx = pfx_index_get(iter->view, pfx->address.version)) == NULL) {
+    return -1;
+  }
+
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    index_entry_set_v4(&key, &pfx->bs_ipv4);
+  } else {
+    index_entry_set_v6(&key, &pfx->bs_ipv6);
+  }
+
+  iter->version_filter = pfx->address.version;
+  iter->version_ptr = pfx->address.version;
+  iter->pfx_state_mask = state_mask;
+  iter->pfx_peer_it_valid = 0;
+  iter->pfx_sorted = 1;
+
+  /* the prefix itself sorts before all its more-specifics, while the prefixes
+     that cover it sort before it (if they have the same address) or have an
+     address smaller than the prefix address */
+  iter->pfx_sorted_pos = pfx_index_lower_bound(idx, &key);
+  iter->pfx_sorted_min_len = key.mask_len;
+
+  /* the range ends after the last address of the prefix */
+  if (key.mask_len < 64) {
+    key.addr_hi |= UINT64_MAX >> key.mask_len;
+    key.addr_lo = UINT64_MAX;
+  } else if (key.mask_len < 128) {
+    key.addr_lo |= UINT64_MAX >> (key.mask_len - 64);
+  }
+  key.mask_len = UINT8_MAX;
+  iter->pfx_sorted_end = pfx_index_lower_bound(idx, &key);
+
+  sorted_scan(iter);
+  return __iter_has_more_pfx(iter);
+}
+
+/* clear the host bits of the prefix beyond the given mask length */
+static void pfx_set_mask_len(bgpstream_pfx_t *pfx, int len)
+{
+  uint8_t *bytes;
+  int b;
+
+  pfx->mask_len = len;
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    pfx->bs_ipv4.mask_len = len;
+    pfx->bs_ipv4.address.addr.s_addr &=
+      htonl(len == 0 ? 0 : UINT32_MAX << (32 - len));
+  } else {
+    pfx->bs_ipv6.mask_len = len;
+    bytes = pfx->bs_ipv6.address.addr.s6_addr;
+    for (b = len / 8; b < 16; b++) {
+      bytes[b] &= (b == len / 8) ? (0xFF << (8 - len % 8)) & 0xFF : 0;
+    }
+  }
+}
+
+/* set the iterator to the end of the prefix table of the given version, as
+   bgpview_iter_seek_pfx does when the prefix is not found */
+static void seek_pfx_end(bgpview_iter_t *iter, int version,
+                         uint8_t state_mask)
+{
+  iter->version_filter = version;
+  iter->version_ptr = version;
+  iter->pfx_state_mask = state_mask;
+  iter->pfx_peer_it_valid = 0;
+  iter->pfx_sorted = 0;
+  iter->pfx_it = (version == BGPSTREAM_ADDR_VERSION_IPV4)
+                   ? kh_end(iter->view->v4pfxs)
+                   : kh_end(iter->view->v6pfxs);
+}
+
+#define INDEX_HAS_LEN(idx, len)                                                \
+  (((idx)->lens[(len) / 64] & ((uint64_t)1 << ((len) % 64))) != 0)
+
+int bgpview_iter_seek_pfx_lpm(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                              uint8_t state_mask)
+{
+  bwv_pfx_index_t *idx;
+  bgpstream_pfx_t cur = *pfx;
+  int len;
+
+  if ((idx = pfx_index_get(iter->view, pfx->address.version)) == NULL) {
+    return -1;
+  }
+
+  /* only look up the mask lengths that are in the view */
+  for (len = pfx->mask_len > 128 ? 128 : pfx->mask_len; len >= 0; len--) {
+    if (INDEX_HAS_LEN(idx, len) == 0) {
+      continue;
+    }
+    pfx_set_mask_len(&cur, len);
+    if (bgpview_iter_seek_pfx(iter, &cur, state_mask) != 0) {
+      return 1;
+    }
+  }
+
+  seek_pfx_end(iter, pfx->address.version, state_mask);
+  return 0;
+}
+
+int bgpview_iter_seek_pfx_mincovering(bgpview_iter_t *iter,
+                                      bgpstream_pfx_t *pfx, uint8_t state_mask)
+{
+  bwv_pfx_index_t *idx;
+  bgpstream_pfx_t cur;
+  int len;
+
+  if ((idx = pfx_index_get(iter->view, pfx->address.version)) == NULL) {
+    return -1;
+  }
+
+  /* the shortest mask length that is in the view first */
+  for (len = 0; len < pfx->mask_len && len <= 128; len++) {
+    if (INDEX_HAS_LEN(idx, len) == 0) {
+      continue;
+    }
+    cur = *pfx;
+    pfx_set_mask_len(&cur, len);
+    if (bgpview_iter_seek_pfx(iter, &cur, state_mask) != 0) {
+      return 1;
+    }
+  }
+
+  seek_pfx_end(iter, pfx->address.version, state_mask);
+  return 0;
+}
+
 /* ==================== PFX-PEER ITERATORS ==================== */
 
 /* optimized macros. be careful when using these */
@@ -1061,6 +1749,10 @@ int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
   do {                                                                         \
     for ( ; (iter)->pfx_peer_it != kh_end(peertable); ++(iter)->pfx_peer_it) { \
       if (!kh_exist(peertable, (iter)->pfx_peer_it)) continue;                 \
+      if ((iter)->pfx_peer_filter != NULL &&                                   \
+          !BGPVIEW_PEER_BITMAP_EXISTS((iter)->pfx_peer_filter,                 \
+                                      kh_key(peertable, (iter)->pfx_peer_it))) \
+        continue;                                                              \
       if ((iter)->pfx_peer_state_mask &                                        \
           kh_val(peertable, (iter)->pfx_peer_it).state) {                      \
         __iter_seek_peer((iter), kh_key(peertable, (iter)->pfx_peer_it),       \
@@ -1071,25 +1763,29 @@ int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
     }                                                                          \
   } while (0)
 
-#define __iter_pfx_first_peer_tab(iter, peertable, state_mask)                 \
+#define __iter_pfx_first_peer_tab(iter, peertable, state_mask, filter)         \
   do {                                                                         \
     (iter)->pfx_peer_state_mask = state_mask;                                  \
+    (iter)->pfx_peer_filter = filter;                                          \
     (iter)->pfx_peer_it = 0;                                                   \
     (iter)->pfx_peer_it_valid = 0;                                             \
     if (!peertable) break;                                                     \
     SCAN_FOR_MATCHING_PFX_PEER(iter, peertable);                               \
   } while (0)
 
-#define __iter_pfx_first_peer(iter, state_mask)                                \
+#define __iter_pfx_first_peer_in(iter, state_mask, filter)                     \
   do {                                                                         \
     bwv_peerid_pfxinfo_t *__infos = __pfx_peerinfos((iter));                   \
     if ((iter)->view->disable_extended) {                                      \
-      __iter_pfx_first_peer_tab(iter, __infos->peers_min, state_mask);         \
+      __iter_pfx_first_peer_tab(iter, __infos->peers_min, state_mask, filter); \
     } else {                                                                   \
-      __iter_pfx_first_peer_tab(iter, __infos->peers_ext, state_mask);         \
+      __iter_pfx_first_peer_tab(iter, __infos->peers_ext, state_mask, filter); \
     }                                                                          \
   } while (0)
 
+#define __iter_pfx_first_peer(iter, state_mask)                                \
+  __iter_pfx_first_peer_in(iter, state_mask, NULL)
+
 #define __iter_pfx_next_peer_tab(iter, peertable)                              \
   do {                                                                         \
     (iter)->pfx_peer_it_valid = 0;                                             \
@@ -1113,6 +1809,7 @@ int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
 #define __iter_pfx_seek_peer_tab(iter, tabtype, peertable, peerid, state_mask) \
   do {                                                                         \
     (iter)->pfx_peer_state_mask = state_mask;                                  \
+    (iter)->pfx_peer_filter = NULL;                                            \
     khiter_t k;                                                                \
     if (peertable &&                                                           \
         (k = kh_get(tabtype, peertable, peerid)) != kh_end(peertable) &&       \
@@ -1146,6 +1843,14 @@ int bgpview_iter_pfx_first_peer(bgpview_iter_t *iter, uint8_t state_mask)
   return (iter->pfx_peer_it_valid);
 }
 
+int bgpview_iter_pfx_first_peer_in(bgpview_iter_t *iter, uint8_t state_mask,
+                                   const bgpview_peer_bitmap_t *peers)
+{
+  __iter_pfx_first_peer_in(iter, state_mask, peers);
+  assert(iter->pfx_peer_it_valid == 0 || __iter_has_more_peer(iter));
+  return (iter->pfx_peer_it_valid);
+}
+
 int bgpview_iter_pfx_next_peer(bgpview_iter_t *iter)
 {
   __iter_pfx_next_peer(iter);
@@ -1244,6 +1949,87 @@ int bgpview_iter_seek_pfx_peer(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
   return 0;
 }
 
+/* ==================== CHANGED-PFX ITERATORS ==================== */
+
+#define WHILE_NOT_EXIST_CHANGED(iter, set)                                     \
+  while ((iter)->changed_it != kh_end((set)) &&                                \
+         !kh_exist((set), (iter)->changed_it))
+
+#define __iter_has_more_changed_pfx(iter)                                      \
+  (((iter)->changed_version_ptr == BGPSTREAM_ADDR_VERSION_IPV4)                \
+     ? ((iter)->changed_it != kh_end((iter)->view->changes->v4pfxs))           \
+     : ((iter)->changed_version_ptr == BGPSTREAM_ADDR_VERSION_IPV6)            \
+         ? ((iter)->changed_it != kh_end((iter)->view->changes->v6pfxs))       \
+         : 0)
+
+int bgpview_iter_first_changed_pfx(bgpview_iter_t *iter, int version)
+{
+  bwv_changes_t *ch = iter->view->changes;
+  assert(ch != NULL);
+
+  iter->changed_version_filter = version;
+
+  if (version == 0 || version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    iter->changed_version_ptr = BGPSTREAM_ADDR_VERSION_IPV4;
+    iter->changed_it = kh_begin(ch->v4pfxs);
+    WHILE_NOT_EXIST_CHANGED(iter, ch->v4pfxs)
+    {
+      iter->changed_it++;
+    }
+    if (iter->changed_it != kh_end(ch->v4pfxs) || version != 0) {
+      return __iter_has_more_changed_pfx(iter);
+    }
+  }
+
+  iter->changed_version_ptr = BGPSTREAM_ADDR_VERSION_IPV6;
+  iter->changed_it = kh_begin(ch->v6pfxs);
+  WHILE_NOT_EXIST_CHANGED(iter, ch->v6pfxs)
+  {
+    iter->changed_it++;
+  }
+  return __iter_has_more_changed_pfx(iter);
+}
+
+int bgpview_iter_next_changed_pfx(bgpview_iter_t *iter)
+{
+  bwv_changes_t *ch = iter->view->changes;
+
+  if (iter->changed_version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
+    do {
+      iter->changed_it++;
+    }
+    WHILE_NOT_EXIST_CHANGED(iter, ch->v4pfxs);
+    if (iter->changed_it == kh_end(ch->v4pfxs) &&
+        iter->changed_version_filter == 0) {
+      /* skip to the first changed v6 pfx */
+      bgpview_iter_first_changed_pfx(iter, BGPSTREAM_ADDR_VERSION_IPV6);
+      iter->changed_version_filter = 0;
+    }
+  } else {
+    do {
+      iter->changed_it++;
+    }
+    WHILE_NOT_EXIST_CHANGED(iter, ch->v6pfxs);
+  }
+
+  return __iter_has_more_changed_pfx(iter);
+}
+
+int bgpview_iter_has_more_changed_pfx(bgpview_iter_t *iter)
+{
+  return __iter_has_more_changed_pfx(iter);
+}
+
+bgpstream_pfx_t *bgpview_iter_changed_pfx_get_pfx(bgpview_iter_t *iter)
+{
+  if (iter->changed_version_ptr == BGPSTREAM_ADDR_VERSION_IPV4) {
+    return (bgpstream_pfx_t *)&kh_key(iter->view->changes->v4pfxs,
+                                      iter->changed_it);
+  }
+  return (bgpstream_pfx_t *)&kh_key(iter->view->changes->v6pfxs,
+                                    iter->changed_it);
+}
+
 /* ==================== CREATION FUNCS ==================== */
 
 bgpstream_peer_id_t bgpview_iter_add_peer(bgpview_iter_t *iter,
@@ -1461,6 +2247,10 @@ int bgpview_iter_pfx_add_peer_by_id(bgpview_iter_t *iter,
   /* this code is mostly a duplicate of the above func, for efficiency */
   __iter_seek_peer(iter, peer_id, BGPVIEW_FIELD_ALL_VALID);
 
+  if (path_id_canonicalize(iter, &path_id) != 0) {
+    return -1;
+  }
+
   return peerid_pfxinfo_insert(iter, __pfx_peerinfos(iter), peer_id, path_id);
 }
 
@@ -1481,6 +2271,7 @@ int bgpview_iter_pfx_remove_peer(bgpview_iter_t *iter)
   BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
       BGPVIEW_FIELD_INVALID);
   pfxinfo->peers_cnt[BGPVIEW_FIELD_INACTIVE]--;
+  pfx_mark_changed(iter);
 
   assert(__iter_has_more_peer(iter));
   switch (iter->version_ptr) {
@@ -1679,6 +2470,7 @@ int bgpview_iter_pfx_activate_peer(bgpview_iter_t *iter)
 
   BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
       BGPVIEW_FIELD_ACTIVE);
+  pfx_mark_changed(iter);
 
   return 1;
 }
@@ -1698,6 +2490,7 @@ int bgpview_iter_pfx_deactivate_peer(bgpview_iter_t *iter)
   /* set the state to inactive */
   BWV_PFX_SET_PEER_STATE(iter->view, pfxinfo, iter->pfx_peer_it,
       BGPVIEW_FIELD_INACTIVE);
+  pfx_mark_changed(iter);
 
   /* update the number of peers that observe the pfx */
   DEACTIVATE_FIELD_CNT(pfxinfo->peers_cnt);
@@ -1853,6 +2646,16 @@ void bgpview_destroy(bgpview_t *view)
     view->user = NULL;
   }
 
+  if (view->changes != NULL) {
+    kh_destroy(bwv_v4pfx_set, view->changes->v4pfxs);
+    kh_destroy(bwv_v6pfx_set, view->changes->v6pfxs);
+    free(view->changes);
+    view->changes = NULL;
+  }
+
+  pfx_index_destroy(&view->v4idx);
+  pfx_index_destroy(&view->v6idx);
+
   free(view);
 }
 
@@ -1899,6 +2702,12 @@ void bgpview_clear(bgpview_t *view)
   view->peerinfo_cnt[BGPVIEW_FIELD_INACTIVE] = 0;
   view->peerinfo_cnt[BGPVIEW_FIELD_ACTIVE] = 0;
 
+  /* cells were dropped without being recorded, so the change sets are no
+     longer usable until the next mark */
+  if (view->changes != NULL) {
+    view->changes->incomplete = 1;
+  }
+
   bgpview_iter_destroy(lit);
 }
 
@@ -1919,6 +2728,9 @@ void bgpview_gc(bgpview_t *view)
       }
     }
     view->need_gc_v4pfxs = 0;
+    if (view->v4idx.valid != 0) {
+      INDEX_COMPACT(&view->v4idx, view->v4pfxs);
+    }
   }
 
   if (view->need_gc_v6pfxs) {
@@ -1930,6 +2742,9 @@ void bgpview_gc(bgpview_t *view)
       }
     }
     view->need_gc_v6pfxs = 0;
+    if (view->v6idx.valid != 0) {
+      INDEX_COMPACT(&view->v6idx, view->v6pfxs);
+    }
   }
 
   if (view->need_gc_peerinfo) {
@@ -2062,6 +2877,368 @@ err:
   return NULL;
 }
 
+/* copy the active pfx-peers (of the peers in the bitmap, unless it is NULL) of
+   the prefix src_iter points at into dst_iter's view (the views must share
+   their peer sigs and path store) */
+static int copy_pfx_shared(bgpview_iter_t *dst_iter, bgpview_iter_t *src_iter,
+                           const bgpview_peer_bitmap_t *peers)
+{
+  bgpstream_pfx_t *pfx = bgpview_iter_pfx_get_pfx(src_iter);
+  bgpstream_peer_id_t peer_id;
+  bgpstream_as_path_store_path_id_t pathid;
+  int first = 1;
+
+  if (peers != NULL) {
+    bgpview_iter_pfx_first_peer_in(src_iter, BGPVIEW_FIELD_ACTIVE, peers);
+  } else {
+    bgpview_iter_pfx_first_peer(src_iter, BGPVIEW_FIELD_ACTIVE);
+  }
+  for (; bgpview_iter_pfx_has_more_peer(src_iter);
+       bgpview_iter_pfx_next_peer(src_iter)) {
+    peer_id = bgpview_iter_peer_get_peer_id(src_iter);
+    pathid = bgpview_iter_pfx_peer_get_as_path_store_path_id(src_iter);
+    if (first != 0) {
+      if (bgpview_iter_add_pfx_peer_by_id(dst_iter, pfx, peer_id, pathid) !=
+          0) {
+        return -1;
+      }
+      first = 0;
+    } else {
+      if (bgpview_iter_pfx_add_peer_by_id(dst_iter, peer_id, pathid) != 0) {
+        return -1;
+      }
+    }
+    bgpview_iter_pfx_activate_peer(dst_iter);
+  }
+
+  return 0;
+}
+
+#define PEER_SELECTED(peers, peer_id)                                          \
+  ((peers) == NULL || BGPVIEW_PEER_BITMAP_EXISTS((peers), (peer_id)))
+
+/* are the active peers of dst the active peers of src (that are in the bitmap,
+   unless it is NULL)? */
+static int same_active_peers(bgpview_t *dst, bgpview_t *src,
+                             const bgpview_peer_bitmap_t *peers)
+{
+  khiter_t k;
+  uint32_t cnt = 0;
+
+  for (k = kh_begin(src->peerinfo); k != kh_end(src->peerinfo); ++k) {
+    if (!kh_exist(src->peerinfo, k) ||
+        kh_val(src->peerinfo, k).state != BGPVIEW_FIELD_ACTIVE ||
+        !PEER_SELECTED(peers, kh_key(src->peerinfo, k))) {
+      continue;
+    }
+    khiter_t dk = kh_get(bwv_peerid_peerinfo, dst->peerinfo,
+                         kh_key(src->peerinfo, k));
+    if (dk == kh_end(dst->peerinfo) ||
+        kh_val(dst->peerinfo, dk).state != BGPVIEW_FIELD_ACTIVE) {
+      return 0;
+    }
+    cnt++;
+  }
+
+  return dst->peerinfo_cnt[BGPVIEW_FIELD_ACTIVE] == cnt;
+}
+
+/* clear dst and copy the active peers and pfx-peers of src (of the peers in
+   the bitmap) into it (the views must share their peer sigs and path store) */
+static int copy_filtered(bgpview_t *dst, bgpview_t *src,
+                         const bgpview_peer_bitmap_t *peers)
+{
+  bgpview_iter_t *src_iter = NULL;
+  bgpview_iter_t *dst_iter = NULL;
+  bgpstream_peer_sig_t *ps;
+
+  bgpview_clear(dst);
+  dst->time = src->time;
+
+  if (((src_iter = bgpview_iter_create(src)) == NULL) ||
+      ((dst_iter = bgpview_iter_create(dst)) == NULL)) {
+    goto err;
+  }
+
+  for (bgpview_iter_first_peer(src_iter, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(src_iter); bgpview_iter_next_peer(src_iter)) {
+    if (!PEER_SELECTED(peers, bgpview_iter_peer_get_peer_id(src_iter))) {
+      continue;
+    }
+    /* the peer sigs are shared, so the peer keeps its id */
+    ps = bgpview_iter_peer_get_sig(src_iter);
+    if (bgpview_iter_add_peer(dst_iter, ps->collector_str, &ps->peer_ip_addr,
+                              ps->peer_asnumber) == 0) {
+      goto err;
+    }
+    bgpview_iter_activate_peer(dst_iter);
+  }
+
+  for (bgpview_iter_first_pfx(src_iter, 0, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_pfx(src_iter); bgpview_iter_next_pfx(src_iter)) {
+    if (copy_pfx_shared(dst_iter, src_iter, peers) != 0) {
+      goto err;
+    }
+  }
+
+  bgpview_iter_destroy(src_iter);
+  bgpview_iter_destroy(dst_iter);
+  return 0;
+
+err:
+  bgpview_iter_destroy(src_iter);
+  bgpview_iter_destroy(dst_iter);
+  return -1;
+}
+
+int bgpview_sync(bgpview_t *dst, bgpview_t *src)
+{
+  return bgpview_sync_filtered(dst, src, NULL);
+}
+
+int bgpview_sync_filtered(bgpview_t *dst, bgpview_t *src,
+                          const bgpview_peer_bitmap_t *peers)
+{
+  bgpview_iter_t *src_iter = NULL;
+  bgpview_iter_t *dst_iter = NULL;
+  bgpstream_pfx_t *pfx;
+  uint32_t slots, valid;
+  int shared =
+    dst->peersigns == src->peersigns && dst->pathstore == src->pathstore;
+
+  if (peers != NULL && shared == 0) {
+    fprintf(stderr, "ERROR: A filtered view sync requires the views to share "
+                    "their peer sigs and path store\n");
+    return -1;
+  }
+
+  /* the incremental path only works if dst holds a copy of the view that src
+     was marked at, with the same peer ids and path ids */
+  if (shared == 0 || bgpview_has_changes_since(src, dst->time) == 0 ||
+      same_active_peers(dst, src, peers) == 0) {
+    if (peers != NULL) {
+      return copy_filtered(dst, src, peers);
+    }
+    bgpview_clear(dst);
+    return bgpview_copy(dst, src);
+  }
+
+  dst->time = src->time;
+
+  if (((src_iter = bgpview_iter_create(src)) == NULL) ||
+      ((dst_iter = bgpview_iter_create(dst)) == NULL)) {
+    goto err;
+  }
+
+  /* replace each changed prefix with its current content */
+  for (bgpview_iter_first_changed_pfx(src_iter, 0);
+       bgpview_iter_has_more_changed_pfx(src_iter);
+       bgpview_iter_next_changed_pfx(src_iter)) {
+    pfx = bgpview_iter_changed_pfx_get_pfx(src_iter);
+
+    if (bgpview_iter_seek_pfx(dst_iter, pfx, BGPVIEW_FIELD_ALL_VALID) != 0 &&
+        bgpview_iter_remove_pfx(dst_iter) != 0) {
+      goto err;
+    }
+
+    if (bgpview_iter_seek_pfx(src_iter, pfx, BGPVIEW_FIELD_ACTIVE) != 0 &&
+        copy_pfx_shared(dst_iter, src_iter, peers) != 0) {
+      goto err;
+    }
+  }
+
+  bgpview_iter_destroy(src_iter);
+  bgpview_iter_destroy(dst_iter);
+
+  /* removed prefixes are usually re-added in a later interval, so only
+     garbage collect once they take up a sizable part of the tables */
+  slots = kh_size(dst->v4pfxs) + kh_size(dst->v6pfxs);
+  valid = bgpview_pfx_cnt(dst, BGPVIEW_FIELD_ALL_VALID);
+  if (slots - valid > valid / 8) {
+    bgpview_gc(dst);
+  }
+
+  return 0;
+
+err:
+  bgpview_iter_destroy(src_iter);
+  bgpview_iter_destroy(dst_iter);
+  return -1;
+}
+
+/* are the paths of the pfx-peers the two iterators point at different? */
+static int diff_pfx_peer_paths(bgpview_iter_t *old_it, bgpview_iter_t *new_it,
+                               int same_store)
+{
+  bgpstream_as_path_store_path_id_t old_id, new_id;
+  bgpstream_as_path_t *old_path, *new_path;
+  int differ;
+
+  old_id = bgpview_iter_pfx_peer_get_as_path_store_path_id(old_it);
+  new_id = bgpview_iter_pfx_peer_get_as_path_store_path_id(new_it);
+  if (same_store != 0) {
+    return memcmp(&old_id, &new_id, sizeof(old_id)) != 0;
+  }
+
+  old_path = bgpview_iter_pfx_peer_get_as_path(old_it);
+  new_path = bgpview_iter_pfx_peer_get_as_path(new_it);
+  differ = bgpstream_as_path_equal(old_path, new_path) == 0;
+  bgpstream_as_path_destroy(old_path);
+  bgpstream_as_path_destroy(new_path);
+  return differ;
+}
+
+#define DIFF_CB(type)                                                          \
+  do {                                                                         \
+    if (cb((type), old_it, new_it, user) != 0) {                               \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+/* report the differences between the pfx-peers of a prefix that is active in
+   both views */
+static int diff_pfx_peers(bgpview_iter_t *old_it, bgpview_iter_t *new_it,
+                          int same_store, bgpview_diff_cb_t *cb, void *user)
+{
+  bgpstream_peer_id_t peer_id;
+  bgpview_diff_type_t type;
+  int pfx_reported = 0;
+
+  for (bgpview_iter_pfx_first_peer(new_it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_pfx_has_more_peer(new_it);
+       bgpview_iter_pfx_next_peer(new_it)) {
+    peer_id = bgpview_iter_peer_get_peer_id(new_it);
+    if (bgpview_iter_pfx_seek_peer(old_it, peer_id, BGPVIEW_FIELD_ACTIVE) ==
+        0) {
+      type = BGPVIEW_DIFF_PFX_PEER_ADDED;
+    } else if (diff_pfx_peer_paths(old_it, new_it, same_store) != 0) {
+      type = BGPVIEW_DIFF_PFX_PEER_CHANGED;
+    } else {
+      continue;
+    }
+    if (pfx_reported == 0) {
+      DIFF_CB(BGPVIEW_DIFF_PFX_CHANGED);
+      pfx_reported = 1;
+    }
+    DIFF_CB(type);
+  }
+
+  for (bgpview_iter_pfx_first_peer(old_it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_pfx_has_more_peer(old_it);
+       bgpview_iter_pfx_next_peer(old_it)) {
+    peer_id = bgpview_iter_peer_get_peer_id(old_it);
+    if (bgpview_iter_pfx_seek_peer(new_it, peer_id, BGPVIEW_FIELD_ACTIVE) !=
+        0) {
+      continue;
+    }
+    if (pfx_reported == 0) {
+      DIFF_CB(BGPVIEW_DIFF_PFX_CHANGED);
+      pfx_reported = 1;
+    }
+    DIFF_CB(BGPVIEW_DIFF_PFX_PEER_REMOVED);
+  }
+
+  return 0;
+}
+
+/* report the differences for a single prefix. old_exists and new_exists
+   indicate whether old_it and new_it point at the (active) prefix */
+static int diff_pfx(bgpview_iter_t *old_it, int old_exists,
+                    bgpview_iter_t *new_it, int new_exists, int same_store,
+                    bgpview_diff_cb_t *cb, void *user)
+{
+  if (old_exists != 0 && new_exists != 0) {
+    return diff_pfx_peers(old_it, new_it, same_store, cb, user);
+  }
+  if (new_exists != 0) {
+    DIFF_CB(BGPVIEW_DIFF_PFX_ADDED);
+  } else if (old_exists != 0) {
+    DIFF_CB(BGPVIEW_DIFF_PFX_REMOVED);
+  }
+  return 0;
+}
+
+int bgpview_diff(bgpview_t *old_view, bgpview_t *new_view,
+                 bgpview_diff_cb_t *cb, void *user)
+{
+  bgpview_iter_t *old_it = NULL;
+  bgpview_iter_t *new_it = NULL;
+  bgpstream_pfx_t *pfx;
+  int same_store = old_view->pathstore == new_view->pathstore;
+  int old_exists, new_exists;
+
+  if (old_view->peersigns != new_view->peersigns) {
+    fprintf(stderr, "ERROR: Views must share peer signatures to be diffed\n");
+    return -1;
+  }
+
+  if (((old_it = bgpview_iter_create(old_view)) == NULL) ||
+      ((new_it = bgpview_iter_create(new_view)) == NULL)) {
+    goto err;
+  }
+
+  /* peers */
+  for (bgpview_iter_first_peer(new_it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(new_it); bgpview_iter_next_peer(new_it)) {
+    if (bgpview_iter_seek_peer(old_it, bgpview_iter_peer_get_peer_id(new_it),
+                               BGPVIEW_FIELD_ACTIVE) == 0 &&
+        cb(BGPVIEW_DIFF_PEER_ADDED, old_it, new_it, user) != 0) {
+      goto err;
+    }
+  }
+  for (bgpview_iter_first_peer(old_it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(old_it); bgpview_iter_next_peer(old_it)) {
+    if (bgpview_iter_seek_peer(new_it, bgpview_iter_peer_get_peer_id(old_it),
+                               BGPVIEW_FIELD_ACTIVE) == 0 &&
+        cb(BGPVIEW_DIFF_PEER_REMOVED, old_it, new_it, user) != 0) {
+      goto err;
+    }
+  }
+
+  /* prefixes */
+  if (bgpview_has_changes_since(new_view, old_view->time) != 0) {
+    /* only the prefixes touched since the old view can differ (this covers
+       both added and removed prefixes) */
+    for (bgpview_iter_first_changed_pfx(new_it, 0);
+         bgpview_iter_has_more_changed_pfx(new_it);
+         bgpview_iter_next_changed_pfx(new_it)) {
+      pfx = bgpview_iter_changed_pfx_get_pfx(new_it);
+      new_exists = bgpview_iter_seek_pfx(new_it, pfx, BGPVIEW_FIELD_ACTIVE);
+      old_exists = bgpview_iter_seek_pfx(old_it, pfx, BGPVIEW_FIELD_ACTIVE);
+      if (diff_pfx(old_it, old_exists, new_it, new_exists, same_store, cb,
+                   user) != 0) {
+        goto err;
+      }
+    }
+  } else {
+    for (bgpview_iter_first_pfx(new_it, 0, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_has_more_pfx(new_it); bgpview_iter_next_pfx(new_it)) {
+      pfx = bgpview_iter_pfx_get_pfx(new_it);
+      old_exists = bgpview_iter_seek_pfx(old_it, pfx, BGPVIEW_FIELD_ACTIVE);
+      if (diff_pfx(old_it, old_exists, new_it, 1, same_store, cb, user) != 0) {
+        goto err;
+      }
+    }
+    for (bgpview_iter_first_pfx(old_it, 0, BGPVIEW_FIELD_ACTIVE);
+         bgpview_iter_has_more_pfx(old_it); bgpview_iter_next_pfx(old_it)) {
+      pfx = bgpview_iter_pfx_get_pfx(old_it);
+      if (bgpview_iter_seek_pfx(new_it, pfx, BGPVIEW_FIELD_ACTIVE) == 0 &&
+          cb(BGPVIEW_DIFF_PFX_REMOVED, old_it, new_it, user) != 0) {
+        goto err;
+      }
+    }
+  }
+
+  bgpview_iter_destroy(old_it);
+  bgpview_iter_destroy(new_it);
+  return 0;
+
+err:
+  bgpview_iter_destroy(old_it);
+  bgpview_iter_destroy(new_it);
+  return -1;
+}
+
 void bgpview_disable_user_data(bgpview_t *view)
 {
   /* the user can't be wanting to destroy pfx-peer user data... */
@@ -2072,6 +3249,67 @@ void bgpview_disable_user_data(bgpview_t *view)
   view->disable_extended = 1;
 }
 
+/* ==================== CHANGE TRACKING FUNCTIONS ==================== */
+
+int bgpview_enable_change_tracking(bgpview_t *view)
+{
+  if (view->changes != NULL) {
+    return 0;
+  }
+
+  if ((view->changes = malloc_zero(sizeof(bwv_changes_t))) == NULL) {
+    goto err;
+  }
+
+  if ((view->changes->v4pfxs = kh_init(bwv_v4pfx_set)) == NULL ||
+      (view->changes->v6pfxs = kh_init(bwv_v6pfx_set)) == NULL) {
+    goto err;
+  }
+
+  /* anything already in the view predates the (implicit) mark at time 0 */
+  view->changes->mark_time = 0;
+  view->changes->incomplete = 0;
+
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not enable change tracking\n");
+  if (view->changes != NULL) {
+    if (view->changes->v4pfxs != NULL) {
+      kh_destroy(bwv_v4pfx_set, view->changes->v4pfxs);
+    }
+    free(view->changes);
+    view->changes = NULL;
+  }
+  return -1;
+}
+
+void bgpview_mark_changes(bgpview_t *view)
+{
+  if (view->changes == NULL) {
+    return;
+  }
+
+  kh_clear(bwv_v4pfx_set, view->changes->v4pfxs);
+  kh_clear(bwv_v6pfx_set, view->changes->v6pfxs);
+  view->changes->mark_time = view->time;
+  view->changes->incomplete = 0;
+}
+
+int bgpview_has_changes_since(bgpview_t *view, uint32_t time)
+{
+  return view->changes != NULL && view->changes->incomplete == 0 &&
+         view->changes->mark_time != 0 && view->changes->mark_time == time;
+}
+
+uint32_t bgpview_changed_pfx_cnt(bgpview_t *view)
+{
+  if (view->changes == NULL) {
+    return 0;
+  }
+  return kh_size(view->changes->v4pfxs) + kh_size(view->changes->v6pfxs);
+}
+
 /* ==================== SIMPLE ACCESSOR FUNCTIONS ==================== */
 
 uint32_t bgpview_v4pfx_cnt(bgpview_t *view, uint8_t state_mask)
@@ -30,6 +30,8 @@
 
 #include "bgpstream_utils_as_path.h"
 #include "bgpstream_utils_peer_sig_map.h"
+#include <stdint.h>
+#include <string.h>
 
 /** @file
  *
@@ -80,6 +82,36 @@ typedef enum {
 
 } bgpview_field_state_t;
 
+/** Types of differences reported by bgpview_diff */
+typedef enum {
+
+  /** A peer is active in the new view, but not in the old view */
+  BGPVIEW_DIFF_PEER_ADDED = 0,
+
+  /** A peer is active in the old view, but not in the new view */
+  BGPVIEW_DIFF_PEER_REMOVED = 1,
+
+  /** A prefix is active in the new view, but not in the old view */
+  BGPVIEW_DIFF_PFX_ADDED = 2,
+
+  /** A prefix is active in the old view, but not in the new view */
+  BGPVIEW_DIFF_PFX_REMOVED = 3,
+
+  /** A prefix is active in both views, but its pfx-peers differ (the
+   *  differing pfx-peers are reported next) */
+  BGPVIEW_DIFF_PFX_CHANGED = 4,
+
+  /** A pfx-peer is active in the new view, but not in the old view */
+  BGPVIEW_DIFF_PFX_PEER_ADDED = 5,
+
+  /** A pfx-peer is active in the old view, but not in the new view */
+  BGPVIEW_DIFF_PFX_PEER_REMOVED = 6,
+
+  /** A pfx-peer is active in both views, but with a different AS path */
+  BGPVIEW_DIFF_PFX_PEER_CHANGED = 7,
+
+} bgpview_diff_type_t;
+
 /** @} */
 
 /**
@@ -102,6 +134,10 @@ typedef enum {
 
 #endif
 
+/** Number of 64 bit words in a peer bitmap (one bit for each possible peer
+ *  ID) */
+#define BGPVIEW_PEER_BITMAP_WORDS ((UINT16_MAX + 1) / 64)
+
 /** @} */
 
 /**
@@ -115,6 +151,44 @@ typedef enum {
  */
 typedef void(bgpview_destroy_user_t)(void *user);
 
+/** Callback for receiving the differences between two views (see
+ *  bgpview_diff)
+ *
+ * @param type      type of difference
+ * @param old_it    iterator over the old view, pointing at the
+ *                  peer/prefix/pfx-peer if it exists in the old view
+ * @param new_it    iterator over the new view, pointing at the
+ *                  peer/prefix/pfx-peer if it exists in the new view
+ * @param user      user pointer given to bgpview_diff
+ * @return 0 to continue, -1 to stop the diff with an error
+ *
+ * The callback may read through the iterators, but must not move them.
+ */
+typedef int(bgpview_diff_cb_t)(bgpview_diff_type_t type,
+                               bgpview_iter_t *old_it, bgpview_iter_t *new_it,
+                               void *user);
+
+/** Fixed-size set of peer IDs (peer IDs are small, dense, 16 bit integers, so
+ *  membership can be tested with a single bit check rather than a hash
+ *  lookup) */
+typedef struct bgpview_peer_bitmap {
+  uint64_t words[BGPVIEW_PEER_BITMAP_WORDS];
+} bgpview_peer_bitmap_t;
+
+/** Remove all peers from the given peer bitmap */
+#define BGPVIEW_PEER_BITMAP_CLEAR(bitmap)                                      \
+  memset((bitmap)->words, 0, sizeof((bitmap)->words))
+
+/** Add the given peer ID to the given peer bitmap */
+#define BGPVIEW_PEER_BITMAP_INSERT(bitmap, peerid)                             \
+  ((bitmap)->words[(uint16_t)(peerid) >> 6] |=                                 \
+   (UINT64_C(1) << ((uint16_t)(peerid)&63)))
+
+/** Check if the given peer ID is in the given peer bitmap (non-zero if it is)
+ */
+#define BGPVIEW_PEER_BITMAP_EXISTS(bitmap, peerid)                             \
+  (((bitmap)->words[(uint16_t)(peerid) >> 6] >> ((uint16_t)(peerid)&63)) & 1)
+
 /** @} */
 
 /** Create a new BGP View
@@ -228,6 +302,65 @@ int bgpview_copy(bgpview_t *dst, bgpview_t *src);
  */
 bgpview_t *bgpview_dup(bgpview_t *src);
 
+/** Update a copy of a view so that it matches the view again
+ *
+ * @param dst           pointer to the copy (e.g., created using bgpview_dup)
+ * @param src           pointer to the view to copy
+ * @return 0 if the view was copied successfully, -1 otherwise
+ *
+ * If src has change tracking enabled and the recorded changes are relative to
+ * the time of dst (see bgpview_has_changes_since), and the views share their
+ * peer sigs and path store, only the prefixes that changed since the mark are
+ * copied. Otherwise dst is cleared and a full bgpview_copy is performed.
+ *
+ * This is the cheap way to keep the previous state of a view around from one
+ * interval to the next.
+ */
+int bgpview_sync(bgpview_t *dst, bgpview_t *src);
+
+/** Update a filtered copy of a view so that it matches the view again
+ *
+ * @param dst           pointer to the copy, which must share the peer sigs and
+ *                      path store of src (e.g., created using
+ *                      bgpview_create_shared)
+ * @param src           pointer to the view to copy
+ * @param peers         pointer to the bitmap of the peers to copy (NULL to copy
+ *                      all peers)
+ * @return 0 if the view was copied successfully, -1 otherwise
+ *
+ * Like bgpview_sync, except that only the active peers of src that are in the
+ * bitmap, and their pfx-peers, are copied (prefixes without any such pfx-peer
+ * are left out). The incremental update is only possible while the bitmap
+ * selects the same active peers as it did for the previous sync; otherwise dst
+ * is rebuilt from scratch.
+ *
+ * If dst tracks its own changes, they reflect the prefixes that were copied,
+ * so dst can in turn be used as the (smaller) source of a diff.
+ */
+int bgpview_sync_filtered(bgpview_t *dst, bgpview_t *src,
+                          const bgpview_peer_bitmap_t *peers);
+
+/** Report the differences between two views
+ *
+ * @param old_view      pointer to the old view
+ * @param new_view      pointer to the new view
+ * @param cb            callback to call for each difference
+ * @param user          user pointer to pass to the callback
+ * @return 0 if the views were compared successfully, -1 otherwise
+ *
+ * Only active fields are compared. Peers are reported first, then prefixes.
+ * For a prefix that is active in both views, a BGPVIEW_DIFF_PFX_CHANGED is
+ * reported before the differing pfx-peers of that prefix. The pfx-peers of
+ * added and removed prefixes are not reported individually.
+ *
+ * The views must share their peer signatures (e.g., old_view was created
+ * with bgpview_dup). If they also share their AS path store, paths are
+ * compared by ID. If new_view tracks changes since the time of old_view (see
+ * bgpview_has_changes_since), only the changed prefixes are compared.
+ */
+int bgpview_diff(bgpview_t *old_view, bgpview_t *new_view,
+                 bgpview_diff_cb_t *cb, void *user);
+
 /** Disable user data for a view
  *
  * @param view          view to disable user data for
@@ -384,6 +517,62 @@ bgpstream_peer_id_t bgpview_get_peer_id(bgpview_t *view,
 
 /** @} */
 
+/**
+ * @name Change Tracking Functions
+ *
+ * A view can optionally keep track of the prefixes whose pfx-peer cells have
+ * been touched (added, removed, (de)activated, or had their AS path set) since
+ * the last time the view was marked. This allows producers of diffs (e.g., the
+ * Kafka io module) to only consider prefixes that may have changed, rather
+ * than comparing every cell of the view against a parent view.
+ *
+ * @{ */
+
+/** Enable change tracking for the given view
+ *
+ * @param view          pointer to a view structure
+ * @return 0 if tracking was enabled successfully, -1 otherwise
+ *
+ * Once enabled, change tracking cannot be disabled. The view starts out as
+ * though it had been marked at time 0 (i.e., nothing has changed since time 0,
+ * which is never a valid view time).
+ */
+int bgpview_enable_change_tracking(bgpview_t *view);
+
+/** Mark the current state of the view as the baseline for change tracking
+ *
+ * @param view          pointer to a view structure
+ *
+ * Forgets all changes recorded so far and records the current time of the
+ * view as the time of the mark. This should be called just after the view has
+ * been published, and before it is modified again. Does nothing if change
+ * tracking is not enabled.
+ */
+void bgpview_mark_changes(bgpview_t *view);
+
+/** Check whether the changes recorded in the view are relative to a view with
+ *  the given time
+ *
+ * @param view          pointer to a view structure
+ * @param time          time of the (parent) view to compare against
+ * @return 1 if change tracking is enabled, the view was marked when its time
+ *         was `time`, and the recorded changes are complete, 0 otherwise
+ *
+ * If this function returns 0, the caller must fall back to a full comparison
+ * of the view (e.g., because the view was cleared since the mark).
+ */
+int bgpview_has_changes_since(bgpview_t *view, uint32_t time);
+
+/** Get the number of prefixes that have changed since the last mark
+ *
+ * @param view          pointer to a view structure
+ * @return the number of changed prefixes, or 0 if change tracking is not
+ *         enabled
+ */
+uint32_t bgpview_changed_pfx_cnt(bgpview_t *view);
+
+/** @} */
+
 /**
  * @name View Iterator Functions
  *
@@ -498,6 +687,91 @@ int bgpview_iter_has_more_pfx(bgpview_iter_t *iter);
 int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
                           uint8_t state_mask);
 
+/** Reset the prefix iterator to the first prefix that matches the mask, in
+ *  prefix order (i.e. sorted by address, and then by mask length, with all
+ *  the IPv4 prefixes before the IPv6 prefixes)
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param version       0 if the intent is to iterate over all IP versions,
+ *                      BGPSTREAM_ADDR_VERSION_IPV4 for IPv4 only,
+ *                      BGPSTREAM_ADDR_VERSION_IPV6 for IPv6 only.
+ * @param state_mask    A mask that indicates the state of the pfx
+ *                      fields we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached, -1 if the sorted index could not be
+ *         built
+ *
+ * The view keeps a sorted index of its prefixes, built the first time it is
+ * needed and then kept up to date as prefixes are added and garbage
+ * collected (the added prefixes are merged in when the index is next used),
+ * so a view that changes a little between two uses is not sorted again.
+ * Prefixes must not be added to the view while it is iterated in order.
+ * bgpview_iter_next_pfx and bgpview_iter_has_more_pfx continue in prefix
+ * order, until the iterator is reset or seeked.
+ */
+int bgpview_iter_first_pfx_sorted(bgpview_iter_t *iter, int version,
+                                  uint8_t state_mask);
+
+/** Reset the prefix iterator to the first prefix that is equal to, or more
+ *  specific than, the given prefix and matches the mask (in prefix order)
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param pfx           Pointer to the covering prefix
+ * @param state_mask    A mask that indicates the state of the pfx
+ *                      fields we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if the end has been reached, -1 if the sorted index could not be
+ *         built
+ *
+ * E.g., given 10.0.0.0/8, bgpview_iter_next_pfx walks 10.0.0.0/8 (if it is in
+ * the view) and all its more-specifics, in prefix order. The range is found
+ * using a binary search in the sorted index (see
+ * bgpview_iter_first_pfx_sorted).
+ */
+int bgpview_iter_first_pfx_within(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                                  uint8_t state_mask);
+
+/** Find the most specific prefix in the view that is equal to, or covers, the
+ *  given prefix and matches the mask (i.e. the longest prefix match); set the
+ *  provided iterator to point at that prefix (if it exists) or set it to the
+ *  end of the prefix table (if it doesn't exist)
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param pfx           Pointer to the prefix to look up (use a /32 or a /128
+ *                      to look up an address)
+ * @param state_mask    A mask that indicates the state of the pfx
+ *                      fields we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if there is no covering prefix, -1 if the sorted index could not
+ *         be built
+ *
+ * Only the mask lengths that are in the sorted index of the view are looked
+ * up.
+ */
+int bgpview_iter_seek_pfx_lpm(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
+                              uint8_t state_mask);
+
+/** Find the least specific prefix in the view that covers the given prefix
+ *  (the prefix itself is not considered) and matches the mask; set the
+ *  provided iterator to point at that prefix (if it exists) or set it to the
+ *  end of the prefix table (if it doesn't exist)
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param pfx           Pointer to the prefix to look up
+ * @param state_mask    A mask that indicates the state of the pfx
+ *                      fields we iterate through
+ * @return 1 if the iterator points at an existing prefix,
+ *         0 if there is no covering prefix, -1 if the sorted index could not
+ *         be built
+ *
+ * Together with bgpview_iter_first_pfx_within (to walk the more-specifics of
+ * a prefix), this answers the queries consumers otherwise build a patricia
+ * tree of the view prefixes for.
+ */
+int bgpview_iter_seek_pfx_mincovering(bgpview_iter_t *iter,
+                                      bgpstream_pfx_t *pfx,
+                                      uint8_t state_mask);
+
 /** Reset the peer iterator to the first peer (of the current
  *  prefix) that matches the mask
  *
@@ -515,6 +789,23 @@ int bgpview_iter_seek_pfx(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
  */
 int bgpview_iter_pfx_first_peer(bgpview_iter_t *iter, uint8_t state_mask);
 
+/** Reset the peer iterator to the first peer (of the current
+ *  prefix) that matches the mask and is in the given peer bitmap
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param state_mask    A mask that indicates the state of the
+ *                      fields we iterate through
+ * @param peers         Pointer to the bitmap of peers to iterate through
+ * @return 1 if the iterator points at an existing peer,
+ *         0 if the end has been reached
+ *
+ * Subsequent calls to bgpview_iter_pfx_next_peer will also skip the peers
+ * that are not in the bitmap, until the pfx-peer iterator is reset (the
+ * bitmap must not be freed before then).
+ */
+int bgpview_iter_pfx_first_peer_in(bgpview_iter_t *iter, uint8_t state_mask,
+                                   const bgpview_peer_bitmap_t *peers);
+
 /** Advance the provided iterator to the next peer that
  * matches the mask for the current prefix
  *
@@ -611,6 +902,48 @@ int bgpview_iter_seek_pfx_peer(bgpview_iter_t *iter, bgpstream_pfx_t *pfx,
                                bgpstream_peer_id_t peerid, uint8_t pfx_mask,
                                uint8_t peer_mask);
 
+/** Reset the changed-prefix iterator to the first prefix that has changed
+ *  since the last mark
+ *
+ * @param iter          Pointer to an iterator structure
+ * @param version       0 if the intent is to iterate over all IP versions,
+ *                      BGPSTREAM_ADDR_VERSION_IPV4 for IPv4 only,
+ *                      BGPSTREAM_ADDR_VERSION_IPV6 for IPv6 only.
+ * @return 1 if the iterator points at a changed prefix,
+ *         0 if the end has been reached
+ *
+ * The changed-prefix iterator is independent of the prefix iterator: a
+ * changed prefix may no longer exist in the view (i.e. it has been removed),
+ * so use bgpview_iter_changed_pfx_get_pfx to retrieve it, and then
+ * bgpview_iter_seek_pfx to look it up in this (or another) view.
+ *
+ * @note the view must have change tracking enabled
+ */
+int bgpview_iter_first_changed_pfx(bgpview_iter_t *iter, int version);
+
+/** Advance the provided iterator to the next changed prefix
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at a changed prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_next_changed_pfx(bgpview_iter_t *iter);
+
+/** Check if the iterator points at a changed prefix
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return 1 if the iterator points at a changed prefix,
+ *         0 if the end has been reached
+ */
+int bgpview_iter_has_more_changed_pfx(bgpview_iter_t *iter);
+
+/** Get the current changed prefix
+ *
+ * @param iter          Pointer to an iterator structure
+ * @return a pointer to the changed prefix the iterator currently points at
+ */
+bgpstream_pfx_t *bgpview_iter_changed_pfx_get_pfx(bgpview_iter_t *iter);
+
 /** @} */
 
 /**
@@ -742,6 +1075,14 @@ int bgpview_iter_pfx_add_peer(bgpview_iter_t *iter,
  * When a new pfx-peer is created its state is set to inactive.
  * The provided path ID must correspond to the appropriate AS Path in the store
  * used by this view.
+ * If the ID is an alias of a core path (i.e. a non-core path that starts with
+ * the peer ASN), it is replaced by the ID of the core path, so that two
+ * pfx-peers of the same peer have the same path ID if and only if they have
+ * the same path. (A core path is shared by all the peers whose paths only
+ * differ by the peer ASN, so pfx-peers of different peers may have the same
+ * path ID and different paths.) Building with BGPVIEW_VALIDATE_PATH_IDS
+ * defined checks every ID against a lookup by value and warns about
+ * mismatches.
  */
 int bgpview_iter_pfx_add_peer_by_id(bgpview_iter_t *iter,
                                     bgpstream_peer_id_t peer_id,
@@ -974,6 +1315,7 @@ int bgpview_iter_pfx_peer_set_as_path(bgpview_iter_t *iter,
  * @return 0 if the path was set successfully, -1 otherwise
  *
  * The given AS path ID must already exist in the path store used by the view.
+ * It is canonicalized as described for bgpview_iter_pfx_add_peer_by_id.
  */
 int bgpview_iter_pfx_peer_set_as_path_by_id(
   bgpview_iter_t *iter, bgpstream_as_path_store_path_id_t path_id);
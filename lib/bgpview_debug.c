@@ -73,8 +73,10 @@ static void pfxs_dump(bgpview_t *view, bgpview_iter_t *it)
           bgpview_v4pfx_cnt(view, BGPVIEW_FIELD_ACTIVE),
           bgpview_v6pfx_cnt(view, BGPVIEW_FIELD_ACTIVE));
 
-  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE);
-       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+  if (bgpview_iter_first_pfx_sorted(it, 0, BGPVIEW_FIELD_ACTIVE) < 0) {
+    return;
+  }
+  for (; bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
     pfx = bgpview_iter_pfx_get_pfx(it);
     bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
     fprintf(stdout, "  %s (%d peers)\n", pfx_str,
@@ -72,7 +72,7 @@
  */
 #define BVC_GENERATE_PTRS(consname)                                            \
   bvc_##consname##_init, bvc_##consname##_destroy,                             \
-    bvc_##consname##_process_view, 0, NULL, NULL, NULL
+    bvc_##consname##_process_view, 0, NULL, NULL, NULL, NULL
 
 /** Structure which represents a metadata consumer */
 struct bvc {
@@ -156,7 +156,41 @@ struct bvc {
   /** A borrowed pointer to the shared consumer state object */
   bvc_chain_state_t *chain_state;
 
+  /** A borrowed pointer to the manager that owns this consumer */
+  bgpview_consumer_manager_t *manager;
+
   /** }@ */
 };
 
+/** Hand a key package off to the consumer manager to be flushed
+ *
+ * @param consumer      The consumer that owns the key package
+ * @param kp            The key package to flush
+ * @param time          The time to flush the values with
+ * @return 0 if the key package was queued (or flushed), -1 otherwise
+ *
+ * The flush is carried out by the manager's flush thread, so this returns
+ * as soon as there is room in the queue. The consumer must not modify the key
+ * package until its next process_view call (the manager waits for all queued
+ * flushes to complete before passing on the next view). A failed flush is
+ * reported as a warning by the flush thread.
+ */
+int bvc_timeseries_kp_flush(bvc_t *consumer, timeseries_kp_t *kp,
+                            uint32_t time);
+
+/** Hand a single value off to the consumer manager to be written
+ *
+ * @param consumer      The consumer writing the value
+ * @param key           The key to write (copied)
+ * @param value         The value to write
+ * @param time          The time to write the value with
+ * @return 0 if the value was queued (or written), -1 otherwise
+ *
+ * This is the timeseries_set_single equivalent of bvc_timeseries_kp_flush.
+ * Values go through the same queue, so the backends are only ever used from
+ * one thread at a time.
+ */
+int bvc_timeseries_set_single(bvc_t *consumer, const char *key, uint64_t value,
+                              uint32_t time);
+
 #endif /* __BGPVIEW_CONSUMER_INT_H */
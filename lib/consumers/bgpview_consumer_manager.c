@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -33,6 +34,7 @@
 
 #include "bgpview_consumer_interface.h"
 #include "bgpview_consumer_manager.h"
+#include "bgpview_consumer_pfx_summary.h"
 
 /* include all consumers here */
 
@@ -98,6 +100,29 @@
 
 #define MAXOPTS 1024
 
+/** Maximum number of flushes that can be queued before consumers block */
+#define FLUSH_QUEUE_LEN 64
+
+/** A flush (or single value) handed off by a consumer */
+typedef struct flush_job {
+
+  /** Name of the consumer that queued the job (for error messages) */
+  const char *consumer_name;
+
+  /** Key package to flush (NULL if this is a single value) */
+  timeseries_kp_t *kp;
+
+  /** Key of the single value (owned by the job) */
+  char *key;
+
+  /** Single value */
+  uint64_t value;
+
+  /** Time to flush the key package or write the value with */
+  uint32_t time;
+
+} flush_job_t;
+
 struct bgpview_consumer_manager {
 
   /** Array of consumers
@@ -110,6 +135,38 @@ struct bgpview_consumer_manager {
 
   /** State structure that is passed along with each view */
   bvc_chain_state_t chain_state;
+
+  /** Circular queue of flushes waiting for the flush thread */
+  flush_job_t flush_queue[FLUSH_QUEUE_LEN];
+
+  /** Index of the oldest job in the queue */
+  int flush_queue_head;
+
+  /** Number of jobs in the queue */
+  int flush_queue_cnt;
+
+  /** Is the flush thread working on a job that has left the queue? */
+  int flush_busy;
+
+  /** Has the flush thread been asked to exit? */
+  int flush_shutdown;
+
+  /** Is the flush thread running? (it is only started once the first job is
+      queued, so that it is not lost if the process forks after the manager
+      is created) */
+  int flush_thread_running;
+
+  /** Flush thread */
+  pthread_t flush_thread;
+
+  /** Protects the queue and the flags above */
+  pthread_mutex_t flush_mutex;
+
+  /** Signalled when a job is queued or the thread is asked to exit */
+  pthread_cond_t flush_job_cond;
+
+  /** Signalled when the flush thread completes a job */
+  pthread_cond_t flush_done_cond;
 };
 
 /** Convenience typedef for the backend alloc function type */
@@ -197,8 +254,7 @@ static const consumer_alloc_func_t consumer_alloc_functions[] = {
 
 /* ==================== PRIVATE FUNCTIONS ==================== */
 
-static bvc_t *consumer_alloc(timeseries_t *timeseries,
-                             bvc_chain_state_t *chain_state, bvc_id_t id)
+static bvc_t *consumer_alloc(bgpview_consumer_manager_t *mgr, bvc_id_t id)
 {
   bvc_t *consumer;
   assert(ARR_CNT(consumer_alloc_functions) == BVC_ID_LAST);
@@ -215,9 +271,11 @@ static bvc_t *consumer_alloc(timeseries_t *timeseries,
   /* get the core consumer details (id, name, func ptrs) from the plugin */
   memcpy(consumer, consumer_alloc_functions[id - 1](), sizeof(bvc_t));
 
-  consumer->timeseries = timeseries;
+  consumer->timeseries = mgr->timeseries;
 
-  consumer->chain_state = chain_state;
+  consumer->chain_state = &mgr->chain_state;
+
+  consumer->manager = mgr;
 
   return consumer;
 }
@@ -272,10 +330,16 @@ static int init_bvc_chain_state(bgpview_consumer_manager_t *mgr)
 
   for (i = 0; i < BGPSTREAM_MAX_IP_VERSION_IDX; i++) {
     mgr->chain_state.full_feed_peer_ids[i] = bgpstream_id_set_create();
+    BGPVIEW_PEER_BITMAP_CLEAR(&mgr->chain_state.full_feed_peer_bitmap[i]);
     mgr->chain_state.peer_ids_cnt[i] = 0;
     mgr->chain_state.full_feed_peer_asns_cnt[i] = 0;
     mgr->chain_state.usable_table_flag[i] = 0;
   }
+
+  if ((mgr->chain_state.pfx_summaries = bvc_pfx_summary_table_create()) ==
+      NULL) {
+    return -1;
+  }
   return 0;
 }
 
@@ -288,6 +352,96 @@ static void destroy_bvc_chain_state(bgpview_consumer_manager_t *mgr)
       mgr->chain_state.full_feed_peer_ids[i] = NULL;
     }
   }
+
+  bvc_pfx_summary_table_destroy(mgr->chain_state.pfx_summaries);
+  mgr->chain_state.pfx_summaries = NULL;
+}
+
+static void flush_job_run(bgpview_consumer_manager_t *mgr, flush_job_t *job)
+{
+  if (job->kp != NULL) {
+    if (timeseries_kp_flush(job->kp, job->time) != 0) {
+      fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n",
+              job->consumer_name, job->time);
+    }
+  } else {
+    timeseries_set_single(mgr->timeseries, job->key, job->value, job->time);
+    free(job->key);
+  }
+}
+
+static void *flush_thread(void *user)
+{
+  bgpview_consumer_manager_t *mgr = (bgpview_consumer_manager_t *)user;
+  flush_job_t job;
+
+  pthread_mutex_lock(&mgr->flush_mutex);
+  while (1) {
+    while (mgr->flush_queue_cnt == 0 && mgr->flush_shutdown == 0) {
+      pthread_cond_wait(&mgr->flush_job_cond, &mgr->flush_mutex);
+    }
+    /* only exit once everything that was queued has been flushed */
+    if (mgr->flush_queue_cnt == 0) {
+      break;
+    }
+    job = mgr->flush_queue[mgr->flush_queue_head];
+    mgr->flush_queue_head = (mgr->flush_queue_head + 1) % FLUSH_QUEUE_LEN;
+    mgr->flush_queue_cnt--;
+    mgr->flush_busy = 1;
+    pthread_mutex_unlock(&mgr->flush_mutex);
+
+    flush_job_run(mgr, &job);
+
+    pthread_mutex_lock(&mgr->flush_mutex);
+    mgr->flush_busy = 0;
+    pthread_cond_broadcast(&mgr->flush_done_cond);
+  }
+  pthread_mutex_unlock(&mgr->flush_mutex);
+
+  return NULL;
+}
+
+static void flush_job_queue(bgpview_consumer_manager_t *mgr, flush_job_t *job)
+{
+  pthread_mutex_lock(&mgr->flush_mutex);
+
+  if (mgr->flush_thread_running == 0) {
+    if (pthread_create(&mgr->flush_thread, NULL, flush_thread, mgr) != 0) {
+      /* fall back to flushing from the caller */
+      pthread_mutex_unlock(&mgr->flush_mutex);
+      fprintf(stderr, "WARN: Could not start flush thread, flushing %s "
+                      "synchronously\n",
+              job->consumer_name);
+      flush_job_run(mgr, job);
+      return;
+    }
+    mgr->flush_thread_running = 1;
+  }
+
+  while (mgr->flush_queue_cnt == FLUSH_QUEUE_LEN) {
+    pthread_cond_wait(&mgr->flush_done_cond, &mgr->flush_mutex);
+  }
+  mgr->flush_queue[(mgr->flush_queue_head + mgr->flush_queue_cnt) %
+                   FLUSH_QUEUE_LEN] = *job;
+  mgr->flush_queue_cnt++;
+  pthread_cond_signal(&mgr->flush_job_cond);
+
+  pthread_mutex_unlock(&mgr->flush_mutex);
+}
+
+static void flush_thread_stop(bgpview_consumer_manager_t *mgr)
+{
+  if (mgr->flush_thread_running == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&mgr->flush_mutex);
+  mgr->flush_shutdown = 1;
+  pthread_cond_signal(&mgr->flush_job_cond);
+  pthread_mutex_unlock(&mgr->flush_mutex);
+
+  pthread_join(mgr->flush_thread, NULL);
+  mgr->flush_thread_running = 0;
 }
 
 /* ==================== PUBLIC MANAGER FUNCTIONS ==================== */
@@ -305,13 +459,17 @@ bgpview_consumer_manager_create(timeseries_t *timeseries)
 
   mgr->timeseries = timeseries;
 
+  pthread_mutex_init(&mgr->flush_mutex, NULL);
+  pthread_cond_init(&mgr->flush_job_cond, NULL);
+  pthread_cond_init(&mgr->flush_done_cond, NULL);
+
   if (init_bvc_chain_state(mgr) < 0) {
     goto err;
   }
 
   /* allocate the consumers (some may/will be NULL) */
   for (id = BVC_ID_FIRST; id <= BVC_ID_LAST; id++) {
-    mgr->consumers[id - 1] = consumer_alloc(timeseries, &mgr->chain_state, id);
+    mgr->consumers[id - 1] = consumer_alloc(mgr, id);
   }
 
   return mgr;
@@ -337,6 +495,13 @@ void bgpview_consumer_manager_destroy(bgpview_consumer_manager_t **mgr_p)
   *mgr_p = NULL;
   int id;
 
+  if (mgr == NULL) {
+    return;
+  }
+
+  /* the queued flushes use the consumers' key packages */
+  flush_thread_stop(mgr);
+
   /* loop across all backends and free each one */
   for (id = BVC_ID_FIRST; id <= BVC_ID_LAST; id++) {
     consumer_destroy(&mgr->consumers[id - 1]);
@@ -344,6 +509,10 @@ void bgpview_consumer_manager_destroy(bgpview_consumer_manager_t **mgr_p)
 
   destroy_bvc_chain_state(mgr);
 
+  pthread_cond_destroy(&mgr->flush_done_cond);
+  pthread_cond_destroy(&mgr->flush_job_cond);
+  pthread_mutex_destroy(&mgr->flush_mutex);
+
   free(mgr);
   return;
 }
@@ -462,6 +631,10 @@ int bgpview_consumer_manager_process_view(bgpview_consumer_manager_t *mgr,
   bvc_t *consumer;
   assert(mgr != NULL);
 
+  /* consumers update their key packages while processing the view, so the
+     flushes for the previous view must be complete */
+  bgpview_consumer_manager_wait_flush(mgr);
+
   for (id = BVC_ID_FIRST; id <= BVC_ID_LAST; id++) {
     if ((consumer = bgpview_consumer_manager_get_consumer_by_id(mgr, id)) ==
           NULL ||
@@ -476,6 +649,15 @@ int bgpview_consumer_manager_process_view(bgpview_consumer_manager_t *mgr,
   return 0;
 }
 
+void bgpview_consumer_manager_wait_flush(bgpview_consumer_manager_t *mgr)
+{
+  pthread_mutex_lock(&mgr->flush_mutex);
+  while (mgr->flush_queue_cnt > 0 || mgr->flush_busy != 0) {
+    pthread_cond_wait(&mgr->flush_done_cond, &mgr->flush_mutex);
+  }
+  pthread_mutex_unlock(&mgr->flush_mutex);
+}
+
 /* ==================== CONSUMER ACCESSOR FUNCTIONS ==================== */
 
 int bvc_is_enabled(bvc_t *consumer)
@@ -492,3 +674,25 @@ const char *bvc_get_name(bvc_t *consumer)
 {
   return consumer->name;
 }
+
+int bvc_timeseries_kp_flush(bvc_t *consumer, timeseries_kp_t *kp,
+                            uint32_t time)
+{
+  flush_job_t job = {consumer->name, kp, NULL, 0, time};
+
+  flush_job_queue(consumer->manager, &job);
+  return 0;
+}
+
+int bvc_timeseries_set_single(bvc_t *consumer, const char *key, uint64_t value,
+                              uint32_t time)
+{
+  flush_job_t job = {consumer->name, NULL, NULL, value, time};
+
+  if ((job.key = strdup(key)) == NULL) {
+    fprintf(stderr, "ERROR: Could not copy key %s\n", key);
+    return -1;
+  }
+  flush_job_queue(consumer->manager, &job);
+  return 0;
+}
@@ -59,6 +59,10 @@ typedef struct bgpview_consumer_manager bgpview_consumer_manager_t;
 /** Opaque struct holding state for a bgpview consumer */
 typedef struct bvc bvc_t;
 
+/** Opaque struct holding per-prefix full-feed summaries for a view (see
+    bgpview_consumer_pfx_summary.h) */
+typedef struct bvc_pfx_summary_table bvc_pfx_summary_table_t;
+
 /** @} */
 
 /**
@@ -89,6 +93,10 @@ typedef struct bvc_chain_state {
   /* Set of full feed peers */
   bgpstream_id_set_t *full_feed_peer_ids[BGPSTREAM_MAX_IP_VERSION_IDX];
 
+  /** Bitmap of full feed peers (same content as full_feed_peer_ids, but
+      membership is a single bit check) */
+  bgpview_peer_bitmap_t full_feed_peer_bitmap[BGPSTREAM_MAX_IP_VERSION_IDX];
+
   /** Total number of full feed peer ASns in the view */
   uint32_t full_feed_peer_asns_cnt[BGPSTREAM_MAX_IP_VERSION_IDX];
 
@@ -103,6 +111,13 @@ typedef struct bvc_chain_state {
   /** What is the minimum mask length for a prefix to be considered visible */
   int pfx_vis_mask_len_threshold;
 
+  /** Set by consumers (at init time) that read pfx_summaries */
+  int pfx_summaries_wanted;
+
+  /** Per-prefix full-feed peer counts and origin ASNs (only built by the
+      visibility consumer if pfx_summaries_wanted is set) */
+  bvc_pfx_summary_table_t *pfx_summaries;
+
 } bvc_chain_state_t;
 
 /** @} */
@@ -296,6 +311,19 @@ bgpview_consumer_manager_get_all_consumers(bgpview_consumer_manager_t *mgr);
 int bgpview_consumer_manager_process_view(bgpview_consumer_manager_t *mgr,
                                           bgpview_t *view);
 
+/** Wait for the timeseries flushes queued by the consumers to complete
+ *
+ * @param mgr           The manager object
+ *
+ * Consumers hand their key packages off to a flush thread owned by the
+ * manager, so the flushes for a view may still be running once
+ * bgpview_consumer_manager_process_view returns. The manager already waits
+ * before processing the next view and when it is destroyed; this only needs
+ * to be called if the timeseries instance is used elsewhere in the meantime
+ * (e.g. by the bsrt io module).
+ */
+void bgpview_consumer_manager_wait_flush(bgpview_consumer_manager_t *mgr);
+
 /** Check if the given consumer is enabled already
  *
  * @param consumer       The consumer to check the status of
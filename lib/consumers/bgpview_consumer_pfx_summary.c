@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bgpview_consumer_pfx_summary.h"
+#include "bgpstream_utils_pfx.h"
+#include "khash.h"
+#include "utils.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Number of summaries/origins to allocate at a time */
+#define ALLOC_INCR 65536
+
+/** Map from prefix to index in the summaries array */
+KHASH_INIT(bvcps_v4pfx_idx, bgpstream_ipv4_pfx_t, uint32_t, 1,
+           bgpstream_ipv4_pfx_hash_val, bgpstream_ipv4_pfx_equal_val)
+
+KHASH_INIT(bvcps_v6pfx_idx, bgpstream_ipv6_pfx_t, uint32_t, 1,
+           bgpstream_ipv6_pfx_hash_val, bgpstream_ipv6_pfx_equal_val)
+
+struct bvc_pfx_summary_table {
+
+  /** Index of the summary of each v4 prefix */
+  khash_t(bvcps_v4pfx_idx) * v4pfxs;
+
+  /** Index of the summary of each v6 prefix */
+  khash_t(bvcps_v6pfx_idx) * v6pfxs;
+
+  /** Array of prefix summaries */
+  bvc_pfx_summary_t *summaries;
+
+  /** Number of summaries in use */
+  uint32_t summaries_cnt;
+
+  /** Number of summaries allocated */
+  uint32_t summaries_alloc;
+
+  /** Pool of origin ASNs (each summary points to a contiguous range) */
+  uint32_t *origins;
+
+  /** Number of origins in use */
+  uint32_t origins_cnt;
+
+  /** Number of origins allocated */
+  uint32_t origins_alloc;
+
+  /** Scratch set of the full-feed peer ASNs of the current prefix */
+  bgpstream_id_set_t *ff_asns;
+};
+
+/* add the given origin to the sorted range of origins that starts at `start`
+   (and currently holds s->origins_cnt origins) unless it is already there */
+static int add_origin(bvc_pfx_summary_table_t *table, uint32_t start,
+                      bvc_pfx_summary_t *s, uint32_t asn)
+{
+  uint32_t *range = &table->origins[start];
+  int i;
+
+  for (i = 0; i < s->origins_cnt && range[i] < asn; i++)
+    ;
+  if (i < s->origins_cnt && range[i] == asn) {
+    return 0;
+  }
+
+  if (table->origins_cnt == table->origins_alloc) {
+    if ((table->origins =
+           realloc(table->origins, sizeof(uint32_t) * (table->origins_alloc +
+                                                       ALLOC_INCR))) == NULL) {
+      return -1;
+    }
+    table->origins_alloc += ALLOC_INCR;
+    range = &table->origins[start];
+  }
+
+  memmove(&range[i + 1], &range[i], sizeof(uint32_t) * (s->origins_cnt - i));
+  range[i] = asn;
+  s->origins_cnt++;
+  table->origins_cnt++;
+
+  return 0;
+}
+
+static int index_pfx(bvc_pfx_summary_table_t *table, bgpstream_pfx_t *pfx,
+                     uint32_t idx)
+{
+  khiter_t k;
+  int khret;
+
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    k = kh_put(bvcps_v4pfx_idx, table->v4pfxs, pfx->bs_ipv4, &khret);
+    if (khret == -1) {
+      return -1;
+    }
+    kh_val(table->v4pfxs, k) = idx;
+    break;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    k = kh_put(bvcps_v6pfx_idx, table->v6pfxs, pfx->bs_ipv6, &khret);
+    if (khret == -1) {
+      return -1;
+    }
+    kh_val(table->v6pfxs, k) = idx;
+    break;
+
+  default:
+    return -1;
+  }
+
+  return 0;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+bvc_pfx_summary_table_t *bvc_pfx_summary_table_create(void)
+{
+  bvc_pfx_summary_table_t *table;
+
+  if ((table = malloc_zero(sizeof(bvc_pfx_summary_table_t))) == NULL) {
+    return NULL;
+  }
+
+  if ((table->v4pfxs = kh_init(bvcps_v4pfx_idx)) == NULL ||
+      (table->v6pfxs = kh_init(bvcps_v6pfx_idx)) == NULL) {
+    goto err;
+  }
+
+  if ((table->ff_asns = bgpstream_id_set_create()) == NULL) {
+    goto err;
+  }
+
+  return table;
+
+err:
+  bvc_pfx_summary_table_destroy(table);
+  return NULL;
+}
+
+void bvc_pfx_summary_table_destroy(bvc_pfx_summary_table_t *table)
+{
+  if (table == NULL) {
+    return;
+  }
+
+  if (table->v4pfxs != NULL) {
+    kh_destroy(bvcps_v4pfx_idx, table->v4pfxs);
+  }
+  if (table->v6pfxs != NULL) {
+    kh_destroy(bvcps_v6pfx_idx, table->v6pfxs);
+  }
+  if (table->ff_asns != NULL) {
+    bgpstream_id_set_destroy(table->ff_asns);
+  }
+  free(table->summaries);
+  free(table->origins);
+
+  free(table);
+}
+
+void bvc_pfx_summary_table_clear(bvc_pfx_summary_table_t *table)
+{
+  kh_clear(bvcps_v4pfx_idx, table->v4pfxs);
+  kh_clear(bvcps_v6pfx_idx, table->v6pfxs);
+  table->summaries_cnt = 0;
+  table->origins_cnt = 0;
+}
+
+int bvc_pfx_summary_table_build(
+  bvc_pfx_summary_table_t *table, bgpview_t *view,
+  const bgpview_peer_bitmap_t ff_peers[BGPSTREAM_MAX_IP_VERSION_IDX])
+{
+  bgpview_iter_t *it = NULL;
+  bgpstream_pfx_t *pfx;
+  bgpstream_peer_sig_t *sg;
+  bgpstream_as_path_seg_t *origin_seg;
+  bvc_pfx_summary_t *s;
+  uint32_t origins_start;
+  uint32_t i;
+  int ipv_idx;
+
+  bvc_pfx_summary_table_clear(table);
+
+  if ((it = bgpview_iter_create(view)) == NULL) {
+    goto err;
+  }
+
+  for (bgpview_iter_first_pfx(it, 0 /* all ip versions*/, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+    pfx = bgpview_iter_pfx_get_pfx(it);
+    ipv_idx = bgpstream_ipv2idx(pfx->address.version);
+
+    if (table->summaries_cnt == table->summaries_alloc) {
+      if ((table->summaries = realloc(
+             table->summaries, sizeof(bvc_pfx_summary_t) *
+                                 (table->summaries_alloc + ALLOC_INCR))) ==
+          NULL) {
+        goto err;
+      }
+      table->summaries_alloc += ALLOC_INCR;
+    }
+    s = &table->summaries[table->summaries_cnt];
+    memset(s, 0, sizeof(bvc_pfx_summary_t));
+    origins_start = table->origins_cnt;
+    bgpstream_id_set_clear(table->ff_asns);
+
+    /* only walk the full-feed peers */
+    for (bgpview_iter_pfx_first_peer_in(it, BGPVIEW_FIELD_ACTIVE,
+                                        &ff_peers[ipv_idx]);
+         bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+      s->ff_peers_cnt++;
+
+      sg = bgpview_iter_peer_get_sig(it);
+      assert(sg != NULL);
+      bgpstream_id_set_insert(table->ff_asns, sg->peer_asnumber);
+
+      /* we do not consider sets and confederations */
+      origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it);
+      if (origin_seg == NULL || origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
+        continue;
+      }
+      if (add_origin(table, origins_start, s,
+                     ((bgpstream_as_path_seg_asn_t *)origin_seg)->asn) != 0) {
+        goto err;
+      }
+    }
+
+    if (s->ff_peers_cnt == 0) {
+      /* not observed by any full-feed peer */
+      continue;
+    }
+    s->ff_asns_cnt = bgpstream_id_set_size(table->ff_asns);
+
+    if (index_pfx(table, pfx, table->summaries_cnt) != 0) {
+      goto err;
+    }
+    table->summaries_cnt++;
+  }
+
+  /* the origin pool is no longer reallocated, so now the summaries can point
+     into it (the ranges are contiguous and in the same order as the
+     summaries) */
+  origins_start = 0;
+  for (i = 0; i < table->summaries_cnt; i++) {
+    table->summaries[i].origins = &table->origins[origins_start];
+    origins_start += table->summaries[i].origins_cnt;
+  }
+  assert(origins_start == table->origins_cnt);
+
+  bgpview_iter_destroy(it);
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not build prefix summary table\n");
+  bgpview_iter_destroy(it);
+  bvc_pfx_summary_table_clear(table);
+  return -1;
+}
+
+bvc_pfx_summary_t *bvc_pfx_summary_table_get(bvc_pfx_summary_table_t *table,
+                                             bgpstream_pfx_t *pfx)
+{
+  khiter_t k;
+
+  switch (pfx->address.version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    if ((k = kh_get(bvcps_v4pfx_idx, table->v4pfxs, pfx->bs_ipv4)) ==
+        kh_end(table->v4pfxs)) {
+      return NULL;
+    }
+    return &table->summaries[kh_val(table->v4pfxs, k)];
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    if ((k = kh_get(bvcps_v6pfx_idx, table->v6pfxs, pfx->bs_ipv6)) ==
+        kh_end(table->v6pfxs)) {
+      return NULL;
+    }
+    return &table->summaries[kh_val(table->v6pfxs, k)];
+
+  default:
+    return NULL;
+  }
+}
+
+uint32_t bvc_pfx_summary_table_size(bvc_pfx_summary_table_t *table)
+{
+  return table->summaries_cnt;
+}
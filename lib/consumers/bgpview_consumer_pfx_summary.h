@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __BGPVIEW_CONSUMER_PFX_SUMMARY_H
+#define __BGPVIEW_CONSUMER_PFX_SUMMARY_H
+
+#include "bgpstream_utils_id_set.h"
+#include "bgpview.h"
+#include "bgpview_consumer_manager.h" /* for bvc_pfx_summary_table_t */
+#include <stdint.h>
+
+/** @file
+ *
+ * @brief Header file that exposes the per-view table of full-feed prefix
+ * summaries shared by consumers through the chain state
+ *
+ * The table is built (at most) once per view by the visibility consumer, so
+ * that consumers which only need to know how many full-feed peers observe a
+ * prefix, and which origin ASNs they observe, do not each have to walk every
+ * pfx-peer of the view.
+ */
+
+/**
+ * @name Public Data Structures
+ *
+ * @{ */
+
+/** Summary of the full-feed observations of a single prefix */
+typedef struct bvc_pfx_summary {
+
+  /** Number of full-feed peers that observe the prefix */
+  uint16_t ff_peers_cnt;
+
+  /** Number of distinct ASNs of the full-feed peers that observe the prefix */
+  uint16_t ff_asns_cnt;
+
+  /** Number of distinct origin ASNs in the origins array */
+  uint16_t origins_cnt;
+
+  /** Sorted array of the distinct origin ASNs observed by full-feed peers
+      (origins that are AS sets or confederations are ignored) */
+  uint32_t *origins;
+
+} bvc_pfx_summary_t;
+
+/** @} */
+
+/**
+ * @name Public API Functions
+ *
+ * @{ */
+
+/** Create a new, empty, prefix summary table
+ *
+ * @return pointer to the table created, NULL if an error occurred
+ */
+bvc_pfx_summary_table_t *bvc_pfx_summary_table_create(void);
+
+/** Destroy the given prefix summary table
+ *
+ * @param table         pointer to the table to destroy
+ */
+void bvc_pfx_summary_table_destroy(bvc_pfx_summary_table_t *table);
+
+/** Remove all the summaries from the given table
+ *
+ * @param table         pointer to the table to clear
+ */
+void bvc_pfx_summary_table_clear(bvc_pfx_summary_table_t *table);
+
+/** Build the summaries of all the active prefixes of the given view
+ *
+ * @param table         pointer to the table to (re-)build
+ * @param view          pointer to the view to summarize
+ * @param ff_peers      array of bitmaps of full-feed peers (one per IP
+ *                      version)
+ * @return 0 if the table was built successfully, -1 otherwise
+ *
+ * Prefixes that are not observed by any full-feed peer are not added to the
+ * table.
+ */
+int bvc_pfx_summary_table_build(
+  bvc_pfx_summary_table_t *table, bgpview_t *view,
+  const bgpview_peer_bitmap_t ff_peers[BGPSTREAM_MAX_IP_VERSION_IDX]);
+
+/** Get the summary of the given prefix
+ *
+ * @param table         pointer to the table to query
+ * @param pfx           pointer to the prefix to look up
+ * @return borrowed pointer to the prefix summary, NULL if the prefix is not
+ * observed by any full-feed peer
+ *
+ * The returned pointer is only valid until the table is rebuilt or cleared.
+ */
+bvc_pfx_summary_t *bvc_pfx_summary_table_get(bvc_pfx_summary_table_t *table,
+                                             bgpstream_pfx_t *pfx);
+
+/** Get the number of prefixes in the given table
+ *
+ * @param table         pointer to the table
+ * @return the number of prefixes observed by at least one full-feed peer
+ */
+uint32_t bvc_pfx_summary_table_size(bvc_pfx_summary_table_t *table);
+
+/** @} */
+
+#endif /* __BGPVIEW_CONSUMER_PFX_SUMMARY_H */
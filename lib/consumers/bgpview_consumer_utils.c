@@ -25,18 +25,40 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <errno.h>
+#include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include "khash.h"
 #include "utils.h"
 #include "bgpview.h"
 #include "bgpview_consumer_utils.h"
 
+/* core paths are keyed by (path store index, peer ASN) */
+KHASH_INIT(bvcu_core_marks, uint64_t, uint8_t, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
+KHASH_INIT(bvcu_core_results, uint64_t, void *, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
+
+/* returns 1 and sets the key if the pfx-peer has a core path, 0 otherwise */
+static int core_path_key(bgpview_iter_t *it,
+                         bgpstream_as_path_store_path_t *spath, uint64_t *key)
+{
+  if (bgpstream_as_path_store_path_is_core(spath) == 0) {
+    return 0;
+  }
+  *key = ((uint64_t)bgpstream_as_path_store_path_get_idx(spath) << 32) |
+         bgpview_iter_peer_get_sig(it)->peer_asnumber;
+  return 1;
+}
+
 iow_t* bvcu_open_outfile(char *namebuf, const char *fmt, ...)
 {
   iow_t *file;
@@ -115,3 +137,668 @@ int bvcu_print_pfx_peer_as_path(iow_t *wf, bgpview_iter_t *it,
   }
   return 0;
 }
+
+uint8_t *bvcu_path_marks_get(bvcu_path_marks_t *pm, bgpview_iter_t *it)
+{
+  bgpstream_as_path_store_path_t *spath =
+    bgpview_iter_pfx_peer_get_as_path_store_path(it);
+  uint32_t idx = bgpstream_as_path_store_path_get_idx(spath);
+  uint32_t new_cnt;
+  uint8_t *new_marks;
+  khash_t(bvcu_core_marks) *core;
+  uint64_t key;
+  khiter_t k;
+  int khret;
+
+  if (core_path_key(it, spath, &key) != 0) {
+    if (pm->core_marks == NULL &&
+        (pm->core_marks = kh_init(bvcu_core_marks)) == NULL) {
+      fprintf(stderr, "ERROR: Could not create core path marks\n");
+      return NULL;
+    }
+    core = pm->core_marks;
+    if ((k = kh_put(bvcu_core_marks, core, key, &khret)) == kh_end(core)) {
+      fprintf(stderr, "ERROR: Could not add core path mark\n");
+      return NULL;
+    }
+    if (khret != 0) {
+      kh_val(core, k) = 0;
+    }
+    return &kh_val(core, k);
+  }
+
+  if (idx >= pm->alloc_cnt) {
+    new_cnt = (idx + 1) * 2;
+    if ((new_marks = realloc(pm->marks, new_cnt)) == NULL) {
+      fprintf(stderr, "ERROR: Could not grow path marks\n");
+      return NULL;
+    }
+    memset(new_marks + pm->alloc_cnt, 0, new_cnt - pm->alloc_cnt);
+    pm->marks = new_marks;
+    pm->alloc_cnt = new_cnt;
+  }
+
+  return &pm->marks[idx];
+}
+
+void bvcu_path_marks_clear(bvcu_path_marks_t *pm)
+{
+  if (pm->marks != NULL) {
+    memset(pm->marks, 0, pm->alloc_cnt);
+  }
+  if (pm->core_marks != NULL) {
+    kh_clear(bvcu_core_marks, (khash_t(bvcu_core_marks) *)pm->core_marks);
+  }
+}
+
+void bvcu_path_marks_free(bvcu_path_marks_t *pm)
+{
+  free(pm->marks);
+  pm->marks = NULL;
+  pm->alloc_cnt = 0;
+  if (pm->core_marks != NULL) {
+    kh_destroy(bvcu_core_marks, (khash_t(bvcu_core_marks) *)pm->core_marks);
+    pm->core_marks = NULL;
+  }
+}
+
+void bvcu_path_cache_init(bvcu_path_cache_t *pc,
+    bvcu_path_cache_derive_t *derive, bvcu_path_cache_free_t *free_result)
+{
+  memset(pc, 0, sizeof(bvcu_path_cache_t));
+  pc->derive = derive;
+  pc->free_result = free_result;
+}
+
+static void path_cache_flush(bvcu_path_cache_t *pc)
+{
+  khash_t(bvcu_core_results) *core = pc->core_results;
+  uint32_t i;
+  khiter_t k;
+  for (i = 0; i < pc->alloc_cnt; i++) {
+    if (pc->results[i] != NULL) {
+      pc->free_result(pc->results[i]);
+      pc->results[i] = NULL;
+    }
+  }
+  if (core != NULL) {
+    for (k = kh_begin(core); k != kh_end(core); k++) {
+      if (kh_exist(core, k) && kh_val(core, k) != NULL) {
+        pc->free_result(kh_val(core, k));
+      }
+    }
+    kh_clear(bvcu_core_results, core);
+  }
+}
+
+void *bvcu_path_cache_get(bvcu_path_cache_t *pc, bgpview_iter_t *it)
+{
+  bgpstream_as_path_store_t *store =
+    bgpview_get_as_path_store(bgpview_iter_get_view(it));
+  bgpstream_as_path_store_path_t *spath;
+  uint32_t idx;
+  uint32_t new_cnt;
+  void **new_results;
+  khash_t(bvcu_core_results) *core;
+  uint64_t key;
+  khiter_t k;
+  int khret;
+
+  if (store != pc->store) {
+    /* indexes of another store are meaningless */
+    path_cache_flush(pc);
+    pc->store = store;
+  }
+
+  spath = bgpview_iter_pfx_peer_get_as_path_store_path(it);
+
+  if (core_path_key(it, spath, &key) != 0) {
+    /* the derived result includes the peer ASN */
+    if (pc->core_results == NULL &&
+        (pc->core_results = kh_init(bvcu_core_results)) == NULL) {
+      fprintf(stderr, "ERROR: Could not create core path cache\n");
+      return NULL;
+    }
+    core = pc->core_results;
+    if ((k = kh_put(bvcu_core_results, core, key, &khret)) == kh_end(core)) {
+      fprintf(stderr, "ERROR: Could not add core path to cache\n");
+      return NULL;
+    }
+    if (khret != 0) {
+      kh_val(core, k) = NULL;
+    }
+    if (kh_val(core, k) == NULL) {
+      kh_val(core, k) = pc->derive(it);
+    }
+    return kh_val(core, k);
+  }
+
+  idx = bgpstream_as_path_store_path_get_idx(spath);
+
+  if (idx >= pc->alloc_cnt) {
+    new_cnt = (idx + 1) * 2;
+    if ((new_results = realloc(pc->results, sizeof(void *) * new_cnt)) ==
+        NULL) {
+      fprintf(stderr, "ERROR: Could not grow path cache\n");
+      return NULL;
+    }
+    memset(new_results + pc->alloc_cnt, 0,
+           sizeof(void *) * (new_cnt - pc->alloc_cnt));
+    pc->results = new_results;
+    pc->alloc_cnt = new_cnt;
+  }
+
+  if (pc->results[idx] == NULL) {
+    pc->results[idx] = pc->derive(it);
+  }
+
+  return pc->results[idx];
+}
+
+void bvcu_path_cache_free(bvcu_path_cache_t *pc)
+{
+  path_cache_flush(pc);
+  free(pc->results);
+  pc->results = NULL;
+  pc->alloc_cnt = 0;
+  if (pc->core_results != NULL) {
+    kh_destroy(bvcu_core_results,
+               (khash_t(bvcu_core_results) *)pc->core_results);
+    pc->core_results = NULL;
+  }
+  pc->store = NULL;
+}
+
+struct bvcu_outfile {
+  /* the underlying (compressed) file */
+  iow_t *file;
+
+  /* buffer being filled, and the number of bytes in it */
+  char *buf;
+  size_t len;
+
+  /* buffer being written by the writer thread (if pending_len > 0) */
+  char *pending;
+  size_t pending_len;
+
+  /* set when the file is being closed */
+  int shutdown;
+
+  /* set if the writer thread failed to write a buffer */
+  int error;
+
+  pthread_t writer;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+static void *outfile_writer(void *data)
+{
+  bvcu_outfile_t *of = (bvcu_outfile_t *)data;
+
+  pthread_mutex_lock(&of->mutex);
+  while (1) {
+    while (of->pending_len == 0 && of->shutdown == 0) {
+      pthread_cond_wait(&of->cond, &of->mutex);
+    }
+    if (of->pending_len == 0) {
+      break;
+    }
+    /* compress and write without holding the lock */
+    pthread_mutex_unlock(&of->mutex);
+    int64_t written = wandio_wwrite(of->file, of->pending, of->pending_len);
+    pthread_mutex_lock(&of->mutex);
+    if (written < 0 || (size_t)written != of->pending_len) {
+      of->error = 1;
+    }
+    of->pending_len = 0;
+    pthread_cond_broadcast(&of->cond);
+  }
+  pthread_mutex_unlock(&of->mutex);
+
+  return NULL;
+}
+
+/* hand the current buffer to the writer thread, and continue with the other
+ * one */
+static int outfile_flush(bvcu_outfile_t *of)
+{
+  char *tmp;
+  int error;
+
+  if (of->len == 0) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&of->mutex);
+  while (of->pending_len > 0) {
+    pthread_cond_wait(&of->cond, &of->mutex);
+  }
+  tmp = of->pending;
+  of->pending = of->buf;
+  of->pending_len = of->len;
+  error = of->error;
+  pthread_cond_broadcast(&of->cond);
+  pthread_mutex_unlock(&of->mutex);
+
+  of->buf = tmp;
+  of->len = 0;
+
+  if (error != 0) {
+    fprintf(stderr, "ERROR: Could not write data to file\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* make sure there are at least len free bytes in the buffer */
+#define OUTFILE_RESERVE(of, l)                                                 \
+  do {                                                                         \
+    if ((of)->len + (l) > BVCU_OUTFILE_BUFFER_LEN &&                           \
+        outfile_flush(of) != 0) {                                              \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+bvcu_outfile_t *bvcu_outfile_open(char *namebuf, const char *fmt, ...)
+{
+  bvcu_outfile_t *of;
+  va_list ap;
+
+  va_start(ap, fmt);
+  int size = vsnprintf(namebuf, BVCU_PATH_MAX-1, fmt, ap);
+  va_end(ap);
+  if (size >= BVCU_PATH_MAX) {
+    fprintf(stderr, "ERROR: File name too long\n");
+    return NULL;
+  }
+
+  if ((of = malloc_zero(sizeof(bvcu_outfile_t))) == NULL) {
+    return NULL;
+  }
+  if ((of->buf = malloc(BVCU_OUTFILE_BUFFER_LEN)) == NULL ||
+      (of->pending = malloc(BVCU_OUTFILE_BUFFER_LEN)) == NULL) {
+    goto err;
+  }
+  if ((of->file = wandio_wcreate(namebuf,
+      wandio_detect_compression_type(namebuf), BVCU_DEFAULT_COMPRESS_LEVEL,
+      O_CREAT)) == NULL) {
+    fprintf(stderr, "ERROR: Could not open %s for writing\n", namebuf);
+    goto err;
+  }
+
+  pthread_mutex_init(&of->mutex, NULL);
+  pthread_cond_init(&of->cond, NULL);
+  if (pthread_create(&of->writer, NULL, outfile_writer, of) != 0) {
+    fprintf(stderr, "ERROR: Could not start writer thread for %s\n", namebuf);
+    pthread_mutex_destroy(&of->mutex);
+    pthread_cond_destroy(&of->cond);
+    wandio_wdestroy(of->file);
+    goto err;
+  }
+
+  return of;
+
+err:
+  free(of->buf);
+  free(of->pending);
+  free(of);
+  return NULL;
+}
+
+int bvcu_outfile_close(bvcu_outfile_t *of)
+{
+  int rc;
+
+  if (of == NULL) {
+    return 0;
+  }
+
+  rc = outfile_flush(of);
+
+  pthread_mutex_lock(&of->mutex);
+  of->shutdown = 1;
+  pthread_cond_broadcast(&of->cond);
+  pthread_mutex_unlock(&of->mutex);
+  pthread_join(of->writer, NULL);
+
+  if (rc == 0 && of->error != 0) {
+    fprintf(stderr, "ERROR: Could not write data to file\n");
+    rc = -1;
+  }
+
+  wandio_wdestroy(of->file);
+  pthread_mutex_destroy(&of->mutex);
+  pthread_cond_destroy(&of->cond);
+  free(of->buf);
+  free(of->pending);
+  free(of);
+
+  return rc;
+}
+
+int bvcu_outfile_puts(bvcu_outfile_t *of, const char *str)
+{
+  size_t len = strlen(str);
+  size_t n;
+
+  while (len > 0) {
+    OUTFILE_RESERVE(of, 1);
+    n = BVCU_OUTFILE_BUFFER_LEN - of->len;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(of->buf + of->len, str, n);
+    of->len += n;
+    str += n;
+    len -= n;
+  }
+  return 0;
+}
+
+int bvcu_outfile_putc(bvcu_outfile_t *of, char c)
+{
+  OUTFILE_RESERVE(of, 1);
+  of->buf[of->len++] = c;
+  return 0;
+}
+
+/* format val into buf (at least 10 bytes), returns the number of digits */
+static int format_u32(char *buf, uint32_t val)
+{
+  char tmp[10];
+  int n = 0;
+  int i;
+
+  do {
+    tmp[n++] = '0' + (val % 10);
+    val /= 10;
+  } while (val != 0);
+
+  for (i = 0; i < n; i++) {
+    buf[i] = tmp[n - 1 - i];
+  }
+  return n;
+}
+
+int bvcu_outfile_put_u32(bvcu_outfile_t *of, uint32_t val)
+{
+  OUTFILE_RESERVE(of, 10);
+  of->len += format_u32(of->buf + of->len, val);
+  return 0;
+}
+
+int bvcu_outfile_put_pfx(bvcu_outfile_t *of, bgpstream_pfx_t *pfx)
+{
+  uint8_t *bytes;
+  int i;
+
+  if (pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV4) {
+    /* IPv6 (and anything else) goes through the library */
+    OUTFILE_RESERVE(of, INET6_ADDRSTRLEN + 4);
+    if (bgpstream_pfx_snprintf(of->buf + of->len, INET6_ADDRSTRLEN + 4, pfx) ==
+        NULL) {
+      return -1;
+    }
+    of->len += strlen(of->buf + of->len);
+    return 0;
+  }
+
+  /* a.b.c.d/len */
+  OUTFILE_RESERVE(of, INET_ADDRSTRLEN + 3);
+  bytes = (uint8_t *)&pfx->address.bs_ipv4.addr.s_addr;
+  for (i = 0; i < 4; i++) {
+    if (i != 0) {
+      of->buf[of->len++] = '.';
+    }
+    of->len += format_u32(of->buf + of->len, bytes[i]);
+  }
+  of->buf[of->len++] = '/';
+  of->len += format_u32(of->buf + of->len, pfx->mask_len);
+  return 0;
+}
+
+int bvcu_outfile_printf(bvcu_outfile_t *of, const char *fmt, ...)
+{
+  va_list ap;
+  int size;
+
+  va_start(ap, fmt);
+  size = vsnprintf(of->buf + of->len, BVCU_OUTFILE_BUFFER_LEN - of->len, fmt,
+                   ap);
+  va_end(ap);
+  if (size < 0) {
+    return -1;
+  }
+  if (of->len + size < BVCU_OUTFILE_BUFFER_LEN) {
+    of->len += size;
+    return 0;
+  }
+
+  /* did not fit (vsnprintf needs room for the nul), try again in an empty
+   * buffer */
+  if (outfile_flush(of) != 0) {
+    return -1;
+  }
+  if (size >= BVCU_OUTFILE_BUFFER_LEN) {
+    fprintf(stderr, "ERROR: Formatted output too long\n");
+    return -1;
+  }
+  va_start(ap, fmt);
+  vsnprintf(of->buf, BVCU_OUTFILE_BUFFER_LEN, fmt, ap);
+  va_end(ap);
+  of->len = size;
+  return 0;
+}
+
+/* header of a node of an expiry index (followed by the key) */
+typedef struct expiry_node {
+  /* the nodes of a bucket form a circular list, headed by a sentinel node */
+  uint32_t prev;
+  uint32_t next;
+  uint32_t ts;
+} expiry_node_t;
+
+#define EXPIRY_NODE(ex, idx)                                                   \
+  ((expiry_node_t *)((ex)->nodes + (size_t)(idx) * (ex)->node_len))
+#define EXPIRY_NODE_KEY(ex, idx) ((void *)(EXPIRY_NODE(ex, idx) + 1))
+
+void bvcu_expiry_init(bvcu_expiry_t *ex, size_t key_len)
+{
+  memset(ex, 0, sizeof(bvcu_expiry_t));
+  ex->key_len = key_len;
+  /* keep the keys 8-byte aligned */
+  ex->node_len = (sizeof(expiry_node_t) + key_len + 7) & ~7;
+  ex->free_node = BVCU_EXPIRY_NONE;
+}
+
+static uint32_t expiry_node_alloc(bvcu_expiry_t *ex)
+{
+  uint32_t idx;
+  uint32_t new_cnt;
+  uint8_t *new_nodes;
+
+  if (ex->free_node != BVCU_EXPIRY_NONE) {
+    idx = ex->free_node;
+    ex->free_node = EXPIRY_NODE(ex, idx)->next;
+    return idx;
+  }
+
+  if (ex->nodes_cnt == ex->nodes_alloc_cnt) {
+    new_cnt = ex->nodes_alloc_cnt == 0 ? 1024 : ex->nodes_alloc_cnt * 2;
+    if ((new_nodes = realloc(ex->nodes, (size_t)new_cnt * ex->node_len)) ==
+        NULL) {
+      fprintf(stderr, "ERROR: Could not grow expiry index\n");
+      return BVCU_EXPIRY_NONE;
+    }
+    ex->nodes = new_nodes;
+    ex->nodes_alloc_cnt = new_cnt;
+  }
+
+  return ex->nodes_cnt++;
+}
+
+static void expiry_node_free(bvcu_expiry_t *ex, uint32_t idx)
+{
+  EXPIRY_NODE(ex, idx)->next = ex->free_node;
+  ex->free_node = idx;
+}
+
+static void expiry_node_unlink(bvcu_expiry_t *ex, uint32_t idx)
+{
+  expiry_node_t *node = EXPIRY_NODE(ex, idx);
+  EXPIRY_NODE(ex, node->prev)->next = node->next;
+  EXPIRY_NODE(ex, node->next)->prev = node->prev;
+}
+
+/* find (or create) the bucket for the given time and return its sentinel */
+static uint32_t expiry_bucket_get(bvcu_expiry_t *ex, uint32_t ts)
+{
+  bvcu_expiry_bucket_t *buckets = ex->buckets + ex->buckets_first;
+  bvcu_expiry_bucket_t *new_buckets;
+  uint32_t lo = 0, hi = ex->buckets_cnt, mid;
+  uint32_t new_cnt;
+  uint32_t head;
+
+  /* the common case: the most recent bucket */
+  if (ex->buckets_cnt > 0 && buckets[ex->buckets_cnt - 1].ts <= ts) {
+    if (buckets[ex->buckets_cnt - 1].ts == ts) {
+      return buckets[ex->buckets_cnt - 1].head;
+    }
+    lo = ex->buckets_cnt;
+  } else {
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (buckets[mid].ts < ts) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < ex->buckets_cnt && buckets[lo].ts == ts) {
+      return buckets[lo].head;
+    }
+  }
+
+  /* new bucket, to be inserted at lo */
+  if ((head = expiry_node_alloc(ex)) == BVCU_EXPIRY_NONE) {
+    return BVCU_EXPIRY_NONE;
+  }
+  EXPIRY_NODE(ex, head)->prev = head;
+  EXPIRY_NODE(ex, head)->next = head;
+  EXPIRY_NODE(ex, head)->ts = ts;
+
+  if (ex->buckets_first + ex->buckets_cnt == ex->buckets_alloc_cnt) {
+    if (ex->buckets_first > 0) {
+      /* reuse the space of the expired buckets */
+      memmove(ex->buckets, ex->buckets + ex->buckets_first,
+              sizeof(bvcu_expiry_bucket_t) * ex->buckets_cnt);
+      ex->buckets_first = 0;
+    } else {
+      new_cnt = ex->buckets_alloc_cnt == 0 ? 64 : ex->buckets_alloc_cnt * 2;
+      if ((new_buckets = realloc(ex->buckets, sizeof(bvcu_expiry_bucket_t) *
+                                                new_cnt)) == NULL) {
+        fprintf(stderr, "ERROR: Could not grow expiry index\n");
+        expiry_node_free(ex, head);
+        return BVCU_EXPIRY_NONE;
+      }
+      ex->buckets = new_buckets;
+      ex->buckets_alloc_cnt = new_cnt;
+    }
+    buckets = ex->buckets + ex->buckets_first;
+  }
+
+  memmove(&buckets[lo + 1], &buckets[lo],
+          sizeof(bvcu_expiry_bucket_t) * (ex->buckets_cnt - lo));
+  buckets[lo].ts = ts;
+  buckets[lo].head = head;
+  ex->buckets_cnt++;
+
+  return head;
+}
+
+int bvcu_expiry_touch(bvcu_expiry_t *ex, bvcu_expiry_handle_t *handle,
+                      const void *key, uint32_t ts)
+{
+  uint32_t idx = *handle;
+  uint32_t head;
+  expiry_node_t *node;
+
+  if (idx != BVCU_EXPIRY_NONE && EXPIRY_NODE(ex, idx)->ts == ts) {
+    /* already in the right bucket */
+    return 0;
+  }
+
+  /* find the bucket first, as it may need a node from the pool */
+  if ((head = expiry_bucket_get(ex, ts)) == BVCU_EXPIRY_NONE) {
+    return -1;
+  }
+
+  if (idx == BVCU_EXPIRY_NONE) {
+    if ((idx = expiry_node_alloc(ex)) == BVCU_EXPIRY_NONE) {
+      return -1;
+    }
+    memcpy(EXPIRY_NODE_KEY(ex, idx), key, ex->key_len);
+    ex->cnt++;
+    *handle = idx;
+  } else {
+    expiry_node_unlink(ex, idx);
+  }
+
+  /* append the node to the bucket */
+  node = EXPIRY_NODE(ex, idx);
+  node->ts = ts;
+  node->next = head;
+  node->prev = EXPIRY_NODE(ex, head)->prev;
+  EXPIRY_NODE(ex, node->prev)->next = idx;
+  EXPIRY_NODE(ex, head)->prev = idx;
+
+  return 0;
+}
+
+void bvcu_expiry_remove(bvcu_expiry_t *ex, bvcu_expiry_handle_t *handle)
+{
+  if (*handle == BVCU_EXPIRY_NONE) {
+    return;
+  }
+  expiry_node_unlink(ex, *handle);
+  expiry_node_free(ex, *handle);
+  ex->cnt--;
+  *handle = BVCU_EXPIRY_NONE;
+}
+
+uint32_t bvcu_expiry_expire(bvcu_expiry_t *ex, uint32_t cutoff,
+                            bvcu_expiry_cb_t *cb, void *user)
+{
+  bvcu_expiry_bucket_t *bucket;
+  uint32_t idx, next;
+  uint32_t expired = 0;
+
+  while (ex->buckets_cnt > 0 &&
+         (bucket = &ex->buckets[ex->buckets_first])->ts < cutoff) {
+    for (idx = EXPIRY_NODE(ex, bucket->head)->next; idx != bucket->head;
+         idx = next) {
+      next = EXPIRY_NODE(ex, idx)->next;
+      cb(EXPIRY_NODE_KEY(ex, idx), bucket->ts, user);
+      expiry_node_free(ex, idx);
+      expired++;
+    }
+    expiry_node_free(ex, bucket->head);
+    ex->buckets_first++;
+    ex->buckets_cnt--;
+  }
+
+  if (ex->buckets_cnt == 0) {
+    ex->buckets_first = 0;
+  }
+  ex->cnt -= expired;
+
+  return expired;
+}
+
+void bvcu_expiry_free(bvcu_expiry_t *ex)
+{
+  free(ex->nodes);
+  free(ex->buckets);
+  bvcu_expiry_init(ex, ex->key_len);
+}
@@ -24,7 +24,9 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdint.h>
 #include <wandio.h>
+#include "bgpview.h"
 
 #ifdef __GNUC__
 #define ATTR_FORMAT_PRINTF(i,j) __attribute__((format(printf, i, j)))
@@ -83,3 +85,265 @@ int bvcu_is_writable_folder(const char *path);
  */
 int bvcu_print_pfx_peer_as_path(iow_t *wf, bgpview_iter_t *it,
     const char *delim1, const char *delim2);
+
+/** Per-view marks for the distinct AS paths of a view.
+ *
+ * Marks are indexed by AS path store index (which is stable for as long as
+ * the path store lives), so that path-derived consumers can process each
+ * distinct path once per view rather than once per pfx-peer. A core path is
+ * stored without the peer ASN and is shared by all the peers that have the
+ * same path after their own ASN, so those are marked per (index, peer ASN).
+ */
+typedef struct bvcu_path_marks {
+  uint8_t *marks;
+  uint32_t alloc_cnt;
+  /* marks of the core paths (opaque hash) */
+  void *core_marks;
+} bvcu_path_marks_t;
+
+/** Get the mark of the AS path of the pfx-peer an iterator points at.
+ *
+ * @param pm      the path marks
+ * @param it      the bgpview pfx-peer iterator with the AS path
+ * @return        Pointer to the mark (0 if the path has not been marked since
+ *                the marks were last cleared), NULL if an error occurred
+ *
+ * The pointer is only valid until the next call to this function.
+ */
+uint8_t *bvcu_path_marks_get(bvcu_path_marks_t *pm, bgpview_iter_t *it);
+
+/** Reset all path marks to 0.
+ *
+ * @param pm      the path marks
+ */
+void bvcu_path_marks_clear(bvcu_path_marks_t *pm);
+
+/** Free the memory used by the path marks.
+ *
+ * @param pm      the path marks
+ */
+void bvcu_path_marks_free(bvcu_path_marks_t *pm);
+
+/** Callback that derives a result from the AS path of the pfx-peer an
+ *  iterator points at (returns NULL if an error occurred) */
+typedef void *(bvcu_path_cache_derive_t)(bgpview_iter_t *it);
+
+/** Callback that frees a result returned by a bvcu_path_cache_derive_t */
+typedef void(bvcu_path_cache_free_t)(void *result);
+
+/** Cache of results derived from AS paths, kept across views.
+ *
+ * Results are indexed by AS path store index, so each distinct path is only
+ * decomposed once for as long as the path store lives. Results of core paths
+ * (which include the peer ASN) are indexed by (index, peer ASN). If a view
+ * that uses a different path store is seen, the cache is flushed.
+ */
+typedef struct bvcu_path_cache {
+  bgpstream_as_path_store_t *store;
+  void **results;
+  uint32_t alloc_cnt;
+  /* results of the core paths (opaque hash) */
+  void *core_results;
+  bvcu_path_cache_derive_t *derive;
+  bvcu_path_cache_free_t *free_result;
+} bvcu_path_cache_t;
+
+/** Initialize an (empty) path cache.
+ *
+ * @param pc           the path cache
+ * @param derive       callback used to compute the result for a path
+ * @param free_result  callback used to free a result
+ */
+void bvcu_path_cache_init(bvcu_path_cache_t *pc,
+    bvcu_path_cache_derive_t *derive, bvcu_path_cache_free_t *free_result);
+
+/** Get the result for the AS path of the pfx-peer an iterator points at.
+ *
+ * @param pc      the path cache
+ * @param it      the bgpview pfx-peer iterator with the AS path
+ * @return        Borrowed pointer to the result (derived now if it was not
+ *                cached), NULL if an error occurred
+ */
+void *bvcu_path_cache_get(bvcu_path_cache_t *pc, bgpview_iter_t *it);
+
+/** Free all the cached results.
+ *
+ * @param pc      the path cache
+ */
+void bvcu_path_cache_free(bvcu_path_cache_t *pc);
+
+/** Size of each of the two buffers of a bvcu_outfile_t */
+#define BVCU_OUTFILE_BUFFER_LEN (1024 * 1024)
+
+/** Opaque handle for a buffered output file.
+ *
+ * Output is formatted into a large buffer, and full buffers are handed to a
+ * background thread that compresses and writes them while the next buffer is
+ * filled. The bvcu_outfile_put* functions format integers and prefixes
+ * directly, without going through printf.
+ */
+typedef struct bvcu_outfile bvcu_outfile_t;
+
+/** Open a buffered output file.
+ *
+ * @param namebuf  Pointer to a char[BVCU_PATH_MAX] buffer to hold the filename
+ * @param fmt      printf format string to generate file name
+ * @param ...      printf arguments
+ * @return         Pointer to a bvcu_outfile_t if the file was opened, NULL if
+ *                 an error occurred
+ *
+ * The file is opened like bvcu_open_outfile() does.
+ */
+ATTR_FORMAT_PRINTF(2, 3)
+bvcu_outfile_t *bvcu_outfile_open(char *namebuf, const char *fmt, ...);
+
+/** Flush and close a buffered output file.
+ *
+ * @param of      the output file to close (may be NULL)
+ * @return        0 if all the output was written, -1 if an error occurred
+ */
+int bvcu_outfile_close(bvcu_outfile_t *of);
+
+/** Write a string to a buffered output file.
+ *
+ * @param of      the output file
+ * @param str     the string to write
+ * @return        0 for success, -1 for error
+ */
+int bvcu_outfile_puts(bvcu_outfile_t *of, const char *str);
+
+/** Write a character to a buffered output file.
+ *
+ * @param of      the output file
+ * @param c       the character to write
+ * @return        0 for success, -1 for error
+ */
+int bvcu_outfile_putc(bvcu_outfile_t *of, char c);
+
+/** Write an unsigned integer (in decimal) to a buffered output file.
+ *
+ * @param of      the output file
+ * @param val     the value to write
+ * @return        0 for success, -1 for error
+ */
+int bvcu_outfile_put_u32(bvcu_outfile_t *of, uint32_t val);
+
+/** Write a prefix (in the same format as bgpstream_pfx_snprintf) to a
+ *  buffered output file.
+ *
+ * @param of      the output file
+ * @param pfx     the prefix to write
+ * @return        0 for success, -1 for error
+ */
+int bvcu_outfile_put_pfx(bvcu_outfile_t *of, bgpstream_pfx_t *pfx);
+
+/** Write formatted output to a buffered output file.
+ *
+ * @param of      the output file
+ * @param fmt     printf format string
+ * @param ...     printf arguments
+ * @return        0 for success, -1 for error
+ */
+ATTR_FORMAT_PRINTF(2, 3)
+int bvcu_outfile_printf(bvcu_outfile_t *of, const char *fmt, ...);
+
+/** Handle of an entry in a bvcu_expiry_t, stored by the user alongside the
+ *  entry (BVCU_EXPIRY_NONE if the entry is not in the index) */
+typedef uint32_t bvcu_expiry_handle_t;
+
+/** Value of a bvcu_expiry_handle_t that refers to no entry */
+#define BVCU_EXPIRY_NONE UINT32_MAX
+
+/** Callback invoked for each entry that expires
+ *
+ * @param key        the key given when the entry was last touched
+ * @param last_seen  the time the entry was last touched
+ * @param user       the user pointer given to bvcu_expiry_expire
+ *
+ * The entry has already been removed from the index, so the callback must
+ * reset the handle of the entry to BVCU_EXPIRY_NONE, and must not touch or
+ * remove any entry of the index.
+ */
+typedef void(bvcu_expiry_cb_t)(const void *key, uint32_t last_seen,
+                               void *user);
+
+/** A bucket of entries that were last seen at the same time */
+typedef struct bvcu_expiry_bucket {
+  uint32_t ts;
+  uint32_t head;
+} bvcu_expiry_bucket_t;
+
+/** Index of entries by the time they were last seen.
+ *
+ * Entries are kept in one bucket per distinct last-seen time (i.e. per view),
+ * so that expiring the entries that have not been seen since a given time only
+ * touches those entries, rather than scanning the whole table of a windowed
+ * consumer. Moving an entry to the current bucket is O(1).
+ */
+typedef struct bvcu_expiry {
+  /* size of the keys (in bytes) */
+  uint32_t key_len;
+  /* size of a node (header and key) */
+  uint32_t node_len;
+  /* pool of nodes, the handles are indexes in the pool */
+  uint8_t *nodes;
+  uint32_t nodes_cnt;
+  uint32_t nodes_alloc_cnt;
+  /* list of the free nodes */
+  uint32_t free_node;
+  /* the buckets, in increasing time order, starting at buckets_first */
+  bvcu_expiry_bucket_t *buckets;
+  uint32_t buckets_first;
+  uint32_t buckets_cnt;
+  uint32_t buckets_alloc_cnt;
+  /* number of entries in the index */
+  uint32_t cnt;
+} bvcu_expiry_t;
+
+/** Initialize an (empty) expiry index.
+ *
+ * @param ex       the expiry index
+ * @param key_len  size of the keys of the entries (in bytes)
+ */
+void bvcu_expiry_init(bvcu_expiry_t *ex, size_t key_len);
+
+/** Record that an entry was seen at the given time.
+ *
+ * @param ex       the expiry index
+ * @param handle   pointer to the handle of the entry (BVCU_EXPIRY_NONE to add
+ *                 the entry to the index), updated by this function
+ * @param key      pointer to the key of the entry (only used if the entry is
+ *                 added to the index)
+ * @param ts       time the entry was seen
+ * @return 0 if the entry was recorded, -1 if an error occurred
+ *
+ * This is cheap if the entry has already been touched at the same time, and
+ * O(1) if the time is the most recent time of the index.
+ */
+int bvcu_expiry_touch(bvcu_expiry_t *ex, bvcu_expiry_handle_t *handle,
+                      const void *key, uint32_t ts);
+
+/** Remove an entry from the index.
+ *
+ * @param ex       the expiry index
+ * @param handle   pointer to the handle of the entry, reset to
+ *                 BVCU_EXPIRY_NONE by this function
+ */
+void bvcu_expiry_remove(bvcu_expiry_t *ex, bvcu_expiry_handle_t *handle);
+
+/** Remove the entries that were last seen before the given time.
+ *
+ * @param ex       the expiry index
+ * @param cutoff   entries last seen strictly before this time expire
+ * @param cb       callback invoked for each expired entry
+ * @param user     user pointer passed to the callback
+ * @return the number of entries that expired
+ */
+uint32_t bvcu_expiry_expire(bvcu_expiry_t *ex, uint32_t cutoff,
+                            bvcu_expiry_cb_t *cb, void *user);
+
+/** Free the memory used by the expiry index.
+ *
+ * @param ex       the expiry index
+ */
+void bvcu_expiry_free(bvcu_expiry_t *ex);
@@ -67,9 +67,9 @@
 static bvc_t bvc_announcedpfxs = {BVC_ID_ANNOUNCEDPFXS, NAME,
                                   BVC_GENERATE_PTRS(announcedpfxs)};
 
-/** Map <ipv4-prefix,last_ts>
+/** Map <ipv4-prefix,expiry handle> (the expiry index holds the last_ts)
  */
-KHASH_INIT(bwv_v4pfx_timestamp, bgpstream_ipv4_pfx_t, uint32_t, 1,
+KHASH_INIT(bwv_v4pfx_timestamp, bgpstream_ipv4_pfx_t, bvcu_expiry_handle_t, 1,
            bgpstream_ipv4_pfx_hash_val, bgpstream_ipv4_pfx_equal_val)
 typedef khash_t(bwv_v4pfx_timestamp) bwv_v4pfx_timestamp_t;
 
@@ -90,6 +90,9 @@ typedef struct bvc_announcedpfxs_state {
   /** blacklist prefixes */
   bgpstream_pfx_set_t *blacklist_pfxs;
 
+  /** prefixes indexed by the last ts they were announced */
+  bvcu_expiry_t expiry;
+
   /** first timestamp processed by view consumer */
   uint32_t first_ts;
 
@@ -236,6 +239,7 @@ int bvc_announcedpfxs_init(bvc_t *consumer, int argc, char **argv)
   state->next_output_time = 0;
   state->first_ts = 0;
   state->v4pfx_ts = NULL;
+  bvcu_expiry_init(&state->expiry, sizeof(bgpstream_ipv4_pfx_t));
 
   /* parse the command line args */
   if (parse_args(consumer, argc, argv) != 0) {
@@ -300,6 +304,7 @@ void bvc_announcedpfxs_destroy(bvc_t *consumer)
     if (state->v4pfx_ts != NULL) {
       kh_destroy(bwv_v4pfx_timestamp, state->v4pfx_ts);
     }
+    bvcu_expiry_free(&state->expiry);
     if (state->blacklist_pfxs != NULL) {
       bgpstream_pfx_set_destroy(state->blacklist_pfxs);
     }
@@ -310,6 +315,18 @@ void bvc_announcedpfxs_destroy(bvc_t *consumer)
   }
 }
 
+/** Remove a prefix that has not been announced within the window */
+static void remove_stale_pfx(const void *key, uint32_t last_seen, void *user)
+{
+  bvc_t *consumer = (bvc_t *)user;
+  khiter_t k;
+
+  k = kh_get(bwv_v4pfx_timestamp, STATE->v4pfx_ts,
+             *(bgpstream_ipv4_pfx_t *)key);
+  assert(k != kh_end(STATE->v4pfx_ts));
+  kh_del(bwv_v4pfx_timestamp, STATE->v4pfx_ts, k);
+}
+
 int bvc_announcedpfxs_process_view(bvc_t *consumer, bgpview_t *view)
 {
   bvc_announcedpfxs_state_t *state = STATE;
@@ -349,27 +366,37 @@ int bvc_announcedpfxs_process_view(bvc_t *consumer, bgpview_t *view)
       continue;
     }
 
-    if ((k = kh_get(bwv_v4pfx_timestamp, state->v4pfx_ts, pfx->bs_ipv4)) ==
-        kh_end(state->v4pfx_ts)) {
-      /* new prefix */
-      k = kh_put(bwv_v4pfx_timestamp, state->v4pfx_ts, pfx->bs_ipv4, &khret);
-      kh_value(state->v4pfx_ts, k) = 0;
-    }
-
     for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
          bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
       /* only consider peers that are full-feed */
       peerid = bgpview_iter_peer_get_peer_id(it);
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv4_idx],
+      if (BGPVIEW_PEER_BITMAP_EXISTS(
+            &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv4_idx],
             peerid)) {
+        if ((k = kh_get(bwv_v4pfx_timestamp, state->v4pfx_ts,
+                        pfx->bs_ipv4)) == kh_end(state->v4pfx_ts)) {
+          /* new prefix */
+          k = kh_put(bwv_v4pfx_timestamp, state->v4pfx_ts, pfx->bs_ipv4,
+                     &khret);
+          kh_value(state->v4pfx_ts, k) = BVCU_EXPIRY_NONE;
+        }
         /* update the prefix timestamp */
-        kh_value(state->v4pfx_ts, k) = current_view_ts;
+        if (bvcu_expiry_touch(&state->expiry, &kh_value(state->v4pfx_ts, k),
+                              &pfx->bs_ipv4, current_view_ts) != 0) {
+          bgpview_iter_destroy(it);
+          return -1;
+        }
         break;
       }
     }
   }
 
+  /* remove stale entries from prefix list */
+  if (current_view_ts > state->window_size) {
+    bvcu_expiry_expire(&state->expiry, last_valid_timestamp, remove_stale_pfx,
+                       consumer);
+  }
+
   bgpview_iter_destroy(it);
 
   /* update first timestamp */
@@ -402,30 +429,21 @@ int bvc_announcedpfxs_process_view(bvc_t *consumer, bgpview_t *view)
     }
   }
 
-  /* prefix map iteration and update*/
-  for (k = kh_begin(state->v4pfx_ts); k != kh_end(state->v4pfx_ts); ++k) {
-    if (kh_exist(state->v4pfx_ts, k)) {
-      /* print prefix if within the window */
-      if (kh_value(state->v4pfx_ts, k) >= last_valid_timestamp) {
-        if (state->next_output_time <= current_view_ts) {
-          if (bgpstream_pfx_snprintf(
-                buffer_str, INET6_ADDRSTRLEN + 3,
-                (bgpstream_pfx_t *)&kh_key(state->v4pfx_ts, k)) != NULL) {
-            if (wandio_printf(f, "%s\n", buffer_str) == -1) {
-              fprintf(stderr, "ERROR: Could not write %s file\n", filename);
-              return -1;
-            }
+  if (state->next_output_time <= current_view_ts) {
+    /* print the prefixes (all within the window) */
+    for (k = kh_begin(state->v4pfx_ts); k != kh_end(state->v4pfx_ts); ++k) {
+      if (kh_exist(state->v4pfx_ts, k)) {
+        if (bgpstream_pfx_snprintf(
+              buffer_str, INET6_ADDRSTRLEN + 3,
+              (bgpstream_pfx_t *)&kh_key(state->v4pfx_ts, k)) != NULL) {
+          if (wandio_printf(f, "%s\n", buffer_str) == -1) {
+            fprintf(stderr, "ERROR: Could not write %s file\n", filename);
+            return -1;
           }
         }
       }
-      /* remove stale entry from prefix list */
-      else {
-        kh_del(bwv_v4pfx_timestamp, state->v4pfx_ts, k);
-      }
     }
-  }
 
-  if (state->next_output_time <= current_view_ts) {
     /* Close file and generate .done if new information was printed */
     wandio_wdestroy(f);
 
@@ -453,7 +471,7 @@ int bvc_announcedpfxs_process_view(bvc_t *consumer, bgpview_t *view)
 
   timeseries_kp_set(state->kp, state->window_size_idx, current_window_size);
 
-  if (timeseries_kp_flush(STATE->kp, current_view_ts) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, current_view_ts) != 0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
@@ -98,22 +98,34 @@ typedef struct edge_info {
   uint32_t start;
   // current status
   bool ongoing;
+  // handle in the expiry index (only ongoing edges are indexed)
+  bvcu_expiry_handle_t expiry;
 } edge_info_t;
 
-KHASH_INIT(edge_list, uint32_t, edge_info_t, 1, kh_int_hash_func,
-           kh_int_hash_equal)
-typedef khash_t(edge_list) edge_list_t;
+/** Pack an (undirected) edge into a 64 bit key (asn1 is the greater ASN) */
+#define EDGE_KEY(asn1, asn2) (((uint64_t)(asn1) << 32) | (uint32_t)(asn2))
+#define EDGE_ASN1(edge) ((uint32_t)((edge) >> 32))
+#define EDGE_ASN2(edge) ((uint32_t)(edge))
 
 // contains all the edges
-KHASH_INIT(edges_map, uint32_t, edge_list_t *, 1, kh_int_hash_func,
-           kh_int_hash_equal)
+KHASH_INIT(edges_map, uint64_t, edge_info_t, 1, kh_int64_hash_func,
+           kh_int64_hash_equal)
 typedef khash_t(edges_map) edges_map_t;
 
-KHASH_INIT(new_edges, char *, char, 1, kh_str_hash_func, kh_str_hash_equal)
-typedef khash_t(new_edges) new_edges_t;
+// set of edges
+KHASH_INIT(edge_set, uint64_t, char, 0, kh_int64_hash_func,
+           kh_int64_hash_equal)
+typedef khash_t(edge_set) edge_set_t;
 
-KHASH_INIT(newrec_edges, char *, char, 1, kh_str_hash_func, kh_str_hash_equal)
-typedef khash_t(newrec_edges) newrec_edges_t;
+/** The edges of an AS path (cached per path) */
+typedef struct path_edges {
+  uint32_t cnt;
+  uint64_t edges[];
+} path_edges_t;
+
+/* values of the per-view AS path marks */
+#define PATH_NO_NEW_EDGES 1
+#define PATH_NEW_EDGES 2
 
 /* our 'instance' */
 // main struct
@@ -126,6 +138,12 @@ typedef struct bvc_edges_state {
   char output_folder[MAX_BUFFER_LEN];
   // Khash holding edges
   edges_map_t *edges_map;
+  // Ongoing edges indexed by the time they were seen last
+  bvcu_expiry_t expiry;
+  // AS paths already processed in the current view
+  bvcu_path_marks_t path_marks;
+  // Edges of each AS path
+  bvcu_path_cache_t path_edges;
   // Khash holding triplets
   // Output files for edges and triplets
   char filename_newedges[BVCU_PATH_MAX];
@@ -179,7 +197,7 @@ static int output_timeseries(bvc_t *consumer, uint32_t ts)
                     state->finished_edges_count);
   timeseries_kp_set(state->kp, state->newrec_edges_count_idx,
                     state->newrec_edges_count);
-  if (timeseries_kp_flush(state->kp, ts) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, state->kp, ts) != 0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME, ts);
   }
 
@@ -294,6 +312,69 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
 
 /* ==================== CONSUMER INTERFACE FUNCTIONS ==================== */
 
+/* ==================== PATH FUNCTIONS ==================== */
+
+/* decompose the AS path of the current pfx-peer into its edges */
+static void *path_edges_derive(bgpview_iter_t *it)
+{
+  path_edges_t *pe = NULL, *tmp;
+  uint32_t alloc_cnt = 0;
+  bgpstream_as_path_seg_t *origin_seg;
+  bgpstream_as_path_seg_t *seg;
+  uint32_t asn;
+  uint32_t prev_asn = 0;
+
+  /* get origin asn */
+  if ((origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it)) == NULL) {
+    return NULL;
+  }
+
+  if ((pe = malloc_zero(sizeof(path_edges_t))) == NULL) {
+    return NULL;
+  }
+
+  /* we do not consider sets and confederations for the moment */
+  /* TODO (extend the code to deal with segments */
+  if (origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
+    return pe;
+  }
+
+  bgpview_iter_pfx_peer_as_path_seg_iter_reset(it);
+  while ((seg = bgpview_iter_pfx_peer_as_path_seg_next(it)) != NULL) {
+    /* checking if a segment is a regular asn */
+    if (seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
+      prev_asn = 0;
+      continue;
+    }
+    asn = ((bgpstream_as_path_seg_asn_t *)seg)->asn;
+
+    // Previous asn was a regular one
+    if (prev_asn != 0) {
+      // Continue if ASN prepending is observed
+      if (asn == prev_asn) {
+        continue;
+      }
+      if (pe->cnt == alloc_cnt) {
+        alloc_cnt = (alloc_cnt == 0) ? 8 : alloc_cnt * 2;
+        if ((tmp = realloc(pe, sizeof(path_edges_t) +
+                                 sizeof(uint64_t) * alloc_cnt)) == NULL) {
+          free(pe);
+          return NULL;
+        }
+        pe = tmp;
+      }
+      // Getting the greater than two ASNs. Assuming edges are not
+      // directional
+      pe->edges[pe->cnt++] = (asn < prev_asn) ? EDGE_KEY(prev_asn, asn)
+                                              : EDGE_KEY(asn, prev_asn);
+    }
+    // updating ASN variables for next ASNs in the aspath
+    prev_asn = asn;
+  }
+
+  return pe;
+}
+
 bvc_t *bvc_edges_alloc()
 {
   return &bvc_edges;
@@ -319,6 +400,8 @@ int bvc_edges_init(bvc_t *consumer, int argc, char **argv)
     fprintf(stderr, "Error: could not create edges map\n");
     return -1;
   }
+  bvcu_path_cache_init(&state->path_edges, path_edges_derive, free);
+  bvcu_expiry_init(&state->expiry, sizeof(uint64_t));
   /* parse the command line args */
   if (parse_args(consumer, argc, argv) != 0) {
     goto err;
@@ -366,13 +449,12 @@ void bvc_edges_destroy(bvc_t *consumer)
 {
   bvc_edges_state_t *state = STATE;
   if (state != NULL) {
-    khint_t k;
-    for (k = kh_begin(state->edges_map); k != kh_end(state->edges_map); k++) {
-      if (kh_exist(state->edges_map, k)) {
-        kh_destroy(edge_list, kh_value(state->edges_map, k));
-      }
+    if (state->edges_map != NULL) {
+      kh_destroy(edges_map, state->edges_map);
     }
-    kh_destroy(edges_map, state->edges_map);
+    bvcu_path_marks_free(&state->path_marks);
+    bvcu_path_cache_free(&state->path_edges);
+    bvcu_expiry_free(&state->expiry);
 
     if (state->blacklist_pfxs != NULL) {
       bgpstream_pfx_set_destroy(state->blacklist_pfxs);
@@ -429,36 +511,23 @@ void bvc_edges_destroy(bvc_t *consumer)
 /*   printf("\n"); */
 /* } */
 
-static edge_info_t get_edge_struct(bvc_t *consumer, char *asn1, char *asn2)
+static edge_info_t get_edge_struct(bvc_t *consumer, uint64_t edge)
 {
   bvc_edges_state_t *state = STATE;
-  khint_t j, k;
-  edge_list_t *edge_list;
-  uint32_t as1, as2;
-  sscanf(asn1, "%" PRIu32 "", &as1);
-  sscanf(asn2, "%" PRIu32 "", &as2);
-  // printf("print stage:  asn1 %d : asn2 %d \n ",as1,as2);
-
-  k = kh_get(edges_map, state->edges_map, as1);
+  khint_t k;
+
+  k = kh_get(edges_map, state->edges_map, edge);
   if (k == kh_end(state->edges_map)) {
     printf("ERR1 \n");
     exit(0);
   }
-  edge_list = kh_value(state->edges_map, k);
-  edge_info_t edge_info;
-  j = kh_get(edge_list, edge_list, as2);
-  if (j == kh_end(edge_list)) {
-    printf("ERR2 \n");
-    exit(0);
-  }
-  edge_info = kh_value(edge_list, j);
 
-  return edge_info;
+  return kh_value(state->edges_map, k);
 }
 
 static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
-                            new_edges_t *new_edges,
-                            newrec_edges_t *newrec_edges, bgpview_iter_t *it)
+                            edge_set_t *new_edges, edge_set_t *newrec_edges,
+                            bgpview_iter_t *it)
 {
   // printf("****************Inside printer \n");
   // return 1;
@@ -473,13 +542,7 @@ static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
 
   for (k = kh_begin(new_edges); k != kh_end(new_edges); k++) {
     if (kh_exist(new_edges, k)) {
-      char *edge_str, *asn1, *asn2;
-      edge_str = kh_key(new_edges, k);
-      // printf("edge_str %s \n",edge_str);
-      asn1 = strtok(edge_str, "-");
-      asn2 = strtok(NULL, "-");
-      // printf("edge1 %s : edge2 %s\n",asn1,asn2);
-      edge_info = get_edge_struct(consumer, asn1, asn2);
+      edge_info = get_edge_struct(consumer, kh_key(new_edges, k));
       // printf("printing\n");
       /*DEPRECATED
       if (wandio_printf(
@@ -507,8 +570,8 @@ static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
 
         // printing a path for each peer
         peerid = bgpview_iter_peer_get_peer_id(it);
-        if (bgpstream_id_set_exists(
-              BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+        if (BGPVIEW_PEER_BITMAP_EXISTS(
+              &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
               peerid)) {
 
           if (bvcu_print_pfx_peer_as_path(state->file_newedges, it, "", " ") < 0)
@@ -529,13 +592,7 @@ static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
 
   for (k = kh_begin(newrec_edges); k != kh_end(newrec_edges); k++) {
     if (kh_exist(newrec_edges, k)) {
-      char *edge_str, *asn1, *asn2;
-      edge_str = kh_key(newrec_edges, k);
-      // printf("edge_str %s \n",edge_str);
-      asn1 = strtok(edge_str, "-");
-      asn2 = strtok(NULL, "-");
-      // printf("edge1 %s : edge2 %s\n",asn1,asn2);
-      edge_info = get_edge_struct(consumer, asn1, asn2);
+      edge_info = get_edge_struct(consumer, kh_key(newrec_edges, k));
       // printf("printing\n");
       if (wandio_printf(
             state->file_newedges,
@@ -555,8 +612,8 @@ static int print_new_newrec(bvc_t *consumer, bgpstream_pfx_t *pfx,
 
         // printing a path for each peer
         peerid = bgpview_iter_peer_get_peer_id(it);
-        if (bgpstream_id_set_exists(
-              BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+        if (BGPVIEW_PEER_BITMAP_EXISTS(
+              &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
               peerid)) {
 
           if (bvcu_print_pfx_peer_as_path(state->file_newedges, it, "", " ") < 0)
@@ -628,142 +685,98 @@ static void print_ongoing_newedges(bvc_t *consumer)
 }
 */
 
-// Scans all ongoing edges and remove stale ones
-static void remove_stale_link(bvc_t *consumer)
+// Declares an ongoing edge that expired dead
+static void remove_stale_link(const void *key, uint32_t last_seen, void *user)
 {
+  bvc_t *consumer = (bvc_t *)user;
   bvc_edges_state_t *state = STATE;
-  khint_t k, j;
-  for (k = kh_begin(state->edges_map); k != kh_end(state->edges_map); k++) {
-    if (kh_exist(state->edges_map, k)) {
-      edge_list_t *edge_list = kh_value(state->edges_map, k);
-      for (j = kh_begin(edge_list); j != kh_end(edge_list); j++) {
-        if (kh_exist(edge_list, j)) {
-          edge_info_t edge_info = kh_value(edge_list, j);
-          // if last_seen is different from current time then declare it dead
-          if (edge_info.last_seen + state->window_size < state->time_now &&
-              edge_info.ongoing) {
-            // kh_del(edge_list,edge_list,j);
-            edge_info.end = state->time_now;
-            edge_info.ongoing = 0;
-            kh_value(edge_list, j) = edge_info;
-            print_to_file_newedges(consumer, FINISHED, edge_info, NULL);
-            state->finished_edges_count++;
-          }
-        }
-      }
-      kh_value(state->edges_map, k) = edge_list;
-    }
+  khint_t k;
+
+  k = kh_get(edges_map, state->edges_map, *(uint64_t *)key);
+  assert(k != kh_end(state->edges_map));
+  edge_info_t *edge_info = &kh_value(state->edges_map, k);
+  edge_info->end = state->time_now;
+  edge_info->ongoing = 0;
+  edge_info->expiry = BVCU_EXPIRY_NONE;
+  print_to_file_newedges(consumer, FINISHED, *edge_info, NULL);
+  state->finished_edges_count++;
+}
+
+// Removes the ongoing edges that have not been seen in the window
+static void remove_stale_links(bvc_t *consumer)
+{
+  bvc_edges_state_t *state = STATE;
+  if (state->time_now > state->window_size) {
+    bvcu_expiry_expire(&state->expiry, state->time_now - state->window_size,
+                       remove_stale_link, consumer);
   }
 }
 
-// Updates khash and stores new and newrec edges
-static int insert_update_edges(bvc_t *consumer, uint32_t asn1, uint32_t asn2,
+// Updates khash and stores new and newrec edges. Returns NEW or NEWREC if the
+// edge started in this view, 0 otherwise, -1 on error
+static int insert_update_edges(bvc_t *consumer, uint64_t edge,
   bgpstream_pfx_t *pfx)
 {
   int ret, category;
-  category = -1;
+  category = 0;
   bvc_edges_state_t *state = STATE;
-  khint_t k, j, p;
-  edge_list_t *edge_list;
+  khint_t k;
   edge_info_t edge_info;
-  k = kh_get(edges_map, state->edges_map, asn1);
-  // ASN1 never seen before. New edge seen
-  if (k == kh_end(state->edges_map)) {
-    edge_list = kh_init(edge_list);
-    j = kh_put(edge_list, edge_list, asn2, &ret);
-    edge_info.asn1 = asn1;
-    edge_info.asn2 = asn2;
+  k = kh_put(edges_map, state->edges_map, edge, &ret);
+  if (ret == -1) {
+    fprintf(stderr, "ERROR: Could not insert edge\n");
+    return -1;
+  }
+  // New edge seen
+  if (ret != 0) {
+    edge_info.asn1 = EDGE_ASN1(edge);
+    edge_info.asn2 = EDGE_ASN2(edge);
     edge_info.last_seen = state->time_now;
     edge_info.first_seen = state->time_now;
     edge_info.start = state->time_now;
     edge_info.end = 0;
     edge_info.ongoing = 1;
-    kh_value(edge_list, j) = edge_info;
-    k = kh_put(edges_map, state->edges_map, asn1, &ret);
-    kh_value(state->edges_map, k) = edge_list;
-    // state->new_edges_count++;
-    // print_to_file_newedges(consumer,NEW,edge_info,pfx);
+    edge_info.expiry = BVCU_EXPIRY_NONE;
+    kh_value(state->edges_map, k) = edge_info;
     category = NEW;
     state->new_edges_count++;
-    // insert
   }
-  // ASN1 seen before
+  // seen this edge before. Updating timestamp or checking for new_rec
   else {
-    edge_list = kh_value(state->edges_map, k);
-    j = kh_get(edge_list, edge_list, asn2);
-    // seen this edge before. Updating timestamp or checking for new_rec
-    if (j != kh_end(edge_list)) {
-      edge_info = kh_value(edge_list, j);
-      edge_info.last_seen = state->time_now;
-      // if ongoing, update last_seen. otherwise check for new or newrec
-      if (edge_info.ongoing == 0) {
-        edge_info.ongoing = 1;
-        // NEWREC if last end is within current window
+    edge_info = kh_value(state->edges_map, k);
+    edge_info.last_seen = state->time_now;
+    // if ongoing, update last_seen. otherwise check for new or newrec
+    if (edge_info.ongoing == 0) {
+      edge_info.ongoing = 1;
+      // NEWREC if last end is within current window
+      if (edge_info.end + state->window_size > state->time_now) {
+        category = NEWREC;
+        state->newrec_edges_count++;
+      } else {
+        category = NEW;
+        state->new_edges_count++;
+      }
+      edge_info.start = state->time_now;
+    }
+    // New Edge seen in this view. edge_info was updated in this view.
+    else {
+      if (edge_info.start == state->time_now) {
         if (edge_info.end + state->window_size > state->time_now) {
-          // print_to_file_newedges(consumer,NEWREC,edge_info,pfx);
-          // state->newrec_edges_count++;
           category = NEWREC;
-          state->newrec_edges_count++;
         } else {
-          // print_to_file_newedges(consumer,NEW,edge_info,pfx);
-          // state->new_edges_count++;
           category = NEW;
-          state->new_edges_count++;
-        }
-        edge_info.start = state->time_now;
-      }
-      // New Edge seen in this view. edge_info was updated in this view.
-      else {
-        if (edge_info.start == state->time_now) {
-          if (edge_info.end + state->window_size > state->time_now) {
-            category = NEWREC;
-          } else {
-            category = NEW;
-          }
         }
       }
-      kh_value(edge_list, j) = edge_info;
     }
-    // New edge seen. ASN2 seen first time
-    else {
-      edge_info.asn1 = asn1;
-      edge_info.asn2 = asn2;
-      edge_info.last_seen = state->time_now;
-      edge_info.first_seen = state->time_now;
-      edge_info.start = state->time_now;
-      edge_info.end = 0;
-      edge_info.ongoing = 1;
-      p = kh_put(edge_list, edge_list, asn2, &ret);
-      kh_value(edge_list, p) = edge_info;
-      // print_to_file_newedges(consumer,NEW,edge_info,pfx);
-      state->new_edges_count++;
-      category = NEW;
-    }
-    kh_value(state->edges_map, k) = edge_list;
+    kh_value(state->edges_map, k) = edge_info;
   }
 
-  return category;
-}
-
-static void clear_new_edges(new_edges_t *new_edges)
-{
-  khint_t p;
-  for (p = kh_begin(new_edges); p != kh_end(new_edges); p++) {
-    if (kh_exist(new_edges, p)) {
-      free(kh_key(new_edges, p));
-    }
-  }
-  kh_clear(new_edges, new_edges);
-}
-static void clear_newrec_edges(newrec_edges_t *newrec_edges)
-{
-  khint_t p;
-  for (p = kh_begin(newrec_edges); p != kh_end(newrec_edges); p++) {
-    if (kh_exist(newrec_edges, p)) {
-      free(kh_key(newrec_edges, p));
-    }
+  if (bvcu_expiry_touch(&state->expiry, &kh_value(state->edges_map, k).expiry,
+                        &edge, state->time_now) != 0) {
+    return -1;
   }
-  kh_clear(newrec_edges, newrec_edges);
+
+  return category;
 }
 
 int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
@@ -772,20 +785,17 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
   bgpview_iter_t *it;
   bgpstream_pfx_t *pfx;
 
-  bgpstream_peer_id_t peerid;
   uint32_t time_now = bgpview_get_time(view);
   state->time_now = time_now;
   /* compute arrival delay */
   state->arrival_delay = epoch_sec() - bgpview_get_time(view);
-  // as_paths_t *as_paths = kh_init(as_paths);
-  new_edges_t *new_edges = kh_init(new_edges);
-  newrec_edges_t *newrec_edges = kh_init(newrec_edges);
+  edge_set_t *new_edges = kh_init(edge_set);
+  edge_set_t *newrec_edges = kh_init(edge_set);
   // Initializing counter for libtimeseries
   state->new_edges_count = 0;
   state->ongoing_edges_count = 0;
   state->finished_edges_count = 0;
   state->newrec_edges_count = 0;
-  int count = 0;
   // Opening file for newedges
   if (!(state->file_newedges = bvcu_open_outfile(state->filename_newedges,
       OUTPUT_FILE_FORMAT_NEWEDGES, state->output_folder, time_now,
@@ -793,21 +803,10 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
     return -1;
   }
 
-  bgpstream_as_path_seg_t *origin_seg;
-  // uint32_t origin_asn;
-  // uint32_t last_origin_asn;
-  // uint32_t peers_cnt;
-  // char buf[MAX_BUFFER_LEN];
-  int ipv_idx, i, ret, category, written;
-
-  /* borrowed pointer to a path segment */
-  bgpstream_as_path_seg_t *seg;
-  uint32_t asn1;
-  uint32_t asn2;
-  uint32_t asn;
-  uint32_t normal_asn;
-  uint32_t prev_asn;
-  char pfx_str[MAX_BUFFER_LEN];
+  int ipv_idx, ret, category;
+  uint8_t *path_mark;
+  path_edges_t *pe;
+  uint32_t i;
   // prints  ongoing edges
   //DANILO: we will not print the ongoing events
   //print_ongoing_newedges(consumer);
@@ -820,13 +819,12 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
     return -1;
   }
 
+  /* no path has been decomposed in this view yet */
+  bvcu_path_marks_clear(&state->path_marks);
+
   /* iterate through all prefixes */
   for (bgpview_iter_first_pfx(it, 0 /* all versions */, BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
-    if (count == 2) {
-      // break;
-    }
-    count++;
     pfx = bgpview_iter_pfx_get_pfx(it);
 
     /* ignore prefixes in blacklist */
@@ -836,148 +834,58 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
 
     ipv_idx = bgpstream_ipv2idx(pfx->address.version);
 
-    bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
-
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+    /* only consider peers that are full-feed */
+    for (bgpview_iter_pfx_first_peer_in(
+           it, BGPVIEW_FIELD_ACTIVE,
+           &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx]);
          bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
-      /* only consider peers that are full-feed */
-      peerid = bgpview_iter_peer_get_peer_id(it);
-
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
-            peerid)) {
-        /* get origin asn */
-        if ((origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it)) == NULL) {
-          return -1;
-        }
-        /* we do not consider sets and confederations for the moment */
-        /* TODO (extend the code to deal with segments */
-        if (origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
-          continue;
-        }
+      /* the edges of a path that has already been decomposed in this view
+       * have all been updated, so we only need to walk it again if some of
+       * them are new (they must be reported for each prefix) */
+      if ((path_mark = bvcu_path_marks_get(&state->path_marks, it)) == NULL) {
+        goto err;
+      }
+      if (*path_mark == PATH_NO_NEW_EDGES) {
+        continue;
+      }
 
-        // bgpstream_as_path_snprintf(buf2, MAX_BUFFER_LEN,aspath);
-        // printf("As_path i saw: %s \n",buf2);
-        // printf("The size of has was %d \n",kh_size(as_paths));
-        // initializing asns for each view
-        i = 0;
-        asn1 = 0;
-        asn2 = 0;
-        normal_asn = 0;
-        prev_asn = 0;
-        bgpview_iter_pfx_peer_as_path_seg_iter_reset(it);
-        while ((seg = bgpview_iter_pfx_peer_as_path_seg_next(it)) != NULL) {
-          // printf("my ppers \n");
-          i++;
-          /* printing segment (any type) */
-          // gpstream_as_path_seg_snprintf(buf, MAX_BUFFER_LEN, seg);
-          /* checking if a segment is a regular asn */
-          if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
-            asn = ((bgpstream_as_path_seg_asn_t *)seg)->asn;
-            normal_asn = 1;
-          }
-          // Check whether asn is a regular asn
-          else {
-            normal_asn = 0;
-            prev_asn = 0;
-            continue;
-          }
+      *path_mark = PATH_NO_NEW_EDGES;
 
-          if (normal_asn) {
-            // Previous asn was a regular one
-            if (prev_asn != 0) {
-              asn1 = asn;
-              asn2 = prev_asn;
-              // Continue if ASN perpending is observed
-              if (asn == prev_asn) {
-                continue;
-              }
-              // Getting the greater than two ASNs. Assuming edges are not
-              // directional
-              if (asn < prev_asn) {
-                asn1 = prev_asn;
-                asn2 = asn;
-              }
-
-              // int st=epoch_msec();
-              category = insert_update_edges(consumer, asn1, asn2, pfx);
-              char edge_str[25];
-              edge_str[0] = '\0';
-
-              written = 0;
-              // Making a char array from two ASNs
-
-              if (state->vc > 1) {
-                ret = snprintf(edge_str, sizeof(edge_str) - 1,
-                               "%" PRIu32 "-%" PRIu32 "", asn1, asn2);
-                // ret =snprintf(triplet, sizeof(edge_str) - 1, "%"PRIu32"-%"PRIu32"",
-                // prev_asn, asn);
-                if (ret < 0 || ret >= sizeof(edge_str) - written - 1) {
-                  fprintf(stderr, "ERROR: cannot write ASN tiplet.\n");
-                  return -1;
-                }
-                written += ret;
-                edge_str[written] = '\0';
-                if (category == NEW) {
-                  char *copy_edge;
-                  if ((copy_edge = strdup(edge_str)) == NULL) {
-                    fprintf(stderr, "Cannot copy \n");
-                  }
-                  kh_put(new_edges, new_edges, copy_edge, &ret);
-                  if (!ret) {
-                    free(copy_edge);
-                  }
-
-                  // printf("edge_str-NEW -%s-. The value was  %d
-                  // \n",edge_str,ret);
-                  // print_edge_hash(new_edges);
-                } else if (category == NEWREC) {
-                  char *copy_edge; // ABC ///DEF
-                  // copy insert in an array
-                  if ((copy_edge = strdup(edge_str)) == NULL) {
-                    fprintf(stderr, "Cannot copy \n");
-                  }
-                  kh_put(newrec_edges, newrec_edges, copy_edge, &ret);
-                  if (!ret) {
-                    free(copy_edge);
-                  }
-                }
-              }
-              // int time_taken=epoch_msec() - st;
-              // printf("edges scheme took %d \n",time_taken);
-            }
-            // Reading atleast three different ASNs to create first triplet
-            // updating ASN variables for next ASNs in the aspath
-            prev_asn = asn;
+      /* the edges of the path are only computed the first time the path is
+       * seen */
+      if ((pe = bvcu_path_cache_get(&state->path_edges, it)) == NULL) {
+        goto err;
+      }
+      for (i = 0; i < pe->cnt; i++) {
+        if ((category = insert_update_edges(consumer, pe->edges[i], pfx)) ==
+            -1) {
+          goto err;
+        }
+        if (category == NEW || category == NEWREC) {
+          *path_mark = PATH_NEW_EDGES;
+          if (state->vc > 1) {
+            kh_put(edge_set, category == NEW ? new_edges : newrec_edges,
+                   pe->edges[i], &ret);
           }
         }
-        prev_asn = 0;
       }
     }
     if (state->vc > 1) {
       print_new_newrec(consumer, pfx, new_edges, newrec_edges, it);
-    } // delete_entries
-    // printf("######PREFIX DONE");
-    clear_new_edges(new_edges);
-    clear_newrec_edges(newrec_edges);
-
-    // break;
+    }
+    kh_clear(edge_set, new_edges);
+    kh_clear(edge_set, newrec_edges);
   }
 
-  // Loops through all ongoing edges and checks for stale edges/triplets
-  remove_stale_link(consumer);
+  // Expires the ongoing edges that are stale
+  remove_stale_links(consumer);
   // Print the surviving edges/triplets
   bgpview_iter_destroy(it);
   // Close file I/O
   wandio_wdestroy(state->file_newedges);
 
-  // print_asps(as_paths);
-  // clear_aspaths(as_paths);
-  clear_new_edges(new_edges);
-  clear_newrec_edges(newrec_edges);
-
-  kh_destroy(new_edges, new_edges);
-  kh_destroy(newrec_edges, newrec_edges);
+  kh_destroy(edge_set, new_edges);
+  kh_destroy(edge_set, newrec_edges);
 
   /* generate separate .done files for both edges and triplets*/
   bvcu_create_donefile(state->filename_newedges);
@@ -992,4 +900,12 @@ int bvc_edges_process_view(bvc_t *consumer, bgpview_t *view)
   }
 
   return 0;
+
+err:
+  bgpview_iter_destroy(it);
+  wandio_wdestroy(state->file_newedges);
+  state->file_newedges = NULL;
+  kh_destroy(edge_set, new_edges);
+  kh_destroy(edge_set, newrec_edges);
+  return -1;
 }
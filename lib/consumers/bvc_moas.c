@@ -26,6 +26,7 @@
 
 #include "bvc_moas.h"
 #include "bgpview_consumer_interface.h"
+#include "bgpview_consumer_pfx_summary.h"
 #include "bgpview_consumer_utils.h"
 #include "bgpstream_utils_pfx_set.h"
 #include "khash.h"
@@ -36,6 +37,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define NAME "moas"
@@ -89,68 +91,68 @@ typedef struct moas_properties {
   uint32_t end;
 } moas_properties_t;
 
-/** List of origin ASns in a MOAS */
+/** List of origin ASns in a MOAS.
+ *
+ * Signatures are interned: each distinct origin set is stored once, in
+ * canonical (sorted) order with its hash precomputed, and prefixes refer to
+ * it by id.
+ */
 typedef struct moas_signature {
-  uint32_t origins[MAX_UNIQUE_ORIGINS];
+  uint32_t *origins;
+  uint32_t hash;
   uint8_t n;
 } moas_signature_t;
 
-/** MOAS signature hash function */
-#if ULONG_MAX == ULLONG_MAX
-static unsigned long
-#else
-static unsigned long long
-#endif
-moasinfo_map_hash(moas_signature_t ms)
+/** Hash a (sorted) list of origin ASns */
+static uint32_t moas_signature_hash(uint32_t *origins, uint8_t n)
 {
   uint8_t i;
-  uint32_t h = 0;
-  for (i = 0; i < ms.n; i++) {
-    h += ms.origins[i];
+  uint32_t h = n;
+  for (i = 0; i < n; i++) {
+    h = (h << 5) - h + origins[i];
   }
   return h;
 }
 
-/** uint32 comparison function for qsort */
-static int uint32_cmp(const void *a, const void *b)
-{
-  const uint32_t *x = (const uint32_t *)a;
-  const uint32_t *y = (const uint32_t *)b;
-  if (*x < *y) {
-    return -1;
-  }
-  if (*x > *y) {
-    return 1;
-  }
-  return 0;
-}
+/** MOAS signature hash function (the hash is computed once, when the
+ *  signature is built) */
+#define moas_sig_map_hash(ms) ((ms).hash)
 
 /** MOAS signature equal function */
-static int moasinfo_map_equal(moas_signature_t ms1, moas_signature_t ms2)
-{
-  if (ms1.n == ms2.n) {
-    qsort(&ms1.origins, ms1.n, sizeof(uint32_t), uint32_cmp);
-    qsort(&ms2.origins, ms2.n, sizeof(uint32_t), uint32_cmp);
-    int i;
-    for (i = 0; i < ms1.n; i++) {
-      if (ms1.origins[i] != ms2.origins[i]) {
-        return 0;
-      }
-    }
-    return 1;
-  }
-  return 0;
-}
-
-/** Map <moas_sig,moas_properties>: store the timestamps
- *  for each MOAS in the current window */
-KHASH_INIT(moasinfo_map, moas_signature_t, moas_properties_t, 1,
-           moasinfo_map_hash, moasinfo_map_equal)
-typedef khash_t(moasinfo_map) moasinfo_map_t;
-
-/** Map <pfx,moas_info>: store information for each
+#define moas_sig_map_equal(ms1, ms2)                                           \
+  ((ms1).hash == (ms2).hash && (ms1).n == (ms2).n &&                           \
+   memcmp((ms1).origins, (ms2).origins, sizeof(uint32_t) * (ms1).n) == 0)
+
+/** Map <moas_sig,sig_id>: interned MOAS signatures */
+KHASH_INIT(moas_sig_map, moas_signature_t, uint32_t, 1, moas_sig_map_hash,
+           moas_sig_map_equal)
+typedef khash_t(moas_sig_map) moas_sig_map_t;
+
+/** An interned MOAS signature */
+typedef struct moas_sig_info {
+  moas_signature_t sig;
+
+  /** number of prefixes that refer to this signature (0 if the id is
+   *  unused) */
+  uint32_t refcnt;
+} moas_sig_info_t;
+
+/** A MOAS observed for a prefix in the current window */
+typedef struct pfx_moas {
+  uint32_t sig_id;
+  moas_properties_t props;
+} pfx_moas_t;
+
+/** The MOASes observed for a prefix in the current window */
+typedef struct pfx_moases {
+  pfx_moas_t *moases;
+  uint16_t cnt;
+  uint16_t alloc_cnt;
+} pfx_moases_t;
+
+/** Map <pfx,moases>: store information for each
  *  MOAS prefix in the current window */
-KHASH_INIT(pfx_moasinfo_map, bgpstream_pfx_t, moasinfo_map_t *, 1,
+KHASH_INIT(pfx_moasinfo_map, bgpstream_pfx_t, pfx_moases_t, 1,
            bgpstream_pfx_hash_val, bgpstream_pfx_equal_val)
 typedef khash_t(pfx_moasinfo_map) pfx_moasinfo_map_t;
 
@@ -181,6 +183,18 @@ typedef struct bvc_moas_state {
   /** MOASes observed in the current window */
   pfx_moasinfo_map_t *current_moases;
 
+  /** Interned MOAS signatures (signature -> id) */
+  moas_sig_map_t *sig_ids;
+
+  /** Interned MOAS signatures, indexed by id */
+  moas_sig_info_t *sigs;
+  uint32_t sigs_cnt;
+  uint32_t sigs_alloc_cnt;
+
+  /** Ids of unused entries in sigs (has room for sigs_alloc_cnt ids) */
+  uint32_t *free_sig_ids;
+  uint32_t free_sig_ids_cnt;
+
   /** New/recurring/ongoing/finished MOAS prefixes count */
   uint32_t new_moas_pfxs_count;
   uint32_t new_recurring_moas_pfxs_count;
@@ -232,7 +246,7 @@ static int output_timeseries(bvc_t *consumer, uint32_t ts)
   timeseries_kp_set(state->kp, state->current_window_size_idx,
                     state->current_window_size);
 
-  if (timeseries_kp_flush(state->kp, ts) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, state->kp, ts) != 0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME, ts);
   }
 
@@ -385,8 +399,8 @@ static int log_moas(bvc_t *consumer, bgpview_t *view, bgpview_iter_t *it,
 
       // printing a path for each peer
       peerid = bgpview_iter_peer_get_peer_id(it);
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+      if (BGPVIEW_PEER_BITMAP_EXISTS(
+            &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
             peerid)) {
 
         // if it's not the first path, print ":" at the beginning of the path
@@ -415,47 +429,145 @@ static int log_moas(bvc_t *consumer, bgpview_t *view, bgpview_iter_t *it,
   return 0;
 }
 
+/** Get the id of the interned signature for the given (sorted) origins,
+ *  interning it if needed (the new signature has no references) */
+static int get_sig_id(bvc_t *consumer, uint32_t *origins, uint8_t n,
+                      uint32_t *sig_id)
+{
+  bvc_moas_state_t *state = STATE;
+  moas_signature_t ms;
+  moas_sig_info_t *sigs;
+  uint32_t *free_ids;
+  uint32_t alloc_cnt;
+  uint32_t id;
+  khiter_t k;
+  int khret;
+
+  ms.origins = origins;
+  ms.n = n;
+  ms.hash = moas_signature_hash(origins, n);
+
+  if ((k = kh_get(moas_sig_map, state->sig_ids, ms)) !=
+      kh_end(state->sig_ids)) {
+    *sig_id = kh_val(state->sig_ids, k);
+    return 0;
+  }
+
+  /* new signature: pick an id */
+  if (state->free_sig_ids_cnt > 0) {
+    id = state->free_sig_ids[--state->free_sig_ids_cnt];
+  } else {
+    if (state->sigs_cnt == state->sigs_alloc_cnt) {
+      alloc_cnt = state->sigs_alloc_cnt == 0 ? 1024 : state->sigs_alloc_cnt * 2;
+      if ((sigs = realloc(state->sigs, sizeof(moas_sig_info_t) * alloc_cnt)) ==
+          NULL) {
+        goto err;
+      }
+      state->sigs = sigs;
+      if ((free_ids = realloc(state->free_sig_ids,
+                              sizeof(uint32_t) * alloc_cnt)) == NULL) {
+        goto err;
+      }
+      state->free_sig_ids = free_ids;
+      state->sigs_alloc_cnt = alloc_cnt;
+    }
+    id = state->sigs_cnt++;
+  }
+
+  /* store a canonical copy */
+  if ((ms.origins = malloc(sizeof(uint32_t) * n)) == NULL) {
+    state->free_sig_ids[state->free_sig_ids_cnt++] = id;
+    goto err;
+  }
+  memcpy(ms.origins, origins, sizeof(uint32_t) * n);
+
+  k = kh_put(moas_sig_map, state->sig_ids, ms, &khret);
+  if (khret < 0) {
+    free(ms.origins);
+    state->free_sig_ids[state->free_sig_ids_cnt++] = id;
+    goto err;
+  }
+  kh_val(state->sig_ids, k) = id;
+  state->sigs[id].sig = ms;
+  state->sigs[id].refcnt = 0;
+
+  *sig_id = id;
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not intern MOAS signature\n");
+  return -1;
+}
+
+/** Drop a reference to an interned signature, and release it if it is no
+ *  longer used */
+static void unref_sig(bvc_t *consumer, uint32_t sig_id)
+{
+  bvc_moas_state_t *state = STATE;
+  moas_sig_info_t *si = &state->sigs[sig_id];
+  khiter_t k;
+
+  assert(si->refcnt > 0);
+  if (--si->refcnt > 0) {
+    return;
+  }
+  if ((k = kh_get(moas_sig_map, state->sig_ids, si->sig)) !=
+      kh_end(state->sig_ids)) {
+    kh_del(moas_sig_map, state->sig_ids, k);
+  }
+  free(si->sig.origins);
+  si->sig.origins = NULL;
+  state->free_sig_ids[state->free_sig_ids_cnt++] = sig_id;
+}
+
 /** Update the moas structure (and log finished moases) */
 static int clean_moas(bvc_t *consumer, uint32_t ts, uint32_t last_valid_ts)
 {
 
   bvc_moas_state_t *state = STATE;
-  khiter_t p, m;
+  khiter_t p;
   bgpstream_pfx_t *pfx;
-  moasinfo_map_t *per_pfx_moases;
-  moas_signature_t *ms;
-  moas_properties_t *mpro;
+  pfx_moases_t *per_pfx_moases;
+  pfx_moas_t *pm;
+  int i;
 
   /* for each prefix */
   for (p = kh_begin(state->current_moases); p != kh_end(state->current_moases);
        p++) {
     if (kh_exist(state->current_moases, p)) {
       pfx = &kh_key(state->current_moases, p);
-      per_pfx_moases = kh_val(state->current_moases, p);
+      per_pfx_moases = &kh_val(state->current_moases, p);
 
       /* for each moas */
-      for (m = kh_begin(per_pfx_moases); m != kh_end(per_pfx_moases); m++) {
-        if (kh_exist(per_pfx_moases, m)) {
-          ms = &kh_key(per_pfx_moases, m);
-          mpro = &kh_val(per_pfx_moases, m);
-
-          /* outdated moas, remove it */
-          if (mpro->end < last_valid_ts) {
-            kh_del(moasinfo_map, per_pfx_moases, m);
-          } else {
-            if (mpro->end < ts) {
-              // report finished moases
-              if (mpro->start > 0) {
-                if (log_moas(consumer, NULL, NULL, pfx, ms,
-                             mpro, FINISHED, ts) != 0) {
-                  return -1;
-                }
-                // signal that the moas has finished
-                kh_val(per_pfx_moases, m).start = 0;
-              }
+      i = 0;
+      while (i < per_pfx_moases->cnt) {
+        pm = &per_pfx_moases->moases[i];
+
+        /* outdated moas, remove it */
+        if (pm->props.end < last_valid_ts) {
+          unref_sig(consumer, pm->sig_id);
+          *pm = per_pfx_moases->moases[--per_pfx_moases->cnt];
+          continue;
+        }
+        if (pm->props.end < ts) {
+          // report finished moases
+          if (pm->props.start > 0) {
+            if (log_moas(consumer, NULL, NULL, pfx,
+                         &state->sigs[pm->sig_id].sig, &pm->props, FINISHED,
+                         ts) != 0) {
+              return -1;
             }
+            // signal that the moas has finished
+            pm->props.start = 0;
           }
         }
+        i++;
+      }
+
+      /* no moas left in the window, forget the prefix */
+      if (per_pfx_moases->cnt == 0) {
+        free(per_pfx_moases->moases);
+        kh_del(pfx_moasinfo_map, state->current_moases, p);
       }
     }
   }
@@ -464,68 +576,90 @@ static int clean_moas(bvc_t *consumer, uint32_t ts, uint32_t last_valid_ts)
 
 /** Add moas to current moases */
 static int add_moas(bvc_t *consumer, bgpview_t *view, bgpview_iter_t *it,
-                    moas_signature_t *ms, uint32_t ts, uint32_t last_valid_ts)
+                    uint32_t sig_id, uint32_t ts, uint32_t last_valid_ts)
 {
   bvc_moas_state_t *state = STATE;
   bgpstream_pfx_t *pfx;
 
-  moasinfo_map_t *per_pfx_moases;
-  moas_properties_t *moas_properties = NULL;
+  pfx_moases_t *per_pfx_moases;
+  pfx_moas_t *pm;
+  pfx_moas_t *moases;
+  uint32_t alloc_cnt;
 
   moas_category_t mc = FINISHED;
   khiter_t k;
   int khret;
+  int i;
 
   /* convert pfx_ptr in storage */
   pfx = bgpview_iter_pfx_get_pfx(it);
 
   /* check if prefix is in MOAS already, otherwise create it */
-  if ((k = kh_get(pfx_moasinfo_map, state->current_moases, *pfx)) ==
-      kh_end(state->current_moases)) {
-    /* if not insert the prefix */
-    k = kh_put(pfx_moasinfo_map, state->current_moases, *pfx, &khret);
-    /* moasinfo_map is an empty map */
-    if ((kh_value(state->current_moases, k) = kh_init(moasinfo_map)) == NULL) {
-      fprintf(stderr, "Error: could not create moas_info map\n");
-      return -1;
-    }
+  k = kh_put(pfx_moasinfo_map, state->current_moases, *pfx, &khret);
+  if (khret < 0) {
+    fprintf(stderr, "Error: could not add prefix to current moases\n");
+    return -1;
+  }
+  per_pfx_moases = &kh_value(state->current_moases, k);
+  if (khret > 0) {
+    /* no moases yet */
+    per_pfx_moases->moases = NULL;
+    per_pfx_moases->cnt = 0;
+    per_pfx_moases->alloc_cnt = 0;
   }
-
-  /* get the moasinfo map*/
-  per_pfx_moases = kh_value(state->current_moases, k);
 
   /* check if it is a new moas */
-  if ((k = kh_get(moasinfo_map, per_pfx_moases, *ms)) ==
-      kh_end(per_pfx_moases)) {
+  pm = NULL;
+  for (i = 0; i < per_pfx_moases->cnt; i++) {
+    if (per_pfx_moases->moases[i].sig_id == sig_id) {
+      pm = &per_pfx_moases->moases[i];
+      break;
+    }
+  }
+
+  if (pm == NULL) {
     mc = NEW;
-    k = kh_put(moasinfo_map, per_pfx_moases, *ms, &khret);
-    kh_value(per_pfx_moases, k).start = ts;
-    kh_value(per_pfx_moases, k).end = ts;
-    kh_value(per_pfx_moases, k).first_seen = ts;
+    if (per_pfx_moases->cnt == per_pfx_moases->alloc_cnt) {
+      alloc_cnt = per_pfx_moases->alloc_cnt == 0 ?
+        1 : per_pfx_moases->alloc_cnt * 2;
+      if (alloc_cnt > UINT16_MAX ||
+          (moases = realloc(per_pfx_moases->moases,
+                            sizeof(pfx_moas_t) * alloc_cnt)) == NULL) {
+        fprintf(stderr, "Error: could not grow moas list\n");
+        return -1;
+      }
+      per_pfx_moases->moases = moases;
+      per_pfx_moases->alloc_cnt = alloc_cnt;
+    }
+    pm = &per_pfx_moases->moases[per_pfx_moases->cnt++];
+    pm->sig_id = sig_id;
+    state->sigs[sig_id].refcnt++;
+    pm->props.start = ts;
+    pm->props.end = ts;
+    pm->props.first_seen = ts;
   } else {
     /* if start is 0 it means the the moas finished
      * so this is a new occurence */
-    if (kh_value(per_pfx_moases, k).start == 0) {
-      if (kh_value(per_pfx_moases, k).end < last_valid_ts) {
+    if (pm->props.start == 0) {
+      if (pm->props.end < last_valid_ts) {
         mc = NEW;
       } else {
         mc = NEWREC;
       }
-      kh_value(per_pfx_moases, k).start = ts;
-      kh_value(per_pfx_moases, k).end = ts;
+      pm->props.start = ts;
+      pm->props.end = ts;
     } 
     /* DANILO: removed print ongoing MOAS
        MINGWEI: uncommented out the following block. it causes bug that generates duplicated NEW events.
     */
     else { // otherwise is a moas which is continuing
       mc = ONGOING;
-      kh_value(per_pfx_moases, k).end = ts;
+      pm->props.end = ts;
     }
   }
 
-  moas_properties = &kh_value(per_pfx_moases, k);
-
-  return log_moas(consumer, view, it, pfx, ms, moas_properties, mc, ts);
+  return log_moas(consumer, view, it, pfx, &state->sigs[sig_id].sig,
+                  &pm->props, mc, ts);
 }
 
 /** Create timeseries metrics */
@@ -693,6 +827,11 @@ int bvc_moas_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
+  if ((state->sig_ids = kh_init(moas_sig_map)) == NULL) {
+    fprintf(stderr, "Error: Could not create MOAS signature map\n");
+    goto err;
+  }
+
   /* add default routes to blacklist */
   if (!(bgpstream_str2pfx(IPV4_DEFAULT_ROUTE, &pfx) != NULL &&
         bgpstream_pfx_set_insert(state->blacklist_pfxs, &pfx) >= 0)) {
@@ -722,6 +861,10 @@ int bvc_moas_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
+  /* ask Visibility to also summarize the full feed observations of each
+     prefix */
+  BVC_GET_CHAIN_STATE(consumer)->pfx_summaries_wanted = 1;
+
   return 0;
 
 err:
@@ -740,12 +883,24 @@ void bvc_moas_destroy(bvc_t *consumer)
       for (p = kh_begin(state->current_moases);
            p != kh_end(state->current_moases); p++) {
         if (kh_exist(state->current_moases, p)) {
-          kh_destroy(moasinfo_map, kh_val(state->current_moases, p));
+          free(kh_val(state->current_moases, p).moases);
         }
       }
       kh_destroy(pfx_moasinfo_map, state->current_moases);
     }
 
+    if (state->sig_ids != NULL) {
+      khiter_t k;
+      for (k = kh_begin(state->sig_ids); k != kh_end(state->sig_ids); k++) {
+        if (kh_exist(state->sig_ids, k)) {
+          free(kh_key(state->sig_ids, k).origins);
+        }
+      }
+      kh_destroy(moas_sig_map, state->sig_ids);
+    }
+    free(state->sigs);
+    free(state->free_sig_ids);
+
     if (state->blacklist_pfxs != NULL) {
       bgpstream_pfx_set_destroy(state->blacklist_pfxs);
     }
@@ -765,12 +920,10 @@ int bvc_moas_process_view(bvc_t *consumer, bgpview_t *view)
   bgpview_iter_t *it;
   bgpstream_pfx_t *pfx;
 
-  int ipv_idx; // ip version index
-  bgpstream_peer_id_t peerid;
-  bgpstream_as_path_seg_t *origin_seg;
-  moas_signature_t ms;
-  int i;
-  uint32_t origin_asn;
+  bvc_pfx_summary_t *summary;
+  uint8_t origins_cnt;
+  uint32_t sig_id;
+  int rc;
   uint32_t last_valid_ts = bgpview_get_time(view) - state->window_size;
 
   /* compute arrival delay */
@@ -809,53 +962,31 @@ int bvc_moas_process_view(bvc_t *consumer, bgpview_t *view)
       continue;
     }
 
-    ipv_idx = bgpstream_ipv2idx(pfx->address.version);
-
-    ms.n = 0;
-
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
-         bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
-
-      peerid = bgpview_iter_peer_get_peer_id(it);
-
-      /* only consider peers that are full-feed */
-
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
-            peerid)) {
-
-        /* get origin asn */
-        if ((origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it)) == NULL) {
-          return -1;
-        }
-
-        /* we do not consider sets and confederations for the moment */
-        /* TODO (extend the code to deal with segments */
-        if (origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
-          continue;
-        }
-        origin_asn = ((bgpstream_as_path_seg_asn_t *)origin_seg)->asn;
-
-        /* check if origin is already in the moas signature struct
-         * this check works when the signature is empty too */
-        for (i = 0; i < ms.n; i++) {
-          if (ms.origins[i] == origin_asn) {
-            break;
-          }
-        }
-        /* if the origin was not found, add it */
-        if (i == ms.n) {
-          ms.origins[ms.n] = origin_asn;
-          ms.n++;
-        }
-      }
+    /* the (sorted) origins observed by full-feed peers have already been
+     * computed by the visibility consumer */
+    /* we do not consider sets and confederations for the moment */
+    /* TODO (extend the code to deal with segments */
+    if ((summary = bvc_pfx_summary_table_get(
+           BVC_GET_CHAIN_STATE(consumer)->pfx_summaries, pfx)) == NULL) {
+      continue;
     }
+    origins_cnt = summary->origins_cnt < MAX_UNIQUE_ORIGINS ?
+      summary->origins_cnt : MAX_UNIQUE_ORIGINS;
 
     /* check if a moas has been detected */
-    if (ms.n > 1) {
-      /* add moas to state and log it on file */
-      if (add_moas(consumer, view, it, &ms, bgpview_get_time(view),
-                   last_valid_ts) != 0) {
+    if (origins_cnt > 1) {
+      /* the summary origins are sorted, so they are already a canonical
+       * signature */
+      if (get_sig_id(consumer, summary->origins, origins_cnt, &sig_id) != 0) {
+        return -1;
+      }
+      /* add moas to state and log it on file (holding a reference so that a
+       * new signature is released if add_moas does not keep it) */
+      state->sigs[sig_id].refcnt++;
+      rc = add_moas(consumer, view, it, sig_id, bgpview_get_time(view),
+                    last_valid_ts);
+      unref_sig(consumer, sig_id);
+      if (rc != 0) {
         return -1;
       }
     }
@@ -87,6 +87,9 @@ typedef struct bvc_pathchange_state {
   /** Copy of the previous view */
   bgpview_t *parent_view;
 
+  /** String representation of each AS path */
+  bvcu_path_cache_t path_strs;
+
   /* timeseries indexes: */
   int proc_time_idx;
 
@@ -244,28 +247,26 @@ static int create_ts_metrics(bvc_t *consumer)
   return 0;
 }
 
-/* returns 0 if they are the same */
-static int diff_cells(bgpview_iter_t *parent_view_it, bgpview_iter_t *itC)
+/* format the AS path of the current pfx-peer */
+static void *path_str_derive(bgpview_iter_t *it)
 {
-  bgpstream_as_path_store_path_id_t idxH =
-    bgpview_iter_pfx_peer_get_as_path_store_path_id(parent_view_it);
-  bgpstream_as_path_store_path_id_t idxC =
-    bgpview_iter_pfx_peer_get_as_path_store_path_id(itC);
+  char path_str[4096] = "";
+  bgpstream_as_path_t *path;
+
+  if ((path = bgpview_iter_pfx_peer_get_as_path(it)) == NULL) {
+    return NULL;
+  }
+  bgpstream_as_path_snprintf(path_str, 4096, path);
+  bgpstream_as_path_destroy(path);
 
-  return bcmp(&idxH, &idxC, sizeof(bgpstream_as_path_store_path_id_t)) != 0;
+  return strdup(path_str);
 }
 
-static int diff_paths(bvc_t *consumer, bgpview_t *view)
+/* bgpview_diff callback: log the pfx-peers whose path changed */
+static int diff_cb(bgpview_diff_type_t type, bgpview_iter_t *parent_view_it,
+                   bgpview_iter_t *it, void *user)
 {
-  if (STATE->parent_view == NULL) {
-    /* nothing to compare with */
-    return 0;
-  }
-
-  bgpview_iter_t *it;
-  bgpview_iter_t *parent_view_it;
-  bgpstream_pfx_t *pfx;
-  bgpstream_peer_id_t peer_id;
+  bvc_t *consumer = (bvc_t *)user;
 
   char pfx_str[INET6_ADDRSTRLEN + 3] = "";
   bgpstream_peer_sig_t *ps;
@@ -274,75 +275,74 @@ static int diff_paths(bvc_t *consumer, bgpview_t *view)
   bgpstream_as_path_t *old_path = NULL;
   char new_path_str[4096] = "";
   bgpstream_as_path_t *new_path = NULL;
+  char *old_path_cstr;
+  char *new_path_cstr;
 
-  if ((it = bgpview_iter_create(view)) == NULL) {
-    return -1;
-  }
-
-  if ((parent_view_it = bgpview_iter_create(STATE->parent_view)) == NULL) {
-    return -1;
+  /* new prefixes and new peers are skipped, we only care about paths that
+   * changed */
+  if (type != BGPVIEW_DIFF_PFX_PEER_CHANGED) {
+    return 0;
   }
 
-  /* for each prefix in view */
-  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE); //
-       bgpview_iter_has_more_pfx(it);                       //
-       bgpview_iter_next_pfx(it)) {
-
-    pfx = bgpview_iter_pfx_get_pfx(it);
-
-    if (bgpview_iter_seek_pfx(parent_view_it, pfx, BGPVIEW_FIELD_ACTIVE) == 0) {
-      // this is a new prefix, skip it...
-      continue;
+  /* paths of both views can only be looked up in the cache if they come from
+   * the same store (i.e. the parent view is a dup of a previous view). path
+   * IDs are canonical within a store, so bgpview_diff has already established
+   * that the paths differ */
+  if (bgpview_get_as_path_store(bgpview_iter_get_view(parent_view_it)) ==
+      bgpview_get_as_path_store(bgpview_iter_get_view(it))) {
+    if ((old_path_cstr = bvcu_path_cache_get(&STATE->path_strs,
+                                             parent_view_it)) == NULL ||
+        (new_path_cstr = bvcu_path_cache_get(&STATE->path_strs, it)) ==
+          NULL) {
+      return -1;
     }
+    bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3,
+                           bgpview_iter_pfx_get_pfx(it));
+    ps = bgpview_iter_peer_get_sig(it);
+    bgpstream_addr_ntop(peer_str, INET6_ADDRSTRLEN, &ps->peer_ip_addr);
+    wandio_printf(STATE->outfile, "%" PRIu32 "|%s|%s|%" PRIu32 "|%s|%s|%s\n",
+                  bgpview_get_time(bgpview_iter_get_view(it)), pfx_str,
+                  ps->collector_str, ps->peer_asnumber, peer_str,
+                  old_path_cstr, new_path_cstr);
+    return 0;
+  }
 
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE); //
-         bgpview_iter_pfx_has_more_peer(it);                    //
-         bgpview_iter_pfx_next_peer(it)) {
-
-      peer_id = bgpview_iter_peer_get_peer_id(it);
+  old_path = bgpview_iter_pfx_peer_get_as_path(parent_view_it);
+  new_path = bgpview_iter_pfx_peer_get_as_path(it);
+  if (bgpstream_as_path_equal(old_path, new_path) == 0) {
+    bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3,
+                           bgpview_iter_pfx_get_pfx(it));
+    ps = bgpview_iter_peer_get_sig(it);
+    bgpstream_addr_ntop(peer_str, INET6_ADDRSTRLEN, &ps->peer_ip_addr);
+    bgpstream_as_path_snprintf(old_path_str, 4096, old_path);
+    bgpstream_as_path_snprintf(new_path_str, 4096, new_path);
+
+    wandio_printf(STATE->outfile, "%" PRIu32 "|" /* time */
+                                  "%s|"          /* prefix */
+                                  "%s|"          /* collector */
+                                  "%" PRIu32 "|" /* peer ASN */
+                                  "%s|"          /* peer IP */
+                                  "%s|"          /* old-path */
+                                  "%s"           /* new-path */
+                                  "\n",
+                  bgpview_get_time(bgpview_iter_get_view(it)), pfx_str,
+                  ps->collector_str, ps->peer_asnumber, peer_str,
+                  old_path_str, new_path_str);
+  }
+  bgpstream_as_path_destroy(old_path);
+  bgpstream_as_path_destroy(new_path);
 
-      /* is it in parent view? */
-      if (bgpview_iter_pfx_seek_peer(parent_view_it, peer_id,
-                                     BGPVIEW_FIELD_ACTIVE) == 0) {
-        // new peer, skip it...
-        continue;
-      }
+  return 0;
+}
 
-      /* is the path different? */
-      if (diff_cells(parent_view_it, it) != 0) {
-        /* there is currently a bug somewhere that causes us to use different
-         * path store IDs for the same effective path, so we need to do a full
-         * check of the paths */
-        old_path = bgpview_iter_pfx_peer_get_as_path(parent_view_it);
-        new_path = bgpview_iter_pfx_peer_get_as_path(it);
-        if (bgpstream_as_path_equal(old_path, new_path) == 0) {
-          bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
-          ps = bgpview_iter_peer_get_sig(it);
-          bgpstream_addr_ntop(peer_str, INET6_ADDRSTRLEN, &ps->peer_ip_addr);
-          bgpstream_as_path_snprintf(old_path_str, 4096, old_path);
-          bgpstream_as_path_snprintf(new_path_str, 4096, new_path);
-
-          wandio_printf(STATE->outfile, "%" PRIu32 "|" /* time */
-                                        "%s|"          /* prefix */
-                                        "%s|"          /* collector */
-                                        "%" PRIu32 "|" /* peer ASN */
-                                        "%s|"          /* peer IP */
-                                        "%s|"          /* old-path */
-                                        "%s"           /* new-path */
-                                        "\n",
-                        bgpview_get_time(view), pfx_str, ps->collector_str,
-                        ps->peer_asnumber, peer_str, old_path_str,
-                        new_path_str);
-        }
-        bgpstream_as_path_destroy(old_path);
-        bgpstream_as_path_destroy(new_path);
-      }
-    }
+static int diff_paths(bvc_t *consumer, bgpview_t *view)
+{
+  if (STATE->parent_view == NULL) {
+    /* nothing to compare with */
+    return 0;
   }
 
-  bgpview_iter_destroy(it);
-  bgpview_iter_destroy(parent_view_it);
-  return 0;
+  return bgpview_diff(STATE->parent_view, view, diff_cb, consumer);
 }
 
 /* ==================== CONSUMER INTERFACE FUNCTIONS ==================== */
@@ -362,6 +362,7 @@ int bvc_pathchange_init(bvc_t *consumer, int argc, char **argv)
   BVC_SET_STATE(consumer, state);
 
   /* allocate dynamic memory HERE */
+  bvcu_path_cache_init(&state->path_strs, path_str_derive, free);
 
   /* set defaults */
 
@@ -424,6 +425,8 @@ void bvc_pathchange_destroy(bvc_t *consumer)
   bgpview_destroy(state->parent_view);
   state->parent_view = NULL;
 
+  bvcu_path_cache_free(&state->path_strs);
+
   free(state);
 
   BVC_SET_STATE(consumer, NULL);
@@ -477,10 +480,9 @@ int bvc_pathchange_process_view(bvc_t *consumer, bgpview_t *view)
       goto err;
     }
   } else {
-    /* we have a parent view, just copy into it */
-    /* first, clear the destination */
-    bgpview_clear(STATE->parent_view);
-    if (bgpview_copy(STATE->parent_view, view) != 0) {
+    /* we have a parent view, bring it up to date (only copies the
+       prefixes that changed, if the view tracks changes) */
+    if (bgpview_sync(STATE->parent_view, view) != 0) {
       goto err;
     }
   }
@@ -491,7 +493,8 @@ int bvc_pathchange_process_view(bvc_t *consumer, bgpview_t *view)
   timeseries_kp_set(STATE->kp, STATE->proc_time_idx, proc_time);
 
   // flush
-  if (timeseries_kp_flush(STATE->kp, bgpview_get_time(view)) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, bgpview_get_time(view)) !=
+      0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
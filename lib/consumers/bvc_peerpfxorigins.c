@@ -76,13 +76,13 @@ typedef struct bvc_peerpfxorigins_state {
   char peers_outfile_name[BVCU_PATH_MAX];
 
   /** peer table output file */
-  iow_t *peers_outfile;
+  bvcu_outfile_t *peers_outfile;
 
   /** prefix origins output file name */
   char pfx_outfile_name[BVCU_PATH_MAX];
 
   /** prefix origins output file */
-  iow_t *pfx_outfile;
+  bvcu_outfile_t *pfx_outfile;
 
   /** only output peer counts */
   int peer_count_only;
@@ -101,13 +101,13 @@ static int open_outfiles(bvc_t *consumer, uint32_t vtime)
 {
   if (STATE->peer_count_only == 0) {
     /* peers table */
-    if (!(STATE->peers_outfile = bvcu_open_outfile(STATE->peers_outfile_name,
+    if (!(STATE->peers_outfile = bvcu_outfile_open(STATE->peers_outfile_name,
         "%s/" PEER_TABLE_NAME ".%" PRIu32 ".gz", STATE->outdir, vtime)))
       return -1;
   }
 
   /* pfx origins table */
-  if (!(STATE->pfx_outfile = bvcu_open_outfile(STATE->pfx_outfile_name,
+  if (!(STATE->pfx_outfile = bvcu_outfile_open(STATE->pfx_outfile_name,
         "%s/" NAME ".%" PRIu32 ".gz", STATE->outdir, vtime)))
     return -1;
 
@@ -116,17 +116,25 @@ static int open_outfiles(bvc_t *consumer, uint32_t vtime)
 
 static int close_outfiles(bvc_t *consumer, uint32_t vtime)
 {
+  int rc = 0;
+
   if (STATE->peer_count_only == 0) {
-    wandio_wdestroy(STATE->peers_outfile);
+    if (bvcu_outfile_close(STATE->peers_outfile) != 0) {
+      rc = -1;
+    } else {
+      bvcu_create_donefile(STATE->peers_outfile_name);
+    }
     STATE->peers_outfile = NULL;
-    bvcu_create_donefile(STATE->peers_outfile_name);
   }
 
-  wandio_wdestroy(STATE->pfx_outfile);
+  if (bvcu_outfile_close(STATE->pfx_outfile) != 0) {
+    rc = -1;
+  } else {
+    bvcu_create_donefile(STATE->pfx_outfile_name);
+  }
   STATE->pfx_outfile = NULL;
-  bvcu_create_donefile(STATE->pfx_outfile_name);
 
-  return 0;
+  return rc;
 }
 
 static int output_peers(bvc_t *consumer, bgpview_t *view)
@@ -136,29 +144,30 @@ static int output_peers(bvc_t *consumer, bgpview_t *view)
   char peer_ip[INET6_ADDRSTRLEN];
 
   if (STATE->peer_count_only != 0) {
-    wandio_printf(STATE->pfx_outfile, "# peer_cnt: %d\n",
-                  bgpview_peer_cnt(view, BGPVIEW_FIELD_ACTIVE));
+    bvcu_outfile_printf(STATE->pfx_outfile, "# peer_cnt: %d\n",
+                        bgpview_peer_cnt(view, BGPVIEW_FIELD_ACTIVE));
     return 0;
   }
 
   it = bgpview_iter_create(view);
 
-  wandio_printf(STATE->peers_outfile, "peer_id|collector|peer_asn|peer_ip\n");
+  bvcu_outfile_puts(STATE->peers_outfile,
+                    "peer_id|collector|peer_asn|peer_ip\n");
 
   for (bgpview_iter_first_peer(it, BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_has_more_peer(it); //
        bgpview_iter_next_peer(it)) {
     peer_sig = bgpview_iter_peer_get_sig(it);
     bgpstream_addr_ntop(peer_ip, sizeof(peer_ip), &peer_sig->peer_ip_addr);
-    wandio_printf(STATE->peers_outfile,
-                  "%"PRIu16"|" // peer id
-                  "%s|" // collector
-                  "%"PRIu32"|" // peer asn
-                  "%s\n", // peer ip
-                  bgpview_iter_peer_get_peer_id(it),
-                  peer_sig->collector_str,
-                  peer_sig->peer_asnumber,
-                  peer_ip);
+    bvcu_outfile_printf(STATE->peers_outfile,
+                        "%"PRIu16"|" // peer id
+                        "%s|" // collector
+                        "%"PRIu32"|" // peer asn
+                        "%s\n", // peer ip
+                        bgpview_iter_peer_get_peer_id(it),
+                        peer_sig->collector_str,
+                        peer_sig->peer_asnumber,
+                        peer_ip);
   }
 
   bgpview_iter_destroy(it);
@@ -167,16 +176,15 @@ static int output_peers(bvc_t *consumer, bgpview_t *view)
 
 static int output_origins(bvc_t *consumer, bgpstream_pfx_t *pfx)
 {
-  char pfx_str[INET6_ADDRSTRLEN + 3];
   char orig_str[4096];
   int i, j;
   origin_peers_t *op;
 
-  bgpstream_pfx_snprintf(pfx_str, sizeof(pfx_str), pfx);
-
 #if 0
   /* DEBUG */
   if (STATE->origins_cnt > 10) {
+    char pfx_str[INET6_ADDRSTRLEN + 3];
+    bgpstream_pfx_snprintf(pfx_str, sizeof(pfx_str), pfx);
     fprintf(stderr, "DEBUG: %s has %d unique origins\n", pfx_str,
             STATE->origins_cnt);
   }
@@ -191,17 +199,21 @@ static int output_origins(bvc_t *consumer, bgpstream_pfx_t *pfx)
       return -1;
     }
 
+    bvcu_outfile_put_pfx(STATE->pfx_outfile, pfx);
+    bvcu_outfile_putc(STATE->pfx_outfile, '|');
+    bvcu_outfile_puts(STATE->pfx_outfile, orig_str);
+    bvcu_outfile_putc(STATE->pfx_outfile, '|');
     if (STATE->peer_count_only != 0) {
-      wandio_printf(STATE->pfx_outfile, "%s|%s|%d\n", pfx_str, orig_str,
-        op->peers_cnt);
+      bvcu_outfile_put_u32(STATE->pfx_outfile, op->peers_cnt);
     } else {
-      wandio_printf(STATE->pfx_outfile, "%s|%s|", pfx_str, orig_str);
       for (j = 0; j < op->peers_cnt; j++) {
-        wandio_printf(STATE->pfx_outfile, "%s%"PRIu16, (j > 0) ? "," : "",
-                      op->peers[j]);
+        if (j > 0) {
+          bvcu_outfile_putc(STATE->pfx_outfile, ',');
+        }
+        bvcu_outfile_put_u32(STATE->pfx_outfile, op->peers[j]);
       }
-      wandio_printf(STATE->pfx_outfile, "\n");
     }
+    bvcu_outfile_putc(STATE->pfx_outfile, '\n');
   }
 
   return 0;
@@ -215,9 +227,9 @@ static int process_prefixes(bvc_t *consumer, bgpview_t *view)
   bgpstream_as_path_seg_t *seg;
 
   if (STATE->peer_count_only != 0) {
-    wandio_printf(STATE->pfx_outfile, "prefix|origin|peer_cnt\n");
+    bvcu_outfile_puts(STATE->pfx_outfile, "prefix|origin|peer_cnt\n");
   } else {
-    wandio_printf(STATE->pfx_outfile, "prefix|origin|peer_id\n");
+    bvcu_outfile_puts(STATE->pfx_outfile, "prefix|origin|peer_id\n");
   }
 
   // for each prefix
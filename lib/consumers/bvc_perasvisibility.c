@@ -26,7 +26,7 @@
 
 #include "bvc_perasvisibility.h"
 #include "bgpview_consumer_interface.h"
-#include "bgpstream_utils_patricia.h"
+#include "bgpview_consumer_pfx_summary.h"
 #include "khash.h"
 #include "utils.h"
 #include <assert.h>
@@ -42,7 +42,6 @@
 #define META_METRIC_PREFIX_FORMAT "%s.meta.bgpview.consumer." NAME ".%s"
 
 #define BUFFER_LEN 1024
-#define MAX_NUM_PEERS 1024
 
 #define STATE (BVC_GET_STATE(consumer, perasvisibility))
 
@@ -65,13 +64,6 @@ typedef enum {
 
 typedef struct pervis_info {
 
-  /* All the prefixes that belong to
-   * this threshold, i.e. they have been
-   * observed by at least TH full feed ASn,
-   * but they do not belong to the higher threshold
-   */
-  bgpstream_patricia_tree_t *pt;
-
   int pfx_cnt_idx[BGPSTREAM_MAX_IP_VERSION_IDX];
   int subnet_cnt_idx[BGPSTREAM_MAX_IP_VERSION_IDX];
 
@@ -87,8 +79,27 @@ typedef struct peras_info {
 
   pervis_info_t info[VIS_THRESHOLDS_CNT];
 
+  /* whether the AS originates prefixes in the current view */
+  uint8_t in_view;
+
 } peras_info_t;
 
+/** A prefix originated by an AS in the current view, as an address interval
+ *  (addresses are left-aligned in 128 bits, so IPv4 and IPv6 prefixes are
+ *  handled the same way) */
+typedef struct peras_pfx {
+
+  uint32_t asn;
+  uint8_t version_idx;
+  /* the highest threshold the prefix belongs to */
+  uint8_t threshold;
+  uint8_t mask_len;
+  /* first address of the prefix */
+  uint64_t addr_hi;
+  uint64_t addr_lo;
+
+} peras_pfx_t;
+
 /** Hash table: <origin ASn,pfxs info> */
 KHASH_INIT(as_pfxs_info, uint32_t, peras_info_t, 1, kh_int_hash_func,
            kh_int_hash_equal)
@@ -100,13 +111,15 @@ typedef struct bvc_perasvisibility_state {
    *  announced by a specific ASn */
   khash_t(as_pfxs_info) * as_pfxs_vis;
 
-  /** Re-usable variables that are used in the flip table
-   *  function: we make them part of the state to avoid
-   *  allocating new memory each time we process a new
-   *  view */
-  bgpstream_id_set_t *ff_asns;
-  uint32_t origin_asns[MAX_NUM_PEERS];
-  uint16_t valid_origins;
+  /** The prefixes of all the origin ASns in the current view (an arena
+   *  shared by all ASns, sorted by ASn before computing the metrics) */
+  peras_pfx_t *pfxs;
+  uint32_t pfxs_cnt;
+  uint32_t pfxs_alloc_cnt;
+
+  /** Full-feed summary of the prefix currently being processed (borrowed
+   *  from the chain state) */
+  bvc_pfx_summary_t *pfx_summary;
 
   /* Thresholds values */
   double thresholds[VIS_THRESHOLDS_CNT];
@@ -187,38 +200,6 @@ static const char *threshold_string(int i)
   }
 }
 
-/* ==================== ORIGINS FUNCTIONS ==================== */
-
-/* reset the array of origin ASn*/
-static void reset_origins(bvc_perasvisibility_state_t *state)
-{
-  state->valid_origins = 0;
-}
-
-/* check if an origin ASn is already part of the array and
- * if not it adds it */
-static void add_origin(bvc_perasvisibility_state_t *state,
-                       bgpstream_as_path_seg_t *origin_seg)
-{
-  uint32_t origin_asn;
-  if (origin_seg == NULL || origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
-    return;
-  } else {
-    origin_asn = ((bgpstream_as_path_seg_asn_t *)origin_seg)->asn;
-  }
-
-  int i;
-  for (i = 0; i < state->valid_origins; i++) {
-    if (state->origin_asns[i] == origin_asn) {
-      /* origin_asn is already there */
-      return;
-    }
-  }
-  /* if we did not find the origin, we add it*/
-  state->origin_asns[state->valid_origins] = origin_asn;
-  state->valid_origins++;
-}
-
 /* ==================== PER-AS-INFO FUNCTIONS ==================== */
 
 static int peras_info_init(bvc_t *consumer, peras_info_t *per_as, uint32_t asn)
@@ -226,11 +207,8 @@ static int peras_info_init(bvc_t *consumer, peras_info_t *per_as, uint32_t asn)
   bvc_perasvisibility_state_t *state = STATE;
   char buffer[BUFFER_LEN];
   int i, v;
+  per_as->in_view = 0;
   for (i = 0; i < VIS_THRESHOLDS_CNT; i++) {
-    /* create all Patricia Trees */
-    if ((per_as->info[i].pt = bgpstream_patricia_tree_create(NULL)) == NULL) {
-      return -1;
-    }
     /* create indexes for timeseries */
     for (v = 0; v < BGPSTREAM_MAX_IP_VERSION_IDX; v++) {
       /* visible_prefixes_cnt */
@@ -258,9 +236,14 @@ static int peras_info_init(bvc_t *consumer, peras_info_t *per_as, uint32_t asn)
 }
 
 static int peras_info_update(bvc_t *consumer, peras_info_t *per_as,
-                             bgpstream_pfx_t *pfx)
+                             uint32_t asn, bgpstream_pfx_t *pfx)
 {
   bvc_perasvisibility_state_t *state = STATE;
+  peras_pfx_t *pp;
+  peras_pfx_t *new_pfxs;
+  uint32_t new_cnt;
+  uint8_t *bytes;
+  int bytes_cnt, b;
 
   /* number of full feed ASns for the current IP version*/
   int totalfullfeed =
@@ -269,32 +252,132 @@ static int peras_info_update(bvc_t *consumer, peras_info_t *per_as,
   assert(totalfullfeed > 0);
 
   /* number of full feed ASns observing the current prefix*/
-  int pfx_ff_cnt = bgpstream_id_set_size(state->ff_asns);
+  int pfx_ff_cnt = state->pfx_summary->ff_asns_cnt;
   assert(pfx_ff_cnt > 0);
 
   double ratio = (double)pfx_ff_cnt / (double)totalfullfeed;
 
+  if (state->pfxs_cnt == state->pfxs_alloc_cnt) {
+    new_cnt = state->pfxs_alloc_cnt == 0 ? 4096 : state->pfxs_alloc_cnt * 2;
+    if ((new_pfxs = realloc(state->pfxs, sizeof(peras_pfx_t) * new_cnt)) ==
+        NULL) {
+      return -1;
+    }
+    state->pfxs = new_pfxs;
+    state->pfxs_alloc_cnt = new_cnt;
+  }
+  pp = &state->pfxs[state->pfxs_cnt++];
+
+  pp->asn = asn;
+  pp->version_idx = bgpstream_ipv2idx(pfx->address.version);
+  pp->mask_len = pfx->mask_len;
+
   /* we navigate the thresholds array starting from the
-   * higher one, and populate each threshold information
-   * only if the prefix belongs there */
-  int i;
-  for (i = VIS_THRESHOLDS_CNT - 1; i >= 0; i--) {
-    if (ratio >= state->thresholds[i]) {
-      /* add prefix to the Patricia Tree */
-      if (bgpstream_patricia_tree_insert(per_as->info[i].pt, pfx) == NULL) {
-        return -1;
-      }
+   * higher one, the prefix belongs to the first one it matches */
+  for (pp->threshold = VIS_THRESHOLDS_CNT - 1; pp->threshold > 0;
+       pp->threshold--) {
+    if (ratio >= state->thresholds[pp->threshold]) {
       break;
     }
   }
+
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    bytes = (uint8_t *)&pfx->address.bs_ipv4.addr.s_addr;
+    bytes_cnt = 4;
+  } else {
+    bytes = pfx->address.bs_ipv6.addr.s6_addr;
+    bytes_cnt = 16;
+  }
+  pp->addr_hi = 0;
+  pp->addr_lo = 0;
+  for (b = 0; b < bytes_cnt; b++) {
+    if (b < 8) {
+      pp->addr_hi |= (uint64_t)bytes[b] << (56 - 8 * b);
+    } else {
+      pp->addr_lo |= (uint64_t)bytes[b] << (56 - 8 * (b - 8));
+    }
+  }
+  /* ignore any host bits */
+  if (pp->mask_len < 64) {
+    pp->addr_hi &= pp->mask_len == 0 ? 0 : ~(UINT64_MAX >> pp->mask_len);
+    pp->addr_lo = 0;
+  } else if (pp->mask_len < 128) {
+    pp->addr_lo &= ~(UINT64_MAX >> (pp->mask_len - 64));
+  }
+
+  per_as->in_view = 1;
   return 0;
 }
 
-static void peras_info_destroy(peras_info_t per_as)
+static int peras_pfx_cmp(const void *a, const void *b)
 {
-  int i;
-  for (i = 0; i < VIS_THRESHOLDS_CNT; i++) {
-    bgpstream_patricia_tree_destroy(per_as.info[i].pt);
+  const peras_pfx_t *pa = (const peras_pfx_t *)a;
+  const peras_pfx_t *pb = (const peras_pfx_t *)b;
+
+  if (pa->asn != pb->asn) {
+    return pa->asn < pb->asn ? -1 : 1;
+  }
+  if (pa->version_idx != pb->version_idx) {
+    return pa->version_idx < pb->version_idx ? -1 : 1;
+  }
+  if (pa->addr_hi != pb->addr_hi) {
+    return pa->addr_hi < pb->addr_hi ? -1 : 1;
+  }
+  if (pa->addr_lo != pb->addr_lo) {
+    return pa->addr_lo < pb->addr_lo ? -1 : 1;
+  }
+  /* covering prefixes first */
+  return (int)pa->mask_len - (int)pb->mask_len;
+}
+
+/** Count the prefixes of a (sorted) run of prefixes of an ASn and IP version
+ *  that match a threshold, as well as the number of subnets of the given size
+ *  they cover (in the same way as bgpstream_patricia_tree_count_24subnets and
+ *  bgpstream_patricia_tree_count_64subnets do) */
+static void count_pfxs(peras_pfx_t *pfxs, uint32_t cnt, int threshold,
+                       uint8_t subnet_size, uint64_t *pfx_cnt,
+                       uint64_t *subnet_cnt)
+{
+  uint64_t end_hi = 0, end_lo = 0;
+  int have_top = 0;
+  uint8_t m;
+  uint32_t i;
+
+  *pfx_cnt = 0;
+  *subnet_cnt = 0;
+
+  for (i = 0; i < cnt; i++) {
+    if (pfxs[i].threshold < threshold) {
+      continue;
+    }
+    (*pfx_cnt)++;
+
+    /* prefixes that are covered by the last top-level prefix do not add any
+     * subnet (prefixes are either nested or disjoint) */
+    if (have_top != 0 &&
+        (pfxs[i].addr_hi < end_hi ||
+         (pfxs[i].addr_hi == end_hi && pfxs[i].addr_lo <= end_lo))) {
+      continue;
+    }
+
+    m = pfxs[i].mask_len;
+    if (m >= subnet_size) {
+      (*subnet_cnt)++;
+    } else if (subnet_size - m == 64) {
+      *subnet_cnt = UINT64_MAX;
+    } else {
+      *subnet_cnt += (uint64_t)1 << (subnet_size - m);
+    }
+
+    /* last address of the prefix */
+    if (m >= 64) {
+      end_hi = pfxs[i].addr_hi;
+      end_lo = pfxs[i].addr_lo | (m == 128 ? 0 : UINT64_MAX >> (m - 64));
+    } else {
+      end_hi = pfxs[i].addr_hi | (m == 0 ? UINT64_MAX : UINT64_MAX >> m);
+      end_lo = UINT64_MAX;
+    }
+    have_top = 1;
   }
 }
 
@@ -305,32 +388,33 @@ static int update_pfx_asns_information(bvc_t *consumer, bgpstream_pfx_t *pfx)
   bvc_perasvisibility_state_t *state = STATE;
 
   /* Requirements:
-   * state->origin_asns contains <state->valid_origins> (> 0) that currently
+   * state->pfx_summary contains the (> 0) origin ASns that currently
    * announce the prefix */
-  assert(state->valid_origins > 0);
+  bvc_pfx_summary_t *summary = state->pfx_summary;
+  assert(summary != NULL && summary->origins_cnt > 0);
 
   khiter_t k = 0;
   int khret;
   peras_info_t *all_infos;
   int i;
   /* check if the origin ASn is already in the as_pfxs_vis hash map */
-  for (i = 0; i < state->valid_origins; i++) {
+  for (i = 0; i < summary->origins_cnt; i++) {
     /* if it is the first time we observe this ASn, then we
      * have to initialized its information */
-    if ((k = kh_get(as_pfxs_info, state->as_pfxs_vis, state->origin_asns[i])) ==
+    if ((k = kh_get(as_pfxs_info, state->as_pfxs_vis, summary->origins[i])) ==
         kh_end(state->as_pfxs_vis)) {
-      k =
-        kh_put(as_pfxs_info, state->as_pfxs_vis, state->origin_asns[i], &khret);
+      k = kh_put(as_pfxs_info, state->as_pfxs_vis, summary->origins[i], &khret);
       /* init peras_info_t */
       all_infos = &kh_val(state->as_pfxs_vis, k);
-      if (peras_info_init(consumer, all_infos, state->origin_asns[i]) != 0) {
+      if (peras_info_init(consumer, all_infos, summary->origins[i]) != 0) {
         return -1;
       }
     } else {
       all_infos = &kh_val(state->as_pfxs_vis, k);
     }
     /* once we have a pointer to the AS information, we update it */
-    if (peras_info_update(consumer, all_infos, pfx) != 0) {
+    if (peras_info_update(consumer, all_infos, summary->origins[i], pfx) !=
+        0) {
       return -1;
     }
   }
@@ -343,7 +427,6 @@ static int compute_origin_pfx_visibility(bvc_t *consumer, bgpview_iter_t *it)
   bvc_perasvisibility_state_t *state = STATE;
 
   bgpstream_pfx_t *pfx;
-  bgpstream_peer_sig_t *sg;
 
   /* for each prefix in the view */
   for (bgpview_iter_first_pfx(it, 0 /* all ip versions*/, BGPVIEW_FIELD_ACTIVE);
@@ -358,42 +441,17 @@ static int compute_origin_pfx_visibility(bvc_t *consumer, bgpview_iter_t *it)
       continue;
     }
 
-    /* reset information for the current prefix */
-    bgpstream_id_set_clear(state->ff_asns);
-    reset_origins(state);
-
-    /* iterate over the peers for the current pfx and get the number of unique
-     * full feed AS numbers observing this prefix as well as the unique set of
-     * origin ASes */
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
-         bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
-
-      /* only consider peers that are full-feed (checking if peer id is a full
-       * feed
-       * for the current pfx IP version ) */
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)
-              ->full_feed_peer_ids[bgpstream_ipv2idx(pfx->address.version)],
-            bgpview_iter_peer_get_peer_id(it)) == 0) {
-        continue;
-      }
-
-      /* get peer signature */
-      sg = bgpview_iter_peer_get_sig(it);
-      assert(sg);
-
-      /* Add peer AS number to the set of full feed peers observing the prefix
-       */
-      bgpstream_id_set_insert(state->ff_asns, sg->peer_asnumber);
-
-      /* Add origin AS number to the array of origin ASns for the prefix */
-      add_origin(state, bgpview_iter_pfx_peer_get_origin_seg(it));
+    /* the number of unique full feed AS numbers observing this prefix as
+     * well as the unique set of origin ASes have been computed by the
+     * visibility consumer */
+    state->pfx_summary =
+      bvc_pfx_summary_table_get(CHAIN_STATE->pfx_summaries, pfx);
+    if (state->pfx_summary == NULL || state->pfx_summary->origins_cnt == 0) {
+      continue;
     }
 
-    if (state->valid_origins > 0) {
-      if (update_pfx_asns_information(consumer, pfx) != 0) {
-        return -1;
-      }
+    if (update_pfx_asns_information(consumer, pfx) != 0) {
+      return -1;
     }
   }
 
@@ -403,61 +461,74 @@ static int compute_origin_pfx_visibility(bvc_t *consumer, bgpview_iter_t *it)
 static int output_metrics_and_reset(bvc_t *consumer)
 {
   bvc_perasvisibility_state_t *state = STATE;
-  int i;
+  int i, v;
   khiter_t k;
   peras_info_t *per_as;
+  uint32_t first, last, split;
+  uint64_t pfx_cnt, subnet_cnt;
 
-  /* for each AS number */
+  /* ASns that do not originate any prefix in this view have no visibility */
   for (k = kh_begin(state->as_pfxs_vis); k != kh_end(state->as_pfxs_vis); ++k) {
     if (kh_exist(state->as_pfxs_vis, k)) {
-      /* collect the information for all thresholds */
       per_as = &kh_val(state->as_pfxs_vis, k);
-      for (i = VIS_THRESHOLDS_CNT - 1; i >= 0; i--) {
-        /* we merge all the trees with the previous one,
-         * except the first */
-        if (i != (VIS_THRESHOLDS_CNT - 1)) {
-          bgpstream_patricia_tree_merge(per_as->info[i].pt,
-                                        per_as->info[i + 1].pt);
+      if (per_as->in_view != 0) {
+        per_as->in_view = 0;
+        continue;
+      }
+      for (i = 0; i < VIS_THRESHOLDS_CNT; i++) {
+        for (v = 0; v < BGPSTREAM_MAX_IP_VERSION_IDX; v++) {
+          timeseries_kp_set(state->kp, per_as->info[i].pfx_cnt_idx[v], 0);
+          timeseries_kp_set(state->kp, per_as->info[i].subnet_cnt_idx[v], 0);
         }
-
-        /* now that the tree represents all the prefixes
-         * that match the threshold, we extract the information
-         * that we want to output */
-
-        /* IPv4*/
-        timeseries_kp_set(
-          state->kp,
-          per_as->info[i]
-            .pfx_cnt_idx[bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV4)],
-          bgpstream_patricia_prefix_count(per_as->info[i].pt,
-                                          BGPSTREAM_ADDR_VERSION_IPV4));
-        timeseries_kp_set(
-          state->kp,
-          per_as->info[i]
-            .subnet_cnt_idx[bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV4)],
-          bgpstream_patricia_tree_count_24subnets(per_as->info[i].pt));
-
-        /* IPv6*/
-        timeseries_kp_set(
-          state->kp,
-          per_as->info[i]
-            .pfx_cnt_idx[bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV6)],
-          bgpstream_patricia_prefix_count(per_as->info[i].pt,
-                                          BGPSTREAM_ADDR_VERSION_IPV6));
-        timeseries_kp_set(
-          state->kp,
-          per_as->info[i]
-            .subnet_cnt_idx[bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV6)],
-          bgpstream_patricia_tree_count_64subnets(per_as->info[i].pt));
       }
+    }
+  }
 
-      /* metrics are set, now we have to clean the patricia trees */
-      for (i = VIS_THRESHOLDS_CNT - 1; i >= 0; i--) {
-        bgpstream_patricia_tree_clear(per_as->info[i].pt);
-      }
+  /* group the prefixes by ASn and IP version, in address order */
+  qsort(state->pfxs, state->pfxs_cnt, sizeof(peras_pfx_t), peras_pfx_cmp);
+
+  /* for each AS number */
+  for (first = 0; first < state->pfxs_cnt; first = last) {
+    last = first + 1;
+    while (last < state->pfxs_cnt &&
+           state->pfxs[last].asn == state->pfxs[first].asn) {
+      last++;
+    }
+    k = kh_get(as_pfxs_info, state->as_pfxs_vis, state->pfxs[first].asn);
+    assert(k != kh_end(state->as_pfxs_vis));
+    per_as = &kh_val(state->as_pfxs_vis, k);
+
+    /* the IPv4 prefixes of the ASn are sorted before the IPv6 ones */
+    split = first;
+    while (split < last && state->pfxs[split].version_idx ==
+                             bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV4)) {
+      split++;
+    }
+
+    /* collect the information for all thresholds, each threshold includes the
+     * prefixes of the higher ones */
+    for (i = 0; i < VIS_THRESHOLDS_CNT; i++) {
+      /* IPv4 */
+      v = bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV4);
+      count_pfxs(&state->pfxs[first], split - first, i, 24, &pfx_cnt,
+                 &subnet_cnt);
+      timeseries_kp_set(state->kp, per_as->info[i].pfx_cnt_idx[v], pfx_cnt);
+      timeseries_kp_set(state->kp, per_as->info[i].subnet_cnt_idx[v],
+                        subnet_cnt);
+
+      /* IPv6 */
+      v = bgpstream_ipv2idx(BGPSTREAM_ADDR_VERSION_IPV6);
+      count_pfxs(&state->pfxs[split], last - split, i, 64, &pfx_cnt,
+                 &subnet_cnt);
+      timeseries_kp_set(state->kp, per_as->info[i].pfx_cnt_idx[v], pfx_cnt);
+      timeseries_kp_set(state->kp, per_as->info[i].subnet_cnt_idx[v],
+                        subnet_cnt);
     }
   }
 
+  /* metrics are set, now we have to clean the prefixes */
+  state->pfxs_cnt = 0;
+
   return 0;
 }
 
@@ -484,11 +555,6 @@ int bvc_perasvisibility_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
-  if ((state->ff_asns = bgpstream_id_set_create()) == NULL) {
-    fprintf(stderr, "Error: Could not create full feed origin ASns set\n");
-    goto err;
-  }
-
   init_thresholds(state);
 
   /* init key package and meta metrics */
@@ -533,6 +599,10 @@ int bvc_perasvisibility_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
+  /* ask Visibility to also summarize the full feed observations of each
+     prefix */
+  CHAIN_STATE->pfx_summaries_wanted = 1;
+
   return 0;
 
 err:
@@ -550,15 +620,11 @@ void bvc_perasvisibility_destroy(bvc_t *consumer)
 
   /* destroy things here */
   if (state->as_pfxs_vis != NULL) {
-    kh_free_vals(as_pfxs_info, state->as_pfxs_vis, peras_info_destroy);
     kh_destroy(as_pfxs_info, state->as_pfxs_vis);
     state->as_pfxs_vis = NULL;
   }
 
-  if (state->ff_asns != NULL) {
-    bgpstream_id_set_destroy(state->ff_asns);
-    state->ff_asns = NULL;
-  }
+  free(state->pfxs);
 
   timeseries_kp_free(&state->kp);
 
@@ -617,7 +683,8 @@ int bvc_perasvisibility_process_view(bvc_t *consumer, bgpview_t *view)
                     state->processing_time);
 
   /* now flush the gen kp */
-  if (timeseries_kp_flush(state->kp, bgpview_get_time(view)) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, state->kp, bgpview_get_time(view)) !=
+      0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
@@ -41,7 +41,7 @@
   do {                                                                         \
     char buf[1024];                                                            \
     snprintf(buf, 1024, META_METRIC_PREFIX_FORMAT "." fmt, __VA_ARGS__);       \
-    timeseries_set_single(BVC_GET_TIMESERIES(consumer), buf, value, time);     \
+    bvc_timeseries_set_single(consumer, buf, value, time);                     \
   } while (0)
 
 #define STATE (BVC_GET_STATE(consumer, perfmonitor))
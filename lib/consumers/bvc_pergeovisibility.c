@@ -26,14 +26,20 @@
 
 #include "bvc_pergeovisibility.h"
 #include "bgpview_consumer_interface.h"
+#include "bgpview_consumer_pfx_summary.h"
+#include "bgpview_io.h"
 #include "bgpstream_utils_patricia.h"
 #include "bgpstream_utils_pfx_set.h"
 #include "khash.h"
 #include "utils.h"
 #include "libipmeta.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <unistd.h>
 #include <math.h>
 
@@ -51,9 +57,23 @@
 #define META_METRIC_PREFIX_FORMAT "%s.meta.bgpview.consumer." NAME ".%s"
 
 #define BUFFER_LEN 1024
-#define MAX_NUM_PEERS 1024
 #define MAX_IP_VERSION_ALLOWED BGPSTREAM_MAX_IP_VERSION_IDX
 
+/** Prefixes that have not been seen for this long are dropped from the geo
+ * cache (this is also how often the cache is checked) */
+#define GEO_CACHE_TIMEOUT 86400
+
+#define GEO_CACHE_MAGIC 0x47454F43 /* GEOC */
+#define GEO_CACHE_END_MAGIC 0x43454E44 /* CEND */
+#define GEO_CACHE_VERSION 2
+
+/** Compression level used when the snapshot name implies compression */
+#define GEO_CACHE_COMPRESS_LEVEL 6
+
+#define WRITE_VAL(from) BGPVIEW_IO_WRITE_VAL(outfile, from, "geo cache")
+
+#define READ_VAL(to) BGPVIEW_IO_READ_VAL(infile, to, "geo cache")
+
 static const char *continent_strings[] = {
   "??", // Unknown
   "AF", // Africa
@@ -90,23 +110,28 @@ static const int netacq_cont_map[] = {
 /** a hash type to map ISO3 country codes to a continent.ISO2 string */
 KHASH_INIT(strstr, char *, char *, 1, kh_str_hash_func, kh_str_hash_equal)
 
-/** Define our own hash function that doesn't consider a /24's (empty) least
- * significant byte.  We simply right-shift the unused host bits away and
- * multiply the result by the prime number 59, to distribute our keys more
- * uniformly across the hash table's buckets. */
-#define kh_slash24_hash_func(key)   (khint32_t) (((key) >> 8) * 59)
-#define kh_slash24_hash_equal(a, b) ((a) == (b))
-
-KHASH_INIT(slash24_id_set /* name */, uint32_t /* khkey_t */,
-           char /* khval_t */, 0 /* kh_is_set */,
-           kh_slash24_hash_func /*__hash_func */,
-           kh_slash24_hash_equal /* __hash_equal */)
-
-/* We define our own set data structure because we need a different hash
- * function for dealing with our /24s.
+/** Number of 64 bit words in a slash24 block, i.e. a bitmap of the 256 /24s
+ * of a /16 */
+#define SLASH24_BLOCK_WORDS 4
+
+/** Bitmap of the /24s of a /16 */
+typedef struct slash24_block {
+  uint64_t words[SLASH24_BLOCK_WORDS];
+} slash24_block_t;
+
+KHASH_INIT(slash24_blocks /* name */, uint32_t /* khkey_t (/16 id) */,
+           slash24_block_t /* khval_t */, 1 /* kh_is_map */,
+           kh_int_hash_func /*__hash_func */,
+           kh_int_hash_equal /* __hash_equal */)
+
+/* A set of /24s is a sparse bitmap: only the /16s that contain at least one
+ * /24 of the set have a (dense) block. Geographical regions (and especially
+ * countries and polygons) only cover a small part of the address space, so
+ * this is much smaller than a 2^24 bit bitmap, while ranges of /24s are still
+ * inserted and merged a word at a time.
  */
 typedef struct slash24_id_set {
-  khash_t(slash24_id_set) * hash;
+  khash_t(slash24_blocks) * blocks;
 } slash24_id_set_t;
 
 /* creates a metric:
@@ -249,8 +274,28 @@ typedef struct per_geo {
 
 } __attribute__((packed)) per_geo_t;
 
-/** Attached to prefixes in the view to cache continent, country, region, and
- * polygon indices.
+/** A run of addresses of a prefix that geolocate to the same place, as
+ * returned by ipmeta.
+ */
+typedef struct geo_run {
+
+  /** Continent index (into the STATE->continents array) */
+  uint16_t continent_idx;
+
+  /** Country index (into the STATE->countries array) */
+  uint16_t country_idx;
+
+  /** Polygon of each table (indexes into the STATE->polygons arrays) */
+  uint16_t poly_idxs[METRIC_NETACQ_EDGE_POLYS_TBL_CNT];
+  uint8_t poly_idxs_cnt;
+
+  /** Number of addresses (or /64s for a v6 run) */
+  uint64_t num_ips;
+
+} geo_run_t;
+
+/** Geo cache entry of a prefix: continent, country, region, and polygon
+ * indices.
  */
 typedef struct perpfx_cache {
 
@@ -296,8 +341,20 @@ typedef struct perpfx_cache {
   uint64_t *per_poly_addr_run_cnt[METRIC_NETACQ_EDGE_POLYS_TBL_CNT];
   uint64_t *per_poly_addr6_pfx_cnt[METRIC_NETACQ_EDGE_POLYS_TBL_CNT];
 
+  /** The geo runs the above was built from (kept for the snapshot) */
+  geo_run_t *runs;
+  uint32_t runs_cnt;
+
+  /** Time of the last view the prefix was seen in */
+  uint32_t last_seen;
+
 } __attribute__((packed)) perpfx_cache_t;
 
+/** Maps prefixes to their geo information. The cache belongs to the
+ * consumer, so it survives views being cleared or rebuilt */
+KHASH_INIT(pfx_geo_cache, bgpstream_pfx_t, perpfx_cache_t *, 1,
+           bgpstream_pfx_hash_val, bgpstream_pfx_equal_val)
+
 /* our 'instance' */
 typedef struct bvc_pergeovisibility_state {
 
@@ -307,6 +364,11 @@ typedef struct bvc_pergeovisibility_state {
   char *provider_arg;
   int reload_freq;
   uint32_t last_reload;
+
+  /** Identity of the geolocation database that ipmeta was last loaded from
+      (see geo_db_id) */
+  uint64_t geo_db_id;
+
   ipmeta_t *ipmeta;
   ipmeta_provider_t *provider;
   ipmeta_record_set_t *records;
@@ -326,13 +388,19 @@ typedef struct bvc_pergeovisibility_state {
   /** Number of tables used in polygons and polygons_cnt */
   int polygons_tbl_cnt;
 
-  /** Re-usable variables that are used in the flip table
-   *  function: we make them part of the state to avoid
-   *  allocating new memory each time we process a new
-   *  view */
-  bgpstream_id_set_t *ff_asns;
-  uint32_t origin_asns[MAX_NUM_PEERS];
-  uint16_t valid_origins;
+  /** Full-feed summary of the prefix currently being processed (borrowed
+   *  from the chain state) */
+  bvc_pfx_summary_t *pfx_summary;
+
+  /** Geo information of each prefix */
+  khash_t(pfx_geo_cache) * geo_cache;
+
+  /** Time of the last check for stale geo cache entries */
+  uint32_t geo_cache_last_check;
+
+  /** File the geo cache is loaded from at startup, and written to at
+   *  shutdown */
+  char *geo_cache_file;
 
   /** Timeseries Key Package */
   timeseries_kp_t *kp;
@@ -349,7 +417,12 @@ typedef struct bvc_pergeovisibility_state {
 /** Print usage information to stderr */
 static void usage(bvc_t *consumer)
 {
-  fprintf(stderr, "consumer usage: %s -p <ipmeta-provider>\n", consumer->name);
+  fprintf(stderr,
+          "consumer usage: %s -p <ipmeta-provider>\n"
+          "       -r <seconds>     ipmeta reload frequency (default: never)\n"
+          "       -c <file>        geo cache snapshot, loaded at startup and\n"
+          "                        written at shutdown (default: none)\n",
+          consumer->name);
 }
 
 /** Parse the arguments given to the consumer */
@@ -362,8 +435,12 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, ":p:r:?")) >= 0) {
+  while ((opt = getopt(argc, argv, ":c:p:r:?")) >= 0) {
     switch (opt) {
+    case 'c':
+      STATE->geo_cache_file = strdup(optarg);
+      assert(STATE->geo_cache_file != NULL);
+      break;
     case 'p':
       STATE->provider_config = strdup(optarg);
       assert(STATE->provider_config != NULL);
@@ -390,41 +467,57 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
   return 0;
 }
 
-/* ==================== ORIGINS FUNCTIONS ==================== */
+/* ==================== SET FUNCTIONS ==================== */
 
-/* check if an origin ASN is already part of the array and
- * if not it adds it */
-static void add_origin(bvc_pergeovisibility_state_t *state,
-                       bgpstream_as_path_seg_t *origin_seg)
+/* get the block of the given /16, adding an empty one if needed */
+static slash24_block_t *slash24_id_set_get_block(slash24_id_set_t *set,
+                                                 uint32_t block_id)
 {
-  uint32_t origin_asn;
-  int i;
+  khiter_t k;
+  int khret;
 
-  if (origin_seg == NULL || origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
-    return;
+  k = kh_put(slash24_blocks, set->blocks, block_id, &khret);
+  if (khret < 0) {
+    return NULL;
   }
-  origin_asn = ((bgpstream_as_path_seg_asn_t *)origin_seg)->asn;
-
-  /* we do a linear search since the number of distinct origins should be very
-     small (often just 1) */
-  for (i = 0; i < state->valid_origins; i++) {
-    if (state->origin_asns[i] == origin_asn) {
-      /* origin_asn is already there */
-      return;
-    }
+  if (khret > 0) {
+    memset(&kh_val(set->blocks, k), 0, sizeof(slash24_block_t));
   }
-  /* if we did not find the origin, we add it*/
-  state->origin_asns[state->valid_origins++] = origin_asn;
+  return &kh_val(set->blocks, k);
 }
 
-/* ==================== SET FUNCTIONS ==================== */
-
-static int slash24_id_set_insert(slash24_id_set_t *set, uint32_t id)
+/* insert the cnt /24s starting at the given address (host byte order) */
+static int slash24_id_set_insert_range(slash24_id_set_t *set, uint32_t addr,
+                                       uint32_t cnt)
 {
-  int khret;
+  /* /24 ids are 24 bit, so the range end cannot overflow */
+  uint32_t id = addr >> 8;
+  uint32_t last = id + cnt;
+  uint32_t block_end, bit, n;
+  slash24_block_t *block;
+
+  while (id < last) {
+    if ((block = slash24_id_set_get_block(set, id >> 8)) == NULL) {
+      return -1;
+    }
+    block_end = ((id >> 8) + 1) << 8;
+    if (block_end > last) {
+      block_end = last;
+    }
+    /* fill the bits of this block one word at a time */
+    while (id < block_end) {
+      bit = id & 63;
+      n = 64 - bit;
+      if (n > block_end - id) {
+        n = block_end - id;
+      }
+      block->words[(id & 0xff) >> 6] |=
+        (n == 64) ? UINT64_MAX : (((UINT64_C(1) << n) - 1) << bit);
+      id += n;
+    }
+  }
 
-  kh_put(slash24_id_set, set->hash, id, &khret);
-  return khret;
+  return 0;
 }
 
 static slash24_id_set_t *slash24_id_set_create(void)
@@ -435,14 +528,10 @@ static slash24_id_set_t *slash24_id_set_create(void)
     return NULL;
   }
 
-  if ((set->hash = kh_init(slash24_id_set)) == NULL) {
-    kh_destroy(slash24_id_set, set->hash);
+  if ((set->blocks = kh_init(slash24_blocks)) == NULL) {
     free(set);
     return NULL;
   }
-  /* Pre-allocate to reduce the number of expensive realloc calls. The minimum
-   * number that kh_resize accepts is 4. */
-  kh_resize(slash24_id_set, set->hash, 4);
 
   return set;
 }
@@ -451,11 +540,18 @@ static int slash24_id_set_merge(slash24_id_set_t *dst_set,
                                 slash24_id_set_t *src_set)
 {
   khiter_t k;
-  for (k = kh_begin(src_set->hash); k != kh_end(src_set->hash); ++k) {
-    if (kh_exist(src_set->hash, k)) {
-      if (slash24_id_set_insert(dst_set, kh_key(src_set->hash, k)) < 0) {
+  slash24_block_t *block;
+  int i;
+
+  for (k = kh_begin(src_set->blocks); k != kh_end(src_set->blocks); ++k) {
+    if (kh_exist(src_set->blocks, k)) {
+      if ((block = slash24_id_set_get_block(
+             dst_set, kh_key(src_set->blocks, k))) == NULL) {
         return -1;
       }
+      for (i = 0; i < SLASH24_BLOCK_WORDS; i++) {
+        block->words[i] |= kh_val(src_set->blocks, k).words[i];
+      }
     }
   }
 
@@ -464,17 +560,29 @@ static int slash24_id_set_merge(slash24_id_set_t *dst_set,
 
 static void slash24_id_set_clear(slash24_id_set_t *set)
 {
-  kh_clear(slash24_id_set, set->hash);
+  kh_clear(slash24_blocks, set->blocks);
 }
 
 static int slash24_id_set_size(slash24_id_set_t *set)
 {
-  return kh_size(set->hash);
+  khiter_t k;
+  int i;
+  int size = 0;
+
+  for (k = kh_begin(set->blocks); k != kh_end(set->blocks); ++k) {
+    if (kh_exist(set->blocks, k)) {
+      for (i = 0; i < SLASH24_BLOCK_WORDS; i++) {
+        size += __builtin_popcountll(kh_val(set->blocks, k).words[i]);
+      }
+    }
+  }
+
+  return size;
 }
 
 static void slash24_id_set_destroy(slash24_id_set_t *set)
 {
-  kh_destroy(slash24_id_set, set->hash);
+  kh_destroy(slash24_blocks, set->blocks);
   free(set);
 }
 
@@ -656,7 +764,7 @@ static int per_geo_update_v6(bvc_t *consumer, per_geo_t *pg,
   assert(totalfullfeed > 0);
 
   /* number of full feed ASNs observing the current prefix*/
-  int pfx_ff_cnt = bgpstream_id_set_size(STATE->ff_asns);
+  int pfx_ff_cnt = STATE->pfx_summary->ff_asns_cnt;
   assert(pfx_ff_cnt > 0);
 
   double ratio = (double)pfx_ff_cnt / (double)totalfullfeed;
@@ -672,10 +780,10 @@ static int per_geo_update_v6(bvc_t *consumer, per_geo_t *pg,
         return -1;
       }
       /* add origin ASNs to asns set */
-      for (j = 0; j < STATE->valid_origins; j++) {
+      for (j = 0; j < STATE->pfx_summary->origins_cnt; j++) {
 
         bgpstream_id_set_insert(pg->thresholds[i].asns_v6,
-              STATE->origin_asns[j]);
+              STATE->pfx_summary->origins[j]);
       }
 
       if (bgpstream_ipv6_pfx_set_iterate(pfx_set, add_geo_v6pfx_to_tree,
@@ -699,7 +807,7 @@ static int per_geo_update(bvc_t *consumer, per_geo_t *pg, bgpstream_pfx_t *pfx,
   assert(totalfullfeed > 0);
 
   /* number of full feed ASNs observing the current prefix*/
-  int pfx_ff_cnt = bgpstream_id_set_size(STATE->ff_asns);
+  int pfx_ff_cnt = STATE->pfx_summary->ff_asns_cnt;
   assert(pfx_ff_cnt > 0);
 
   double ratio = (double)pfx_ff_cnt / (double)totalfullfeed;
@@ -707,7 +815,7 @@ static int per_geo_update(bvc_t *consumer, per_geo_t *pg, bgpstream_pfx_t *pfx,
   /* we navigate the thresholds array starting from the
    * higher one, and populate each threshold information
    * only if the prefix belongs there */
-  int i, j, k;
+  int i, j;
   for (i = VIS_THRESHOLDS_CNT - 1; i >= 0; i--) {
     if (ratio >= threshold_vals[i]) {
       /* add prefix to the Patricia Tree */
@@ -715,23 +823,22 @@ static int per_geo_update(bvc_t *consumer, per_geo_t *pg, bgpstream_pfx_t *pfx,
         return -1;
       }
       /* add origin ASNs to asns set */
-      for (j = 0; j < STATE->valid_origins; j++) {
+      for (j = 0; j < STATE->pfx_summary->origins_cnt; j++) {
 
         bgpstream_id_set_insert(pg->thresholds[i].asns,
-              STATE->origin_asns[j]);
+              STATE->pfx_summary->origins[j]);
       }
-      /* "Explode" each run into a series of /24 or /64 networks and add them
-       * to the set.
-       */
+      /* Add the /24 networks of each run to the set. */
       for (j = 0; j < num_runs; j++) {
         /* Determine the offset to the beginning of the /24. */
         offset = runs[j].network_addr & 0x000000ff;
         /* Round up to the next-highest number of /24 */
         num_slash24s = (runs[j].num_ips + offset + 255) / 256;
 
-        for (k = 0; k < num_slash24s; k++) {
-          slash24_id_set_insert(pg->thresholds[i].slash24s,
-                                (runs[j].network_addr & 0xffffff00) + (k << 8));
+        if (slash24_id_set_insert_range(pg->thresholds[i].slash24s,
+                                        runs[j].network_addr,
+                                        num_slash24s) != 0) {
+          return -1;
         }
       }
       break;
@@ -823,6 +930,49 @@ static int init_kp(bvc_t *consumer)
   return 0;
 }
 
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+  const uint8_t *p = data;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ p[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/* identify the geolocation database from the provider configuration and the
+ * size and modification time of every (local) file it names, so that a geo
+ * cache is not reused once the files are replaced */
+static uint64_t geo_db_id(bvc_t *consumer)
+{
+  uint64_t id = 0xcbf29ce484222325ULL;
+  char args[BUFFER_LEN];
+  char *tok;
+  char *saveptr = NULL;
+  struct stat st;
+  uint64_t u64;
+
+  id = fnv1a(id, STATE->provider_name, strlen(STATE->provider_name) + 1);
+  if (STATE->provider_arg == NULL) {
+    return id;
+  }
+  id = fnv1a(id, STATE->provider_arg, strlen(STATE->provider_arg) + 1);
+
+  snprintf(args, BUFFER_LEN, "%s", STATE->provider_arg);
+  for (tok = strtok_r(args, " ", &saveptr); tok != NULL;
+       tok = strtok_r(NULL, " ", &saveptr)) {
+    if (stat(tok, &st) != 0 || !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    u64 = st.st_size;
+    id = fnv1a(id, &u64, sizeof(u64));
+    u64 = st.st_mtime;
+    id = fnv1a(id, &u64, sizeof(u64));
+  }
+
+  return id;
+}
+
 static int init_ipmeta(bvc_t *consumer)
 {
   /* initialize ipmeta structure */
@@ -863,6 +1013,8 @@ static int init_ipmeta(bvc_t *consumer)
             "ERROR: Only the netacq-edge provider is currently supported\n");
   }
 
+  STATE->geo_db_id = geo_db_id(consumer);
+
   if (ipmeta_enable_provider(STATE->ipmeta, STATE->provider,
                              STATE->provider_arg) != 0) {
     fprintf(stderr, "ERROR: Could not enable provider %s\n",
@@ -920,9 +1072,8 @@ static void destroy_ipmeta(bvc_t *consumer)
   }
 }
 
-static void destroy_pfx_user_ptr(void *user)
+static void destroy_pfx_cache(perpfx_cache_t *pfx_cache)
 {
-  perpfx_cache_t *pfx_cache = (perpfx_cache_t *)user;
   int i, j;
 
   if (pfx_cache == NULL) {
@@ -981,23 +1132,17 @@ static void destroy_pfx_user_ptr(void *user)
     pfx_cache->per_poly_addr6_pfx_cnt[i] = NULL;
   }
 
+  free(pfx_cache->runs);
+  pfx_cache->runs = NULL;
+  pfx_cache->runs_cnt = 0;
+
   free(pfx_cache);
 }
 
-static int clear_geocache(bvc_t *consumer, bgpview_t *view)
+static void clear_geocache(bvc_t *consumer)
 {
-  bgpview_iter_t *it = bgpview_iter_create(view);
-  assert(it != NULL);
-
-  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ALL_VALID); //
-       bgpview_iter_has_more_pfx(it);                    //
-       bgpview_iter_next_pfx(it)) {
-    // will call the destroy func itself
-    bgpview_iter_pfx_set_user(it, NULL);
-  }
-
-  bgpview_iter_destroy(it);
-  return 0;
+  kh_free_vals(pfx_geo_cache, STATE->geo_cache, destroy_pfx_cache);
+  kh_clear(pfx_geo_cache, STATE->geo_cache);
 }
 
 static int create_geo_pfxs_vis(bvc_t *consumer)
@@ -1131,15 +1276,14 @@ err:
   return -1;
 }
 
-static int lookup_polygon(perpfx_cache_t *pfx_cache, ipmeta_record_t *rec,
+static int lookup_polygon(perpfx_cache_t *pfx_cache, uint16_t poly_idx,
         int poly_table) {
   int i;
 
   /* this is a polygon from one of the tables that we are tracking */
   /* check if it is already in our cache */
   for (i = 0; i < pfx_cache->poly_table_idxs_cnt[poly_table]; i++) {
-    if (pfx_cache->poly_table_idxs[poly_table][i] ==
-            rec->polygon_ids[poly_table]) {
+    if (pfx_cache->poly_table_idxs[poly_table][i] == poly_idx) {
       return i;
     }
   }
@@ -1163,18 +1307,14 @@ static int lookup_polygon(perpfx_cache_t *pfx_cache, ipmeta_record_t *rec,
   i = pfx_cache->poly_table_idxs_cnt[poly_table];
   pfx_cache->poly_table_idxs_cnt[poly_table] ++;
 
-  pfx_cache->poly_table_idxs[poly_table][i] = rec->polygon_ids[poly_table];
+  pfx_cache->poly_table_idxs[poly_table][i] = poly_idx;
   return i;
 }
 
-static int lookup_country(perpfx_cache_t *pfx_cache, ipmeta_record_t *rec) {
+static int lookup_country(perpfx_cache_t *pfx_cache, uint16_t cont_idx) {
 
-  int cont_idx = 0x3F3F;
   int i;
 
-  if (rec->country_code[0] != '\0') {
-    cont_idx = CC_16(rec->country_code);
-  }
   /* add country if it doesn't exist already */
 
   /** XXX performance? */
@@ -1203,14 +1343,10 @@ static int lookup_country(perpfx_cache_t *pfx_cache, ipmeta_record_t *rec) {
   return pfx_cache->country_idxs_cnt - 1;
 }
 
-static int lookup_continent(perpfx_cache_t *pfx_cache, ipmeta_record_t *rec) {
+static int lookup_continent(perpfx_cache_t *pfx_cache, uint16_t cont_idx) {
 
-  int cont_idx = 0x3F3F;
   int i, found;
 
-  if (rec->continent_code[0] != '\0') {
-    cont_idx = CC_16(rec->continent_code);
-  }
   /* add continent if it doesn't exist already */
   found = 0;
   for (i = 0; i < pfx_cache->continent_idxs_cnt; i++) {
@@ -1244,161 +1380,403 @@ static int lookup_continent(perpfx_cache_t *pfx_cache, ipmeta_record_t *rec) {
   return pfx_cache->continent_idxs_cnt - 1;
 }
 
-static int update_pfx_v6(bvc_t *consumer, bgpstream_pfx_t *pfx,
-                perpfx_cache_t *pfx_cache, uint64_t *iptally) {
-  uint64_t num_ips = 0;
-  uint64_t cur_address = first_pfx_addr(pfx);
-  ipmeta_record_t *rec = NULL;
+/* add the addresses of a geo run (starting at cur_address) to the cache of
+ * the given prefix */
+static int apply_geo_run(perpfx_cache_t *pfx_cache, bgpstream_pfx_t *pfx,
+                         geo_run_t *run, uint64_t cur_address)
+{
+  int ind;
   int poly_table;
 
-  /* Perform lookup */
-  ipmeta_record_set_clear(STATE->records);
-  ipmeta_lookup_pfx(STATE->ipmeta, AF_INET6,
-                  (void *)(&(pfx->address.bs_ipv6.addr.s6_addr)),
-                  pfx->mask_len, 0, STATE->records);
-
-  ipmeta_record_set_rewind(STATE->records);
-
-  while ((rec = ipmeta_record_set_next(STATE->records, &num_ips))) {
-    int ind;
-
-    ind = lookup_continent(pfx_cache, rec);
-    if (ind < 0) {
+  ind = lookup_continent(pfx_cache, run->continent_idx);
+  if (ind < 0) {
+    return -1;
+  }
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    if ((pfx_cache->continent_addr_runs[ind] =
+        update_ip_addr_run(pfx_cache->continent_addr_runs[ind],
+                           &(pfx_cache->per_continent_addr_run_cnt[ind]),
+                           cur_address, run->num_ips)) == NULL) {
       return -1;
     }
-    if ((pfx_cache->continent_addr6_pfxs[ind] =
-        update_ip6_prefix(pfx_cache->continent_addr6_pfxs[ind],
-                           cur_address, num_ips)) == NULL) {
+  } else if ((pfx_cache->continent_addr6_pfxs[ind] =
+              update_ip6_prefix(pfx_cache->continent_addr6_pfxs[ind],
+                                cur_address, run->num_ips)) == NULL) {
+    return -1;
+  }
+
+  ind = lookup_country(pfx_cache, run->country_idx);
+  if (ind < 0) {
+    return -1;
+  }
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    if ((pfx_cache->country_addr_runs[ind] =
+        update_ip_addr_run(pfx_cache->country_addr_runs[ind],
+                           &(pfx_cache->per_country_addr_run_cnt[ind]),
+                           cur_address, run->num_ips)) == NULL) {
       return -1;
     }
+  } else if ((pfx_cache->country_addr6_pfxs[ind] =
+              update_ip6_prefix(pfx_cache->country_addr6_pfxs[ind],
+                                cur_address, run->num_ips)) == NULL) {
+    return -1;
+  }
 
-    ind = lookup_country(pfx_cache, rec);
+  for (poly_table = 0; poly_table < run->poly_idxs_cnt; poly_table++) {
+    ind = lookup_polygon(pfx_cache, run->poly_idxs[poly_table], poly_table);
     if (ind < 0) {
       return -1;
     }
-    if ((pfx_cache->country_addr6_pfxs[ind] =
-        update_ip6_prefix(pfx_cache->country_addr6_pfxs[ind],
-                           cur_address, num_ips)) == NULL) {
-      return -1;
-    }
-
-    for (poly_table = 0; poly_table < rec->polygon_ids_cnt; poly_table++) {
-      ind = lookup_polygon(pfx_cache, rec, poly_table);
-      if (ind < 0) {
-        return -1;
-      }
-      if ((pfx_cache->poly_addr6_pfxs[poly_table][ind] =
-          update_ip6_prefix(pfx_cache->poly_addr6_pfxs[poly_table][ind],
-                  cur_address, num_ips)) == NULL) {
+    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      if ((pfx_cache->poly_addr_runs[poly_table][ind] =
+          update_ip_addr_run(pfx_cache->poly_addr_runs[poly_table][ind],
+                  &(pfx_cache->per_poly_addr_run_cnt[poly_table][ind]),
+                  cur_address, run->num_ips)) == NULL) {
         return -1;
       }
+    } else if ((pfx_cache->poly_addr6_pfxs[poly_table][ind] =
+                update_ip6_prefix(pfx_cache->poly_addr6_pfxs[poly_table][ind],
+                                  cur_address, run->num_ips)) == NULL) {
+      return -1;
     }
-
-    cur_address += num_ips;
-    (*iptally) += num_ips;
   }
+
   return 0;
 }
 
-static int update_pfx_v4(bvc_t *consumer, bgpstream_pfx_t *pfx,
+/* append a geo run to the cache of the given prefix, and apply it */
+static int add_geo_run(perpfx_cache_t *pfx_cache, bgpstream_pfx_t *pfx,
+                       geo_run_t *run, uint64_t cur_address)
+{
+  geo_run_t *runs;
+
+  if ((runs = realloc(pfx_cache->runs,
+                      sizeof(geo_run_t) * (pfx_cache->runs_cnt + 1))) ==
+      NULL) {
+    return -1;
+  }
+  pfx_cache->runs = runs;
+  pfx_cache->runs[pfx_cache->runs_cnt++] = *run;
+
+  return apply_geo_run(pfx_cache, pfx, run, cur_address);
+}
+
+static int update_pfx(bvc_t *consumer, bgpstream_pfx_t *pfx,
         perpfx_cache_t *pfx_cache, uint64_t *iptally) {
   uint64_t num_ips = 0;
   uint64_t cur_address = first_pfx_addr(pfx);
   ipmeta_record_t *rec = NULL;
+  geo_run_t run;
   int poly_table;
 
   /* Perform lookup */
   ipmeta_record_set_clear(STATE->records);
-  ipmeta_lookup_pfx(STATE->ipmeta, AF_INET,
-                  (void *)(&(pfx->address.bs_ipv4.addr.s_addr)),
-                  pfx->mask_len, 0, STATE->records);
+  if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+    ipmeta_lookup_pfx(STATE->ipmeta, AF_INET,
+                    (void *)(&(pfx->address.bs_ipv4.addr.s_addr)),
+                    pfx->mask_len, 0, STATE->records);
+  } else {
+    ipmeta_lookup_pfx(STATE->ipmeta, AF_INET6,
+                    (void *)(&(pfx->address.bs_ipv6.addr.s6_addr)),
+                    pfx->mask_len, 0, STATE->records);
+  }
 
   ipmeta_record_set_rewind(STATE->records);
 
   while ((rec = ipmeta_record_set_next(STATE->records, &num_ips))) {
-    int ind;
+    memset(&run, 0, sizeof(run));
+    run.continent_idx = 0x3F3F;
+    if (rec->continent_code[0] != '\0') {
+      run.continent_idx = CC_16(rec->continent_code);
+    }
+    run.country_idx = 0x3F3F;
+    if (rec->country_code[0] != '\0') {
+      run.country_idx = CC_16(rec->country_code);
+    }
+    assert(rec->polygon_ids_cnt <= METRIC_NETACQ_EDGE_POLYS_TBL_CNT);
+    run.poly_idxs_cnt = rec->polygon_ids_cnt;
+    for (poly_table = 0; poly_table < rec->polygon_ids_cnt; poly_table++) {
+      run.poly_idxs[poly_table] = rec->polygon_ids[poly_table];
+    }
+    run.num_ips = num_ips;
 
-    ind = lookup_continent(pfx_cache, rec);
-    if (ind < 0) {
+    if (add_geo_run(pfx_cache, pfx, &run, cur_address) != 0) {
       return -1;
     }
-    if ((pfx_cache->continent_addr_runs[ind] =
-        update_ip_addr_run(pfx_cache->continent_addr_runs[ind],
-                           &(pfx_cache->per_continent_addr_run_cnt[ind]),
-                           cur_address, num_ips)) == NULL) {
-      return -1;
+
+    cur_address += num_ips;
+    (*iptally) += num_ips;
+  }
+  return 0;
+}
+
+/* drop the prefixes that have not been seen for a while from the cache */
+static void expire_geocache(bvc_t *consumer, uint32_t view_time)
+{
+  khiter_t k;
+
+  for (k = kh_begin(STATE->geo_cache); k != kh_end(STATE->geo_cache); k++) {
+    if (kh_exist(STATE->geo_cache, k) &&
+        kh_val(STATE->geo_cache, k)->last_seen + GEO_CACHE_TIMEOUT <
+          view_time) {
+      destroy_pfx_cache(kh_val(STATE->geo_cache, k));
+      kh_del(pfx_geo_cache, STATE->geo_cache, k);
     }
+  }
+}
 
-    ind = lookup_country(pfx_cache, rec);
-    if (ind < 0) {
-      return -1;
+static int write_geocache(bvc_t *consumer)
+{
+  char tmpname[BUFFER_LEN];
+  iow_t *outfile = NULL;
+  perpfx_cache_t *pfx_cache;
+  bgpstream_pfx_t *pfx;
+  khiter_t k;
+  uint32_t u32;
+  uint8_t u8;
+  uint32_t i;
+  int j;
+
+  /* write to a temporary file and rename it once complete, so that a crash
+   * while writing never leaves a truncated snapshot behind */
+  if (snprintf(tmpname, BUFFER_LEN, "%s.tmp", STATE->geo_cache_file) >=
+      BUFFER_LEN) {
+    fprintf(stderr, "ERROR: Geo cache file name too long\n");
+    return -1;
+  }
+
+  if ((outfile = wandio_wcreate(
+         tmpname, wandio_detect_compression_type(STATE->geo_cache_file),
+         GEO_CACHE_COMPRESS_LEVEL, O_CREAT)) == NULL) {
+    fprintf(stderr, "ERROR: Could not open %s for writing\n", tmpname);
+    return -1;
+  }
+
+  u32 = GEO_CACHE_MAGIC;
+  WRITE_VAL(u32);
+  u32 = GEO_CACHE_VERSION;
+  WRITE_VAL(u32);
+  /* the snapshot is only valid for the same geolocation database */
+  WRITE_VAL(STATE->geo_db_id);
+  u32 = kh_size(STATE->geo_cache);
+  WRITE_VAL(u32);
+
+  for (k = kh_begin(STATE->geo_cache); k != kh_end(STATE->geo_cache); k++) {
+    if (!kh_exist(STATE->geo_cache, k)) {
+      continue;
     }
-    if ((pfx_cache->country_addr_runs[ind] =
-        update_ip_addr_run(pfx_cache->country_addr_runs[ind],
-                           &(pfx_cache->per_country_addr_run_cnt[ind]),
-                           cur_address, num_ips)) == NULL) {
-      return -1;
+    pfx = &kh_key(STATE->geo_cache, k);
+    pfx_cache = kh_val(STATE->geo_cache, k);
+
+    u8 = pfx->address.version;
+    WRITE_VAL(u8);
+    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
+      WRITE_VAL(pfx->address.bs_ipv4.addr.s_addr);
+    } else {
+      WRITE_VAL(pfx->address.bs_ipv6.addr.s6_addr);
     }
+    WRITE_VAL(pfx->mask_len);
+    WRITE_VAL(pfx_cache->last_seen);
+
+    WRITE_VAL(pfx_cache->runs_cnt);
+    for (i = 0; i < pfx_cache->runs_cnt; i++) {
+      WRITE_VAL(pfx_cache->runs[i].continent_idx);
+      WRITE_VAL(pfx_cache->runs[i].country_idx);
+      WRITE_VAL(pfx_cache->runs[i].poly_idxs_cnt);
+      for (j = 0; j < pfx_cache->runs[i].poly_idxs_cnt; j++) {
+        WRITE_VAL(pfx_cache->runs[i].poly_idxs[j]);
+      }
+      WRITE_VAL(pfx_cache->runs[i].num_ips);
+    }
+  }
 
-    for (poly_table = 0; poly_table < rec->polygon_ids_cnt; poly_table++) {
-      ind = lookup_polygon(pfx_cache, rec, poly_table);
-      if (ind < 0) {
-        return -1;
+  u32 = GEO_CACHE_END_MAGIC;
+  WRITE_VAL(u32);
+
+  wandio_wdestroy(outfile);
+  outfile = NULL;
+
+  if (rename(tmpname, STATE->geo_cache_file) != 0) {
+    fprintf(stderr, "ERROR: Could not rename %s to %s\n", tmpname,
+            STATE->geo_cache_file);
+    return -1;
+  }
+
+  fprintf(stderr, "INFO: Wrote %" PRIu32 " prefixes to geo cache %s\n",
+          kh_size(STATE->geo_cache), STATE->geo_cache_file);
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not write geo cache to %s\n", tmpname);
+  wandio_wdestroy(outfile);
+  remove(tmpname);
+  return -1;
+}
+
+/* a snapshot that cannot be used (missing, built from another database,
+ * corrupt or truncated) is discarded: the cache is then built from scratch */
+static void read_geocache(bvc_t *consumer)
+{
+  io_t *infile = NULL;
+  perpfx_cache_t *pfx_cache = NULL;
+  bgpstream_pfx_t pfx;
+  uint64_t db_id;
+  uint64_t cur_address;
+  geo_run_t run;
+  khiter_t k;
+  int khret;
+  uint32_t pfx_cnt;
+  uint32_t runs_cnt;
+  uint32_t u32;
+  uint8_t u8;
+  uint32_t i, r;
+  int j;
+
+  if ((infile = wandio_create(STATE->geo_cache_file)) == NULL) {
+    fprintf(stderr, "INFO: No geo cache found at %s\n", STATE->geo_cache_file);
+    return;
+  }
+
+  READ_VAL(u32);
+  if (u32 != GEO_CACHE_MAGIC) {
+    fprintf(stderr, "ERROR: %s is not a geo cache\n", STATE->geo_cache_file);
+    goto err;
+  }
+  READ_VAL(u32);
+  if (u32 != GEO_CACHE_VERSION) {
+    fprintf(stderr, "ERROR: Unsupported geo cache version %" PRIu32 "\n",
+            u32);
+    goto err;
+  }
+  READ_VAL(db_id);
+  if (db_id != STATE->geo_db_id) {
+    fprintf(stderr,
+            "INFO: Ignoring geo cache %s built from a different geolocation "
+            "database\n",
+            STATE->geo_cache_file);
+    wandio_destroy(infile);
+    return;
+  }
+  READ_VAL(pfx_cnt);
+
+  for (i = 0; i < pfx_cnt; i++) {
+    memset(&pfx, 0, sizeof(pfx));
+    READ_VAL(u8);
+    if (u8 == BGPSTREAM_ADDR_VERSION_IPV4) {
+      pfx.address.version = BGPSTREAM_ADDR_VERSION_IPV4;
+      READ_VAL(pfx.address.bs_ipv4.addr.s_addr);
+    } else if (u8 == BGPSTREAM_ADDR_VERSION_IPV6) {
+      pfx.address.version = BGPSTREAM_ADDR_VERSION_IPV6;
+      READ_VAL(pfx.address.bs_ipv6.addr.s6_addr);
+    } else {
+      fprintf(stderr, "ERROR: Invalid IP version in geo cache (%d)\n", u8);
+      goto err;
+    }
+    READ_VAL(pfx.mask_len);
+
+    if ((pfx_cache = malloc_zero(sizeof(perpfx_cache_t))) == NULL) {
+      goto err;
+    }
+    READ_VAL(pfx_cache->last_seen);
+
+    /* rebuild the cache entry from its geo runs */
+    cur_address = first_pfx_addr(&pfx);
+    READ_VAL(runs_cnt);
+    for (r = 0; r < runs_cnt; r++) {
+      memset(&run, 0, sizeof(run));
+      READ_VAL(run.continent_idx);
+      READ_VAL(run.country_idx);
+      READ_VAL(run.poly_idxs_cnt);
+      if (run.poly_idxs_cnt > STATE->polygons_tbl_cnt) {
+        fprintf(stderr, "ERROR: Invalid polygon count in geo cache\n");
+        goto err;
       }
-      if ((pfx_cache->poly_addr_runs[poly_table][ind] =
-          update_ip_addr_run(pfx_cache->poly_addr_runs[poly_table][ind],
-                  &(pfx_cache->per_poly_addr_run_cnt[poly_table][ind]),
-                  cur_address, num_ips)) == NULL) {
-        return -1;
+      for (j = 0; j < run.poly_idxs_cnt; j++) {
+        READ_VAL(run.poly_idxs[j]);
       }
+      READ_VAL(run.num_ips);
+      if (add_geo_run(pfx_cache, &pfx, &run, cur_address) != 0) {
+        goto err;
+      }
+      cur_address += run.num_ips;
     }
 
-    cur_address += num_ips;
-    (*iptally) += num_ips;
+    k = kh_put(pfx_geo_cache, STATE->geo_cache, pfx, &khret);
+    if (khret < 0) {
+      goto err;
+    }
+    if (khret == 0) {
+      destroy_pfx_cache(kh_val(STATE->geo_cache, k));
+    }
+    kh_val(STATE->geo_cache, k) = pfx_cache;
+    pfx_cache = NULL;
   }
-  return 0;
+
+  READ_VAL(u32);
+  if (u32 != GEO_CACHE_END_MAGIC) {
+    fprintf(stderr, "ERROR: Geo cache %s is truncated\n",
+            STATE->geo_cache_file);
+    goto err;
+  }
+
+  wandio_destroy(infile);
+  fprintf(stderr, "INFO: Loaded %" PRIu32 " prefixes from geo cache %s\n",
+          kh_size(STATE->geo_cache), STATE->geo_cache_file);
+  return;
+
+err:
+  fprintf(stderr, "WARN: Discarding unusable geo cache %s\n",
+          STATE->geo_cache_file);
+  if (pfx_cache != NULL) {
+    destroy_pfx_cache(pfx_cache);
+  }
+  wandio_destroy(infile);
+  clear_geocache(consumer);
 }
 
-static int update_pfx_geo_information(bvc_t *consumer, bgpview_iter_t *it)
+static int update_pfx_geo_information(bvc_t *consumer, bgpview_iter_t *it,
+                                      uint32_t view_time)
 {
   bgpstream_pfx_t *pfx = bgpview_iter_pfx_get_pfx(it);
-  perpfx_cache_t *pfx_cache = (perpfx_cache_t *)bgpview_iter_pfx_get_user(it);
+  perpfx_cache_t *pfx_cache = NULL;
+  khiter_t k;
+  int khret;
 
   uint64_t num_ips = 0;
-  uint64_t cur_address = first_pfx_addr(pfx);
-  ipmeta_record_t *rec = NULL;
 
   int i;
-  uint16_t cont_idx = 0x3F3F;
-  uint16_t country_idx = 0x3F3F;
-  int found;
-  int rec_c = 0;
-
   int poly_table;
 
-  /* if the user pointer (cache) does not exist, then do the lookup now */
-  if (pfx_cache == NULL) {
+  /* Skip any non-v4 and non-v6 prefixes */
+  if (pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV4 &&
+      pfx->address.version != BGPSTREAM_ADDR_VERSION_IPV6) {
+    return 0;
+  }
+
+  /* if the prefix is not in the cache, then do the lookup now */
+  if ((k = kh_get(pfx_geo_cache, STATE->geo_cache, *pfx)) ==
+      kh_end(STATE->geo_cache)) {
     if ((pfx_cache = malloc_zero(sizeof(perpfx_cache_t))) == NULL) {
       fprintf(stderr, "Error: cannot create per-pfx cache\n");
       return -1;
     }
 
-    if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV4) {
-      if (update_pfx_v4(consumer, pfx, pfx_cache, &num_ips) < 0) {
-        return -1;
-      }
-    } else if (pfx->address.version == BGPSTREAM_ADDR_VERSION_IPV6) {
-      if (update_pfx_v6(consumer, pfx, pfx_cache, &num_ips) < 0) {
-        return -1;
-      }
-    } else {
-      /* Skip any non-v4 and non-v6 prefixes */
-      return 0;
+    if (update_pfx(consumer, pfx, pfx_cache, &num_ips) < 0) {
+      destroy_pfx_cache(pfx_cache);
+      return -1;
     }
 
-    /* link the cache to the appropriate user ptr */
-    bgpview_iter_pfx_set_user(it, pfx_cache);
+    /* add the prefix to the cache */
+    k = kh_put(pfx_geo_cache, STATE->geo_cache, *pfx, &khret);
+    if (khret < 0) {
+      destroy_pfx_cache(pfx_cache);
+      return -1;
+    }
+    kh_val(STATE->geo_cache, k) = pfx_cache;
+  } else {
+    pfx_cache = kh_val(STATE->geo_cache, k);
   }
+  pfx_cache->last_seen = view_time;
 
   /* Ensure that the sum of NetAcuity block lengths is identical to the number
    * of addresses in the given prefix.  This is a crucial assumption for our
@@ -1482,7 +1860,6 @@ static int update_pfx_geo_information(bvc_t *consumer, bgpview_iter_t *it)
 static int compute_geo_pfx_visibility(bvc_t *consumer, bgpview_iter_t *it)
 {
   bgpstream_pfx_t *pfx;
-  bgpstream_peer_sig_t *sg;
 
   /* for each prefix in the view */
   for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE); //
@@ -1497,39 +1874,16 @@ static int compute_geo_pfx_visibility(bvc_t *consumer, bgpview_iter_t *it)
       continue;
     }
 
-    /* reset information for the current prefix */
-    bgpstream_id_set_clear(STATE->ff_asns);
-    STATE->valid_origins = 0;
-
-    /* iterate over the peers for the current pfx and get the number of unique
-     * full feed AS numbers observing this prefix as well as the unique set of
-     * origin ASes */
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE); //
-         bgpview_iter_pfx_has_more_peer(it);                    //
-         bgpview_iter_pfx_next_peer(it)) {
-
-      /* only consider peers that are full-feed (checking if peer id is a full
-       * feed for the current pfx IP version) */
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)
-              ->full_feed_peer_ids[bgpstream_ipv2idx(pfx->address.version)],
-            bgpview_iter_peer_get_peer_id(it)) == 0) {
-        continue;
-      }
-
-      /* get peer signature */
-      sg = bgpview_iter_peer_get_sig(it);
-      assert(sg != NULL);
-
-      /* Add peer AS number to set of full feed peers observing the prefix */
-      bgpstream_id_set_insert(STATE->ff_asns, sg->peer_asnumber);
+    /* the number of unique full feed AS numbers observing this prefix as
+     * well as the unique set of origin ASes have been computed by the
+     * visibility consumer */
+    STATE->pfx_summary =
+      bvc_pfx_summary_table_get(CHAIN_STATE->pfx_summaries, pfx);
 
-      /* Add origin AS number to the array of origin ASNs for the prefix */
-      add_origin(STATE, bgpview_iter_pfx_peer_get_origin_seg(it));
-    }
-
-    if (STATE->valid_origins > 0 &&
-        update_pfx_geo_information(consumer, it) != 0) {
+    if (STATE->pfx_summary != NULL && STATE->pfx_summary->origins_cnt > 0 &&
+        update_pfx_geo_information(consumer, it,
+                                   bgpview_get_time(bgpview_iter_get_view(it)))
+          != 0) {
       return -1;
     }
   }
@@ -1665,11 +2019,6 @@ int bvc_pergeovisibility_init(bvc_t *consumer, int argc, char **argv)
 
   /* init and set defaults */
 
-  if ((state->ff_asns = bgpstream_id_set_create()) == NULL) {
-    fprintf(stderr, "Error: Could not create full feed origin ASNs set\n");
-    goto err;
-  }
-
   if (init_kp(consumer) != 0) {
     fprintf(stderr, "ERROR: Could not initialize timeseries KP\n");
     goto err;
@@ -1693,6 +2042,16 @@ int bvc_pergeovisibility_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
+  if ((STATE->geo_cache = kh_init(pfx_geo_cache)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create geo cache\n");
+    goto err;
+  }
+
+  /* warm up the geo cache from the previous run */
+  if (STATE->geo_cache_file != NULL) {
+    read_geocache(consumer);
+  }
+
   /* get full feed peer ids from Visibility */
   if (BVC_GET_CHAIN_STATE(consumer)->visibility_computed == 0) {
     fprintf(stderr,
@@ -1701,6 +2060,10 @@ int bvc_pergeovisibility_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
+  /* ask Visibility to also summarize the full feed observations of each
+     prefix */
+  CHAIN_STATE->pfx_summaries_wanted = 1;
+
   return 0;
 
 err:
@@ -1714,6 +2077,18 @@ void bvc_pergeovisibility_destroy(bvc_t *consumer)
     return;
   }
 
+  if (STATE->geo_cache != NULL) {
+    if (STATE->geo_cache_file != NULL && STATE->provider_config != NULL &&
+        kh_size(STATE->geo_cache) > 0) {
+      write_geocache(consumer);
+    }
+    clear_geocache(consumer);
+    kh_destroy(pfx_geo_cache, STATE->geo_cache);
+    STATE->geo_cache = NULL;
+  }
+  free(STATE->geo_cache_file);
+  STATE->geo_cache_file = NULL;
+
   destroy_ipmeta(consumer);
 
   free(STATE->provider_config);
@@ -1721,11 +2096,6 @@ void bvc_pergeovisibility_destroy(bvc_t *consumer)
   STATE->provider_name = NULL;
   STATE->provider_arg = NULL;
 
-  if (STATE->ff_asns != NULL) {
-    bgpstream_id_set_destroy(STATE->ff_asns);
-    STATE->ff_asns = NULL;
-  }
-
   timeseries_kp_free(&STATE->kp);
 
   free(STATE);
@@ -1740,9 +2110,6 @@ int bvc_pergeovisibility_process_view(bvc_t *consumer, bgpview_t *view)
   uint32_t processed_delay;
   uint32_t processing_time;
 
-  /* set the pfx user pointer destructor function */
-  bgpview_set_pfx_user_destructor(view, destroy_pfx_user_ptr);
-
   if (STATE->last_reload == 0) {
     STATE->last_reload = bgpview_get_time(view);
   }
@@ -1753,7 +2120,7 @@ int bvc_pergeovisibility_process_view(bvc_t *consumer, bgpview_t *view)
     fprintf(stderr, "INFO: reloading libipmeta (after %"PRIu32" seconds)\n",
             (bgpview_get_time(view) - STATE->last_reload));
     /* clear our cache */
-    clear_geocache(consumer, view);
+    clear_geocache(consumer);
 
     /* shut down our existing ipmeta instance */
     destroy_ipmeta(consumer);
@@ -1804,6 +2171,15 @@ int bvc_pergeovisibility_process_view(bvc_t *consumer, bgpview_t *view)
     return -1;
   }
 
+  /* forget the prefixes that have not been seen for a while */
+  if (STATE->geo_cache_last_check == 0) {
+    STATE->geo_cache_last_check = bgpview_get_time(view);
+  } else if (bgpview_get_time(view) >=
+             STATE->geo_cache_last_check + GEO_CACHE_TIMEOUT) {
+    expire_geocache(consumer, bgpview_get_time(view));
+    STATE->geo_cache_last_check = bgpview_get_time(view);
+  }
+
   /* destroy the view iterator */
   bgpview_iter_destroy(it);
 
@@ -1822,7 +2198,8 @@ int bvc_pergeovisibility_process_view(bvc_t *consumer, bgpview_t *view)
   timeseries_kp_set(STATE->kp, STATE->processing_time_idx, processing_time);
 
   /* now flush the KP */
-  if (timeseries_kp_flush(STATE->kp, bgpview_get_time(view)) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, bgpview_get_time(view)) !=
+      0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
@@ -58,15 +58,14 @@ typedef uint16_t viewcnt_t;
 #define MAX_VIEW_CNT UINT16_MAX
 
 typedef struct peerviews {
+  bgpstream_peer_id_t peer_id;
   viewcnt_t full_cnt;    // count of views in which pfx-origin was seen by this
                          // peer and this peer was considered full-feed
   viewcnt_t partial_cnt; // count of views in which pfx-origin was seen by this
                          // peer and this peer was considered partial-feed
 } peerviews_t;
 
-KHASH_INIT(map_peerid_viewcnt, bgpstream_peer_id_t, peerviews_t, 1,
-           kh_int_hash_func, kh_int_hash_equal)
-typedef khash_t(map_peerid_viewcnt) map_peerid_viewcnt_t;
+#define PEERVIEWS_ALLOC_MIN 4
 
 typedef struct origin_info {
   bgpstream_as_path_store_path_id_t pathid; // id of path containing the origin
@@ -74,8 +73,11 @@ typedef struct origin_info {
                                         // feed peer observed this pfx-origin
   viewcnt_t partial_feed_peer_view_cnt; // count of views in which any partial-
                                         // feed peer observed this pfx-origin
-  map_peerid_viewcnt_t *peers;          // peers that observed this pfx-origin,
-                                        // and in how many views
+  uint16_t peer_cnt;                    // number of used entries in peers
+  uint16_t peer_alloc_cnt;              // number of allocated entries in peers
+  peerviews_t *peers;                   // peers that observed this pfx-origin,
+                                        // and in how many views (sorted by
+                                        // peer_id)
 } origin_info_t;
 
 typedef struct pfx_info {
@@ -119,7 +121,7 @@ typedef struct bvc_pfx2as_state {
   char outfile_name[BVCU_PATH_MAX];
 
   /** prefix origins output file */
-  iow_t *outfile;
+  bvcu_outfile_t *outfile;
 
   /** output interval */
   uint32_t out_interval;
@@ -189,7 +191,7 @@ static int open_outfiles(bvc_t *consumer, int version, uint32_t vtime)
   char version_str[6] = "";
   if (version != 0)
     sprintf(version_str, ".v%d", bgpstream_ipv2number(version));
-  if (!(STATE->outfile = bvcu_open_outfile(STATE->outfile_name,
+  if (!(STATE->outfile = bvcu_outfile_open(STATE->outfile_name,
         "%s/" NAME "%s.%" PRIu32 ".gz", STATE->outdir, version_str, vtime)))
     return -1;
 
@@ -198,8 +200,11 @@ static int open_outfiles(bvc_t *consumer, int version, uint32_t vtime)
 
 static int close_outfiles(bvc_t *consumer)
 {
-  wandio_wdestroy(STATE->outfile);
+  int rc = bvcu_outfile_close(STATE->outfile);
   STATE->outfile = NULL;
+  if (rc != 0) {
+    return -1;
+  }
   bvcu_create_donefile(STATE->outfile_name);
 
   return 0;
@@ -237,13 +242,54 @@ static void pfxinfo_destroy(pfx_info_t *pfxinfo)
 {
   if (!pfxinfo) return;
   for (uint32_t oi = 0; oi < pfxinfo->origin_alloc_cnt; ++oi) {
-    if (pfxinfo->origins[oi].peers) {
-      kh_destroy(map_peerid_viewcnt, pfxinfo->origins[oi].peers);
-    }
+    free(pfxinfo->origins[oi].peers);
   }
   free(pfxinfo);
 }
 
+// Find the entry for peer_id in originfo's peer array, inserting a zeroed
+// entry (in peer_id order) if there is none.  Returns NULL if out of memory
+// or if the (16-bit) peer count is already at its maximum.
+static peerviews_t *originfo_get_peer(origin_info_t *originfo,
+    bgpstream_peer_id_t peer_id)
+{
+  int lo = 0, hi = originfo->peer_cnt;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (originfo->peers[mid].peer_id == peer_id)
+      return &originfo->peers[mid];
+    if (originfo->peers[mid].peer_id < peer_id)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (originfo->peer_cnt == UINT16_MAX)
+    return NULL;
+
+  if (originfo->peer_cnt == originfo->peer_alloc_cnt) {
+    uint32_t alloc_cnt = originfo->peer_alloc_cnt == 0 ? PEERVIEWS_ALLOC_MIN :
+      originfo->peer_alloc_cnt * 2;
+    if (alloc_cnt > UINT16_MAX)
+      alloc_cnt = UINT16_MAX;
+    peerviews_t *peers =
+      realloc(originfo->peers, alloc_cnt * sizeof(peerviews_t));
+    if (!peers)
+      return NULL;
+    originfo->peers = peers;
+    originfo->peer_alloc_cnt = alloc_cnt;
+  }
+
+  memmove(&originfo->peers[lo + 1], &originfo->peers[lo],
+      (originfo->peer_cnt - lo) * sizeof(peerviews_t));
+  originfo->peer_cnt++;
+  originfo->peers[lo].peer_id = peer_id;
+  originfo->peers[lo].full_cnt = 0;
+  originfo->peers[lo].partial_cnt = 0;
+  return &originfo->peers[lo];
+}
+
 static void prep_results(bvc_t *consumer, int version, uint32_t view_interval)
 {
   FOR_EACH_PFX(STATE, version) {
@@ -258,12 +304,11 @@ static void prep_results(bvc_t *consumer, int version, uint32_t view_interval)
       origin_info_t *originfo = &pfxinfo->origins[oi];
 
       // for each peer in origin
-      for (uint32_t mi = 0; mi != kh_end(originfo->peers); ++mi) {
-        if (!kh_exist(originfo->peers, mi)) continue;
-        if (kh_val(originfo->peers, mi).full_cnt > 0 ||
-            kh_val(originfo->peers, mi).partial_cnt > 0) {
+      for (uint32_t mi = 0; mi < originfo->peer_cnt; ++mi) {
+        if (originfo->peers[mi].full_cnt > 0 ||
+            originfo->peers[mi].partial_cnt > 0) {
           int khret;
-          bgpstream_peer_id_t peer_id = kh_key(originfo->peers, mi);
+          bgpstream_peer_id_t peer_id = originfo->peers[mi].peer_id;
           khint_t k = kh_put(map_peerid_pfxcnt, STATE->peers, peer_id, &khret);
           // if peer has not yet counted this pfx, do so now
           if (khret > 0) {
@@ -287,11 +332,10 @@ typedef struct peer_cnts {
 static peer_cnts_t count_peer_types(origin_info_t *originfo)
 {
   peer_cnts_t peercnts = {0, 0};
-  for (uint32_t mi = 0; mi != kh_end(originfo->peers); ++mi) {
-    if (!kh_exist(originfo->peers, mi)) continue;
-    if (kh_val(originfo->peers, mi).full_cnt > 0)
+  for (uint32_t mi = 0; mi < originfo->peer_cnt; ++mi) {
+    if (originfo->peers[mi].full_cnt > 0)
       peercnts.full_cnt++;
-    if (kh_val(originfo->peers, mi).partial_cnt > 0)
+    if (originfo->peers[mi].partial_cnt > 0)
       peercnts.partial_cnt++;
   }
   return peercnts;
@@ -305,13 +349,13 @@ static void dump_results_json(bvc_t *consumer, int version,
 // depends on `indent` being in scope
 #define DUMP_LINE(delim, ...) \
   do {                                                                         \
-    wandio_printf(STATE->outfile, "%s\n%*s", delim, indent, "");               \
-    wandio_printf(STATE->outfile, __VA_ARGS__);                                \
+    bvcu_outfile_printf(STATE->outfile, "%s\n%*s", delim, indent, "");         \
+    bvcu_outfile_printf(STATE->outfile, __VA_ARGS__);                          \
   } while (0)
 
   // Dump dataset metadata
 
-  wandio_printf(STATE->outfile, "dataset: {");
+  bvcu_outfile_printf(STATE->outfile, "dataset: {");
   indent += 2;
 
   DUMP_LINE("", "start: %d", STATE->out_interval_start);
@@ -402,13 +446,11 @@ static void dump_results_json(bvc_t *consumer, int version,
         DUMP_LINE(",", "monitors: [");
         indent += 2;
         const char *pfxmon_delim = "";
-        for (uint32_t mi = 0; mi != kh_end(originfo->peers); ++mi) {
-          if (!kh_exist(originfo->peers, mi)) continue;
+        for (uint32_t mi = 0; mi < originfo->peer_cnt; ++mi) {
           uint32_t duration = view_interval *
-            (kh_val(originfo->peers, mi).full_cnt +
-             kh_val(originfo->peers, mi).partial_cnt);
+            (originfo->peers[mi].full_cnt + originfo->peers[mi].partial_cnt);
           DUMP_LINE(pfxmon_delim, "{ monitor:%"PRIu16", duration:%"PRIu32" }",
-              kh_key(originfo->peers, mi), duration);
+              originfo->peers[mi].peer_id, duration);
           pfxmon_delim = ",";
         }
         indent -= 2;
@@ -427,16 +469,17 @@ static void dump_results_dsv(bvc_t *consumer, int version,
     uint32_t view_interval)
 {
   // Header
-  wandio_printf(STATE->outfile,
+  bvcu_outfile_printf(STATE->outfile,
       "# D|<start>|<duration>|<monitor_cnt>|<pfx_cnt>\n");
   if (!STATE->peer_count_only) {
-    wandio_printf(STATE->outfile,
+    bvcu_outfile_printf(STATE->outfile,
         "# M|<monitor_idx>|<collector>|<address>|<pfx_cnt>|<asn>\n");
   }
-  wandio_printf(STATE->outfile, "# P|<pfx>|<asn>|<full_cnt>|<partial_cnt>|"
+  bvcu_outfile_printf(STATE->outfile,
+      "# P|<pfx>|<asn>|<full_cnt>|<partial_cnt>|"
       "<full_duration>|<partial_duration>\n");
   if (!STATE->peer_count_only) {
-    wandio_printf(STATE->outfile, "# p|"
+    bvcu_outfile_printf(STATE->outfile, "# p|"
 #ifdef REPEAT_PFX_ORIGIN
         "<pfx>|<asn>|"
 #endif
@@ -449,7 +492,7 @@ static void dump_results_dsv(bvc_t *consumer, int version,
       version == BGPSTREAM_ADDR_VERSION_IPV4 ? STATE->v4pfx_cnt :
       version == BGPSTREAM_ADDR_VERSION_IPV6 ? STATE->v6pfx_cnt :
       STATE->v4pfx_cnt + STATE->v6pfx_cnt;
-  wandio_printf(STATE->outfile, "D|%d|%d|%d|%"PRIu32"\n",
+  bvcu_outfile_printf(STATE->outfile, "D|%d|%d|%d|%"PRIu32"\n",
       STATE->out_interval_start,
       STATE->view_cnt * view_interval,
       kh_size(STATE->peers),
@@ -467,7 +510,8 @@ static void dump_results_dsv(bvc_t *consumer, int version,
       bgpstream_peer_sig_t *ps =
         bgpstream_peer_sig_map_get_sig(STATE->peersigs, peer_id);
       bgpstream_addr_ntop(addr_str, sizeof(addr_str), &ps->peer_ip_addr);
-      wandio_printf(STATE->outfile, "M|%d|%s|%s|%"PRIu32"|%"PRIu32"\n",
+      bvcu_outfile_printf(STATE->outfile,
+          "M|%d|%s|%s|%"PRIu32"|%"PRIu32"\n",
           peer_id,
           ps->collector_str,
           addr_str,
@@ -478,8 +522,10 @@ static void dump_results_dsv(bvc_t *consumer, int version,
 
   // Dump prefixes
   FOR_EACH_PFX(STATE, version) {
+#ifdef REPEAT_PFX_ORIGIN
     char pfx_str[INET6_ADDRSTRLEN + 4];
     bgpstream_pfx_snprintf(pfx_str, sizeof(pfx_str), pfx);
+#endif
 
     // dump {pfx,origin} => ...
     for (uint32_t oi = 0; oi < pfxinfo->origin_cnt; ++oi) {
@@ -493,33 +539,38 @@ static void dump_results_dsv(bvc_t *consumer, int version,
 
       peer_cnts_t peercnts = count_peer_types(originfo);
 
-      wandio_printf(STATE->outfile, "P|%s|%s|%d|%d|%d|%d\n",
-          pfx_str,
-          orig_str,
-          peercnts.full_cnt,
-          peercnts.partial_cnt,
-          originfo->full_feed_peer_view_cnt * view_interval,
+      // P|<pfx>|<asn>|<full_cnt>|<partial_cnt>|<full_dur>|<partial_dur>
+      bvcu_outfile_puts(STATE->outfile, "P|");
+      bvcu_outfile_put_pfx(STATE->outfile, pfx);
+      bvcu_outfile_putc(STATE->outfile, '|');
+      bvcu_outfile_puts(STATE->outfile, orig_str);
+      bvcu_outfile_putc(STATE->outfile, '|');
+      bvcu_outfile_put_u32(STATE->outfile, peercnts.full_cnt);
+      bvcu_outfile_putc(STATE->outfile, '|');
+      bvcu_outfile_put_u32(STATE->outfile, peercnts.partial_cnt);
+      bvcu_outfile_putc(STATE->outfile, '|');
+      bvcu_outfile_put_u32(STATE->outfile,
+          originfo->full_feed_peer_view_cnt * view_interval);
+      bvcu_outfile_putc(STATE->outfile, '|');
+      bvcu_outfile_put_u32(STATE->outfile,
           originfo->partial_feed_peer_view_cnt * view_interval);
+      bvcu_outfile_putc(STATE->outfile, '\n');
 
       // list of {monitor_idx, duration}
       if (!STATE->peer_count_only) {
-        for (uint32_t mi = 0; mi != kh_end(originfo->peers); ++mi) {
-          if (!kh_exist(originfo->peers, mi)) continue;
+        for (uint32_t mi = 0; mi < originfo->peer_cnt; ++mi) {
           uint32_t duration = view_interval *
-            (kh_val(originfo->peers, mi).full_cnt +
-             kh_val(originfo->peers, mi).partial_cnt);
+            (originfo->peers[mi].full_cnt + originfo->peers[mi].partial_cnt);
 
-          wandio_printf(STATE->outfile, "p|"
 #ifdef REPEAT_PFX_ORIGIN
-              "%s|%s|"
+          bvcu_outfile_printf(STATE->outfile, "p|%s|%s|", pfx_str, orig_str);
+#else
+          bvcu_outfile_puts(STATE->outfile, "p|");
 #endif
-              "%"PRIu16"|%"PRIu32"\n",
-#ifdef REPEAT_PFX_ORIGIN
-              pfx_str,
-              orig_str,
-#endif
-              kh_key(originfo->peers, mi),
-              duration);
+          bvcu_outfile_put_u32(STATE->outfile, originfo->peers[mi].peer_id);
+          bvcu_outfile_putc(STATE->outfile, '|');
+          bvcu_outfile_put_u32(STATE->outfile, duration);
+          bvcu_outfile_putc(STATE->outfile, '\n');
         }
       }
     }
@@ -638,12 +689,11 @@ static void dump_stats(bvc_t *consumer, pfx2as_stats_t *stats)
         bgpstream_as_path_seg_snprintf(orig_str, sizeof(orig_str),
           path_get_origin_seg(STATE->pathstore, pfxinfo->origins[i].pathid));
         printf(" origin %s:", orig_str);
-        for (khint_t mi = 0; mi != kh_end(pfxinfo->origins[i].peers); ++mi) {
-          if (!kh_exist(pfxinfo->origins[i].peers, mi)) continue;
+        for (uint32_t mi = 0; mi < pfxinfo->origins[i].peer_cnt; ++mi) {
           printf(" %d %d+%d;",
-            kh_key(pfxinfo->origins[i].peers, mi), // peer_id
-            kh_val(pfxinfo->origins[i].peers, mi).full_cnt,
-            kh_val(pfxinfo->origins[i].peers, mi).partial_cnt);
+            pfxinfo->origins[i].peers[mi].peer_id,
+            pfxinfo->origins[i].peers[mi].full_cnt,
+            pfxinfo->origins[i].peers[mi].partial_cnt);
         }
       }
       printf("\n");
@@ -748,20 +798,17 @@ int bvc_pfx2as_process_view(bvc_t *consumer, bgpview_t *view)
 
     memset(originflags, 0, sizeof(originflags[0]) * origin_cnt);
 
-    char pfx_str[INET6_ADDRSTRLEN + 4];
-    bgpstream_pfx_snprintf(pfx_str, sizeof(pfx_str), pfx);
-
     // for each peer in pfx
     for (bgpview_iter_pfx_first_peer(vit, BGPVIEW_FIELD_ACTIVE);
         bgpview_iter_pfx_has_more_peer(vit); bgpview_iter_pfx_next_peer(vit)) {
-      khint_t mi; // peer (monitor) index
+      peerviews_t *peerviews;
 
       bgpstream_peer_id_t peer_id = bgpview_iter_peer_get_peer_id(vit);
       bgpstream_as_path_store_path_id_t path_id =
         bgpview_iter_pfx_peer_get_as_path_store_path_id(vit);
       bgpstream_as_path_seg_t *origin = NULL;
-      int is_full =
-        bgpstream_id_set_exists(CHAIN_STATE->full_feed_peer_ids[vidx], peer_id);
+      int is_full = BGPVIEW_PEER_BITMAP_EXISTS(
+        &CHAIN_STATE->full_feed_peer_bitmap[vidx], peer_id);
 
       // Most prefixes have one origin, so a linear search is efficient
       int oi; // origin index
@@ -786,11 +833,13 @@ int bvc_pfx2as_process_view(bvc_t *consumer, bgpview_t *view)
           pfxinfo = malloc(pfxinfo_size(origin_cnt));
           pfxinfo->origin_alloc_cnt = origin_cnt;
           pfxinfo->origins[oi].peers = NULL;
+          pfxinfo->origins[oi].peer_alloc_cnt = 0;
         } else if (origin_cnt > pfxinfo->origin_alloc_cnt) {
           // Add a new origin slot to an existing pfxinfo
           pfxinfo = realloc(pfxinfo, pfxinfo_size(origin_cnt));
           pfxinfo->origin_alloc_cnt = origin_cnt;
           pfxinfo->origins[oi].peers = NULL;
+          pfxinfo->origins[oi].peer_alloc_cnt = 0;
 #ifdef PFX2AS_STATS
           stats.grow_cnt++;
         } else if (origin_cnt == 1) {
@@ -810,28 +859,24 @@ int bvc_pfx2as_process_view(bvc_t *consumer, bgpview_t *view)
         pfxinfo->origins[oi].pathid = path_id;
         pfxinfo->origins[oi].full_feed_peer_view_cnt = 0;
         pfxinfo->origins[oi].partial_feed_peer_view_cnt = 0;
-        if (pfxinfo->origins[oi].peers) {
-          kh_clear(map_peerid_viewcnt, pfxinfo->origins[oi].peers);
-        } else {
-          pfxinfo->origins[oi].peers = kh_init(map_peerid_viewcnt);
-        }
+        // keep any peer array from a previous interval for reuse
+        pfxinfo->origins[oi].peer_cnt = 0;
         memset(&originflags[oi], 0, sizeof(originflags[oi]));
       }
 
       // count pfx-origin-peer and pfx-origin peertype
-      mi = kh_put(map_peerid_viewcnt, pfxinfo->origins[oi].peers, peer_id,
-        &khret);
-      if (khret > 0) { // new entry?
-        memset(&kh_val(pfxinfo->origins[oi].peers, mi), 0, sizeof(peerviews_t));
+      if (!(peerviews = originfo_get_peer(&pfxinfo->origins[oi], peer_id))) {
+        fprintf(stderr, "ERROR: " NAME ": could not add peer counts\n");
+        goto err;
       }
       if (is_full) {
-        kh_val(pfxinfo->origins[oi].peers, mi).full_cnt++;
+        peerviews->full_cnt++;
         if (!originflags[oi].counted_as_full) {
           pfxinfo->origins[oi].full_feed_peer_view_cnt++;
           originflags[oi].counted_as_full = 1;
         }
       } else {
-        kh_val(pfxinfo->origins[oi].peers, mi).partial_cnt++;
+        peerviews->partial_cnt++;
         if (!originflags[oi].counted_as_partial) {
           pfxinfo->origins[oi].partial_feed_peer_view_cnt++;
           originflags[oi].counted_as_partial = 1;
@@ -959,7 +1004,7 @@ int bvc_pfx2as_init(bvc_t *consumer, int argc, char **argv)
   if (open_outfiles(consumer, 0, 0) != 0) {
     goto err;
   }
-  wandio_wdestroy(STATE->outfile);
+  bvcu_outfile_close(STATE->outfile);
   STATE->outfile = NULL;
   remove(STATE->outfile_name);
 
@@ -981,7 +1026,7 @@ void bvc_pfx2as_destroy(bvc_t *consumer)
       fprintf(stderr, "WARNING: omitting incomplete %s output interval %d-%d\n",
           NAME, STATE->out_interval_start, STATE->prev_view_time);
     }
-    wandio_wdestroy(STATE->outfile);
+    bvcu_outfile_close(STATE->outfile);
     STATE->outfile = NULL;
   }
 
@@ -138,14 +138,13 @@ static int process_origin_state(bvc_t *consumer, uint32_t current_view_ts)
 {
   bvc_pfxorigins_state_t *state = STATE;
 
-  iow_t *f = NULL;
+  bvcu_outfile_t *f = NULL;
   char filename[BVCU_PATH_MAX];
   // char buffer_str[BUFFER_LEN];
   char origin_str[MAX_ASPATH_SEGMENT_STR];
-  char pfx_str[INET6_ADDRSTRLEN + 3];
 
   /* open file for writing */
-  if (!(f = bvcu_open_outfile(filename, "%s/" NAME ".%" PRIu32 ".gz",
+  if (!(f = bvcu_outfile_open(filename, "%s/" NAME ".%" PRIu32 ".gz",
       state->output_folder, current_view_ts))) {
     return -1;
   }
@@ -166,7 +165,6 @@ static int process_origin_state(bvc_t *consumer, uint32_t current_view_ts)
   for (k = kh_begin(state->pfx_origins); k != kh_end(state->pfx_origins); k++) {
     if (kh_exist(state->pfx_origins, k)) {
       pfx = &kh_key(state->pfx_origins, k);
-      bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
 
       os = &kh_val(state->pfx_origins, k);
       differ = 0;
@@ -193,40 +191,45 @@ static int process_origin_state(bvc_t *consumer, uint32_t current_view_ts)
       }
 
       /* ts | prefix | origin before | origin after | category */
-      wandio_printf(f, "%" PRIu32 "|%s|", current_view_ts, pfx_str);
+      bvcu_outfile_put_u32(f, current_view_ts);
+      bvcu_outfile_putc(f, '|');
+      bvcu_outfile_put_pfx(f, pfx);
+      bvcu_outfile_putc(f, '|');
       for (i = 0; i < os->previous.num_asns; i++) {
         // printing origin segments
         if (bgpstream_as_path_seg_snprintf(origin_str, MAX_ASPATH_SEGMENT_STR,
                                            os->previous.origin_asns[i]) >=
             MAX_ASPATH_SEGMENT_STR) {
           fprintf(stderr, "Could not write segment string correctly\n");
+          bvcu_outfile_close(f);
           return -1;
         }
-        wandio_printf(f, "%s", origin_str);
+        bvcu_outfile_puts(f, origin_str);
         if (i < os->previous.num_asns - 1) {
-          wandio_printf(f, " ");
+          bvcu_outfile_putc(f, ' ');
         }
       }
-      wandio_printf(f, "|");
+      bvcu_outfile_putc(f, '|');
       for (i = 0; i < os->current.num_asns; i++) {
         if (bgpstream_as_path_seg_snprintf(origin_str, MAX_ASPATH_SEGMENT_STR,
                                            os->current.origin_asns[i]) >=
             MAX_ASPATH_SEGMENT_STR) {
           fprintf(stderr, "Could not write segment string correctly\n");
+          bvcu_outfile_close(f);
           return -1;
         }
-        wandio_printf(f, "%s", origin_str);
+        bvcu_outfile_puts(f, origin_str);
         if (i < os->current.num_asns - 1) {
-          wandio_printf(f, " ");
+          bvcu_outfile_putc(f, ' ');
         }
       }
 
-      wandio_printf(f, "|");
+      bvcu_outfile_putc(f, '|');
       /* if differ == 0, the origin set remained the same, therefore we do not
        * need to
        * update the previous set */
       if (differ == 0) {
-        wandio_printf(f, "STABLE\n");
+        bvcu_outfile_puts(f, "STABLE\n");
         stable_pfxs++;
 
         /* if things did not change, we just reset the current */
@@ -239,15 +242,15 @@ static int process_origin_state(bvc_t *consumer, uint32_t current_view_ts)
         /* if the prefix disappeared, we remove it from
          * the structure */
         if (os->current.num_asns == 0) {
-          wandio_printf(f, "REMOVED\n");
+          bvcu_outfile_puts(f, "REMOVED\n");
           kh_del(bwv_pfx_origin, state->pfx_origins, k);
           removed_pfxs++;
         } else {
           if (os->previous.num_asns == 0) {
-            wandio_printf(f, "NEWROUTED\n");
+            bvcu_outfile_puts(f, "NEWROUTED\n");
             new_routed_pfxs++;
           } else {
-            wandio_printf(f, "CHANGED\n");
+            bvcu_outfile_puts(f, "CHANGED\n");
             changing_pfxs++;
           }
         }
@@ -275,7 +278,9 @@ static int process_origin_state(bvc_t *consumer, uint32_t current_view_ts)
   }
 
   /* Close file and generate .done if new information was printed */
-  wandio_wdestroy(f);
+  if (bvcu_outfile_close(f) != 0) {
+    return -1;
+  }
 
   /* generate the .done file */
   bvcu_create_donefile(filename);
@@ -546,8 +551,8 @@ int bvc_pfxorigins_process_view(bvc_t *consumer, bgpview_t *view)
       /* only consider peers that are full-feed */
       peerid = bgpview_iter_peer_get_peer_id(it);
 
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
+      if (BGPVIEW_PEER_BITMAP_EXISTS(
+            &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx],
             peerid)) {
         /* get origin segment  */
         if ((origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it)) == NULL) {
@@ -636,7 +641,7 @@ int bvc_pfxorigins_process_view(bvc_t *consumer, bgpview_t *view)
                     state->processing_time);
 
   /* flush */
-  if (timeseries_kp_flush(STATE->kp, current_view_ts) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, current_view_ts) != 0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
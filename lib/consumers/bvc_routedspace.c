@@ -74,8 +74,9 @@ static bvc_t bvc_routedspace = {BVC_ID_ROUTEDSPACE, NAME,
  *  pointer */
 typedef struct perpfx_info {
 
-  /** last ts the prefix was observed */
-  uint32_t last_observed;
+  /** handle in the expiry index (which holds the last ts the prefix was
+   * observed) */
+  bvcu_expiry_handle_t expiry;
 
 } perpfx_info_t;
 
@@ -115,6 +116,9 @@ typedef struct bvc_routedspace_state {
   /** Window size */
   uint32_t window_size;
 
+  /** Patricia nodes indexed by the last ts they were observed */
+  bvcu_expiry_t expiry;
+
   /** first timestamp processed by view consumer */
   uint32_t first_ts;
 
@@ -144,23 +148,16 @@ typedef struct bvc_routedspace_state {
 /* ================ per prefix info management ================ */
 
 /** Create a per pfx info structure */
-static perpfx_info_t *perpfx_info_create(uint32_t ts)
+static perpfx_info_t *perpfx_info_create()
 {
   perpfx_info_t *ppi;
   if ((ppi = (perpfx_info_t *)malloc_zero(sizeof(perpfx_info_t))) == NULL) {
     return NULL;
   }
-  ppi->last_observed = ts;
+  ppi->expiry = BVCU_EXPIRY_NONE;
   return ppi;
 }
 
-/** Set the timestamp in the perpfx info structure */
-static void perpfx_info_set_ts(perpfx_info_t *ppi, uint32_t ts)
-{
-  assert(ppi);
-  ppi->last_observed = ts;
-}
-
 /** Destroy the perpfx info structure */
 static void perpfx_info_destroy(void *ppi)
 {
@@ -340,7 +337,7 @@ static void output_metrics(bvc_t *consumer, uint32_t ts,
 
   timeseries_kp_set(state->kp, state->window_size_idx, current_window_size);
 
-  if (timeseries_kp_flush(state->kp, ts) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, state->kp, ts) != 0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME, ts);
   }
 }
@@ -362,6 +359,8 @@ int bvc_routedspace_init(bvc_t *consumer, int argc, char **argv)
   BVC_SET_STATE(consumer, state);
 
   /* allocate dynamic memory */
+  bvcu_expiry_init(&state->expiry, sizeof(bgpstream_patricia_node_t *));
+
   if ((state->patricia = bgpstream_patricia_tree_create(perpfx_info_destroy)) ==
       NULL) {
     fprintf(stderr, "ERROR: routedspace could not create Patricia Tree\n");
@@ -440,6 +439,8 @@ void bvc_routedspace_destroy(bvc_t *consumer)
     bgpstream_patricia_tree_result_set_destroy(&state->results);
   }
 
+  bvcu_expiry_free(&state->expiry);
+
   if (state->filter != NULL) {
     bgpstream_pfx_set_destroy(state->filter);
   }
@@ -449,21 +450,13 @@ void bvc_routedspace_destroy(bvc_t *consumer)
   BVC_SET_STATE(consumer, NULL);
 }
 
-static bgpstream_patricia_walk_cb_result_t remove_old_prefixes(
-    bgpstream_patricia_tree_t *pt, bgpstream_patricia_node_t *node, void *data)
+static void remove_old_prefix(const void *key, uint32_t last_seen, void *user)
 {
-  bvc_t *consumer = (bvc_t *)data;
-  bvc_routedspace_state_t *state = STATE;
-
-  perpfx_info_t *info = (perpfx_info_t *)bgpstream_patricia_tree_get_user(node);
-  if (info != NULL) {
-    /* remove prefixes which have last been seen more than 1 day ago */
-    if ((info->last_observed + state->window_size) < state->ts) {
+  bvc_t *consumer = (bvc_t *)user;
+  bgpstream_patricia_node_t *node = *(bgpstream_patricia_node_t **)key;
 
-      bgpstream_patricia_tree_remove_node(pt, node);
-    }
-  }
-  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  /* this also destroys the perpfx info (and its handle) */
+  bgpstream_patricia_tree_remove_node(STATE->patricia, node);
 }
 
 int bvc_routedspace_process_view(bvc_t *consumer, bgpview_t *view)
@@ -494,9 +487,12 @@ int bvc_routedspace_process_view(bvc_t *consumer, bgpview_t *view)
     current_window_size = state->ts - state->first_ts;
   }
 
-  /* remove stale prefixes from the patricia tree */
-  bgpstream_patricia_tree_walk(state->patricia, remove_old_prefixes,
-                               (void *)consumer);
+  /* remove prefixes which have last been seen more than window_size ago
+   * from the patricia tree */
+  if (state->ts > state->window_size) {
+    bvcu_expiry_expire(&state->expiry, state->ts - state->window_size,
+                       remove_old_prefix, consumer);
+  }
 
   /* output newly routed prefixes into a file (one file per view) */
 
@@ -568,8 +564,10 @@ int bvc_routedspace_process_view(bvc_t *consumer, bgpview_t *view)
     /* attach a ppi structure if it didn't exist */
     if (ppi == NULL) {
       /* if the program is here it means that this pfx did not exist */
-      bgpstream_patricia_tree_set_user(state->patricia, patricia_node,
-                                       perpfx_info_create(state->ts));
+      if ((ppi = perpfx_info_create()) == NULL) {
+        return -1;
+      }
+      bgpstream_patricia_tree_set_user(state->patricia, patricia_node, ppi);
 
       /* if the prefix does not overlap with any other pfxs
        * in the tree, then it's a new routed */
@@ -577,9 +575,12 @@ int bvc_routedspace_process_view(bvc_t *consumer, bgpview_t *view)
             state->patricia, patricia_node) == BGPSTREAM_PATRICIA_EXACT_MATCH) {
         new_routed = 1;
       }
-    } else {
-      /* otherwise update it with the latest ts */
-      perpfx_info_set_ts(ppi, state->ts);
+    }
+
+    /* update it with the latest ts */
+    if (bvcu_expiry_touch(&state->expiry, &ppi->expiry, &patricia_node,
+                          state->ts) != 0) {
+      return -1;
     }
 
     /* print the current prefixes on file */
@@ -26,6 +26,7 @@
 
 #include "bvc_subpfx.h"
 #include "bgpview_consumer_interface.h"
+#include "bgpview_consumer_pfx_summary.h"
 #include "bgpview_consumer_utils.h"
 #include "bgpstream_utils_patricia.h"
 #include "khash.h"
@@ -35,6 +36,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #define NAME "subpfx"
@@ -46,9 +48,6 @@
  * the state variables shared by other consumers */
 #define CHAIN_STATE (BVC_GET_CHAIN_STATE(consumer))
 
-#define CUR_SUBPFXS (STATE->subpfxs[STATE->current_subpfxs_idx])
-#define PREV_SUBPFXS (STATE->subpfxs[(STATE->current_subpfxs_idx + 1) % 2])
-
 #define DEFAULT_OUTPUT_DIR "./"
 #define OUTPUT_FILE_FORMAT "%s/" NAME "-%s.%" PRIu32 ".events.gz"
 #define BUFFER_LEN 4096
@@ -72,12 +71,19 @@ typedef struct pt_user {
   // number of ASes in the array
   int ases_cnt;
 
+  // number of the last view the prefix was seen in
+  uint32_t view_cnt;
+
 } pt_user_t;
 
 /* Maps sub-prefixes to super prefixes */
 KHASH_INIT(pfx2pfx, bgpstream_pfx_t, bgpstream_pfx_t, 1,
            bgpstream_pfx_hash_val, bgpstream_pfx_equal_val)
 
+/* Set of prefixes */
+KHASH_INIT(pfx_set, bgpstream_pfx_t, char, 0, bgpstream_pfx_hash_val,
+           bgpstream_pfx_equal_val)
+
 enum {
   NEW = 0,
   FINISHED = 1,
@@ -115,18 +121,31 @@ typedef struct bvc_subpfx_state {
   char *outdir;
   int mode; // SUBMOAS or DEFCON
 
-  // Patricia tree used to find sub-prefixes in the current view
+  // Patricia tree of the full-feed prefixes of the current view (kept
+  // across views and updated with the prefixes that changed)
   bgpstream_patricia_tree_t *pt;
 
+  // Number of prefixes in the patricia tree
+  uint32_t pt_pfx_cnt;
+
+  // Number of views processed so far
+  uint32_t view_cnt;
+
   // Re-usable result set used when finding parent prefix
   bgpstream_patricia_tree_result_set_t *pt_res;
 
-  // Flip-flop buffer for current and previous sub-prefix to super-prefix maps
-  khash_t(pfx2pfx) * subpfxs[2];
+  // Sub-prefix to super-prefix map for the current view
+  khash_t(pfx2pfx) * subpfxs;
 
-  // which subpfxs map should be filled for this view
-  // ((current_subpfxs_idx+1)%2) is the map for the previous view
-  int current_subpfxs_idx;
+  // Sub-prefixes that are NEW or FINISHED in the current view (indexed by
+  // diff type), mapped to their super-prefix
+  khash_t(pfx2pfx) * diffs[2];
+
+  // Prefixes added to the tree (or whose origins changed) in this view
+  khash_t(pfx_set) * changed_pfxs;
+
+  // Prefixes whose sub-prefix status must be re-evaluated in this view
+  khash_t(pfx_set) * dirty_pfxs;
 
   // IPv4 default route prefix
   bgpstream_pfx_t v4_default_pfx;
@@ -247,49 +266,47 @@ static int pt_user_contains_asn(pt_user_t *ptu, uint32_t asn)
   return 0;
 }
 
-static int pt_user_add_asn(pt_user_t *ptu, uint32_t asn)
+/* returns 1 if the origin set changed, 0 if not, -1 on error */
+static int pt_user_set_origins(pt_user_t *ptu, bvc_pfx_summary_t *summary)
 {
-  // common case: its already there, and its probably the first AS in the set
-  if (pt_user_contains_asn(ptu, asn) != 0) {
+  // both arrays are sorted, so they can be compared directly
+  if (ptu->ases_cnt == summary->origins_cnt &&
+      memcmp(ptu->ases, summary->origins,
+             sizeof(uint32_t) * summary->origins_cnt) == 0) {
     return 0;
   }
 
-  // not there... realloc, blah
-  if ((ptu->ases =
-         realloc(ptu->ases, sizeof(uint32_t) * (ptu->ases_cnt + 1))) == NULL) {
+  uint32_t *ases;
+  if ((ases = realloc(ptu->ases, sizeof(uint32_t) * summary->origins_cnt)) ==
+      NULL) {
     return -1;
   }
-  ptu->ases[ptu->ases_cnt++] = asn;
-  return 0;
+  ptu->ases = ases;
+  memcpy(ptu->ases, summary->origins, sizeof(uint32_t) * summary->origins_cnt);
+  ptu->ases_cnt = summary->origins_cnt;
+  return 1;
 }
 
-static bgpstream_patricia_walk_cb_result_t
-find_subpfxs(const bgpstream_patricia_tree_t *const_pt,
-             const bgpstream_patricia_node_t *const_node,
-             void *data)
+/* find the super-prefix of the given node, returns 1 if the node is a
+ * sub-prefix of the type we're interested in, 0 if not, -1 on error */
+static int find_super_pfx(bvc_t *consumer, bgpstream_patricia_node_t *node,
+                          bgpstream_pfx_t **super_pfx)
 {
   int i;
-  bvc_t *consumer = (bvc_t *)data;
-  const bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(const_node);
 
-  // hack around the fact that bgpstream_patricia_tree_get_mincovering_prefix()
-  // takes non-const parameters
-  bgpstream_patricia_tree_t *pt = const_pt;
-  bgpstream_patricia_node_t *node = const_node;
   // does this prefix have a super-prefix?
-  if (bgpstream_patricia_tree_get_mincovering_prefix(pt, node, STATE->pt_res) !=
-      0) {
-    // TODO: change the patricia tree walk func to allow me to error out!
-    assert(0);
+  if (bgpstream_patricia_tree_get_mincovering_prefix(STATE->pt, node,
+                                                     STATE->pt_res) != 0) {
+    return -1;
   }
   bgpstream_patricia_node_t *super_node =
     bgpstream_patricia_tree_result_set_next(STATE->pt_res);
 
   if (super_node == NULL) {
     // there is no way this can be a sub-prefix
-    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+    return 0;
   }
-  const bgpstream_pfx_t *super_pfx = bgpstream_patricia_tree_get_pfx(super_node);
+  *super_pfx = bgpstream_patricia_tree_get_pfx(super_node);
 
   // so, there is an overlapping prefix, but is it of the type we're interested
   // in?
@@ -335,17 +352,133 @@ find_subpfxs(const bgpstream_patricia_tree_t *const_pt,
     }
   }
 
-  if (is_wanted == 0) {
-    // its a sub-prefix, but not one that matches our mode, so give up and move
-    // on
-    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  // if this is a sub-prefix, but not one that matches our mode, we're not
+  // interested in it
+  return is_wanted;
+}
+
+/* record a NEW or FINISHED sub-prefix event */
+static int add_diff(bvc_t *consumer, int diff_type, bgpstream_pfx_t *pfx,
+                    bgpstream_pfx_t *super_pfx)
+{
+  int ret;
+  khiter_t k = kh_put(pfx2pfx, STATE->diffs[diff_type], *pfx, &ret);
+  if (ret < 0) {
+    return -1;
+  }
+  kh_val(STATE->diffs[diff_type], k) = *super_pfx;
+  return 0;
+}
+
+/* the prefix is no longer in the tree: finish it if it was a sub-prefix */
+static int remove_subpfx(bvc_t *consumer, bgpstream_pfx_t *pfx)
+{
+  khiter_t k;
+
+  if ((k = kh_get(pfx2pfx, STATE->subpfxs, *pfx)) == kh_end(STATE->subpfxs)) {
+    return 0;
+  }
+  if (add_diff(consumer, FINISHED, pfx, &kh_val(STATE->subpfxs, k)) != 0) {
+    return -1;
   }
+  kh_del(pfx2pfx, STATE->subpfxs, k);
+  return 0;
+}
 
-  // this is a sub-prefix, add it to our table
+/* re-evaluate whether the prefix of the given node is a sub-prefix, and
+ * record the events caused by a change */
+static int update_subpfx(bvc_t *consumer, bgpstream_patricia_node_t *node)
+{
+  bgpstream_pfx_t *pfx = bgpstream_patricia_tree_get_pfx(node);
+  bgpstream_pfx_t *super_pfx = NULL;
+  khiter_t k;
+  int is_subpfx;
   int ret;
-  int k = kh_put(pfx2pfx, CUR_SUBPFXS, *pfx, &ret);
-  assert(ret > 0); // this prefix must not already be present in the map
-  kh_val(CUR_SUBPFXS, k) = *super_pfx;
+
+  if ((is_subpfx = find_super_pfx(consumer, node, &super_pfx)) < 0) {
+    return -1;
+  }
+
+  k = kh_get(pfx2pfx, STATE->subpfxs, *pfx);
+  if (k != kh_end(STATE->subpfxs)) {
+    // it was a sub-prefix, and it still is with the same super prefix
+    if (is_subpfx != 0 &&
+        bgpstream_pfx_equal(super_pfx, &kh_val(STATE->subpfxs, k)) != 0) {
+      return 0;
+    }
+    if (remove_subpfx(consumer, pfx) != 0) {
+      return -1;
+    }
+  }
+
+  if (is_subpfx == 0) {
+    return 0;
+  }
+
+  // this is a new sub-prefix, add it to our table
+  k = kh_put(pfx2pfx, STATE->subpfxs, *pfx, &ret);
+  if (ret < 0) {
+    return -1;
+  }
+  kh_val(STATE->subpfxs, k) = *super_pfx;
+  return add_diff(consumer, NEW, pfx, super_pfx);
+}
+
+static bgpstream_patricia_walk_cb_result_t
+update_all_subpfxs(bgpstream_patricia_tree_t *pt,
+                   bgpstream_patricia_node_t *node, void *data)
+{
+  bvc_t *consumer = (bvc_t *)data;
+
+  if (update_subpfx(consumer, node) != 0) {
+    // TODO: change the patricia tree walk func to allow me to error out!
+    assert(0);
+  }
+  return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+}
+
+/* add the more-specifics of the given node to the dirty prefixes */
+static int mark_more_specifics_dirty(bvc_t *consumer,
+                                     bgpstream_patricia_node_t *node)
+{
+  bgpstream_patricia_node_t *ms_node;
+  int ret;
+
+  if (bgpstream_patricia_tree_get_more_specifics(STATE->pt, node,
+                                                 STATE->pt_res) != 0) {
+    return -1;
+  }
+  while ((ms_node = bgpstream_patricia_tree_result_set_next(STATE->pt_res)) !=
+         NULL) {
+    kh_put(pfx_set, STATE->dirty_pfxs, *bgpstream_patricia_tree_get_pfx(ms_node),
+           &ret);
+    if (ret < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static bgpstream_patricia_walk_cb_result_t
+remove_stale_pfxs(bgpstream_patricia_tree_t *pt,
+                  bgpstream_patricia_node_t *node, void *data)
+{
+  bvc_t *consumer = (bvc_t *)data;
+  pt_user_t *ptu = bgpstream_patricia_tree_get_user(node);
+
+  if (ptu == NULL || ptu->view_cnt == STATE->view_cnt) {
+    return BGPSTREAM_PATRICIA_WALK_CONTINUE;
+  }
+
+  // the super prefix of its more-specifics may change
+  if (mark_more_specifics_dirty(consumer, node) != 0 ||
+      remove_subpfx(consumer, bgpstream_patricia_tree_get_pfx(node)) != 0) {
+    // TODO: change the patricia tree walk func to allow me to error out!
+    assert(0);
+  }
+  bgpstream_patricia_tree_remove_node(pt, node);
+  STATE->pt_pfx_cnt--;
+
   return BGPSTREAM_PATRICIA_WALK_CONTINUE;
 }
 
@@ -452,32 +585,22 @@ static int dump_subpfx(bvc_t *consumer, bgpview_t *view, bgpview_iter_t *it,
   return 0;
 }
 
-static uint64_t subpfxs_diff(bvc_t *consumer, bgpview_t *view,
-                             bgpview_iter_t *it, khash_t(pfx2pfx) * a,
-                             khash_t(pfx2pfx) * b, int diff_type)
+static int dump_subpfxs(bvc_t *consumer, bgpview_t *view, bgpview_iter_t *it,
+                        int diff_type)
 {
-  khiter_t k, j;
-  uint64_t cnt = 0;
-  for (k = kh_begin(a); k != kh_end(a); k++) {
-    if (kh_exist(a, k) == 0) {
-      continue;
-    }
-    bgpstream_pfx_t *pfx = &kh_key(a, k);
-    bgpstream_pfx_t *super_pfx = &kh_val(a, k);
-    // this prefix must have been a sub-prefix in the previous view,
-    // and it must have had the same super prefix
-    if ((j = kh_get(pfx2pfx, b, *pfx)) != kh_end(b) &&
-        bgpstream_pfx_equal(super_pfx, &kh_val(b, j)) != 0) {
+  khash_t(pfx2pfx) *diffs = STATE->diffs[diff_type];
+  khiter_t k;
+  for (k = kh_begin(diffs); k != kh_end(diffs); k++) {
+    if (kh_exist(diffs, k) == 0) {
       continue;
     }
-
     // this is a new/finished sub-pfx!
-    if (dump_subpfx(consumer, view, it, pfx, &kh_val(a, k), diff_type) != 0) {
-      return UINT64_MAX;
+    if (dump_subpfx(consumer, view, it, &kh_key(diffs, k), &kh_val(diffs, k),
+                    diff_type) != 0) {
+      return -1;
     }
-    cnt++;
   }
-  return cnt;
+  return 0;
 }
 
 static int create_ts_metrics(bvc_t *consumer)
@@ -557,14 +680,26 @@ int bvc_subpfx_init(bvc_t *consumer, int argc, char **argv)
     goto err;
   }
 
+  if ((STATE->subpfxs = kh_init(pfx2pfx)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create subpfx map\n");
+    goto err;
+  }
   int i;
   for (i = 0; i < 2; i++) {
-    if ((STATE->subpfxs[i] = kh_init(pfx2pfx)) == NULL) {
-      fprintf(stderr, "ERROR: Could not create subpfx map\n");
+    if ((STATE->diffs[i] = kh_init(pfx2pfx)) == NULL) {
+      fprintf(stderr, "ERROR: Could not create subpfx diff map\n");
       goto err;
     }
   }
-  STATE->current_subpfxs_idx = 0;
+
+  if ((STATE->changed_pfxs = kh_init(pfx_set)) == NULL ||
+      (STATE->dirty_pfxs = kh_init(pfx_set)) == NULL) {
+    fprintf(stderr, "ERROR: Could not create prefix sets\n");
+    goto err;
+  }
+
+  /* full feed prefixes and their origins are summarized by Visibility */
+  CHAIN_STATE->pfx_summaries_wanted = 1;
 
   /* build blacklist prefixes */
   if (bgpstream_str2pfx(IPV4_DEFAULT_ROUTE, &STATE->v4_default_pfx) == NULL ||
@@ -604,10 +739,24 @@ void bvc_subpfx_destroy(bvc_t *consumer)
   state->pt = NULL;
   bgpstream_patricia_tree_result_set_destroy(&state->pt_res);
 
+  if (state->subpfxs != NULL) {
+    kh_destroy(pfx2pfx, state->subpfxs);
+    state->subpfxs = NULL;
+  }
   int i;
   for (i = 0; i < 2; i++) {
-    kh_destroy(pfx2pfx, state->subpfxs[i]);
-    state->subpfxs[i] = NULL;
+    if (state->diffs[i] != NULL) {
+      kh_destroy(pfx2pfx, state->diffs[i]);
+      state->diffs[i] = NULL;
+    }
+  }
+  if (state->changed_pfxs != NULL) {
+    kh_destroy(pfx_set, state->changed_pfxs);
+    state->changed_pfxs = NULL;
+  }
+  if (state->dirty_pfxs != NULL) {
+    kh_destroy(pfx_set, state->dirty_pfxs);
+    state->dirty_pfxs = NULL;
   }
 
   timeseries_kp_free(&state->kp);
@@ -622,8 +771,11 @@ int bvc_subpfx_process_view(bvc_t *consumer, bgpview_t *view)
   bgpview_iter_t *it = NULL;
   bgpstream_pfx_t *pfx = NULL;
   pt_user_t *ptu = NULL;
-  bgpstream_as_path_seg_t *origin_seg;
+  bvc_pfx_summary_t *summary;
   bgpstream_patricia_node_t *node;
+  uint32_t seen_cnt = 0;
+  khiter_t k;
+  int ret;
 
   uint32_t start_time = epoch_sec();
   uint32_t view_time = bgpview_get_time(view);
@@ -642,12 +794,14 @@ int bvc_subpfx_process_view(bvc_t *consumer, bgpview_t *view)
     return -1;
   }
 
-  /* build the patricia tree of prefixes in the current view */
+  STATE->view_cnt++;
+
+  /* update the patricia tree with the prefixes in the current view */
   for (bgpview_iter_first_pfx(it, 0 /* all ip versions*/, BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_has_more_pfx(it); //
        bgpview_iter_next_pfx(it)) {
-    // we have to walk through the peers to see if this prefix is announced by
-    // at least one FF peer and to collect origin ASNs
+    // the visibility consumer has already found which prefixes are announced
+    // by at least one FF peer, and collected their origin ASNs
     pfx = bgpview_iter_pfx_get_pfx(it);
 
     // ignore default prefixes
@@ -656,86 +810,122 @@ int bvc_subpfx_process_view(bvc_t *consumer, bgpview_t *view)
       continue;
     }
 
-    int ipv_idx = bgpstream_ipv2idx(pfx->address.version);
-
-    // check if this is a "full-feed prefix", and build the origin AS set
-    int is_ff = 0;
-    if ((ptu = pt_user_create()) == NULL) {
-      fprintf(stderr, "ERROR: Could not create patricia user structure\n");
-      goto err;
-    }
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE); //
-         bgpview_iter_pfx_has_more_peer(it);                    //
-         bgpview_iter_pfx_next_peer(it)) {
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
-            bgpview_iter_peer_get_peer_id(it)) == 0) {
-        continue;
-      }
-      /* get origin asn */
-      if ((origin_seg = bgpview_iter_pfx_peer_get_origin_seg(it)) == NULL) {
-        return -1;
-      }
-      if (origin_seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
-        /* skip sets and confederations */
-        continue;
-      }
-      if (pt_user_add_asn(
-            ptu, ((bgpstream_as_path_seg_asn_t *)origin_seg)->asn) != 0) {
-        fprintf(stderr, "ERROR: Could not add origin AS\n");
-        return -1;
-      }
-      is_ff = 1;
+    // check if this is a "full-feed prefix" (sets and confederations are
+    // skipped when building the summary)
+    summary = bvc_pfx_summary_table_get(CHAIN_STATE->pfx_summaries, pfx);
+    if (summary == NULL || summary->origins_cnt == 0) {
+      continue;
     }
 
-    // now, add to the patricia tree if it is full-feed
-    if (is_ff == 0) {
-      // not a full-feed prefix, we wasted our time finding the origins ASes
-      pt_user_destroy(ptu);
-      ptu = NULL;
-    } else {
+    if ((node = bgpstream_patricia_tree_search_exact(STATE->pt, pfx)) ==
+        NULL) {
       // first, insert this prefix into the tree
+      if ((ptu = pt_user_create()) == NULL) {
+        fprintf(stderr, "ERROR: Could not create patricia user structure\n");
+        goto err;
+      }
       if ((node = bgpstream_patricia_tree_insert(STATE->pt, pfx)) == NULL) {
         fprintf(stderr, "ERROR: Could not insert prefix in patricia tree\n");
         goto err;
       }
-      // now set the user data to the origin set
+      // now set the user data to the (empty) origin set
       if (bgpstream_patricia_tree_set_user(STATE->pt, node, ptu) != 1) {
         fprintf(stderr, "ERROR: Could not set patricia user data\n");
         goto err;
       }
       // patricia now owns ptu
+      STATE->pt_pfx_cnt++;
+    } else {
+      ptu = bgpstream_patricia_tree_get_user(node);
+    }
+    ptu->view_cnt = STATE->view_cnt;
+    seen_cnt++;
+
+    // update the origin AS set
+    if ((ret = pt_user_set_origins(ptu, summary)) < 0) {
       ptu = NULL;
+      fprintf(stderr, "ERROR: Could not set origin ASes\n");
+      goto err;
+    }
+    ptu = NULL;
+    if (ret != 0) {
+      kh_put(pfx_set, STATE->changed_pfxs, *pfx, &ret);
+      if (ret < 0) {
+        fprintf(stderr, "ERROR: Could not add changed prefix\n");
+        goto err;
+      }
     }
   }
 
-  /* iterate through the prefixes in the tree and find the sub-prefixes */
-  bgpstream_patricia_tree_walk(STATE->pt, find_subpfxs, consumer);
+  /* remove the prefixes that are no longer in the view (the more-specifics of
+   * a removed prefix are marked dirty before it is removed) */
+  if (seen_cnt != STATE->pt_pfx_cnt) {
+    bgpstream_patricia_tree_walk(STATE->pt, remove_stale_pfxs, consumer);
+  }
+  assert(seen_cnt == STATE->pt_pfx_cnt);
 
-  // now that we have a table of sub-prefixes, find out which are new
+  if (kh_size(STATE->changed_pfxs) == STATE->pt_pfx_cnt) {
+    /* every prefix changed (e.g. this is the first view), so there is no
+     * point in finding which ones are affected */
+    bgpstream_patricia_tree_walk(STATE->pt, update_all_subpfxs, consumer);
+  } else {
+    /* a prefix that changed may be a sub-prefix of a different kind, and it
+     * may be the super prefix of its more-specifics */
+    for (k = kh_begin(STATE->changed_pfxs); k != kh_end(STATE->changed_pfxs);
+         k++) {
+      if (kh_exist(STATE->changed_pfxs, k) == 0) {
+        continue;
+      }
+      node = bgpstream_patricia_tree_search_exact(
+        STATE->pt, &kh_key(STATE->changed_pfxs, k));
+      assert(node != NULL);
+      kh_put(pfx_set, STATE->dirty_pfxs, kh_key(STATE->changed_pfxs, k), &ret);
+      if (ret < 0 || mark_more_specifics_dirty(consumer, node) != 0) {
+        fprintf(stderr, "ERROR: Could not mark dirty prefixes\n");
+        goto err;
+      }
+    }
+
+    /* re-evaluate only the affected prefixes */
+    for (k = kh_begin(STATE->dirty_pfxs); k != kh_end(STATE->dirty_pfxs); k++) {
+      if (kh_exist(STATE->dirty_pfxs, k) == 0) {
+        continue;
+      }
+      // a more-specific of a removed prefix may have been removed too
+      if ((node = bgpstream_patricia_tree_search_exact(
+             STATE->pt, &kh_key(STATE->dirty_pfxs, k))) == NULL) {
+        continue;
+      }
+      if (update_subpfx(consumer, node) != 0) {
+        fprintf(stderr, "ERROR: Could not update sub prefix\n");
+        goto err;
+      }
+    }
+  }
+
+  // now that we know which sub-prefixes changed, dump the new ones
   // (i.e., which are in this view but not in the previous one)
-  if ((new_cnt = subpfxs_diff(consumer, view, it, CUR_SUBPFXS, PREV_SUBPFXS,
-                              NEW)) == UINT64_MAX) {
-    fprintf(stderr, "ERROR: Failed to find NEW sub prefixes\n");
+  if (dump_subpfxs(consumer, view, it, NEW) != 0) {
+    fprintf(stderr, "ERROR: Failed to dump NEW sub prefixes\n");
     goto err;
   }
-  // and then do the complement to find finished sub-pfxs
-  if ((finished_cnt = subpfxs_diff(consumer, view, it, PREV_SUBPFXS,
-                                   CUR_SUBPFXS, FINISHED)) == UINT64_MAX) {
-    fprintf(stderr, "ERROR: Failed to find NEW sub prefixes\n");
+  // and then the finished ones
+  if (dump_subpfxs(consumer, view, it, FINISHED) != 0) {
+    fprintf(stderr, "ERROR: Failed to dump FINISHED sub prefixes\n");
     goto err;
   }
+  new_cnt = kh_size(STATE->diffs[NEW]);
+  finished_cnt = kh_size(STATE->diffs[FINISHED]);
 
-  // clear the previous map and then rotate
-  kh_clear(pfx2pfx, PREV_SUBPFXS);
-  STATE->current_subpfxs_idx = (STATE->current_subpfxs_idx + 1) % 2;
+  // clear the per-view sets
+  kh_clear(pfx2pfx, STATE->diffs[NEW]);
+  kh_clear(pfx2pfx, STATE->diffs[FINISHED]);
+  kh_clear(pfx_set, STATE->changed_pfxs);
+  kh_clear(pfx_set, STATE->dirty_pfxs);
 
   /* destroy the view iterator */
   bgpview_iter_destroy(it);
 
-  /* empty the patricia tree */
-  bgpstream_patricia_tree_clear(STATE->pt);
-
   /* close the output file */
   wandio_wdestroy(STATE->outfile);
   STATE->outfile = NULL;
@@ -754,7 +944,7 @@ int bvc_subpfx_process_view(bvc_t *consumer, bgpview_t *view)
   timeseries_kp_set(STATE->kp, STATE->new_subpfxs_cnt_idx, new_cnt);
   timeseries_kp_set(STATE->kp, STATE->finished_subpfxs_cnt_idx, finished_cnt);
 
-  if (timeseries_kp_flush(STATE->kp, view_time) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, view_time) != 0) {
     fprintf(stderr, "Warning: %s could not flush timeseries at %" PRIu32 "\n",
             NAME, view_time);
   }
@@ -762,7 +952,9 @@ int bvc_subpfx_process_view(bvc_t *consumer, bgpview_t *view)
   return 0;
 
 err:
+  pt_user_destroy(ptu);
   bgpview_iter_destroy(it);
   wandio_wdestroy(STATE->outfile);
+  STATE->outfile = NULL;
   return -1;
 }
@@ -159,9 +159,9 @@ int bvc_test_process_view(bvc_t *consumer, bgpview_t *view)
     fprintf(stdout, "--------------------\n");
   }
 
-  timeseries_set_single(BVC_GET_TIMESERIES(consumer), "bvc-test.v4pfxs_cnt",
-                        bgpview_v4pfx_cnt(view, BGPVIEW_FIELD_ACTIVE),
-                        bgpview_get_time(view));
+  bvc_timeseries_set_single(consumer, "bvc-test.v4pfxs_cnt",
+                            bgpview_v4pfx_cnt(view, BGPVIEW_FIELD_ACTIVE),
+                            bgpview_get_time(view));
 
   state->view_cnt++;
 
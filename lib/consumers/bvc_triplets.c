@@ -92,13 +92,37 @@ typedef struct triplet_info {
   uint32_t start;
   // current status
   bool ongoing;
+  // handle in the expiry index (only ongoing triplets are indexed)
+  bvcu_expiry_handle_t expiry;
 
 } triplet_info_t;
 
-KHASH_INIT(triplets_map, char *, triplet_info_t, 1, kh_str_hash_func,
-           kh_str_hash_equal)
+/** Three consecutive (distinct) ASNs of an AS path */
+typedef struct triplet {
+  uint32_t asn1;
+  uint32_t asn2;
+  uint32_t asn3;
+} triplet_t;
+
+#define TRIPLET_FMT "%" PRIu32 "-%" PRIu32 "-%" PRIu32
+#define TRIPLET_ARGS(t) (t).asn1, (t).asn2, (t).asn3
+
+#define triplet_hash_func(t)                                                   \
+  kh_int64_hash_func((((uint64_t)(t).asn1 << 32) | (t).asn2) ^                 \
+                     ((uint64_t)(t).asn3 * UINT64_C(0x9e3779b97f4a7c15)))
+#define triplet_hash_equal(a, b)                                               \
+  ((a).asn1 == (b).asn1 && (a).asn2 == (b).asn2 && (a).asn3 == (b).asn3)
+
+KHASH_INIT(triplets_map, triplet_t, triplet_info_t, 1, triplet_hash_func,
+           triplet_hash_equal)
 typedef khash_t(triplets_map) triplets_map_t;
 
+/** The triplets of an AS path (cached per path) */
+typedef struct path_triplets {
+  uint32_t cnt;
+  triplet_t triplets[];
+} path_triplets_t;
+
 /* our 'instance' */
 // main struct
 typedef struct bvc_triplets_state {
@@ -110,6 +134,12 @@ typedef struct bvc_triplets_state {
   char output_folder[MAX_BUFFER_LEN];
   // Khash holding triplets
   triplets_map_t *triplets_map;
+  // Ongoing triplets indexed by the time they were seen last
+  bvcu_expiry_t expiry;
+  // AS paths already processed in the current view
+  bvcu_path_marks_t path_marks;
+  // Triplets of each AS path
+  bvcu_path_cache_t path_triplets;
   // Output files for edges and triplets
   char filename_triplets[BVCU_PATH_MAX];
   iow_t *file_triplets;
@@ -158,7 +188,7 @@ static int output_timeseries(bvc_t *consumer, uint32_t ts)
   timeseries_kp_set(state->kp, state->newrec_triplets_count_idx,
                     state->newrec_triplets_count);
 
-  if (timeseries_kp_flush(state->kp, ts) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, state->kp, ts) != 0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME, ts);
   }
 
@@ -272,6 +302,61 @@ static int parse_args(bvc_t *consumer, int argc, char **argv)
   return 0;
 }
 
+/* ==================== PATH FUNCTIONS ==================== */
+
+/* decompose the AS path of the current pfx-peer into its triplets */
+static void *path_triplets_derive(bgpview_iter_t *it)
+{
+  path_triplets_t *pt = NULL, *tmp;
+  uint32_t alloc_cnt = 0;
+  bgpstream_as_path_seg_t *seg;
+  uint32_t asn;
+  uint32_t prev_asn = 0;
+  uint32_t prev_prev_asn = 0;
+
+  if ((pt = malloc_zero(sizeof(path_triplets_t))) == NULL) {
+    return NULL;
+  }
+
+  bgpview_iter_pfx_peer_as_path_seg_iter_reset(it);
+
+  while ((seg = bgpview_iter_pfx_peer_as_path_seg_next(it)) != NULL) {
+    /* checking if a segment is a regular asn */
+    if (seg->type != BGPSTREAM_AS_PATH_SEG_ASN) {
+      prev_asn = 0;
+      continue;
+    }
+    asn = ((bgpstream_as_path_seg_asn_t *)seg)->asn;
+
+    // Continue if ASN prepending is observed
+    if (prev_asn != 0 && asn == prev_asn) {
+      continue;
+    }
+
+    // Reading atleast three different ASNs to create first triplet
+    if (prev_prev_asn != 0) {
+      if (pt->cnt == alloc_cnt) {
+        alloc_cnt = (alloc_cnt == 0) ? 8 : alloc_cnt * 2;
+        if ((tmp = realloc(pt, sizeof(path_triplets_t) +
+                                 sizeof(triplet_t) * alloc_cnt)) == NULL) {
+          free(pt);
+          return NULL;
+        }
+        pt = tmp;
+      }
+      pt->triplets[pt->cnt].asn1 = prev_prev_asn;
+      pt->triplets[pt->cnt].asn2 = prev_asn;
+      pt->triplets[pt->cnt].asn3 = asn;
+      pt->cnt++;
+    }
+    // updating ASN variables for next ASNs in the aspath
+    prev_prev_asn = prev_asn;
+    prev_asn = asn;
+  }
+
+  return pt;
+}
+
 /* ==================== CONSUMER INTERFACE FUNCTIONS ==================== */
 
 bvc_t *bvc_triplets_alloc()
@@ -298,6 +383,8 @@ int bvc_triplets_init(bvc_t *consumer, int argc, char **argv)
     fprintf(stderr, "Error: could not create triplets map\n");
     return -1;
   }
+  bvcu_path_cache_init(&state->path_triplets, path_triplets_derive, free);
+  bvcu_expiry_init(&state->expiry, sizeof(triplet_t));
   /* parse the command line args */
   if (parse_args(consumer, argc, argv) != 0) {
     goto err;
@@ -334,14 +421,12 @@ void bvc_triplets_destroy(bvc_t *consumer)
 {
   bvc_triplets_state_t *state = STATE;
   if (state != NULL) {
-    khint_t k;
-    for (k = kh_begin(state->triplets_map); k != kh_end(state->triplets_map);
-         k++) {
-      if (kh_exist(state->triplets_map, k)) {
-        free(kh_key(state->triplets_map, k));
-      }
+    if (state->triplets_map != NULL) {
+      kh_destroy(triplets_map, state->triplets_map);
     }
-    kh_destroy(triplets_map, state->triplets_map);
+    bvcu_path_marks_free(&state->path_marks);
+    bvcu_path_cache_free(&state->path_triplets);
+    bvcu_expiry_free(&state->expiry);
     if (state->kp != NULL) {
       timeseries_kp_free(&state->kp);
     }
@@ -360,7 +445,8 @@ static void print_triplets(bvc_t *consumer)
        k++) {
     if (kh_exist(state->triplets_map, k)) {
       //      printf("for tripet %s : ", kh_key(state->triplets_map,k));
-      printf("new triplet from khash %s \n", kh_key(state->triplets_map, k));
+      printf("new triplet from khash " TRIPLET_FMT " \n",
+             TRIPLET_ARGS(kh_key(state->triplets_map, k)));
       triplet_info_t triplet_info = kh_value(state->triplets_map, k);
       printf(" last seen was %d \n ", triplet_info.last_seen);
     }
@@ -368,8 +454,8 @@ static void print_triplets(bvc_t *consumer)
 }
 
 // Writes in output file for triplets
-static void print_to_file_triplets(bvc_t *consumer, int status, char *triplet,
-  triplet_info_t triplet_info, bgpstream_pfx_t *pfx)
+static void print_to_file_triplets(bvc_t *consumer, int status,
+  triplet_t triplet, triplet_info_t triplet_info, bgpstream_pfx_t *pfx)
 {
   bvc_triplets_state_t *state = STATE;
   char pfx_str[MAX_BUFFER_LEN];
@@ -378,8 +464,10 @@ static void print_to_file_triplets(bvc_t *consumer, int status, char *triplet,
     // printf("printing \n");
     if (wandio_printf(
           state->file_triplets,
-          "%" PRIu32 "|%s|NEW|%" PRIu32 "|%" PRIu32 "|%" PRIu32 "|%s\n",
-          state->time_now, triplet, triplet_info.first_seen, triplet_info.start,
+          "%" PRIu32 "|" TRIPLET_FMT "|NEW|%" PRIu32 "|%" PRIu32 "|%" PRIu32
+          "|%s\n",
+          state->time_now, TRIPLET_ARGS(triplet), triplet_info.first_seen,
+          triplet_info.start,
           triplet_info.end,
           bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx)) == -1) {
       fprintf(stderr, "ERROR: Could not write %s file\n",
@@ -391,8 +479,10 @@ static void print_to_file_triplets(bvc_t *consumer, int status, char *triplet,
   if (status == NEWREC) {
     if (wandio_printf(
           state->file_triplets,
-          "%" PRIu32 "|%s|NEWREC|%" PRIu32 "|%" PRIu32 "|%" PRIu32 "|%s\n",
-          state->time_now, triplet, triplet_info.first_seen, triplet_info.start,
+          "%" PRIu32 "|" TRIPLET_FMT "|NEWREC|%" PRIu32 "|%" PRIu32
+          "|%" PRIu32 "|%s\n",
+          state->time_now, TRIPLET_ARGS(triplet), triplet_info.first_seen,
+          triplet_info.start,
           triplet_info.end,
           bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx)) == -1) {
       fprintf(stderr, "ERROR: Could not write %s file\n",
@@ -402,9 +492,11 @@ static void print_to_file_triplets(bvc_t *consumer, int status, char *triplet,
   }
 
   if (status == FINISHED) {
-    if (wandio_printf(state->file_triplets, "%" PRIu32 "|%s|FINISHED|%" PRIu32
-                                            "|%" PRIu32 "|%" PRIu32 "\n",
-                      state->time_now, triplet, triplet_info.first_seen,
+    if (wandio_printf(state->file_triplets,
+                      "%" PRIu32 "|" TRIPLET_FMT "|FINISHED|%" PRIu32
+                      "|%" PRIu32 "|%" PRIu32 "\n",
+                      state->time_now, TRIPLET_ARGS(triplet),
+                      triplet_info.first_seen,
                       triplet_info.start, triplet_info.end) == -1) {
       fprintf(stderr, "ERROR: Could not write %s file\n",
               state->filename_triplets);
@@ -423,9 +515,10 @@ static void print_ongoing_triplets(bvc_t *consumer)
       triplet_info_t triplet_info = kh_value(state->triplets_map, k);
       if (triplet_info.ongoing) {
         if (wandio_printf(state->file_triplets,
-                          "%" PRIu32 "|%s|ONGOING|%" PRIu32 "|%" PRIu32
-                          "|%" PRIu32 "\n",
-                          state->time_now, kh_key(state->triplets_map, k),
+                          "%" PRIu32 "|" TRIPLET_FMT "|ONGOING|%" PRIu32
+                          "|%" PRIu32 "|%" PRIu32 "\n",
+                          state->time_now,
+                          TRIPLET_ARGS(kh_key(state->triplets_map, k)),
                           triplet_info.first_seen, triplet_info.start,
                           triplet_info.end) == -1) {
           fprintf(stderr, "ERROR: Could not write %s file\n",
@@ -438,32 +531,27 @@ static void print_ongoing_triplets(bvc_t *consumer)
   }
 }
 
-// Scans all ongoing triples and remove stale ones
-static void remove_stale_triplet(bvc_t *consumer)
+// Declares an ongoing triplet that was not seen in this view dead
+static void remove_stale_triplet(const void *key, uint32_t last_seen,
+                                 void *user)
 {
+  bvc_t *consumer = (bvc_t *)user;
   bvc_triplets_state_t *state = STATE;
   khint_t k;
-  for (k = kh_begin(state->triplets_map); k != kh_end(state->triplets_map);
-       k++) {
-    if (kh_exist(state->triplets_map, k)) {
 
-      triplet_info_t triplet_info = kh_value(state->triplets_map, k);
-      // if last_seen is different from current time then declare it dead
-      if (triplet_info.last_seen < state->time_now && triplet_info.ongoing) {
-        triplet_info.end = state->time_now;
-        triplet_info.ongoing = 0;
-        kh_value(state->triplets_map, k) = triplet_info;
-        print_to_file_triplets(consumer, FINISHED,
-                               kh_key(state->triplets_map, k), triplet_info,
-                               NULL);
-        state->finished_triplets_count++;
-      }
-    }
-  }
+  k = kh_get(triplets_map, state->triplets_map, *(triplet_t *)key);
+  assert(k != kh_end(state->triplets_map));
+  triplet_info_t *triplet_info = &kh_value(state->triplets_map, k);
+  triplet_info->end = state->time_now;
+  triplet_info->ongoing = 0;
+  triplet_info->expiry = BVCU_EXPIRY_NONE;
+  print_to_file_triplets(consumer, FINISHED, kh_key(state->triplets_map, k),
+                         *triplet_info, NULL);
+  state->finished_triplets_count++;
 }
 
 // Updates khash and stores new and newrec triplets
-static void insert_update_triplet(bvc_t *consumer, char *triplet,
+static void insert_update_triplet(bvc_t *consumer, triplet_t triplet,
     bgpstream_pfx_t *pfx)
 {
   bvc_triplets_state_t *state = STATE;
@@ -471,25 +559,25 @@ static void insert_update_triplet(bvc_t *consumer, char *triplet,
   int ret;
   k = kh_get(triplets_map, state->triplets_map, triplet);
   triplet_info_t triplet_info;
-  char *copy_triplet;
-  ;
   if (k == kh_end(state->triplets_map)) {
     // NEW triplet
 
-    if ((copy_triplet = strdup(triplet)) == NULL) {
-      fprintf(stderr, "error copying triplet \n");
+    // putting in khash and initializing variables
+    j = kh_put(triplets_map, state->triplets_map, triplet, &ret);
+    if (ret == -1) {
+      fprintf(stderr, "error inserting triplet \n");
       return;
     }
-    // putting in khash and initializing variables
-    j = kh_put(triplets_map, state->triplets_map, copy_triplet, &ret);
     triplet_info.first_seen = state->time_now;
     triplet_info.last_seen = state->time_now;
     triplet_info.start = state->time_now;
     triplet_info.ongoing = 1;
     triplet_info.end = 0;
+    triplet_info.expiry = BVCU_EXPIRY_NONE;
     kh_value(state->triplets_map, j) = triplet_info;
     print_to_file_triplets(consumer, NEW, triplet, triplet_info, pfx);
     state->new_triplets_count++;
+    k = j;
   } else {
     // Triplet seen before
     triplet_info = kh_value(state->triplets_map, k);
@@ -512,6 +600,12 @@ static void insert_update_triplet(bvc_t *consumer, char *triplet,
     }
     kh_value(state->triplets_map, k) = triplet_info;
   }
+
+  if (bvcu_expiry_touch(&state->expiry,
+                        &kh_value(state->triplets_map, k).expiry, &triplet,
+                        state->time_now) != 0) {
+    fprintf(stderr, "error indexing triplet \n");
+  }
 }
 
 int bvc_triplets_process_view(bvc_t *consumer, bgpview_t *view)
@@ -519,7 +613,6 @@ int bvc_triplets_process_view(bvc_t *consumer, bgpview_t *view)
   bvc_triplets_state_t *state = STATE;
   bgpview_iter_t *it;
   bgpstream_pfx_t *pfx;
-  bgpstream_peer_id_t peerid;
   uint32_t time_now = bgpview_get_time(view);
   state->time_now = time_now;
   /* compute arrival delay */
@@ -539,16 +632,11 @@ int bvc_triplets_process_view(bvc_t *consumer, bgpview_t *view)
     return -1;
   }
 
-  int ipv_idx, ret, i;
+  int ipv_idx;
 
-  /* borrowed pointer to a path segment */
-  bgpstream_as_path_seg_t *seg;
-  //  uint32_t asn1;
-  //  uint32_t asn2;
-  uint32_t asn;
-  uint32_t normal_asn;
-  uint32_t prev_asn;
-  uint32_t prev_prev_asn;
+  uint8_t *path_mark;
+  path_triplets_t *pt;
+  uint32_t i;
   // print ongoing triplets
   print_ongoing_triplets(consumer);
 
@@ -557,100 +645,49 @@ int bvc_triplets_process_view(bvc_t *consumer, bgpview_t *view)
     return -1;
   }
 
+  /* no path has been processed in this view yet */
+  bvcu_path_marks_clear(&state->path_marks);
+
   /* iterate through all prefixes */
   for (bgpview_iter_first_pfx(it, 0 /* all versions */, BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
     pfx = bgpview_iter_pfx_get_pfx(it);
     ipv_idx = bgpstream_ipv2idx(pfx->address.version);
-    // peers_cnt = 0;
-    // last_origin_asn = 0;
 
-    for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+    /* only consider peers that are full-feed */
+    for (bgpview_iter_pfx_first_peer_in(
+           it, BGPVIEW_FIELD_ACTIVE,
+           &BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_bitmap[ipv_idx]);
          bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
-      /* only consider peers that are full-feed */
-      peerid = bgpview_iter_peer_get_peer_id(it);
-      if (bgpstream_id_set_exists(
-            BVC_GET_CHAIN_STATE(consumer)->full_feed_peer_ids[ipv_idx],
-            peerid)) {
-
-        // initializing asns for each view
-        i = 0;
-        // asn1=0;
-        // asn2=0;
-        normal_asn = 0;
-        prev_asn = 0;
-        prev_prev_asn = 0;
-
-        bgpview_iter_pfx_peer_as_path_seg_iter_reset(it);
-
-        while ((seg = bgpview_iter_pfx_peer_as_path_seg_next(it)) != NULL) {
-          i++;
-          /* checking if a segment is a regular asn */
-          if (seg->type == BGPSTREAM_AS_PATH_SEG_ASN) {
-            asn = ((bgpstream_as_path_seg_asn_t *)seg)->asn;
-
-            normal_asn = 1;
-          }
-          // Check whether asn is a regular asn
-          else {
-            normal_asn = 0;
-            prev_asn = 0;
-            continue;
-          }
-
-          if (normal_asn) {
-            // Previous asn was a regular one
-            if (prev_asn != 0) {
-              // asn1=asn;
-              // asn2=prev_asn;
-              // Continue if ASN perpending is observed
-              if (asn == prev_asn) {
-                continue;
-              }
-              // Getting the greater than two ASNs. Assuming edges are not
-              // directional
-              if (asn < prev_asn) {
-                // asn1=prev_asn;
-                // asn2=asn;
-              }
-
-              // Check whether we have seen this edge before or not. Update
-              // respective khashes
-            }
-            // Reading atleast three different ASNs to create first triplet
-            if (prev_prev_asn != 0) {
-              char triplet[25];
-              triplet[0] = '\0';
-              int written = 0;
-              // Making a char array from three ASNs
-
-              ret = snprintf(triplet, sizeof(triplet) - 1,
-                             "%" PRIu32 "-%" PRIu32 "-%" PRIu32 " ",
-                             prev_prev_asn, prev_asn, asn);
-              // ret =snprintf(triplet, sizeof(triplet) - 1, "%"PRIu32"-%"PRIu32"",
-              // prev_asn, asn);
-              if (ret < 0 || ret >= sizeof(triplet) - written - 1) {
-                fprintf(stderr, "ERROR: cannot write ASN tiplet.\n");
-                return -1;
-              }
-              written += ret;
-              triplet[written - 1] = '\0';
-              // Check whether we have seen this edge before or not. Update
-              // respective khashes
-              insert_update_triplet(consumer, triplet, pfx);
-            }
-            // updating ASN variables for next ASNs in the aspath
-            prev_prev_asn = prev_asn;
-            prev_asn = asn;
-          }
-        }
-        prev_asn = 0;
-        prev_prev_asn = 0;
+
+      // each triplet of a path has already been updated (and reported, if
+      // NEW, for the first prefix with that path) once the path has been
+      // seen in this view
+      if ((path_mark = bvcu_path_marks_get(&state->path_marks, it)) == NULL) {
+        bgpview_iter_destroy(it);
+        return -1;
+      }
+      if (*path_mark != 0) {
+        continue;
+      }
+      *path_mark = 1;
+
+      // the triplets of the path are only computed the first time the path
+      // is seen
+      if ((pt = bvcu_path_cache_get(&state->path_triplets, it)) == NULL) {
+        bgpview_iter_destroy(it);
+        return -1;
+      }
+      for (i = 0; i < pt->cnt; i++) {
+        // Check whether we have seen this triplet before or not. Update
+        // respective khashes
+        insert_update_triplet(consumer, pt->triplets[i], pfx);
       }
     }
   }
-  // Loops through all ongoing edges and checks for stale edges/triplets
-  remove_stale_triplet(consumer);
+  // Expires the ongoing triplets that were not seen in this view
+  bvcu_expiry_expire(&state->expiry, state->time_now, remove_stale_triplet,
+                     consumer);
   bgpview_iter_destroy(it);
   // Close file I/O
   wandio_wdestroy(state->file_triplets);
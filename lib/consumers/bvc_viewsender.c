@@ -93,8 +93,12 @@ typedef struct bvc_viewsender_state {
 #ifdef WITH_BGPVIEW_IO_KAFKA
   /** Sync interval */
   int sync_interval;
-  /** Parent view */
+  /** Parent view (a copy of the shadow view as it was last sent) */
   bgpview_t *parent_view;
+  /** Shadow view: the view restricted to the full-feed peers */
+  bgpview_t *shadow_view;
+  /** Full-feed peers of the current view */
+  bgpview_peer_bitmap_t ff_peers;
 #endif
 
   /* Metric Indices */
@@ -113,6 +117,7 @@ typedef struct bvc_viewsender_state {
   int changed_pfx_peer_idx;
   int removed_pfx_peer_idx;
   int sync_cnt_idx;
+  int path_cnt_idx;
 #endif
 } bvc_viewsender_state_t;
 
@@ -245,6 +250,14 @@ static int create_ts_metrics(bvc_t *consumer)
     if ((state->pfx_cnt_idx = timeseries_kp_add_key(STATE->kp, buffer)) == -1) {
       return -1;
     }
+
+    snprintf(buffer, BUFFER_LEN, META_METRIC_PREFIX_FORMAT,
+             CHAIN_STATE->metric_prefix, state->io_module, state->gr_instance,
+             "path_cnt");
+    if ((state->path_cnt_idx = timeseries_kp_add_key(STATE->kp, buffer)) ==
+        -1) {
+      return -1;
+    }
   }
 #endif
 
@@ -420,6 +433,56 @@ static int filter_ff(bgpview_iter_t *iter, bgpview_io_filter_type_t type,
            STATE->filter_ff_v6cnt));
 }
 
+#ifdef WITH_BGPVIEW_IO_KAFKA
+/** Bring the shadow view up to date with the full-feed part of the view */
+static int update_shadow_view(bvc_t *consumer, bgpview_t *view)
+{
+  bvc_viewsender_state_t *state = STATE;
+  bgpview_iter_t *it;
+
+  /* the shadow shares the peer ids and path ids of the view */
+  if (state->shadow_view != NULL &&
+      (bgpview_get_peersigns(state->shadow_view) !=
+         bgpview_get_peersigns(view) ||
+       bgpview_get_as_path_store(state->shadow_view) !=
+         bgpview_get_as_path_store(view))) {
+    bgpview_destroy(state->shadow_view);
+    state->shadow_view = NULL;
+    bgpview_destroy(state->parent_view);
+    state->parent_view = NULL;
+  }
+  if (state->shadow_view == NULL) {
+    if ((state->shadow_view = bgpview_create_shared(
+           bgpview_get_peersigns(view), bgpview_get_as_path_store(view), NULL,
+           NULL, NULL, NULL)) == NULL) {
+      return -1;
+    }
+    bgpview_disable_user_data(state->shadow_view);
+    if (bgpview_enable_change_tracking(state->shadow_view) != 0) {
+      return -1;
+    }
+  }
+
+  /* find the full-feed peers */
+  if ((it = bgpview_iter_create(view)) == NULL) {
+    return -1;
+  }
+  BGPVIEW_PEER_BITMAP_CLEAR(&state->ff_peers);
+  for (bgpview_iter_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(it); bgpview_iter_next_peer(it)) {
+    if (filter_ff(it, BGPVIEW_IO_FILTER_PEER, consumer) != 0) {
+      BGPVIEW_PEER_BITMAP_INSERT(&state->ff_peers,
+                                 bgpview_iter_peer_get_peer_id(it));
+    }
+  }
+  bgpview_iter_destroy(it);
+
+  /* only copies the prefixes that changed, if the view tracks changes and the
+     full-feed peers are the same as last time */
+  return bgpview_sync_filtered(state->shadow_view, view, &state->ff_peers);
+}
+#endif
+
 /* ==================== CONSUMER INTERFACE FUNCTIONS ==================== */
 
 bvc_t *bvc_viewsender_alloc()
@@ -497,6 +560,8 @@ void bvc_viewsender_destroy(bvc_t *consumer)
     state->kafka_client = NULL;
     bgpview_destroy(state->parent_view);
     state->parent_view = NULL;
+    bgpview_destroy(state->shadow_view);
+    state->shadow_view = NULL;
   }
 #endif
 
@@ -531,6 +596,15 @@ int bvc_viewsender_process_view(bvc_t *consumer, bgpview_t *view)
     uint32_t sync_time =
       (view_time / state->sync_interval) * state->sync_interval;
 
+    // the full-feed filter is applied once, when the shadow view is updated,
+    // so the diff only needs to look at the cells that changed
+    if (update_shadow_view(consumer, view) != 0) {
+      return -1;
+    }
+
+    uint64_t shadow_end = epoch_sec();
+    uint64_t shadow_time = shadow_end - start_time;
+
     // are we sending a sync frame or a diff frame?
     if ((state->parent_view == NULL) || view_time == sync_time) {
       // we need to send a sync frame, but if we have started out of step,
@@ -540,6 +614,7 @@ int bvc_viewsender_process_view(bvc_t *consumer, bgpview_t *view)
         assert(state->parent_view == NULL);
         fprintf(stderr, "WARN: Sync needed, but refusing to send out-of-step. "
                         "Skipping view publication\n");
+        bgpview_mark_changes(state->shadow_view);
         return 0;
       }
 
@@ -550,33 +625,35 @@ int bvc_viewsender_process_view(bvc_t *consumer, bgpview_t *view)
       fprintf(stderr, "INFO: Sending diff view at %d\n", view_time);
     }
 
-    // send the view
-    if (bgpview_io_kafka_send_view(state->kafka_client, view, pvp, filter_ff,
-                                   consumer) != 0) {
+    // send the (already filtered) shadow view
+    if (bgpview_io_kafka_send_view(state->kafka_client, state->shadow_view,
+                                   pvp, NULL, NULL) != 0) {
       return -1;
     }
 
     uint64_t send_end = epoch_sec();
-    uint64_t send_time = send_end - start_time;
+    uint64_t send_time = send_end - shadow_end;
 
     // do the create/copy
     if (state->parent_view == NULL) {
-      if ((state->parent_view = bgpview_dup(view)) == NULL) {
+      if ((state->parent_view = bgpview_dup(state->shadow_view)) == NULL) {
         return -1;
       }
     } else {
-      /* we have a parent view, just copy into it */
-      /* first, clear the destination */
-      bgpview_clear(state->parent_view);
-      if (bgpview_copy(state->parent_view, view) != 0) {
+      /* we have a parent view, bring it up to date (only copies the
+         prefixes that changed in the shadow view) */
+      if (bgpview_sync(state->parent_view, state->shadow_view) != 0) {
         return -1;
       }
     }
     assert(state->parent_view != NULL);
     assert(bgpview_get_time(view) == bgpview_get_time(state->parent_view));
 
+    /* the next changes of the shadow view are relative to the parent view */
+    bgpview_mark_changes(state->shadow_view);
+
     uint64_t copy_end = epoch_sec();
-    uint64_t copy_time = copy_end - send_end;
+    uint64_t copy_time = shadow_time + (copy_end - send_end);
 
     // set timeseries metrics
     bgpview_io_kafka_stats_t *stats =
@@ -601,6 +678,7 @@ int bvc_viewsender_process_view(bvc_t *consumer, bgpview_t *view)
 
     timeseries_kp_set(state->kp, state->sync_cnt_idx, stats->sync_pfx_cnt);
     timeseries_kp_set(state->kp, state->pfx_cnt_idx, stats->pfx_cnt);
+    timeseries_kp_set(state->kp, state->path_cnt_idx, stats->path_cnt);
   }
 #endif
 #ifdef WITH_BGPVIEW_IO_ZMQ
@@ -620,7 +698,8 @@ int bvc_viewsender_process_view(bvc_t *consumer, bgpview_t *view)
   timeseries_kp_set(state->kp, state->proc_time_idx, proc_time);
 
   // flush
-  if (timeseries_kp_flush(STATE->kp, bgpview_get_time(view)) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, bgpview_get_time(view)) !=
+      0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
@@ -26,6 +26,7 @@
 
 #include "bvc_visibility.h"
 #include "bgpview_consumer_interface.h"
+#include "bgpview_consumer_pfx_summary.h"
 #include "bgpstream_utils_id_set.h"
 #include "bgpstream_utils_pfx_set.h"
 #include "khash.h"
@@ -232,6 +233,8 @@ static void find_ff_peers(bvc_t *consumer, bgpview_iter_t *it)
       if (pfx_cnt >= STATE->full_feed_size[i]) {
         /* add to the  full_feed set */
         bgpstream_id_set_insert(CHAIN_STATE->full_feed_peer_ids[i], peerid);
+        BGPVIEW_PEER_BITMAP_INSERT(&CHAIN_STATE->full_feed_peer_bitmap[i],
+                                   peerid);
         bgpstream_id_set_insert(STATE->full_feed_asns[i], sg->peer_asnumber);
       }
     }
@@ -280,9 +283,11 @@ static void reset_chain_state(bvc_t *consumer)
   for (i = 0; i < BGPSTREAM_MAX_IP_VERSION_IDX; i++) {
     CHAIN_STATE->peer_ids_cnt[i] = 0;
     bgpstream_id_set_clear(CHAIN_STATE->full_feed_peer_ids[i]);
+    BGPVIEW_PEER_BITMAP_CLEAR(&CHAIN_STATE->full_feed_peer_bitmap[i]);
     CHAIN_STATE->full_feed_peer_asns_cnt[i] = 0;
     CHAIN_STATE->usable_table_flag[i] = 0;
   }
+  bvc_pfx_summary_table_clear(CHAIN_STATE->pfx_summaries);
 }
 
 /* ==================== CONSUMER INTERFACE FUNCTIONS ==================== */
@@ -399,6 +404,14 @@ int bvc_visibility_process_view(bvc_t *consumer, bgpview_t *view)
     }
   }
 
+  /* summarize the full-feed observations of each prefix once, for all the
+     consumers that need them */
+  if (CHAIN_STATE->pfx_summaries_wanted != 0 &&
+      bvc_pfx_summary_table_build(CHAIN_STATE->pfx_summaries, view,
+                                  CHAIN_STATE->full_feed_peer_bitmap) != 0) {
+    return -1;
+  }
+
   CHAIN_STATE->visibility_computed = 1;
 
   /* @todo decide later what are the usability rules */
@@ -411,7 +424,8 @@ int bvc_visibility_process_view(bvc_t *consumer, bgpview_t *view)
   dump_gen_metrics(consumer);
 
   /* now flush the kp */
-  if (timeseries_kp_flush(STATE->kp, bgpview_get_time(view)) != 0) {
+  if (bvc_timeseries_kp_flush(consumer, STATE->kp, bgpview_get_time(view)) !=
+      0) {
     fprintf(stderr, "Warning: could not flush %s %" PRIu32 "\n", NAME,
             bgpview_get_time(view));
   }
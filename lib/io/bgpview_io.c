@@ -27,6 +27,7 @@
 #include "bgpview_io.h"
 #include "config.h"
 #include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -420,7 +421,7 @@ int bgpview_io_deserialize_pfx_row(
   bgpview_io_filter_pfx_cb_t *pfx_cb,
   bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
   int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
-  int pathid_map_cnt, bgpview_field_state_t state)
+  uint8_t *pathid_known, int pathid_map_cnt, bgpview_field_state_t state)
 {
   size_t read = 0;
   size_t s = 0;
@@ -486,6 +487,11 @@ int bgpview_io_deserialize_pfx_row(
       /* AS Path Index */
       BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, pathidx);
       if (view != NULL) {
+        if (pathidx >= (uint32_t)pathid_map_cnt ||
+            (pathid_known != NULL && pathid_known[pathidx] == 0)) {
+          fprintf(stderr, "ERROR: Unknown path index %" PRIu32 "\n", pathidx);
+          goto err;
+        }
         pathid = pathid_map[pathidx];
       }
     } else if (state == BGPVIEW_FIELD_ACTIVE) {
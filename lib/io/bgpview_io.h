@@ -78,6 +78,38 @@ typedef enum {
     buf += sizeof(to);                                                         \
   } while (0)
 
+/** Convenience macro to write a simple variable to a wandio file (in host byte
+ * order). Jumps to the `err` label of the caller if the write fails.
+ *
+ * @param outfile       the wandio file to write to
+ * @param from          the variable to write
+ * @param what          string describing the file (for error messages)
+ */
+#define BGPVIEW_IO_WRITE_VAL(outfile, from, what)                              \
+  do {                                                                         \
+    if (wandio_wwrite((outfile), &(from), sizeof(from)) != sizeof(from)) {     \
+      fprintf(stderr, "ERROR: %s: Could not write %s to %s\n", __func__,       \
+              #from, (what));                                                  \
+      goto err;                                                                \
+    }                                                                          \
+  } while (0)
+
+/** Convenience macro to read a simple variable from a wandio file (in host
+ * byte order). Jumps to the `err` label of the caller if the read fails.
+ *
+ * @param infile        the wandio file to read from
+ * @param to            the variable to read
+ * @param what          string describing the file (for error messages)
+ */
+#define BGPVIEW_IO_READ_VAL(infile, to, what)                                  \
+  do {                                                                         \
+    if (wandio_read((infile), &(to), sizeof(to)) != sizeof(to)) {              \
+      fprintf(stderr, "ERROR: %s: Could not read %s from %s\n", __func__,      \
+              #to, (what));                                                    \
+      goto err;                                                                \
+    }                                                                          \
+  } while (0)
+
 /** Callback for filtering entries in a view when sending from
  * bgpview_io_client.
  *
@@ -276,6 +308,9 @@ int bgpview_io_serialize_pfx_row(uint8_t *buf, size_t len, bgpview_iter_t *it,
  * @param peerid_map_cnt number of elements in the peerid_map
  * @param pathid_map    pointer to a mapping from serialized path index to IDs
  *                      in the path store
+ * @param pathid_known  pointer to an array flagging which entries of the
+ *                      pathid_map are set (NULL if they all are)
+ * @param pathid_map_cnt number of elements in the pathid_map
  * @param state         indicates if the deserialized cells should be activated
  *                      or deactivated
  * @return the number of bytes read, or -1 on error
@@ -289,6 +324,6 @@ int bgpview_io_deserialize_pfx_row(
   bgpview_io_filter_pfx_cb_t *pfx_cb,
   bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb, bgpstream_peer_id_t *peerid_map,
   int peerid_map_cnt, bgpstream_as_path_store_path_id_t *pathid_map,
-  int pathid_map_cnt, bgpview_field_state_t state);
+  uint8_t *pathid_known, int pathid_map_cnt, bgpview_field_state_t state);
 
 #endif /* __BGPVIEW_IO_H */
@@ -35,6 +35,7 @@
 #include "bgpcorsaro_log.h"
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #ifdef HAVE_TIME_H
@@ -47,6 +48,9 @@
 
 #define BGPVIEW_IO_BSRT_GAPLIMIT_DEFAULT 0
 #define BGPVIEW_IO_BSRT_INTERVAL_DEFAULT 60
+#define BGPVIEW_IO_BSRT_CHECKPOINT_INTERVAL_DEFAULT 3600
+/* long enough to see a full RIB dump from every RouteViews and RIS collector */
+#define BGPVIEW_IO_BSRT_WARMUP_DEFAULT (8 * 3600)
 
 
 struct bgpview_io_bsrt {
@@ -65,6 +69,12 @@ struct bgpview_io_bsrt {
     int meta_rotate;
     int logfile_disable;
     uint32_t minimum_time;
+    char *checkpoint_file;
+    int checkpoint_interval;
+    int slice_idx;
+    int slice_cnt;
+    int warmup;
+    uint32_t publish_start;
   } cfg;
 };
 
@@ -617,9 +627,19 @@ static void usage(bgpview_io_bsrt_t *bsrt)
     "                   - see man strftime(3) for more options\n"
     "   -r <intervals> rotate output files after n intervals\n"
     "   -R <intervals> rotate bgpcorsaro meta files after n intervals\n"
+    "   -C <file>      checkpoint the routing tables to <file>, and resume\n"
+    "                  from it if it exists\n"
+    "   -I <seconds>   minimum time between checkpoints (default: %d)\n"
+    "   -S <i>/<n>     process only slice <i> (0-based) of <n> equal slices of\n"
+    "                  the time window, so that a backfill can be split\n"
+    "                  across <n> parallel processes\n"
+    "   -W <seconds>   warm-up time processed (but not published) before\n"
+    "                  the start of a slice (default: %d)\n"
     "\n"
     "   -h             print this help menu\n"
-    "* denotes an option that can be given multiple times\n");
+    "* denotes an option that can be given multiple times\n",
+    BGPVIEW_IO_BSRT_CHECKPOINT_INTERVAL_DEFAULT,
+    BGPVIEW_IO_BSRT_WARMUP_DEFAULT);
 
 }
 
@@ -630,6 +650,68 @@ int (*bsrt_record_get_next_elem)(bgpstream_record_t *, bgpstream_elem_t **) =
   bgpstream_record_get_next_elem;
 
 
+/* Restrict the (single) window to the configured slice, extended backwards
+ * by the warm-up time so that every collector has dumped a RIB by the time
+ * the slice starts. Views from the warm-up are processed but not published,
+ * so the outputs of all the slices can simply be concatenated. */
+static int slice_window(bgpview_io_bsrt_t *bsrt, struct window *windows,
+                        int windows_cnt)
+{
+  uint32_t interval;
+  uint32_t base;
+  uint32_t slice_len;
+  uint32_t slice_start;
+  uint32_t slice_end;
+
+  if (windows_cnt != 1 || windows[0].end == BGPSTREAM_FOREVER) {
+    fprintf(stderr, "ERROR: Slicing requires exactly one time window with an "
+                    "end time\n");
+    return -1;
+  }
+
+  interval = bsrt->cfg.interval > 0 ? bsrt->cfg.interval :
+    BGPVIEW_IO_BSRT_INTERVAL_DEFAULT;
+
+  /* slices start on an (aligned) interval boundary and are a whole number of
+   * intervals long, so that every view falls in exactly one slice */
+  base = (windows[0].start / interval) * interval;
+  slice_len = (windows[0].end - base + bsrt->cfg.slice_cnt) /
+    bsrt->cfg.slice_cnt;
+  slice_len = ((slice_len + interval - 1) / interval) * interval;
+
+  slice_start = base + bsrt->cfg.slice_idx * slice_len;
+  if (slice_start < windows[0].start) {
+    /* the first interval of the first slice is cut by the window start */
+    slice_start = windows[0].start;
+  }
+  if (slice_start > windows[0].end) {
+    fprintf(stderr, "ERROR: Slice %d/%d is empty\n", bsrt->cfg.slice_idx,
+            bsrt->cfg.slice_cnt);
+    return -1;
+  }
+  slice_end = base + (bsrt->cfg.slice_idx + 1) * slice_len - 1;
+  if (slice_end > windows[0].end) {
+    slice_end = windows[0].end;
+  }
+
+  fprintf(stderr, "INFO: processing slice %d/%d: %" PRIu32 ",%" PRIu32
+                  " (warm-up: %ds)\n",
+          bsrt->cfg.slice_idx, bsrt->cfg.slice_cnt, slice_start, slice_end,
+          slice_start == windows[0].start ? 0 : bsrt->cfg.warmup);
+
+  if (slice_start != windows[0].start) {
+    bsrt->cfg.publish_start = slice_start;
+    windows[0].start = (slice_start - windows[0].start > bsrt->cfg.warmup) ?
+      slice_start - bsrt->cfg.warmup : windows[0].start;
+  }
+  windows[0].end = slice_end;
+
+  /* interval boundaries must not depend on where the stream starts */
+  bsrt->cfg.align = 1;
+
+  return 0;
+}
+
 static int parse_args(bgpview_io_bsrt_t *bsrt, int argc, char **argv)
 {
 #define PROJECT_CMD_CNT 10
@@ -675,7 +757,7 @@ static int parse_args(bgpview_io_bsrt_t *bsrt, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, "d:o:p:c:t:w:j:k:y:P:i:ag:lLB:n:O:r:R:h")) >= 0) {
+  while ((opt = getopt(argc, argv, "d:o:p:c:t:w:j:k:y:P:i:ag:lLB:n:O:r:R:C:I:S:W:h")) >= 0) {
     switch (opt) {
     case 'd':
       if (strcmp(optarg, "test") == 0) {
@@ -840,6 +922,32 @@ static int parse_args(bgpview_io_bsrt_t *bsrt, int argc, char **argv)
       bsrt->cfg.meta_rotate = atoi(optarg);
       break;
 
+    case 'C':
+      if (bsrt->cfg.checkpoint_file)
+        free(bsrt->cfg.checkpoint_file);
+      bsrt->cfg.checkpoint_file = strdup(optarg);
+      break;
+
+    case 'I':
+      bsrt->cfg.checkpoint_interval = atoi(optarg);
+      break;
+
+    case 'S':
+      if (sscanf(optarg, "%d/%d", &bsrt->cfg.slice_idx,
+                 &bsrt->cfg.slice_cnt) != 2 ||
+          bsrt->cfg.slice_cnt <= 0 || bsrt->cfg.slice_idx < 0 ||
+          bsrt->cfg.slice_idx >= bsrt->cfg.slice_cnt) {
+        fprintf(stderr, "ERROR: Invalid slice '%s' (expecting <i>/<n>)\n",
+                optarg);
+        usage(bsrt);
+        exit(-1);
+      }
+      break;
+
+    case 'W':
+      bsrt->cfg.warmup = atoi(optarg);
+      break;
+
     case ':':
       fprintf(stderr, "ERROR: Missing option argument for -%c\n", optopt);
       usage(bsrt);
@@ -928,8 +1036,41 @@ static int parse_args(bgpview_io_bsrt_t *bsrt, int argc, char **argv)
     free(collectors[i]);
   }
 
+  /* slice */
+  if (bsrt->cfg.slice_cnt > 1 &&
+      slice_window(bsrt, windows, windows_cnt) != 0) {
+    usage(bsrt);
+    return -1;
+  }
+
   /* windows */
   uint32_t current_time = 0;
+  uint32_t resume_time = 0;
+  if (bsrt->cfg.checkpoint_file != NULL &&
+      bgpcorsaro_get_checkpoint_time(bsrt->cfg.checkpoint_file,
+                                     &resume_time) == 0) {
+    /* the checkpoint already covers everything before resume_time, so only
+     * ask bgpstream for what comes after it */
+    fprintf(stderr, "INFO: resuming from checkpoint %s at %" PRIu32 "\n",
+            bsrt->cfg.checkpoint_file, resume_time);
+    int remaining = 0;
+    for (int i = 0; i < windows_cnt; i++) {
+      if (windows[i].end != BGPSTREAM_FOREVER &&
+          windows[i].end < resume_time) {
+        continue;
+      }
+      if (windows[i].start < resume_time) {
+        windows[i].start = resume_time;
+      }
+      windows[remaining++] = windows[i];
+    }
+    if (remaining == 0) {
+      fprintf(stderr, "ERROR: Checkpoint %s is past the end of all windows\n",
+              bsrt->cfg.checkpoint_file);
+      return -1;
+    }
+    windows_cnt = remaining;
+  }
   for (int i = 0; i < windows_cnt; i++) {
     bgpstream_add_interval_filter(bsrt->stream, windows[i].start, windows[i].end);
     current_time = windows[i].start;
@@ -994,6 +1135,8 @@ bgpview_io_bsrt_t *bgpview_io_bsrt_init(const char *opts, timeseries_t *timeseri
   bsrt->cfg.gap_limit = BGPVIEW_IO_BSRT_GAPLIMIT_DEFAULT;
   bsrt->cfg.interval = -1000;
   bsrt->cfg.meta_rotate = -1;
+  bsrt->cfg.checkpoint_interval = BGPVIEW_IO_BSRT_CHECKPOINT_INTERVAL_DEFAULT;
+  bsrt->cfg.warmup = BGPVIEW_IO_BSRT_WARMUP_DEFAULT;
 
   if ((bsrt->stream = bgpstream_create()) == NULL) {
     fprintf(stderr, "ERROR: Could not create BGPStream instance\n");
@@ -1027,6 +1170,7 @@ bgpview_io_bsrt_t *bgpview_io_bsrt_init(const char *opts, timeseries_t *timeseri
     goto err;
   }
   bsrt->bgpcorsaro->minimum_time = bsrt->cfg.minimum_time;
+  bsrt->bgpcorsaro->publish_start = bsrt->cfg.publish_start;
   bsrt->bgpcorsaro->gap_limit = bsrt->cfg.gap_limit;
 
   if (bsrt->cfg.name && bgpcorsaro_set_monitorname(bsrt->bgpcorsaro, bsrt->cfg.name) != 0) {
@@ -1054,6 +1198,12 @@ bgpview_io_bsrt_t *bgpview_io_bsrt_init(const char *opts, timeseries_t *timeseri
     bgpcorsaro_disable_logfile(bsrt->bgpcorsaro);
   }
 
+  if (bsrt->cfg.checkpoint_file != NULL &&
+      bgpcorsaro_set_checkpoint(bsrt->bgpcorsaro, bsrt->cfg.checkpoint_file,
+                                bsrt->cfg.checkpoint_interval) != 0) {
+    goto err;
+  }
+
   if (bgpcorsaro_start_output(bsrt->bgpcorsaro) != 0) {
     usage(bsrt);
     goto err;
@@ -1085,6 +1235,8 @@ void bgpview_io_bsrt_destroy(bgpview_io_bsrt_t *bsrt)
     free(bsrt->cfg.name);
   if (bsrt->cfg.tmpl)
     free(bsrt->cfg.tmpl);
+  if (bsrt->cfg.checkpoint_file)
+    free(bsrt->cfg.checkpoint_file);
 
   free(bsrt);
   return;
@@ -1105,11 +1257,15 @@ int bgpview_io_bsrt_start(bgpview_io_bsrt_t *bsrt)
 int bgpview_io_bsrt_recv_view(bgpview_io_bsrt_t *bsrt)
 {
   int rc;
-  rc = bgpcorsaro_process_interval(bsrt->bgpcorsaro);
-  if (rc < 0) // error
-    return -1;
-  if (rc == 0) // EOF
-    return -1;
+  do {
+    rc = bgpcorsaro_process_interval(bsrt->bgpcorsaro);
+    if (rc < 0) // error
+      return -1;
+    if (rc == 0) // EOF
+      return -1;
+    /* views built during the warm-up of a slice are not published */
+  } while (bgpview_get_time(bsrt->bgpcorsaro->shared_view) <
+           bsrt->cfg.publish_start);
 
   return 0;
 }
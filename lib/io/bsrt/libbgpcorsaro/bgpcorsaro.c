@@ -71,6 +71,11 @@ static void bgpcorsaro_free(bgpcorsaro_t *bc)
     bc->template = NULL;
   }
 
+  if (bc->checkpoint_file) {
+    free(bc->checkpoint_file);
+    bc->checkpoint_file = NULL;
+  }
+
   if (bc->bsrecord) {
     /* we will assume that somebody else is taking care of the bgpstream record */
     bc->bsrecord = NULL;
@@ -448,6 +453,37 @@ int bgpcorsaro_set_monitorname(bgpcorsaro_t *bc, const char *name)
   return 0;
 }
 
+int bgpcorsaro_set_checkpoint(bgpcorsaro_t *bc, const char *filename,
+                              int interval)
+{
+  assert(bc);
+
+  if (bc->started) {
+    bgpcorsaro_log(__func__, bc, "checkpoints can only be set before "
+                                 "bgpcorsaro_start_output is called");
+    return -1;
+  }
+
+  if (bc->checkpoint_file) {
+    free(bc->checkpoint_file);
+  }
+  if ((bc->checkpoint_file = strdup(filename)) == NULL) {
+    bgpcorsaro_log(__func__, bc, "could not duplicate checkpoint file name");
+    return -1;
+  }
+  bc->checkpoint_interval = interval;
+
+  bgpcorsaro_log(__func__, bc, "checkpointing to %s every %d seconds",
+                 bc->checkpoint_file, bc->checkpoint_interval);
+  return 0;
+}
+
+int bgpcorsaro_get_checkpoint_time(const char *filename,
+                                   uint32_t *resume_time)
+{
+  return bgpcorsaro_routingtables_get_checkpoint_time(filename, resume_time);
+}
+
 const char *bgpcorsaro_get_monitorname(bgpcorsaro_t *bc)
 {
   static char monitorname[BGPCORSARO_HOST_NAME_MAX+1];
@@ -198,6 +198,33 @@ void bgpcorsaro_disable_logfile(bgpcorsaro_t *bgpcorsaro);
  */
 int bgpcorsaro_set_monitorname(bgpcorsaro_t *bgpcorsaro, const char *name);
 
+/** Accessor function to enable checkpointing of the routing tables
+ *
+ * @param bgpcorsaro    The bgpcorsaro object to enable checkpoints for
+ * @param filename      The file to write checkpoints to
+ * @param interval      Minimum number of seconds (bgp time) between two
+ *                      checkpoints
+ * @return 0 if checkpointing was successfully enabled, -1 if an error occurs
+ *
+ * This function must be called before bgpcorsaro_start_output. If the file
+ * already exists, the routing tables are restored from it when the output is
+ * started, and records older than the checkpoint are skipped.
+ */
+int bgpcorsaro_set_checkpoint(bgpcorsaro_t *bgpcorsaro, const char *filename,
+                              int interval);
+
+/** Read the time from which a stream should be resumed to continue from the
+ *  given checkpoint
+ *
+ * @param filename      The checkpoint file
+ * @param[out] resume_time  Set to the first bgp time not covered by the
+ *                          checkpoint
+ * @return 0 if the time was read, -1 if an error occurs (e.g. the file does
+ *         not exist)
+ */
+int bgpcorsaro_get_checkpoint_time(const char *filename,
+                                   uint32_t *resume_time);
+
 /** Accessor function to get the monitor name string
  *
  * @param bgpcorsaro    The bgpcorsaro object to set the monitor name for
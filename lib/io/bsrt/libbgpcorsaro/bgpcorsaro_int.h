@@ -194,11 +194,21 @@ struct bgpcorsaro {
   /** Minimum record time allowed */
   uint32_t minimum_time;
 
+  /** Intervals that start before this time are only used to warm up the
+   *  routing tables: their metrics are not published */
+  uint32_t publish_start;
+
   /** Maximum allowed packet inter-arrival time */
   int gap_limit;
 
   /** Shared bgpview */
   bgpview_t *shared_view;
+
+  /** File the routing tables are checkpointed to (NULL if disabled) */
+  char *checkpoint_file;
+
+  /** Minimum number of seconds (bgp time) between two checkpoints */
+  int checkpoint_interval;
 };
 
 #ifdef WITH_PLUGIN_TIMING
@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include <assert.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -132,6 +133,36 @@ int bgpcorsaro_routingtables_init_output(bgpcorsaro_t *bgpcorsaro)
     routingtables_turn_metric_output_off(state->routing_tables);
   }
 
+  routingtables_set_metric_output_start(state->routing_tables,
+                                        bgpcorsaro->publish_start);
+
+  if (bgpcorsaro->checkpoint_file != NULL) {
+    uint32_t resume_time;
+    /* pick up where the last run left off, if it left a checkpoint */
+    if (access(bgpcorsaro->checkpoint_file, F_OK) == 0) {
+      if (routingtables_load_checkpoint(state->routing_tables,
+                                        bgpcorsaro->checkpoint_file,
+                                        &resume_time) != 0) {
+        bgpcorsaro_log(__func__, bgpcorsaro, "could not load checkpoint %s",
+                       bgpcorsaro->checkpoint_file);
+        goto err;
+      }
+      bgpcorsaro_log(__func__, bgpcorsaro,
+                     "restored routing tables from %s (resuming at %" PRIu32
+                     ")",
+                     bgpcorsaro->checkpoint_file, resume_time);
+      if (bgpcorsaro->minimum_time < resume_time) {
+        bgpcorsaro->minimum_time = resume_time;
+      }
+    }
+    if (routingtables_set_checkpoint(state->routing_tables,
+                                     bgpcorsaro->checkpoint_file,
+                                     bgpcorsaro->checkpoint_interval) != 0) {
+      bgpcorsaro_log(__func__, bgpcorsaro, "could not enable checkpoints");
+      goto err;
+    }
+  }
+
   bgpcorsaro->shared_view = routingtables_get_view_ptr(state->routing_tables);
 
   /* defer opening the output file until we start the first interval */
@@ -243,6 +274,13 @@ int bgpcorsaro_routingtables_end_interval(bgpcorsaro_t *bgpcorsaro,
   return 0;
 }
 
+/** Reads the resume time of a routingtables checkpoint */
+int bgpcorsaro_routingtables_get_checkpoint_time(const char *filename,
+                                                 uint32_t *resume_time)
+{
+  return routingtables_read_checkpoint_time(filename, resume_time);
+}
+
 /** Implements the process_record function of the plugin API */
 int bgpcorsaro_routingtables_process_record(bgpcorsaro_t *bgpcorsaro,
                                             bgpstream_record_t *bs_record)
@@ -44,5 +44,7 @@ int bgpcorsaro_routingtables_end_interval(struct bgpcorsaro *bgpcorsaro,
     struct bgpcorsaro_interval *int_end);
 int bgpcorsaro_routingtables_process_record(struct bgpcorsaro *bgpcorsaro,
     struct bgpstream_record *bs_record);
+int bgpcorsaro_routingtables_get_checkpoint_time(const char *filename,
+    uint32_t *resume_time);
 
 #endif /* __BGPCORSARO_ROUTINGTABLES_H */
@@ -75,13 +75,14 @@ static char *graphite_safe(char *buf)
 
 #define get_wall_time_now()  ((uint32_t)time(NULL))
 
-static perpfx_perpeer_info_t *perpfx_perpeer_info_create(void)
+perpfx_perpeer_info_t *perpfx_perpeer_info_create(void)
 {
   perpfx_perpeer_info_t *pfxpeeri =
     (perpfx_perpeer_info_t *)malloc_zero(sizeof(perpfx_perpeer_info_t));
   if (pfxpeeri != NULL) {
     pfxpeeri->pfx_status = RT_INITIAL_PFXSTATUS;
     pfxpeeri->bgp_time_last_ts = 0;
+    pfxpeeri->interval_start = 0;
     pfxpeeri->bgp_time_uc_delta_ts = 0;
     /* the path id is ignored unless it is set by a RIB message
      * (i.e. RT_UC_ANNOUNCED_PFXSTATUS is on), that's
@@ -91,7 +92,7 @@ static perpfx_perpeer_info_t *perpfx_perpeer_info_create(void)
   return pfxpeeri;
 }
 
-static void perpeer_info_destroy(void *p)
+void perpeer_info_destroy(void *p)
 {
   if (p == NULL)
     return;
@@ -103,21 +104,13 @@ static void perpeer_info_destroy(void *p)
     kh_destroy(origin_segments, pi->announcing_ases);
     pi->announcing_ases = NULL;
   }
-  if (pi->announced_pfxs != NULL) {
-    bgpstream_pfx_set_destroy(pi->announced_pfxs);
-    pi->announced_pfxs = NULL;
-  }
-  if (pi->withdrawn_pfxs != NULL) {
-    bgpstream_pfx_set_destroy(pi->withdrawn_pfxs);
-    pi->withdrawn_pfxs = NULL;
-  }
   free(p);
 }
 
 /* default: all ts are 0, while the peer state is
  * BGPSTREAM_ELEM_PEERSTATE_UNKNOWN */
-static perpeer_info_t *perpeer_info_create(routingtables_t *rt, collector_t *c,
-                                           uint32_t peer_id)
+perpeer_info_t *perpeer_info_create(routingtables_t *rt, collector_t *c,
+                                    uint32_t peer_id)
 {
   char ip_str[INET6_ADDRSTRLEN];
   unsigned v = 0;
@@ -149,19 +142,12 @@ static perpeer_info_t *perpeer_info_create(routingtables_t *rt, collector_t *c,
   p->bgp_time_uc_rib_start = 0;
   p->bgp_time_uc_rib_end = 0;
   p->last_ts = 0;
-  p->rib_positive_mismatches_cnt = 0;
-  p->rib_negative_mismatches_cnt = 0;
+  memset(p->interval_cnts, 0, sizeof(p->interval_cnts));
   p->metrics_generated = 0;
 
   if ((p->announcing_ases = kh_init(origin_segments)) == NULL)
     goto err;
 
-  if ((p->announced_pfxs = bgpstream_pfx_set_create()) == NULL)
-    goto err;
-
-  if ((p->withdrawn_pfxs = bgpstream_pfx_set_create()) == NULL)
-    goto err;
-
   return p;
 err:
   fprintf(stderr, "Error: can't create per-peer info\n");
@@ -181,23 +167,65 @@ static void collector_destroy(collector_t *c)
   }
 }
 
-static collector_t *get_collector_data(routingtables_t *rt, const char *project,
-                                       const char *collector)
+collector_t *collector_add(routingtables_t *rt, const char *collector,
+                           const char *collector_str)
 {
   khiter_t k;
   int khret;
   collector_t *c = NULL;
 
+  /* collector data initialization (all the fields needs to be */
+  /* explicitely initialized */
+  if (!(c = malloc(sizeof(collector_t))))
+    goto err;
+
+  strncpy(c->collector_str, collector_str, BGPSTREAM_UTILS_STR_NAME_LEN);
+  c->collector_str[BGPSTREAM_UTILS_STR_NAME_LEN - 1] = '\0';
+
+  if ((c->collector_peerids = kh_init(peer_id_set)) == NULL)
+    goto err;
+
+  c->bgp_time_last = 0;
+#if 0
+  c->wall_time_last = 0;
+#endif
+  c->bgp_time_ref_rib_dump_time = 0;
+  c->bgp_time_ref_rib_start_time = 0;
+  c->bgp_time_uc_rib_dump_time = 0;
+  c->bgp_time_uc_rib_start_time = 0;
+  c->state = RT_COLLECTOR_STATE_UNKNOWN;
+  c->active_peers_cnt = 0;
+  c->valid_record_cnt = 0;
+  c->corrupted_record_cnt = 0;
+  c->empty_record_cnt = 0;
+  c->eovrib_flag = 0;
+  c->publish_flag = 0;
+
+  collector_generate_metrics(rt, c);
+
+  /* insert key,value in map */
+  k = kh_put(collector_data, rt->collectors, strdup(collector), &khret);
+  kh_val(rt->collectors, k) = c;
+
+  return c;
+
+err:
+  fprintf(stderr, "Error: can't create collector data\n");
+  collector_destroy(c);
+  return NULL;
+}
+
+static collector_t *get_collector_data(routingtables_t *rt, const char *project,
+                                       const char *collector)
+{
+  khiter_t k;
+  char collector_str[BGPSTREAM_UTILS_STR_NAME_LEN];
+
   /* create new collector-related structures if it is the first time
    * we see it */
   if ((k = kh_get(collector_data, rt->collectors, (char *)collector)) ==
       kh_end(rt->collectors)) {
 
-    /* collector data initialization (all the fields needs to be */
-    /* explicitely initialized */
-    if (!(c = malloc(sizeof(collector_t))))
-      goto err;
-
     char project_name[BGPSTREAM_UTILS_STR_NAME_LEN];
     strncpy(project_name, project, BGPSTREAM_UTILS_STR_NAME_LEN);
     graphite_safe(project_name);
@@ -206,45 +234,17 @@ static collector_t *get_collector_data(routingtables_t *rt, const char *project,
     strncpy(collector_name, collector, BGPSTREAM_UTILS_STR_NAME_LEN);
     graphite_safe(collector_name);
 
-    if (snprintf(c->collector_str, BGPSTREAM_UTILS_STR_NAME_LEN, "%s.%s",
+    if (snprintf(collector_str, BGPSTREAM_UTILS_STR_NAME_LEN, "%s.%s",
                  project_name,
                  collector_name) >= BGPSTREAM_UTILS_STR_NAME_LEN) {
       fprintf(stderr,
         "Warning: could not print collector signature: truncated output\n");
     }
 
-    if ((c->collector_peerids = kh_init(peer_id_set)) == NULL)
-      goto err;
-
-    c->bgp_time_last = 0;
-#if 0
-    c->wall_time_last = 0;
-#endif
-    c->bgp_time_ref_rib_dump_time = 0;
-    c->bgp_time_ref_rib_start_time = 0;
-    c->bgp_time_uc_rib_dump_time = 0;
-    c->bgp_time_uc_rib_start_time = 0;
-    c->state = RT_COLLECTOR_STATE_UNKNOWN;
-    c->active_peers_cnt = 0;
-    c->valid_record_cnt = 0;
-    c->corrupted_record_cnt = 0;
-    c->empty_record_cnt = 0;
-    c->eovrib_flag = 0;
-    c->publish_flag = 0;
-
-    collector_generate_metrics(rt, c);
-
-    /* insert key,value in map */
-    k = kh_put(collector_data, rt->collectors, strdup(collector), &khret);
-    kh_val(rt->collectors, k) = c;
+    return collector_add(rt, collector, collector_str);
   }
 
   return kh_val(rt->collectors, k);
-
-err:
-  fprintf(stderr, "Error: can't create collector data\n");
-  collector_destroy(c);
-  return NULL;
 }
 
 /** Stop the under construction process
@@ -320,7 +320,7 @@ static void reset_peerpfxdata(routingtables_t *rt, bgpstream_peer_id_t peer_id,
       pp->bgp_time_last_ts = 0;
       if (reset_uc) {
         pp->bgp_time_uc_delta_ts = 0;
-        pp->pfx_status = RT_INITIAL_PFXSTATUS;
+        pp->pfx_status &= RT_INTERVAL_PFXSTATUS;
       }
       bgpview_iter_pfx_deactivate_peer(rt->iter);
     }
@@ -441,7 +441,7 @@ static int apply_end_of_valid_rib_operations(routingtables_t *rt)
                * inactive in the previous state and now it is in the rib */
               if (pp->bgp_time_last_ts != 0 &&
                   !(pp->pfx_status & RT_ANNOUNCED_PFXSTATUS)) {
-                p->rib_negative_mismatches_cnt++;
+                p->interval_cnts[RT_PEER_RIB_NEGATIVE_MISMATCHES_CNT]++;
 
                 fprintf(stderr, "Warning RIB MISMATCH @ %s.%s: %s RIB-A: %" PRIu32
                                 " STATE-W: %" PRIu32 "\n",
@@ -457,7 +457,10 @@ static int apply_end_of_valid_rib_operations(routingtables_t *rt)
                 fprintf(stderr, "Error: could not set AS path\n");
                 return -1;
               }
-              pp->pfx_status = RT_ANNOUNCED_PFXSTATUS;
+              /* the interval flags are kept (they carry their own
+               * interval) */
+              pp->pfx_status &= RT_INTERVAL_PFXSTATUS;
+              pp->pfx_status |= RT_ANNOUNCED_PFXSTATUS;
               pp->bgp_time_last_ts =
                 pp->bgp_time_uc_delta_ts + p->bgp_time_uc_rib_start;
 
@@ -472,7 +475,7 @@ static int apply_end_of_valid_rib_operations(routingtables_t *rt)
                * deactivate the field (it may be already inactive) */
               if (bgpview_iter_pfx_peer_get_state(rt->iter) ==
                   BGPVIEW_FIELD_ACTIVE) {
-                p->rib_positive_mismatches_cnt++;
+                p->interval_cnts[RT_PEER_RIB_POSITIVE_MISMATCHES_CNT]++;
                 fprintf(stderr, "Warning RIB MISMATCH @ %s.%s: %s RIB-W: %" PRIu32
                                 " STATE-A: %" PRIu32 "\n",
                         p->collector_str, p->peer_str,
@@ -482,7 +485,7 @@ static int apply_end_of_valid_rib_operations(routingtables_t *rt)
               }
 
               bgpview_iter_pfx_peer_set_as_path(rt->iter, NULL);
-              pp->pfx_status = RT_INITIAL_PFXSTATUS;
+              pp->pfx_status &= RT_INTERVAL_PFXSTATUS;
               pp->bgp_time_last_ts = 0;
               bgpview_iter_pfx_deactivate_peer(rt->iter);
             }
@@ -583,31 +586,56 @@ static int apply_end_of_valid_rib_operations(routingtables_t *rt)
   return 0;
 }
 
-static int update_peer_stats(perpeer_info_t *p, bgpstream_elem_t *elem)
+/** Update the interval counters of a peer
+ *  @note: the interval flags of pp must have been reset already if they
+ *  refer to a previous interval */
+static int update_peer_stats(routingtables_t *rt, perpeer_info_t *p,
+                             perpfx_perpeer_info_t *pp, bgpstream_elem_t *elem)
 {
+  int v6 = (elem->prefix.address.version == BGPSTREAM_ADDR_VERSION_IPV6);
+  khiter_t k;
+  int khret;
+
   if (elem->type == BGPSTREAM_ELEM_TYPE_ANNOUNCEMENT) {
     /* increase announcements count for current peer */
-    p->pfx_announcements_cnt++;
+    p->interval_cnts[RT_PEER_PFX_ANNOUNCEMENTS_CNT]++;
 
+    /* count each origin once per interval */
     bgpstream_as_path_seg_t *origin =
       bgpstream_as_path_get_origin_seg(elem->as_path);
-    if (kh_get(origin_segments, p->announcing_ases, origin) ==
+    if ((k = kh_get(origin_segments, p->announcing_ases, origin)) ==
         kh_end(p->announcing_ases)) {
-      int khret;
       if ((origin = bgpstream_as_path_seg_dup(origin)) == NULL) {
         fprintf(stderr, "ERROR: could not duplicate origin segment\n");
         return -1;
       }
-      kh_put(origin_segments, p->announcing_ases, origin, &khret);
+      k = kh_put(origin_segments, p->announcing_ases, origin, &khret);
+      kh_val(p->announcing_ases, k) = rt->bgp_time_interval_start;
+      p->interval_cnts[RT_PEER_ANNOUNCING_ORIGIN_AS_CNT]++;
+    } else if (kh_val(p->announcing_ases, k) != rt->bgp_time_interval_start) {
+      kh_val(p->announcing_ases, k) = rt->bgp_time_interval_start;
+      p->interval_cnts[RT_PEER_ANNOUNCING_ORIGIN_AS_CNT]++;
+    }
+
+    /* count each prefix once per interval */
+    if (!(pp->pfx_status & RT_INTERVAL_ANNOUNCED_PFXSTATUS)) {
+      pp->pfx_status |= RT_INTERVAL_ANNOUNCED_PFXSTATUS;
+      p->interval_cnts[v6 ? RT_PEER_ANNOUNCED_V6_PFXS_CNT
+                          : RT_PEER_ANNOUNCED_V4_PFXS_CNT]++;
     }
-    bgpstream_pfx_set_insert(p->announced_pfxs, &elem->prefix);
     return 0;
 
   } else {
     assert(elem->type == BGPSTREAM_ELEM_TYPE_WITHDRAWAL);
     /* increase withdrawals count for current peer */
-    p->pfx_withdrawals_cnt++;
-    bgpstream_pfx_set_insert(p->withdrawn_pfxs, &elem->prefix);
+    p->interval_cnts[RT_PEER_PFX_WITHDRAWALS_CNT]++;
+
+    /* count each prefix once per interval */
+    if (!(pp->pfx_status & RT_INTERVAL_WITHDRAWN_PFXSTATUS)) {
+      pp->pfx_status |= RT_INTERVAL_WITHDRAWN_PFXSTATUS;
+      p->interval_cnts[v6 ? RT_PEER_WITHDRAWN_V6_PFXS_CNT
+                          : RT_PEER_WITHDRAWN_V4_PFXS_CNT]++;
+    }
     return 0;
   }
 }
@@ -655,6 +683,14 @@ static int apply_prefix_update(routingtables_t *rt, collector_t *c,
     bgpview_iter_pfx_peer_set_user(rt->iter, pp);
   }
 
+  /* the interval flags are stale if they were set in a previous interval
+   * (bgp_time_last_ts cannot tell, since RIBs may set it to an earlier
+   * time) */
+  if (pp->interval_start != rt->bgp_time_interval_start) {
+    pp->pfx_status &= ~RT_INTERVAL_PFXSTATUS;
+    pp->interval_start = rt->bgp_time_interval_start;
+  }
+
   /* the ts received is more recent than the information in the pfx-peer
    * we update both ts and path */
   pp->bgp_time_last_ts = ts;
@@ -670,7 +706,7 @@ static int apply_prefix_update(routingtables_t *rt, collector_t *c,
   }
 
   /* update stats associated with the peer */
-  if (update_peer_stats(p, elem) != 0) {
+  if (update_peer_stats(rt, p, pp, elem) != 0) {
     return -1;
   }
 
@@ -741,7 +777,7 @@ static int apply_state_update(routingtables_t *rt, collector_t *c,
   assert(peer_id == bgpview_iter_peer_get_peer_id(rt->iter));
   perpeer_info_t *p = bgpview_iter_peer_get_user(rt->iter);
 
-  p->state_messages_cnt++;
+  p->interval_cnts[RT_PEER_STATE_MESSAGES_CNT]++;
 
   if (p->bgp_fsm_state != new_state) {
     if (p->bgp_fsm_state == BGPSTREAM_ELEM_PEERSTATE_ESTABLISHED) {
@@ -809,7 +845,7 @@ static int apply_rib_message(routingtables_t *rt, collector_t *c,
     p->bgp_time_uc_rib_start = ts;
   }
   p->bgp_time_uc_rib_end = ts;
-  p->rib_messages_cnt++;
+  p->interval_cnts[RT_PEER_RIB_MESSAGES_CNT]++;
 
   if (bgpview_iter_seek_pfx_peer(rt->iter, &elem->prefix, peer_id,
       BGPVIEW_FIELD_ALL_VALID, BGPVIEW_FIELD_ALL_VALID) == 0) {
@@ -1109,6 +1145,11 @@ routingtables_t *routingtables_create(char *plugin_name,
     goto err;
   }
 
+  /* keep track of the prefixes touched in each interval so that diff
+   * producers do not have to compare the whole view against its parent */
+  if (bgpview_enable_change_tracking(rt->view) != 0)
+    goto err;
+
   if ((rt->iter = bgpview_iter_create(rt->view)) == NULL)
     goto err;
 
@@ -1174,10 +1215,19 @@ void routingtables_turn_metric_output_off(routingtables_t *rt)
   rt->metrics_output_on = 0;
 }
 
+void routingtables_set_metric_output_start(routingtables_t *rt,
+                                           uint32_t start_time)
+{
+  rt->metrics_output_start = start_time;
+}
+
 int routingtables_interval_start(routingtables_t *rt, int start_time)
 {
   rt->bgp_time_interval_start = (uint32_t)start_time;
   rt->wall_time_interval_start = get_wall_time_now();
+  /* the view published at the end of the previous interval becomes the
+   * baseline for the changes made during this one */
+  bgpview_mark_changes(rt->view);
   /* setting the time of the view */
   bgpview_set_time(rt->view, rt->bgp_time_interval_start);
   return 0;
@@ -1190,9 +1240,25 @@ int routingtables_interval_end(routingtables_t *rt, int end_time)
 
   uint32_t time_now = get_wall_time_now();
 
-  if (rt->metrics_output_on) {
+  if (rt->metrics_output_on &&
+      rt->bgp_time_interval_start >= rt->metrics_output_start) {
     routingtables_dump_metrics(rt, time_now);
   }
+  /* warm-up intervals must not be accounted in the first published one */
+  routingtables_reset_metrics(rt);
+
+  if (rt->checkpoint_filename != NULL &&
+      rt->bgp_time_interval_end >= rt->checkpoint_next_time) {
+    /* a failed checkpoint only costs a longer replay on restart, so we
+     * keep going and try again at the end of the next interval */
+    if (routingtables_checkpoint_write(rt) == 0) {
+      rt->checkpoint_next_time =
+        rt->bgp_time_interval_end + rt->checkpoint_interval;
+    } else {
+      fprintf(stderr, "Warning: could not write checkpoint %s\n",
+              rt->checkpoint_filename);
+    }
+  }
 
   return 0;
 }
@@ -1298,6 +1364,9 @@ void routingtables_destroy(routingtables_t *rt)
       rt->kp = NULL;
     }
 
+    free(rt->checkpoint_filename);
+    rt->checkpoint_filename = NULL;
+
     free(rt);
   }
 }
@@ -59,6 +59,10 @@ routingtables_t *routingtables_create(char *plugin_name,
  *
  * @param rt               pointer to a routingtables instance to update
  * @return a pointer to the internal bgpview
+ *
+ * The view has change tracking enabled, and is marked at the start of each
+ * interval, so the prefixes touched during the interval can be walked using
+ * bgpview_iter_first_changed_pfx (see bgpview_has_changes_since).
  */
 bgpview_t *routingtables_get_view_ptr(routingtables_t *rt);
 
@@ -82,6 +86,58 @@ char *routingtables_get_metric_prefix(routingtables_t *rt);
 /** turn off metric output */
 void routingtables_turn_metric_output_off(routingtables_t *rt);
 
+/** Only output metrics for the intervals that start at or after the given
+ *  time (i.e. the earlier intervals are only used to warm up the tables)
+ *
+ * @param rt            pointer to a routingtables instance to update
+ * @param start_time    first interval start time (bgp time) to output
+ */
+void routingtables_set_metric_output_start(routingtables_t *rt,
+                                           uint32_t start_time);
+
+/** Periodically checkpoint the routingtables state to a file
+ *
+ * @param rt            pointer to a routingtables instance to update
+ * @param filename      name of the checkpoint file (NULL to disable)
+ * @param interval      minimum number of seconds (bgp time) between two
+ *                      checkpoints (0 to checkpoint at every interval end)
+ * @return 0 if the checkpoint was configured correctly, <0 if an error
+ * occurred.
+ *
+ * Checkpoints are written at the end of an interval, to a temporary file
+ * that then replaces the previous checkpoint, so the file always holds a
+ * complete snapshot. The file is compressed if its name implies it (e.g.
+ * ".gz").
+ */
+int routingtables_set_checkpoint(routingtables_t *rt, const char *filename,
+                                 uint32_t interval);
+
+/** Read the time from which processing should resume when the given
+ *  checkpoint is loaded
+ *
+ * @param filename      name of the checkpoint file
+ * @param[out] resume_time  set to the first bgp time not reflected in the
+ *                          checkpoint
+ * @return 0 if the time was read correctly, <0 if an error occurred (e.g.
+ * the file does not exist).
+ */
+int routingtables_read_checkpoint_time(const char *filename,
+                                       uint32_t *resume_time);
+
+/** Restore the routingtables state from a checkpoint
+ *
+ * @param rt            pointer to an empty routingtables instance
+ * @param filename      name of the checkpoint file
+ * @param[out] resume_time  set to the first bgp time not reflected in the
+ *                          checkpoint
+ * @return 0 if the checkpoint was loaded correctly, <0 if an error occurred.
+ *
+ * The checkpoint must be loaded before any record is processed. Records
+ * older than resume_time must not be fed to the instance afterwards.
+ */
+int routingtables_load_checkpoint(routingtables_t *rt, const char *filename,
+                                  uint32_t *resume_time);
+
 /** Receive the beginning of interval signal
  *
  * @param rt            pointer to a routingtables instance to update
@@ -0,0 +1,755 @@
+/*
+ * Copyright (C) 2014 The Regents of the University of California.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "config.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wandio.h>
+
+#include "utils.h"
+
+#include "bgpview_io.h"
+#include "routingtables_int.h"
+#include "routingtables.h"
+
+/** @file
+ *
+ * @brief Checkpoint/restore of the routingtables state
+ *
+ * A checkpoint contains everything that routingtables needs to carry on
+ * processing a stream as if it had never been interrupted: the collector
+ * state machines, the peers (and their per-peer information), the AS path
+ * store and every prefix-peer cell (active or not) with its per-pfx-peer
+ * information, including the under-construction RIB state.
+ *
+ * The snapshot is meant to be read back by the same build on the same host,
+ * so values are written in host byte order.
+ */
+
+#define RT_CKPT_MAGIC 0x52544350     /* RTCP */
+#define RT_CKPT_END_MAGIC 0x43454E44 /* CEND */
+#define RT_CKPT_VERSION 1
+
+/** Compression level used when the checkpoint name implies compression */
+#define RT_CKPT_COMPRESS_LEVEL 6
+
+/** Path index used for cells that do not reference any path */
+#define RT_CKPT_NO_PATH UINT32_MAX
+
+#define BUFFER_LEN 1024
+
+/** Path store ID of a path read from a checkpoint (the path indices of the
+ *  checkpoint may have gaps, whose entries are not valid) */
+typedef struct ckpt_path {
+  bgpstream_as_path_store_path_id_t id;
+  uint8_t valid;
+} ckpt_path_t;
+
+#define WRITE_VAL(from) BGPVIEW_IO_WRITE_VAL(outfile, from, "checkpoint")
+
+#define READ_VAL(to) BGPVIEW_IO_READ_VAL(infile, to, "checkpoint")
+
+/* ========== WRITE ========== */
+
+static int write_str(iow_t *outfile, const char *str)
+{
+  uint8_t len = strlen(str);
+  WRITE_VAL(len);
+  if (wandio_wwrite(outfile, str, len) != len) {
+    goto err;
+  }
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_ip(iow_t *outfile, bgpstream_ip_addr_t *ip)
+{
+  uint8_t version = ip->version;
+  WRITE_VAL(version);
+  switch (ip->version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    WRITE_VAL(ip->bs_ipv4.addr.s_addr);
+    return 0;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    WRITE_VAL(ip->bs_ipv6.addr.s6_addr);
+    return 0;
+
+  default:
+    break;
+  }
+
+err:
+  return -1;
+}
+
+static int write_collectors(iow_t *outfile, routingtables_t *rt)
+{
+  collector_t *c;
+  uint32_t cnt = kh_size(rt->collectors);
+  uint8_t u8;
+
+  WRITE_VAL(cnt);
+
+  for (khiter_t k = kh_begin(rt->collectors); k != kh_end(rt->collectors);
+       ++k) {
+    if (!kh_exist(rt->collectors, k))
+      continue;
+    c = kh_val(rt->collectors, k);
+
+    if (write_str(outfile, kh_key(rt->collectors, k)) != 0 ||
+        write_str(outfile, c->collector_str) != 0) {
+      goto err;
+    }
+    WRITE_VAL(c->bgp_time_last);
+    WRITE_VAL(c->bgp_time_ref_rib_dump_time);
+    WRITE_VAL(c->bgp_time_ref_rib_start_time);
+    WRITE_VAL(c->bgp_time_uc_rib_dump_time);
+    WRITE_VAL(c->bgp_time_uc_rib_start_time);
+    u8 = c->state;
+    WRITE_VAL(u8);
+    WRITE_VAL(c->eovrib_flag);
+    WRITE_VAL(c->publish_flag);
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_peers(iow_t *outfile, routingtables_t *rt)
+{
+  bgpstream_peer_id_t peer_id;
+  bgpstream_peer_sig_t *sg;
+  perpeer_info_t *p;
+  uint32_t cnt = bgpview_peer_cnt(rt->view, BGPVIEW_FIELD_ALL_VALID);
+  uint8_t u8;
+
+  WRITE_VAL(cnt);
+
+  for (bgpview_iter_first_peer(rt->iter, BGPVIEW_FIELD_ALL_VALID);
+       bgpview_iter_has_more_peer(rt->iter); bgpview_iter_next_peer(rt->iter)) {
+    peer_id = bgpview_iter_peer_get_peer_id(rt->iter);
+    sg = bgpview_iter_peer_get_sig(rt->iter);
+    p = bgpview_iter_peer_get_user(rt->iter);
+    assert(sg != NULL && p != NULL);
+
+    WRITE_VAL(peer_id);
+    if (write_str(outfile, sg->collector_str) != 0 ||
+        write_ip(outfile, &sg->peer_ip_addr) != 0) {
+      goto err;
+    }
+    WRITE_VAL(sg->peer_asnumber);
+
+    u8 = bgpview_iter_peer_get_state(rt->iter);
+    WRITE_VAL(u8);
+    u8 = p->bgp_fsm_state;
+    WRITE_VAL(u8);
+    WRITE_VAL(p->bgp_time_ref_rib_start);
+    WRITE_VAL(p->bgp_time_ref_rib_end);
+    WRITE_VAL(p->bgp_time_uc_rib_start);
+    WRITE_VAL(p->bgp_time_uc_rib_end);
+    WRITE_VAL(p->last_ts);
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_paths(iow_t *outfile, routingtables_t *rt)
+{
+  bgpstream_as_path_store_path_t *spath;
+  bgpstream_as_path_t *path;
+  uint32_t cnt = bgpstream_as_path_store_get_size(rt->pathstore);
+  uint32_t idx;
+  uint8_t *path_data;
+  uint8_t is_core;
+  uint16_t path_len;
+
+  WRITE_VAL(cnt);
+
+  for (bgpstream_as_path_store_iter_first_path(rt->pathstore);
+       bgpstream_as_path_store_iter_has_more_path(rt->pathstore);
+       bgpstream_as_path_store_iter_next_path(rt->pathstore)) {
+    spath = bgpstream_as_path_store_iter_get_path(rt->pathstore);
+    assert(spath != NULL);
+
+    idx = bgpstream_as_path_store_path_get_idx(spath);
+    is_core = bgpstream_as_path_store_path_is_core(spath);
+    path = bgpstream_as_path_store_path_get_int_path(spath);
+    assert(path != NULL);
+    path_len = bgpstream_as_path_get_data(path, &path_data);
+
+    WRITE_VAL(idx);
+    WRITE_VAL(is_core);
+    WRITE_VAL(path_len);
+    if (wandio_wwrite(outfile, path_data, path_len) != path_len) {
+      goto err;
+    }
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_pfx_peers(iow_t *outfile, routingtables_t *rt)
+{
+  bgpstream_peer_id_t peer_id;
+  bgpstream_as_path_store_path_t *spath;
+  perpfx_perpeer_info_t *pp;
+  uint32_t idx;
+  uint8_t u8;
+
+  for (bgpview_iter_pfx_first_peer(rt->iter, BGPVIEW_FIELD_ALL_VALID);
+       bgpview_iter_pfx_has_more_peer(rt->iter);
+       bgpview_iter_pfx_next_peer(rt->iter)) {
+    peer_id = bgpview_iter_peer_get_peer_id(rt->iter);
+    pp = bgpview_iter_pfx_peer_get_user(rt->iter);
+    assert(peer_id != 0 && pp != NULL);
+
+    WRITE_VAL(peer_id);
+
+    spath = bgpview_iter_pfx_peer_get_as_path_store_path(rt->iter);
+    idx = spath != NULL ? bgpstream_as_path_store_path_get_idx(spath)
+                        : RT_CKPT_NO_PATH;
+    WRITE_VAL(idx);
+
+    u8 = bgpview_iter_pfx_peer_get_state(rt->iter);
+    WRITE_VAL(u8);
+
+    /* the uc path id is only meaningful while a RIB is being built */
+    idx = RT_CKPT_NO_PATH;
+    if (pp->pfx_status & RT_UC_ANNOUNCED_PFXSTATUS) {
+      spath = bgpstream_as_path_store_get_store_path(rt->pathstore,
+                                                     pp->uc_as_path_id);
+      assert(spath != NULL);
+      idx = bgpstream_as_path_store_path_get_idx(spath);
+    }
+    WRITE_VAL(idx);
+    WRITE_VAL(pp->bgp_time_uc_delta_ts);
+    WRITE_VAL(pp->bgp_time_last_ts);
+    WRITE_VAL(pp->pfx_status);
+  }
+
+  /* peer ids start from 1, so 0 marks the end of the cells */
+  peer_id = 0;
+  WRITE_VAL(peer_id);
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int write_pfxs(iow_t *outfile, routingtables_t *rt)
+{
+  bgpstream_pfx_t *pfx;
+  uint32_t cnt = bgpview_pfx_cnt(rt->view, BGPVIEW_FIELD_ALL_VALID);
+
+  WRITE_VAL(cnt);
+
+  for (bgpview_iter_first_pfx(rt->iter, 0 /* all versions */,
+                              BGPVIEW_FIELD_ALL_VALID);
+       bgpview_iter_has_more_pfx(rt->iter); bgpview_iter_next_pfx(rt->iter)) {
+    pfx = bgpview_iter_pfx_get_pfx(rt->iter);
+    assert(pfx != NULL);
+
+    if (write_ip(outfile, &pfx->address) != 0) {
+      goto err;
+    }
+    WRITE_VAL(pfx->mask_len);
+
+    if (write_pfx_peers(outfile, rt) != 0) {
+      goto err;
+    }
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+/* ========== READ ========== */
+
+static int read_str(io_t *infile, char *buf, size_t buflen)
+{
+  uint8_t len;
+  READ_VAL(len);
+  if (len >= buflen || wandio_read(infile, buf, len) != len) {
+    goto err;
+  }
+  buf[len] = '\0';
+  return 0;
+
+err:
+  return -1;
+}
+
+static int read_ip(io_t *infile, bgpstream_ip_addr_t *ip)
+{
+  uint8_t version;
+  READ_VAL(version);
+  switch (version) {
+  case BGPSTREAM_ADDR_VERSION_IPV4:
+    ip->version = BGPSTREAM_ADDR_VERSION_IPV4;
+    READ_VAL(ip->bs_ipv4.addr.s_addr);
+    return 0;
+
+  case BGPSTREAM_ADDR_VERSION_IPV6:
+    ip->version = BGPSTREAM_ADDR_VERSION_IPV6;
+    READ_VAL(ip->bs_ipv6.addr.s6_addr);
+    return 0;
+
+  default:
+    fprintf(stderr, "ERROR: Invalid IP version in checkpoint (%d)\n",
+            version);
+    break;
+  }
+
+err:
+  return -1;
+}
+
+static int read_header(io_t *infile, uint32_t *resume_time)
+{
+  uint32_t magic;
+  uint32_t version;
+
+  READ_VAL(magic);
+  if (magic != RT_CKPT_MAGIC) {
+    fprintf(stderr, "ERROR: Not a routingtables checkpoint\n");
+    goto err;
+  }
+  READ_VAL(version);
+  if (version != RT_CKPT_VERSION) {
+    fprintf(stderr, "ERROR: Unsupported checkpoint version %" PRIu32 "\n",
+            version);
+    goto err;
+  }
+  READ_VAL(*resume_time);
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int read_collectors(io_t *infile, routingtables_t *rt)
+{
+  char name[BGPSTREAM_UTILS_STR_NAME_LEN];
+  char collector_str[BGPSTREAM_UTILS_STR_NAME_LEN];
+  collector_t *c;
+  uint32_t cnt;
+  uint8_t u8;
+
+  READ_VAL(cnt);
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    if (read_str(infile, name, sizeof(name)) != 0 ||
+        read_str(infile, collector_str, sizeof(collector_str)) != 0) {
+      goto err;
+    }
+    if ((c = collector_add(rt, name, collector_str)) == NULL) {
+      goto err;
+    }
+    READ_VAL(c->bgp_time_last);
+    READ_VAL(c->bgp_time_ref_rib_dump_time);
+    READ_VAL(c->bgp_time_ref_rib_start_time);
+    READ_VAL(c->bgp_time_uc_rib_dump_time);
+    READ_VAL(c->bgp_time_uc_rib_start_time);
+    READ_VAL(u8);
+    c->state = u8;
+    READ_VAL(c->eovrib_flag);
+    READ_VAL(c->publish_flag);
+  }
+
+  return 0;
+
+err:
+  return -1;
+}
+
+static int read_peers(io_t *infile, routingtables_t *rt,
+                      bgpstream_peer_id_t *peerid_map)
+{
+  char collector_name[BGPSTREAM_UTILS_STR_NAME_LEN];
+  bgpstream_ip_addr_t peer_ip;
+  uint32_t peer_asn;
+  bgpstream_peer_id_t peer_id_orig;
+  bgpstream_peer_id_t peer_id;
+  perpeer_info_t *p = NULL;
+  collector_t *c;
+  khiter_t k;
+  int khret;
+  uint32_t cnt;
+  uint8_t state;
+  uint8_t u8;
+
+  READ_VAL(cnt);
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    READ_VAL(peer_id_orig);
+    memset(&peer_ip, 0, sizeof(peer_ip));
+    if (read_str(infile, collector_name, sizeof(collector_name)) != 0 ||
+        read_ip(infile, &peer_ip) != 0) {
+      goto err;
+    }
+    READ_VAL(peer_asn);
+
+    if ((k = kh_get(collector_data, rt->collectors, collector_name)) ==
+        kh_end(rt->collectors)) {
+      fprintf(stderr, "ERROR: Checkpoint peer for unknown collector %s\n",
+              collector_name);
+      goto err;
+    }
+    c = kh_val(rt->collectors, k);
+
+    if ((peer_id = bgpview_iter_add_peer(rt->iter, collector_name, &peer_ip,
+                                         peer_asn)) == 0) {
+      goto err;
+    }
+    peerid_map[peer_id_orig] = peer_id;
+
+    if ((p = perpeer_info_create(rt, c, peer_id)) == NULL) {
+      goto err;
+    }
+    READ_VAL(state);
+    READ_VAL(u8);
+    p->bgp_fsm_state = u8;
+    READ_VAL(p->bgp_time_ref_rib_start);
+    READ_VAL(p->bgp_time_ref_rib_end);
+    READ_VAL(p->bgp_time_uc_rib_start);
+    READ_VAL(p->bgp_time_uc_rib_end);
+    READ_VAL(p->last_ts);
+
+    bgpview_iter_peer_set_user(rt->iter, p);
+    p = NULL;
+    kh_put(peer_id_set, c->collector_peerids, peer_id, &khret);
+
+    if (state == BGPVIEW_FIELD_ACTIVE) {
+      bgpview_iter_activate_peer(rt->iter);
+    }
+  }
+
+  return 0;
+
+err:
+  perpeer_info_destroy(p);
+  return -1;
+}
+
+static int read_paths(io_t *infile, routingtables_t *rt,
+                      ckpt_path_t **pathid_map, uint32_t *pathid_map_cnt)
+{
+  ckpt_path_t *idmap = NULL;
+  ckpt_path_t *new_idmap;
+  uint32_t idmap_cnt = 0;
+  uint32_t new_cnt;
+  uint32_t cnt;
+  uint32_t idx;
+  uint8_t is_core;
+  uint16_t path_len;
+  uint8_t path_data[BUFFER_LEN];
+
+  READ_VAL(cnt);
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    READ_VAL(idx);
+    READ_VAL(is_core);
+    READ_VAL(path_len);
+    if (path_len > BUFFER_LEN ||
+        wandio_read(infile, path_data, path_len) != path_len) {
+      fprintf(stderr, "ERROR: Could not read path data\n");
+      goto err;
+    }
+
+    if (idx >= idmap_cnt) {
+      new_cnt = idx < cnt ? cnt : idx + 1;
+      if ((new_idmap = realloc(idmap, sizeof(ckpt_path_t) * new_cnt)) ==
+          NULL) {
+        fprintf(stderr, "ERROR: Could not grow path map\n");
+        goto err;
+      }
+      /* indices that are not in the checkpoint stay invalid */
+      memset(new_idmap + idmap_cnt, 0,
+             sizeof(ckpt_path_t) * (new_cnt - idmap_cnt));
+      idmap = new_idmap;
+      idmap_cnt = new_cnt;
+    }
+
+    if (bgpstream_as_path_store_insert_path(rt->pathstore, path_data,
+                                            path_len, is_core,
+                                            &idmap[idx].id) != 0) {
+      goto err;
+    }
+    idmap[idx].valid = 1;
+  }
+
+  *pathid_map = idmap;
+  *pathid_map_cnt = idmap_cnt;
+  return 0;
+
+err:
+  free(idmap);
+  return -1;
+}
+
+static int read_pfxs(io_t *infile, routingtables_t *rt,
+                     bgpstream_peer_id_t *peerid_map,
+                     ckpt_path_t *pathid_map, uint32_t pathid_map_cnt)
+{
+  bgpstream_pfx_t pfx;
+  bgpstream_peer_id_t peer_id;
+  perpfx_perpeer_info_t *pp = NULL;
+  uint32_t cnt;
+  uint32_t path_idx;
+  uint32_t uc_path_idx;
+  uint8_t state;
+
+  READ_VAL(cnt);
+
+  for (uint32_t i = 0; i < cnt; i++) {
+    memset(&pfx, 0, sizeof(pfx));
+    if (read_ip(infile, &pfx.address) != 0) {
+      goto err;
+    }
+    READ_VAL(pfx.mask_len);
+
+    while (1) {
+      READ_VAL(peer_id);
+      if (peer_id == 0) {
+        break;
+      }
+      READ_VAL(path_idx);
+      READ_VAL(state);
+
+      if ((pp = perpfx_perpeer_info_create()) == NULL) {
+        goto err;
+      }
+      READ_VAL(uc_path_idx);
+      READ_VAL(pp->bgp_time_uc_delta_ts);
+      READ_VAL(pp->bgp_time_last_ts);
+      READ_VAL(pp->pfx_status);
+
+      if (path_idx >= pathid_map_cnt || !pathid_map[path_idx].valid ||
+          peerid_map[peer_id] == 0 ||
+          (uc_path_idx != RT_CKPT_NO_PATH &&
+           (uc_path_idx >= pathid_map_cnt ||
+            !pathid_map[uc_path_idx].valid))) {
+        fprintf(stderr, "ERROR: Inconsistent prefix-peer in checkpoint\n");
+        goto err;
+      }
+      if (uc_path_idx != RT_CKPT_NO_PATH) {
+        pp->uc_as_path_id = pathid_map[uc_path_idx].id;
+      }
+
+      if (bgpview_iter_add_pfx_peer_by_id(rt->iter, &pfx, peerid_map[peer_id],
+                                          pathid_map[path_idx].id) != 0) {
+        goto err;
+      }
+      bgpview_iter_pfx_peer_set_user(rt->iter, pp);
+      pp = NULL;
+
+      if (state == BGPVIEW_FIELD_ACTIVE) {
+        bgpview_iter_pfx_activate_peer(rt->iter);
+      }
+    }
+  }
+
+  return 0;
+
+err:
+  free(pp);
+  return -1;
+}
+
+/* ========== PROTECTED FUNCTIONS ========== */
+
+int routingtables_checkpoint_write(routingtables_t *rt)
+{
+  char tmpname[BUFFER_LEN];
+  iow_t *outfile = NULL;
+  uint32_t u32;
+
+  assert(rt->checkpoint_filename != NULL);
+
+  /* write to a temporary file and rename it once complete, so that a crash
+   * while writing never leaves a truncated checkpoint behind */
+  if (snprintf(tmpname, BUFFER_LEN, "%s.tmp", rt->checkpoint_filename) >=
+      BUFFER_LEN) {
+    fprintf(stderr, "ERROR: Checkpoint file name too long\n");
+    return -1;
+  }
+
+  if ((outfile = wandio_wcreate(
+         tmpname, wandio_detect_compression_type(rt->checkpoint_filename),
+         RT_CKPT_COMPRESS_LEVEL, O_CREAT)) == NULL) {
+    fprintf(stderr, "ERROR: Could not open %s for writing\n", tmpname);
+    return -1;
+  }
+
+  u32 = RT_CKPT_MAGIC;
+  WRITE_VAL(u32);
+  u32 = RT_CKPT_VERSION;
+  WRITE_VAL(u32);
+  /* everything up to the end of the interval is reflected in the snapshot */
+  u32 = rt->bgp_time_interval_end + 1;
+  WRITE_VAL(u32);
+  u32 = bgpview_get_time(rt->view);
+  WRITE_VAL(u32);
+
+  if (write_collectors(outfile, rt) != 0 || write_peers(outfile, rt) != 0 ||
+      write_paths(outfile, rt) != 0 || write_pfxs(outfile, rt) != 0) {
+    goto err;
+  }
+
+  u32 = RT_CKPT_END_MAGIC;
+  WRITE_VAL(u32);
+
+  wandio_wdestroy(outfile);
+  outfile = NULL;
+
+  if (rename(tmpname, rt->checkpoint_filename) != 0) {
+    fprintf(stderr, "ERROR: Could not rename %s to %s\n", tmpname,
+            rt->checkpoint_filename);
+    return -1;
+  }
+
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not write checkpoint to %s\n", tmpname);
+  wandio_wdestroy(outfile);
+  remove(tmpname);
+  return -1;
+}
+
+/* ========== PUBLIC FUNCTIONS ========== */
+
+int routingtables_set_checkpoint(routingtables_t *rt, const char *filename,
+                                 uint32_t interval)
+{
+  if (rt->checkpoint_filename != NULL) {
+    free(rt->checkpoint_filename);
+    rt->checkpoint_filename = NULL;
+  }
+  if (filename == NULL) {
+    return 0;
+  }
+  if ((rt->checkpoint_filename = strdup(filename)) == NULL) {
+    return -1;
+  }
+  rt->checkpoint_interval = interval;
+  rt->checkpoint_next_time = 0;
+  return 0;
+}
+
+int routingtables_read_checkpoint_time(const char *filename,
+                                       uint32_t *resume_time)
+{
+  io_t *infile;
+  int rc;
+
+  if ((infile = wandio_create(filename)) == NULL) {
+    return -1;
+  }
+  rc = read_header(infile, resume_time);
+  wandio_destroy(infile);
+  return rc;
+}
+
+int routingtables_load_checkpoint(routingtables_t *rt, const char *filename,
+                                  uint32_t *resume_time)
+{
+  io_t *infile = NULL;
+  bgpstream_peer_id_t *peerid_map = NULL;
+  ckpt_path_t *pathid_map = NULL;
+  uint32_t pathid_map_cnt = 0;
+  uint32_t view_time;
+  uint32_t u32;
+
+  if (kh_size(rt->collectors) != 0 ||
+      bgpview_peer_cnt(rt->view, BGPVIEW_FIELD_ALL_VALID) != 0) {
+    fprintf(stderr,
+            "ERROR: A checkpoint can only be loaded into empty routingtables\n");
+    return -1;
+  }
+
+  if ((infile = wandio_create(filename)) == NULL) {
+    fprintf(stderr, "ERROR: Could not open checkpoint %s\n", filename);
+    return -1;
+  }
+
+  /* peer ids are 16 bit, so a flat map covers every possible id */
+  if ((peerid_map = malloc_zero(sizeof(bgpstream_peer_id_t) *
+                                (UINT16_MAX + 1))) == NULL) {
+    goto err;
+  }
+
+  if (read_header(infile, resume_time) != 0) {
+    goto err;
+  }
+  READ_VAL(view_time);
+
+  if (read_collectors(infile, rt) != 0 ||
+      read_peers(infile, rt, peerid_map) != 0 ||
+      read_paths(infile, rt, &pathid_map, &pathid_map_cnt) != 0 ||
+      read_pfxs(infile, rt, peerid_map, pathid_map, pathid_map_cnt) != 0) {
+    goto err;
+  }
+
+  READ_VAL(u32);
+  if (u32 != RT_CKPT_END_MAGIC) {
+    fprintf(stderr, "ERROR: Checkpoint %s is truncated\n", filename);
+    goto err;
+  }
+
+  bgpview_set_time(rt->view, view_time);
+  rt->bgp_time_interval_end = *resume_time - 1;
+
+  free(peerid_map);
+  free(pathid_map);
+  wandio_destroy(infile);
+  return 0;
+
+err:
+  fprintf(stderr, "ERROR: Could not load checkpoint %s\n", filename);
+  free(peerid_map);
+  free(pathid_map);
+  wandio_destroy(infile);
+  return -1;
+}
@@ -63,6 +63,15 @@ _Static_assert(sizeof(RT_DEFAULT_METRIC_PFX) <= RT_METRIC_PFX_LEN,
 #define RT_ANNOUNCED_PFXSTATUS    0x01
 #define RT_UC_ANNOUNCED_PFXSTATUS 0x10
 
+/* the prefix has been announced/withdrawn by the peer in the current
+ * interval: these flags are only meaningful if the interval_start of the
+ * pfx-peer is the start of the current interval, otherwise they are stale
+ * and must be ignored */
+#define RT_INTERVAL_ANNOUNCED_PFXSTATUS 0x02
+#define RT_INTERVAL_WITHDRAWN_PFXSTATUS 0x04
+#define RT_INTERVAL_PFXSTATUS                                                  \
+  (RT_INTERVAL_ANNOUNCED_PFXSTATUS | RT_INTERVAL_WITHDRAWN_PFXSTATUS)
+
 typedef enum {
 
   /** It is not possible to infer the state of
@@ -100,6 +109,10 @@ typedef struct struct_perpfx_perpeer_info_t {
    *  prefix and the current peer  */
   uint32_t bgp_time_last_ts;
 
+  /** Start (bgp time) of the interval in which the interval flags of
+   *  pfx_status were last updated */
+  uint32_t interval_start;
+
   /** Bitfield that indicates whether the
    *  prefix is currently announced by this peer
    *  in the active state and/or in the uc state */
@@ -132,11 +145,30 @@ typedef struct peer_metric_idx {
 
 } __attribute__((packed)) peer_metric_idx_t;
 
-/** A set that contains a unique set of origin segments */
-KHASH_INIT(origin_segments, bgpstream_as_path_seg_t *, char, 0,
+/** A map from origin segments to the start of the last interval (bgp time)
+ *  in which they were observed */
+KHASH_INIT(origin_segments, bgpstream_as_path_seg_t *, uint32_t, 1,
            bgpstream_as_path_seg_hash, bgpstream_as_path_seg_equal)
 typedef khash_t(origin_segments) origin_segments_t;
 
+/** Per-peer counters that are reset at the end of every interval */
+typedef enum {
+  RT_PEER_RIB_MESSAGES_CNT = 0,
+  RT_PEER_PFX_ANNOUNCEMENTS_CNT,
+  RT_PEER_PFX_WITHDRAWALS_CNT,
+  RT_PEER_STATE_MESSAGES_CNT,
+  RT_PEER_ANNOUNCING_ORIGIN_AS_CNT,
+  RT_PEER_ANNOUNCED_V4_PFXS_CNT,
+  RT_PEER_WITHDRAWN_V4_PFXS_CNT,
+  RT_PEER_ANNOUNCED_V6_PFXS_CNT,
+  RT_PEER_WITHDRAWN_V6_PFXS_CNT,
+  RT_PEER_RIB_POSITIVE_MISMATCHES_CNT,
+  RT_PEER_RIB_NEGATIVE_MISMATCHES_CNT,
+
+  /** Number of per-peer interval counters */
+  RT_PEER_INTERVAL_CNT_NUM,
+} peer_interval_cnt_t;
+
 /** Information about the current status
  *  of a peer */
 typedef struct struct_perpeer_info_t {
@@ -187,44 +219,15 @@ typedef struct struct_perpeer_info_t {
   /** Indices of the peer metrics in the peer Key Package */
   peer_metric_idx_t kp_idxs;
 
-  /** Number of rib messages received in the current
-   * interval */
-  uint32_t rib_messages_cnt;
-
-  /** Number of announcements received in the current
-   * interval */
-  uint32_t pfx_announcements_cnt;
+  /** Counters for the current interval (indexed by peer_interval_cnt_t),
+   *  all reset in one go at the end of the interval */
+  uint32_t interval_cnts[RT_PEER_INTERVAL_CNT_NUM];
 
-  /** Number of withdrawals received in the current
-   * interval */
-  uint32_t pfx_withdrawals_cnt;
-
-  /** Number of state messages received in the current
-   * interval */
-  uint32_t state_messages_cnt;
-
-  /** Set of ASns that announced at least one prefix
-   *  in the current interval */
+  /** Origin segments observed in recent announcements, each tagged with
+   *  the last interval it was seen in, so that the unique origins of an
+   *  interval can be counted without rebuilding the set every interval */
   origin_segments_t *announcing_ases;
 
-  /** Set of prefixes that have been announced at
-   *  least once in the current interval */
-  bgpstream_pfx_set_t *announced_pfxs;
-
-  /** Set of prefixes that have been withdrawn at
-   *  least once in the current interval */
-  bgpstream_pfx_set_t *withdrawn_pfxs;
-
-  /** number of positive mismatches at rib end time
-   *  i.e. number of active prefixes that are not
-   *  observed in the new rib */
-  uint32_t rib_positive_mismatches_cnt;
-
-  /** number of negative mismatches at rib end time
-   *  i.e. number of inactive prefixes that are
-   *  instead observed in the new rib  */
-  uint32_t rib_negative_mismatches_cnt;
-
 } perpeer_info_t;
 
 /** Indices of the collector metrics for a KP */
@@ -372,6 +375,10 @@ struct struct_routingtables_t {
    *  should be outputed or not */
   uint8_t metrics_output_on;
 
+  /** metrics are not outputed for intervals that
+   *  start before this time (bgp time) */
+  uint32_t metrics_output_start;
+
   /** beginning of the interval (bgp time) */
   uint32_t bgp_time_interval_start;
 
@@ -381,8 +388,58 @@ struct struct_routingtables_t {
   /** last time (wall time) we received
    *  an interval_start signal */
   uint32_t wall_time_interval_start;
+
+  /** name of the checkpoint file (NULL if checkpointing is off) */
+  char *checkpoint_filename;
+
+  /** minimum number of seconds (bgp time) between two checkpoints */
+  uint32_t checkpoint_interval;
+
+  /** end of the first interval (bgp time) at which a new checkpoint
+   *  should be written */
+  uint32_t checkpoint_next_time;
 };
 
+/** Create a new collector and insert it in the collectors table
+ *
+ * @param rt            pointer to a routingtables instance
+ * @param collector     collector name (as reported by bgpstream)
+ * @param collector_str graphite-safe collector string: project.collector
+ * @return a pointer to the new collector, NULL if an error occurred.
+ */
+collector_t *collector_add(routingtables_t *rt, const char *collector,
+                           const char *collector_str);
+
+/** Create the per-peer information for a peer already in the view
+ *
+ * @param rt            pointer to a routingtables instance
+ * @param c             pointer to the collector the peer belongs to
+ * @param peer_id       id of the peer
+ * @return a pointer to the new per-peer info, NULL if an error occurred.
+ */
+perpeer_info_t *perpeer_info_create(routingtables_t *rt, collector_t *c,
+                                    uint32_t peer_id);
+
+/** Destroy a per-peer information structure
+ *
+ * @param p             pointer to a perpeer_info_t
+ */
+void perpeer_info_destroy(void *p);
+
+/** Create a per-pfx-peer information structure in its initial state
+ *
+ * @return a pointer to the new structure, NULL if an error occurred.
+ */
+perpfx_perpeer_info_t *perpfx_perpeer_info_create(void);
+
+/** Write a checkpoint of the current state to the configured checkpoint
+ *  file
+ *
+ * @param rt            pointer to a routingtables instance to write
+ * @return 0 if the checkpoint was written correctly, <0 if an error occurred.
+ */
+int routingtables_checkpoint_write(routingtables_t *rt);
+
 /** Read the view in the current routingtables instance and populate
  *  the metrics to be sent to the active timeseries back-ends
  *
@@ -391,6 +448,16 @@ struct struct_routingtables_t {
  */
 void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now);
 
+/** Reset the per-interval counters and expire the origins that were not
+ *  announced in the interval that is ending
+ *
+ * @param rt            pointer to a routingtables instance to reset
+ *
+ * This must be called at the end of every interval, whether or not the
+ * metrics were dumped.
+ */
+void routingtables_reset_metrics(routingtables_t *rt);
+
 /** Generate the metrics associated to a specific peer
  *
  * @param rt            pointer to a routingtables instance to read
@@ -72,6 +72,21 @@ static char metric_buffer[BUFFER_LEN];
   X(rib_positive_mismatches_cnt_idx, rib_subtracted_pfxs_cnt,           extra) \
   X(rib_negative_mismatches_cnt_idx, rib_added_pfxs_cnt,                extra)
 
+// peer metrics that are read straight from the interval counters
+//X(metric_idx,                      interval_cnt)
+#define P_INTERVAL_CNT_METRICS(X)                                              \
+  X(announcing_origin_as_idx,        RT_PEER_ANNOUNCING_ORIGIN_AS_CNT)         \
+  X(announced_v4_pfxs_idx,           RT_PEER_ANNOUNCED_V4_PFXS_CNT)            \
+  X(withdrawn_v4_pfxs_idx,           RT_PEER_WITHDRAWN_V4_PFXS_CNT)            \
+  X(announced_v6_pfxs_idx,           RT_PEER_ANNOUNCED_V6_PFXS_CNT)            \
+  X(withdrawn_v6_pfxs_idx,           RT_PEER_WITHDRAWN_V6_PFXS_CNT)            \
+  X(rib_messages_cnt_idx,            RT_PEER_RIB_MESSAGES_CNT)                 \
+  X(pfx_announcements_cnt_idx,       RT_PEER_PFX_ANNOUNCEMENTS_CNT)            \
+  X(pfx_withdrawals_cnt_idx,         RT_PEER_PFX_WITHDRAWALS_CNT)              \
+  X(state_messages_cnt_idx,          RT_PEER_STATE_MESSAGES_CNT)               \
+  X(rib_positive_mismatches_cnt_idx, RT_PEER_RIB_POSITIVE_MISMATCHES_CNT)      \
+  X(rib_negative_mismatches_cnt_idx, RT_PEER_RIB_NEGATIVE_MISMATCHES_CNT)
+
 // collector metrics
 #define C_METRICS(X, extra)                                                    \
   X(status_idx,                      status,                            extra) \
@@ -146,6 +161,23 @@ static void disable_collector_metrics(timeseries_kp_t *kp, collector_t *c)
   C_METRICS(DISABLE_METRIC, c)
 }
 
+/* Remove the origins that have not been announced in the interval that is
+ * ending: the ones that have been are likely to show up again, so we keep
+ * them around rather than re-allocating them at every interval */
+static void expire_origin_segments(routingtables_t *rt, perpeer_info_t *p)
+{
+  khiter_t k;
+
+  for (k = kh_begin(p->announcing_ases); k != kh_end(p->announcing_ases);
+       ++k) {
+    if (kh_exist(p->announcing_ases, k) &&
+        kh_val(p->announcing_ases, k) != rt->bgp_time_interval_start) {
+      bgpstream_as_path_seg_destroy(kh_key(p->announcing_ases, k));
+      kh_del(origin_segments, p->announcing_ases, k);
+    }
+  }
+}
+
 void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
 {
   khiter_t k;
@@ -205,11 +237,6 @@ void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
         disable_collector_metrics(rt->kp, c);
       }
 
-      /* in all cases we have to reset the metrics */
-      c->valid_record_cnt = 0;
-      c->corrupted_record_cnt = 0;
-      c->empty_record_cnt = 0;
-      /* c->active_peers_cnt is updated by every single message */
       bgpstream_id_set_clear(rt->c_active_ases);
     }
   }
@@ -242,33 +269,11 @@ void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
         bgpview_iter_peer_get_pfx_cnt(rt->iter, BGPSTREAM_ADDR_VERSION_IPV6,
                                       BGPVIEW_FIELD_INACTIVE));
 
-      timeseries_kp_set(rt->kp, p->kp_idxs.announcing_origin_as_idx,
-                        kh_size(p->announcing_ases));
-
-      timeseries_kp_set(rt->kp, p->kp_idxs.announced_v4_pfxs_idx,
-                        bgpstream_pfx_set_version_size(p->announced_pfxs, BGPSTREAM_ADDR_VERSION_IPV4));
-
-      timeseries_kp_set(rt->kp, p->kp_idxs.withdrawn_v4_pfxs_idx,
-                        bgpstream_pfx_set_version_size(p->withdrawn_pfxs, BGPSTREAM_ADDR_VERSION_IPV4));
-
-      timeseries_kp_set(rt->kp, p->kp_idxs.announced_v6_pfxs_idx,
-                        bgpstream_pfx_set_version_size(p->announced_pfxs, BGPSTREAM_ADDR_VERSION_IPV6));
+#define SET_P_INTERVAL_CNT_METRIC(metric_idx, interval_cnt)                    \
+      timeseries_kp_set(rt->kp, p->kp_idxs.metric_idx,                         \
+                        p->interval_cnts[interval_cnt]);
 
-      timeseries_kp_set(rt->kp, p->kp_idxs.withdrawn_v6_pfxs_idx,
-                        bgpstream_pfx_set_version_size(p->withdrawn_pfxs, BGPSTREAM_ADDR_VERSION_IPV6));
-
-      timeseries_kp_set(rt->kp, p->kp_idxs.rib_messages_cnt_idx,
-                        p->rib_messages_cnt);
-      timeseries_kp_set(rt->kp, p->kp_idxs.pfx_announcements_cnt_idx,
-                        p->pfx_announcements_cnt);
-      timeseries_kp_set(rt->kp, p->kp_idxs.pfx_withdrawals_cnt_idx,
-                        p->pfx_withdrawals_cnt);
-      timeseries_kp_set(rt->kp, p->kp_idxs.state_messages_cnt_idx,
-                        p->state_messages_cnt);
-      timeseries_kp_set(rt->kp, p->kp_idxs.rib_positive_mismatches_cnt_idx,
-                        p->rib_positive_mismatches_cnt);
-      timeseries_kp_set(rt->kp, p->kp_idxs.rib_negative_mismatches_cnt_idx,
-                        p->rib_negative_mismatches_cnt);
+      P_INTERVAL_CNT_METRICS(SET_P_INTERVAL_CNT_METRIC)
 
       enable_peer_metrics(rt->kp, p);
     } else {
@@ -276,18 +281,6 @@ void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
         disable_peer_metrics(rt->kp, p);
       }
     }
-
-    /* in all cases we have to reset the metrics */
-    kh_free(origin_segments, p->announcing_ases, bgpstream_as_path_seg_destroy);
-    kh_clear(origin_segments, p->announcing_ases);
-    bgpstream_pfx_set_clear(p->announced_pfxs);
-    bgpstream_pfx_set_clear(p->withdrawn_pfxs);
-    p->rib_messages_cnt = 0;
-    p->pfx_announcements_cnt = 0;
-    p->pfx_withdrawals_cnt = 0;
-    p->state_messages_cnt = 0;
-    p->rib_positive_mismatches_cnt = 0;
-    p->rib_negative_mismatches_cnt = 0;
   }
 
   if (timeseries_kp_flush(rt->kp, rt->bgp_time_interval_start) != 0) {
@@ -295,3 +288,27 @@ void routingtables_dump_metrics(routingtables_t *rt, uint32_t time_now)
             rt->bgp_time_interval_start);
   }
 }
+
+void routingtables_reset_metrics(routingtables_t *rt)
+{
+  khiter_t k;
+  collector_t *c;
+  perpeer_info_t *p;
+
+  for (k = kh_begin(rt->collectors); k != kh_end(rt->collectors); ++k) {
+    if (kh_exist(rt->collectors, k)) {
+      c = kh_val(rt->collectors, k);
+      c->valid_record_cnt = 0;
+      c->corrupted_record_cnt = 0;
+      c->empty_record_cnt = 0;
+      /* c->active_peers_cnt is updated by every single message */
+    }
+  }
+
+  for (bgpview_iter_first_peer(rt->iter, BGPVIEW_FIELD_ALL_VALID);
+       bgpview_iter_has_more_peer(rt->iter); bgpview_iter_next_peer(rt->iter)) {
+    p = bgpview_iter_peer_get_user(rt->iter);
+    memset(p->interval_cnts, 0, sizeof(p->interval_cnts));
+    expire_origin_segments(rt, p);
+  }
+}
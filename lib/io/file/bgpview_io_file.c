@@ -907,8 +907,13 @@ int bgpview_io_file_print(iow_t *outfile, bgpview_t *view)
                 time, bgpview_v4pfx_cnt(view, BGPVIEW_FIELD_ACTIVE),
                 bgpview_v6pfx_cnt(view, BGPVIEW_FIELD_ACTIVE));
 
-  for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE);
-       bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
+  /* print the prefixes in order, so that dumps of different views can be
+     compared line by line */
+  if (bgpview_iter_first_pfx_sorted(it, 0, BGPVIEW_FIELD_ACTIVE) < 0) {
+    bgpview_iter_destroy(it);
+    goto err;
+  }
+  for (; bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
     pfx = bgpview_iter_pfx_get_pfx(it);
     bgpstream_pfx_snprintf(pfx_str, INET6_ADDRSTRLEN + 3, pfx);
 
@@ -86,6 +86,12 @@ static void free_gc_topics(gc_topics_t *gct)
   gct->idmap.map = NULL;
   gct->idmap.alloc_cnt = 0;
 
+  free(gct->pathidmap.map);
+  free(gct->pathidmap.known);
+  gct->pathidmap.map = NULL;
+  gct->pathidmap.known = NULL;
+  gct->pathidmap.alloc_cnt = 0;
+
   if (gct->peers.rkt != NULL) {
     rd_kafka_topic_destroy(gct->peers.rkt);
     gct->peers.rkt = NULL;
@@ -142,7 +148,10 @@ static void usage(void)
     "       -n <namespace>        Kafka topic namespace to use (default: "
     "%s)\n"
     "       -c <channel>          Global metadata channel to use (default: "
-    "unused)\n",
+    "unused)\n"
+    "       -d                    Producer: publish AS paths through a path "
+    "dictionary\n"
+    "                             (consumers must support it)\n",
     BGPVIEW_IO_KAFKA_BROKER_URI_DEFAULT, BGPVIEW_IO_KAFKA_NAMESPACE_DEFAULT);
 }
 
@@ -154,12 +163,16 @@ static int parse_args(bgpview_io_kafka_t *client, int argc, char **argv)
   optind = 1;
 
   /* remember the argv strings DO NOT belong to us */
-  while ((opt = getopt(argc, argv, ":c:i:k:n:?")) >= 0) {
+  while ((opt = getopt(argc, argv, ":c:di:k:n:?")) >= 0) {
     switch (opt) {
     case 'c':
       client->channel = strdup(optarg);
       break;
 
+    case 'd':
+      client->path_dict = 1;
+      break;
+
     case 'i':
       client->identity = strdup(optarg);
       break;
@@ -423,6 +436,16 @@ void bgpview_io_kafka_destroy(bgpview_io_kafka_t *client)
   client->dc_state.idmap.map = NULL;
   client->dc_state.idmap.alloc_cnt = 0;
 
+  free(client->dc_state.pathidmap.map);
+  free(client->dc_state.pathidmap.known);
+  client->dc_state.pathidmap.map = NULL;
+  client->dc_state.pathidmap.known = NULL;
+  client->dc_state.pathidmap.alloc_cnt = 0;
+
+  free(client->prod_state.paths_sent);
+  client->prod_state.paths_sent = NULL;
+  client->prod_state.paths_sent_alloc = 0;
+
   fprintf(stderr, "INFO: Shutting down rdkafka\n");
   if (client->rdk_conn != NULL) {
     rd_kafka_destroy(client->rdk_conn);
@@ -125,6 +125,10 @@ typedef struct bgpview_io_kafka_stats {
   /** The number of prefixes sent as part of a sync frame */
   int sync_pfx_cnt;
 
+  /** The number of AS paths added to the path dictionary (i.e. paths that
+      had not been sent since the last sync frame) */
+  int path_cnt;
+
 } bgpview_io_kafka_stats_t;
 
 /** @} */
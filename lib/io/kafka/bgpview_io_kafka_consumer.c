@@ -101,6 +101,81 @@ static void clear_peerid_mapping(bgpview_io_kafka_peeridmap_t *idmap)
   memset(idmap->map, 0, sizeof(bgpstream_peer_id_t) * idmap->alloc_cnt);
 }
 
+static void reset_pathid_mapping(bgpview_io_kafka_pathidmap_t *pathidmap,
+                                 uint32_t epoch,
+                                 bgpstream_as_path_store_t *store)
+{
+  if (pathidmap->known != NULL) {
+    memset(pathidmap->known, 0, pathidmap->alloc_cnt);
+  }
+  pathidmap->epoch = epoch;
+  pathidmap->store = store;
+}
+
+/* deserialize a path dictionary entry and add it to the mapping (unless the
+   path is already known, in which case it is just skipped). returns the number
+   of bytes read, or -1 on error */
+static ssize_t recv_path(bgpview_io_kafka_pathidmap_t *pathidmap,
+                         uint8_t *buf, size_t len, int have_view)
+{
+  size_t read = 0;
+  ssize_t s;
+  uint32_t idx;
+  int new_cnt;
+  bgpstream_as_path_store_path_id_t *new_map;
+  uint8_t *new_known;
+
+  BGPVIEW_IO_DESERIALIZE_VAL(buf, len, read, idx);
+
+  if (have_view == 0) {
+    /* just skip over the path */
+    if ((s = bgpview_io_deserialize_as_path_store_path(buf, (len - read), NULL,
+                                                       NULL)) == -1) {
+      goto err;
+    }
+    return read + s;
+  }
+
+  /* is the array big enough to possibly already contain idx? */
+  if (idx >= pathidmap->alloc_cnt) {
+    new_cnt = (idx + 1) * 2;
+    /* on failure the arrays are left valid, and alloc_cnt is only updated
+       once both have been grown */
+    if ((new_map = realloc(pathidmap->map,
+                           sizeof(bgpstream_as_path_store_path_id_t) *
+                             new_cnt)) == NULL) {
+      goto err;
+    }
+    pathidmap->map = new_map;
+    if ((new_known = realloc(pathidmap->known, new_cnt)) == NULL) {
+      goto err;
+    }
+    pathidmap->known = new_known;
+    memset(pathidmap->known + pathidmap->alloc_cnt, 0,
+           new_cnt - pathidmap->alloc_cnt);
+    pathidmap->alloc_cnt = new_cnt;
+  }
+
+  if (pathidmap->known[idx] != 0) {
+    /* we already interned this path for a previous view */
+    if ((s = bgpview_io_deserialize_as_path_store_path(buf, (len - read), NULL,
+                                                       NULL)) == -1) {
+      goto err;
+    }
+  } else {
+    if ((s = bgpview_io_deserialize_as_path_store_path(
+           buf, (len - read), pathidmap->store, &pathidmap->map[idx])) == -1) {
+      goto err;
+    }
+    pathidmap->known[idx] = 1;
+  }
+
+  return read + s;
+
+err:
+  return -1;
+}
+
 /* This check doesn't seem to work. It often reports a range that is smaller
    than the actually valid range. I'm going to disable it completely for now. */
 #if 0
@@ -580,6 +655,7 @@ err:
 }
 
 static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
+                     bgpview_io_kafka_pathidmap_t *pathidmap,
                      bgpview_io_kafka_topic_t *topic, bgpview_iter_t *iter,
                      bgpview_io_filter_pfx_cb_t *pfx_cb,
                      bgpview_io_filter_pfx_peer_cb_t *pfx_peer_cb,
@@ -602,6 +678,11 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
   uint32_t pfx_cnt = 0;
   int pfx_rx = 0;
 
+  /* producers that publish a path dictionary announce its epoch first, older
+     producers serialize the full path in every cell */
+  int use_pathids = 0;
+  uint32_t epoch;
+
   int tor = 0;
   int tom = 0;
 
@@ -665,18 +746,48 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
     /* if it is not an 'END' message, then it can contain many prefix row
        messages */
     while (read < msg->len) {
-      /* this is a prefix row message */
-      pfx_rx++;
-
       switch (type) {
+      case 'H':
+        /* path dictionary epoch */
+        BGPVIEW_IO_DESERIALIZE_VAL(ptr, msg->len, read, epoch);
+        use_pathids = 1;
+        if (view != NULL &&
+            (epoch != pathidmap->epoch ||
+             bgpview_get_as_path_store(view) != pathidmap->store)) {
+          fprintf(stderr, "INFO: New path dictionary (epoch %" PRIu32 ")\n",
+                  epoch);
+          reset_pathid_mapping(pathidmap, epoch,
+                               bgpview_get_as_path_store(view));
+        }
+        break;
+
+      case 'A':
+        /* a path dictionary entry */
+        if ((s = recv_path(pathidmap, ptr, (msg->len - read),
+                           view != NULL)) == -1) {
+#ifdef WITH_THREADS
+          if (mutex != NULL) {
+            pthread_mutex_unlock(mutex);
+          }
+#endif
+          goto err;
+        }
+        read += s;
+        ptr += s;
+        break;
+
       /* a sync row*/
       case 'S':
       case 'U':
         /* an update row */
+        pfx_rx++;
         tom++;
         if ((s = bgpview_io_deserialize_pfx_row(
                ptr, (msg->len - read), iter, pfx_cb, pfx_peer_cb, idmap->map,
-               idmap->alloc_cnt, NULL, -1, BGPVIEW_FIELD_ACTIVE)) == -1) {
+               idmap->alloc_cnt, use_pathids ? pathidmap->map : NULL,
+               use_pathids ? pathidmap->known : NULL,
+               use_pathids ? pathidmap->alloc_cnt : -1,
+               BGPVIEW_FIELD_ACTIVE)) == -1) {
 #ifdef WITH_THREADS
           if (mutex != NULL) {
             pthread_mutex_unlock(mutex);
@@ -690,10 +801,12 @@ static int recv_pfxs(bgpview_io_kafka_peeridmap_t *idmap,
 
       case 'R':
         /* a remove row */
+        pfx_rx++;
         tor++;
         if ((s = bgpview_io_deserialize_pfx_row(
                ptr, (msg->len - read), iter, pfx_cb, pfx_peer_cb, idmap->map,
-               idmap->alloc_cnt, NULL, -1, BGPVIEW_FIELD_INACTIVE)) == -1) {
+               idmap->alloc_cnt, NULL, NULL, -1, BGPVIEW_FIELD_INACTIVE)) ==
+            -1) {
 #ifdef WITH_THREADS
           if (mutex != NULL) {
             pthread_mutex_unlock(mutex);
@@ -736,7 +849,8 @@ err:
   return -1;
 }
 
-static int recv_view(bgpview_io_kafka_peeridmap_t *idmap, bgpview_t *view,
+static int recv_view(bgpview_io_kafka_peeridmap_t *idmap,
+                     bgpview_io_kafka_pathidmap_t *pathidmap, bgpview_t *view,
                      bgpview_io_kafka_md_t *meta,
                      bgpview_io_kafka_topic_t *peers_topic,
                      bgpview_io_kafka_topic_t *pfxs_topic,
@@ -766,7 +880,7 @@ static int recv_view(bgpview_io_kafka_peeridmap_t *idmap, bgpview_t *view,
     goto err;
   }
 
-  if (recv_pfxs(idmap, pfxs_topic, it, pfx_cb, pfx_peer_cb, meta->pfxs_offset,
+  if (recv_pfxs(idmap, pathidmap, pfxs_topic, it, pfx_cb, pfx_peer_cb, meta->pfxs_offset,
                 meta->time, rdk_conn
 #ifdef WITH_THREADS
                 ,
@@ -817,9 +931,9 @@ static void *thread_worker(void *user)
 
     /* do some work! */
     /* ask to read each view */
-    if (recv_view(&gct->idmap, gct->view, gct->meta, &gct->peers, &gct->pfxs,
-                  gct->peer_cb, gct->pfx_cb, gct->pfx_peer_cb, gct->rdk_conn,
-                  &gct->global->mutex) != 0) {
+    if (recv_view(&gct->idmap, &gct->pathidmap, gct->view, gct->meta,
+                  &gct->peers, &gct->pfxs, gct->peer_cb, gct->pfx_cb,
+                  gct->pfx_peer_cb, gct->rdk_conn, &gct->global->mutex) != 0) {
       pthread_mutex_lock(&gct->mutex);
       gct->recv_error = 1;
       pthread_mutex_unlock(&gct->mutex);
@@ -1028,8 +1142,9 @@ static int recv_global_view(bgpview_io_kafka_t *client, bgpview_t *view,
     pthread_mutex_unlock(&gct->mutex);
     fprintf(stderr, "DEBUG: assigned job to %s\n", metas[i].identity);
 #else
-    if (recv_view(&gct->idmap, gct->view, &metas[i], &gct->peers, &gct->pfxs,
-                  peer_cb, pfx_cb, pfx_peer_cb, client->rdk_conn) != 0) {
+    if (recv_view(&gct->idmap, &gct->pathidmap, gct->view, &metas[i],
+                  &gct->peers, &gct->pfxs, peer_cb, pfx_cb, pfx_peer_cb,
+                  client->rdk_conn) != 0) {
       fprintf(stderr, "WARN: Failed to receive view for %s, skipping\n",
               metas[i].identity);
       if (deactivate_worker(gct) != 0) {
@@ -1224,8 +1339,8 @@ int bgpview_io_kafka_consumer_recv(bgpview_io_kafka_t *client, bgpview_t *view,
     if (recv_direct_metadata(client, view, &meta, need_sync) != 0) {
       return -1;
     }
-    if (recv_view(&client->dc_state.idmap, view, &meta,
-                  TOPIC(BGPVIEW_IO_KAFKA_TOPIC_ID_PEERS),
+    if (recv_view(&client->dc_state.idmap, &client->dc_state.pathidmap, view,
+                  &meta, TOPIC(BGPVIEW_IO_KAFKA_TOPIC_ID_PEERS),
                   TOPIC(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS), peer_cb, pfx_cb,
                   pfx_peer_cb, client->rdk_conn
 #ifdef WITH_THREADS
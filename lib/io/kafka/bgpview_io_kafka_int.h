@@ -104,6 +104,25 @@ typedef struct bgpview_io_kafka_peeridmap {
 
 } bgpview_io_kafka_peeridmap_t;
 
+typedef struct bgpview_io_kafka_pathidmap {
+
+  /** Epoch of the producer path dictionary this mapping refers to */
+  uint32_t epoch;
+
+  /** Path store that the local path IDs belong to */
+  bgpstream_as_path_store_t *store;
+
+  /** Mapping from producer path index to local path ID */
+  bgpstream_as_path_store_path_id_t *map;
+
+  /** Flags indicating which entries of the map are valid */
+  uint8_t *known;
+
+  /** Length of the map and known arrays */
+  int alloc_cnt;
+
+} bgpview_io_kafka_pathidmap_t;
+
 typedef struct producer_state {
 
   /** Structure to store tx statistics */
@@ -115,12 +134,27 @@ typedef struct producer_state {
   /** The walltime at which we should write another members update */
   uint32_t next_members_update;
 
+  /** Epoch of the path dictionary (changes whenever consumers must forget the
+      path indices they have learned) */
+  uint32_t path_epoch;
+
+  /** Path store that the dictionary indices refer to */
+  bgpstream_as_path_store_t *path_store;
+
+  /** Bitmap of the path indices published since the last sync frame */
+  uint8_t *paths_sent;
+
+  /** Number of bytes allocated for the paths_sent bitmap */
+  uint32_t paths_sent_alloc;
+
 } producer_state_t;
 
 typedef struct direct_consumer_state {
 
   bgpview_io_kafka_peeridmap_t idmap;
 
+  bgpview_io_kafka_pathidmap_t pathidmap;
+
 } direct_consumer_state_t;
 
 enum {
@@ -186,6 +220,9 @@ typedef struct gc_topics {
   /** Mapping of remote to local peer IDs */
   bgpview_io_kafka_peeridmap_t idmap;
 
+  /** Mapping of remote path indices to local path IDs */
+  bgpview_io_kafka_pathidmap_t pathidmap;
+
   /** The time of the last view we successfully received */
   uint32_t parent_view_time;
 
@@ -233,6 +270,10 @@ struct bgpview_io_kafka {
       run) */
   char *channel;
 
+  /** Should the producer publish AS paths through a path dictionary? (only
+      consumers that understand the 'H' and 'A' records can read the stream) */
+  int path_dict;
+
   /* STATE */
 
   /** RD Kafka connection handle */
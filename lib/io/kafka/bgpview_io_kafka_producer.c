@@ -45,6 +45,11 @@
 
 #define STAT(name) (client->prod_state.stats.name)
 
+/** Apply the (optional) filter callback (everything is sent if there is no
+    callback) */
+#define FILTER(cb, cb_user, it, type)                                          \
+  ((cb) == NULL || (cb)((it), (type), (cb_user)))
+
 #define SEND_MSG(topic_id, partition, buf, len)                                \
   do {                                                                         \
     int success = 0;                                                           \
@@ -99,6 +104,106 @@ static int64_t get_offset(bgpview_io_kafka_t *client, char *topic,
   return -1;
 }
 
+/* forget which paths have been published, so that the next view (re-)sends
+   every path it uses. if new_epoch is set, consumers are also told to drop the
+   path indices they have learned */
+static void paths_reset(bgpview_io_kafka_t *client, int new_epoch)
+{
+  if (client->prod_state.paths_sent != NULL) {
+    memset(client->prod_state.paths_sent, 0,
+           client->prod_state.paths_sent_alloc);
+  }
+  if (new_epoch != 0) {
+    client->prod_state.path_epoch++;
+  }
+}
+
+/* serialize a path dictionary entry for the AS path of the pfx-peer that the
+   iterator currently points at, unless it has already been published since the
+   last sync frame. the path is marked as published as soon as it is
+   serialized, so the buffer holding it must be sent before any later message
+   (see send_cells), and a failed send must forget all published paths (see
+   bgpview_io_kafka_producer_send). returns the number of bytes written (0 if
+   the path is already known by the consumers), or -1 on error */
+static ssize_t path_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
+                              size_t len, bgpview_iter_t *it)
+{
+  size_t written = 0;
+  ssize_t s;
+  char type = 'A';
+
+  bgpstream_as_path_store_path_t *spath =
+    bgpview_iter_pfx_peer_get_as_path_store_path(it);
+  uint32_t idx = bgpstream_as_path_store_path_get_idx(spath);
+  uint32_t byte = idx / 8;
+  uint8_t bit = 1 << (idx % 8);
+  uint32_t new_alloc;
+
+  if (byte >= client->prod_state.paths_sent_alloc) {
+    new_alloc = (byte + 1) * 2;
+    if ((client->prod_state.paths_sent =
+           realloc(client->prod_state.paths_sent, new_alloc)) == NULL) {
+      goto err;
+    }
+    memset(client->prod_state.paths_sent + client->prod_state.paths_sent_alloc,
+           0, new_alloc - client->prod_state.paths_sent_alloc);
+    client->prod_state.paths_sent_alloc = new_alloc;
+  }
+
+  if ((client->prod_state.paths_sent[byte] & bit) != 0) {
+    return 0;
+  }
+
+  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, type);
+  BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, idx);
+  if ((s = bgpview_io_serialize_as_path_store_path(buf, (len - written),
+                                                   spath)) == -1) {
+    goto err;
+  }
+  written += s;
+
+  client->prod_state.paths_sent[byte] |= bit;
+  STAT(path_cnt)++;
+
+  return written;
+
+err:
+  return -1;
+}
+
+/* serialize path dictionary entries for the pfx-peers of the current prefix
+   that the filter selects */
+static ssize_t pfx_paths_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
+                                   size_t len, bgpview_iter_t *it,
+                                   bgpview_io_filter_cb_t *cb, void *cb_user)
+{
+  size_t written = 0;
+  ssize_t s;
+  int filter;
+
+  for (bgpview_iter_pfx_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_pfx_has_more_peer(it); bgpview_iter_pfx_next_peer(it)) {
+    if (cb != NULL) {
+      if ((filter = cb(it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user)) < 0) {
+        goto err;
+      }
+      if (filter == 0) {
+        continue;
+      }
+    }
+    if ((s = path_serialize(client, buf, (len - written), it)) == -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
+  }
+
+  return written;
+
+err:
+  return -1;
+}
+
 static int pfx_row_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
                              size_t len, char operation, bgpview_iter_t *it,
                              bgpview_io_filter_cb_t *cb, void *cb_user)
@@ -108,12 +213,22 @@ static int pfx_row_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
 
   int cells_tx = 0;
 
+  // rows that carry paths only refer to them by index, so any path that the
+  // consumers do not know yet must be published before the row
+  if (operation != 'R' && client->path_dict != 0) {
+    if ((s = pfx_paths_serialize(client, buf, len, it, cb, cb_user)) == -1) {
+      goto err;
+    }
+    written += s;
+    buf += s;
+  }
+
   // serialize the operation that must be done with this row
   // "Update" or "Remove"
   BGPVIEW_IO_SERIALIZE_VAL(buf, len, written, operation);
   if ((s = bgpview_io_serialize_pfx_row(
          buf, (len - written), it, operation == 'S' ? NULL : &cells_tx, cb,
-         cb_user, operation == 'R' ? -1 : 0)) == -1) {
+         cb_user, operation == 'R' ? -1 : client->path_dict)) == -1) {
     goto err;
   }
 
@@ -132,6 +247,8 @@ static int pfx_row_serialize(bgpview_io_kafka_t *client, uint8_t *buf,
   }
 
   if (s == 0) {
+    /* the filter selected no pfx-peers, so no paths were published either */
+    assert(written == sizeof(operation));
     return 0;
   } else {
     return written + s;
@@ -373,7 +490,22 @@ err:
   return -1;
 }
 
-static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
+/* send any pending (i.e., serialized but not yet sent) bytes of the prefix
+   buffer, so that later messages do not overtake them */
+#define SEND_PENDING(buf, written)                                             \
+  do {                                                                         \
+    if (*(written) > 0) {                                                      \
+      SEND_MSG(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,                                 \
+               BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, (buf), *(written));    \
+      *(written) = 0;                                                          \
+    }                                                                          \
+  } while (0)
+
+/* cellular diff of a prefix. the rows are sent directly, after the
+   `*pend_written` bytes pending in `pend_buf` (the path epoch header, and the
+   rows and path records of earlier prefixes) have been sent */
+static int send_cells(bgpview_io_kafka_t *client, uint8_t *pend_buf,
+                      size_t *pend_written, bgpview_iter_t *it,
                       bgpview_iter_t *parent_view_it,
                       bgpview_io_filter_cb_t *cb, void *cb_user)
 {
@@ -387,6 +519,11 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
   size_t rem_written = 0;
   int rem_cells = 0;
 
+  /* paths used by the update row that the consumers do not know yet */
+  uint8_t path_buf[BUFFER_LEN];
+  uint8_t *path_ptr = path_buf;
+  size_t path_written = 0;
+
   ssize_t s;
 
   /* both iterators refer to a prefix to do a cellular diff on */
@@ -399,9 +536,10 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
       bgpview_iter_pfx_seek_peer(parent_view_it, peerid, BGPVIEW_FIELD_ACTIVE);
     /* and did we send this cell last time? */
     int parent_exists_sent =
-      parent_exists && cb(parent_view_it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user);
+      parent_exists &&
+      FILTER(cb, cb_user, parent_view_it, BGPVIEW_IO_FILTER_PFX_PEER);
 
-    int send_this = cb(it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user);
+    int send_this = FILTER(cb, cb_user, it, BGPVIEW_IO_FILTER_PFX_PEER);
 
     int upd_cell = 0;
     int rem_cell = 0;
@@ -436,9 +574,20 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
         upd_ptr += s;
       }
 
+      /* publish the path if needed */
+      if (client->path_dict != 0) {
+        if ((s = path_serialize(client, path_ptr, (BUFFER_LEN - path_written),
+                                it)) == -1) {
+          goto err;
+        }
+        path_written += s;
+        path_ptr += s;
+      }
+
       /* add this cell */
       if ((s = bgpview_io_serialize_pfx_peer(
-             upd_ptr, (BUFFER_LEN - upd_written), it, NULL, NULL, 0)) == -1) {
+             upd_ptr, (BUFFER_LEN - upd_written), it, NULL, NULL,
+             client->path_dict)) == -1) {
         goto err;
       }
       if (s > 0) {
@@ -478,7 +627,7 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
        bgpview_iter_pfx_has_more_peer(parent_view_it);
        bgpview_iter_pfx_next_peer(parent_view_it)) {
     /* was this cell actually sent? */
-    if (cb(parent_view_it, BGPVIEW_IO_FILTER_PFX_PEER, cb_user) == 0) {
+    if (FILTER(cb, cb_user, parent_view_it, BGPVIEW_IO_FILTER_PFX_PEER) == 0) {
       /* no need to do anything */
       continue;
     }
@@ -512,6 +661,16 @@ static int send_cells(bgpview_io_kafka_t *client, bgpview_iter_t *it,
     }
   }
 
+  if (path_written > 0 || upd_cells > 0 || rem_cells > 0) {
+    SEND_PENDING(pend_buf, pend_written);
+  }
+
+  if (path_written > 0) {
+    /* the paths must reach the consumers before the row that uses them */
+    SEND_MSG(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
+             BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, path_buf, path_written);
+  }
+
   if (upd_cells > 0) {
     /* send the update row */
     if ((s = pfx_row_end(upd_ptr, (BUFFER_LEN - upd_written), upd_cells)) ==
@@ -546,18 +705,113 @@ err:
   return -1;
 }
 
+/* diff a single prefix. `exists` and `parent_exists` indicate whether `it` and
+   `parent_view_it` (respectively) point at the (active) prefix. rows are
+   serialized into buf after the `*written` bytes already pending there, unless
+   a cellular diff is needed, in which case the pending bytes are sent (and
+   `*written` reset) before the cells. returns the number of bytes serialized
+   into buf (which must be sent by the caller), 0 if nothing needed to be
+   serialized, or -1 on error */
+static ssize_t diff_pfx(bgpview_io_kafka_t *client, uint8_t *buf,
+                        size_t *written, size_t len, bgpview_iter_t *it,
+                        int exists,
+                        bgpview_iter_t *parent_view_it, int parent_exists,
+                        bgpview_io_filter_cb_t *cb, void *cb_user)
+{
+  ssize_t s = 0;
+
+  /* did we send this prefix last time? */
+  int parent_exists_sent =
+    parent_exists && FILTER(cb, cb_user, parent_view_it, BGPVIEW_IO_FILTER_PFX);
+
+  /* does the user want this prefix sent? */
+  int send_this = exists && FILTER(cb, cb_user, it, BGPVIEW_IO_FILTER_PFX);
+
+  if (parent_exists_sent && send_this) {
+    /* cellular diff */
+    if (send_cells(client, buf, written, it, parent_view_it, cb, cb_user) !=
+        0) {
+      return -1;
+    }
+  } else if (parent_exists_sent && !send_this) {
+    /* remove row (parent cb) */
+    if ((s = pfx_row_serialize(client, buf + *written, len - *written, 'R',
+                               parent_view_it, cb, cb_user)) < 0) {
+      return -1;
+    }
+
+    if (s > 0) {
+      STAT(removed_pfxs_cnt)++;
+    }
+  } else if (!parent_exists_sent && send_this) {
+    /* update row (current cb) */
+    if ((s = pfx_row_serialize(client, buf + *written, len - *written, 'U',
+                               it, cb, cb_user)) < 0) {
+      return -1;
+    }
+
+    if (s > 0) {
+      STAT(added_pfxs_cnt)++;
+    }
+  }
+  /* else: nothing to send */
+
+  return s;
+}
+
+/* returns 1 if the filter callback would select a different set of peers for
+   the view than it did for the parent view, 0 otherwise */
+static int sent_peers_changed(bgpview_iter_t *it,
+                              bgpview_iter_t *parent_view_it,
+                              bgpview_io_filter_cb_t *cb, void *cb_user)
+{
+  int sent, parent_sent;
+
+  if (cb == NULL) {
+    return 0;
+  }
+
+  for (bgpview_iter_first_peer(it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(it); bgpview_iter_next_peer(it)) {
+    sent = cb(it, BGPVIEW_IO_FILTER_PEER, cb_user);
+    parent_sent =
+      bgpview_iter_seek_peer(parent_view_it, bgpview_iter_peer_get_peer_id(it),
+                             BGPVIEW_FIELD_ACTIVE) &&
+      cb(parent_view_it, BGPVIEW_IO_FILTER_PEER, cb_user);
+    if (sent < 0 || parent_sent < 0 || (sent != 0) != (parent_sent != 0)) {
+      return 1;
+    }
+  }
+
+  /* and any peers that were sent last time but are no longer in the view */
+  for (bgpview_iter_first_peer(parent_view_it, BGPVIEW_FIELD_ACTIVE);
+       bgpview_iter_has_more_peer(parent_view_it);
+       bgpview_iter_next_peer(parent_view_it)) {
+    if (bgpview_iter_seek_peer(it,
+                               bgpview_iter_peer_get_peer_id(parent_view_it),
+                               BGPVIEW_FIELD_ACTIVE) == 0 &&
+        cb(parent_view_it, BGPVIEW_IO_FILTER_PEER, cb_user) != 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
 static int send_pfxs(bgpview_io_kafka_t *client, bgpview_io_kafka_md_t *meta,
                      bgpview_iter_t *it, bgpview_t *parent_view,
-                     bgpview_iter_t *parent_view_it, bgpview_io_filter_cb_t *cb,
-                     void *cb_user)
+                     bgpview_iter_t *parent_view_it, int changed_only,
+                     bgpview_io_filter_cb_t *cb, void *cb_user)
 {
   /* serialization buffer and state */
   uint8_t buf[BUFFER_LEN];
   uint8_t *ptr = buf;
-  ;
   size_t len = BUFFER_LEN;
   size_t written = 0;
   ssize_t s = 0;
+  bgpstream_pfx_t *pfx;
+  int exists, parent_exists;
+  char type;
 
 again:
   /* find our current offset and update the metadata */
@@ -568,6 +822,46 @@ again:
     goto again;
   }
 
+  /* tell the consumers which path dictionary the path indices refer to
+     (without it, they expect full paths) */
+  if (client->path_dict != 0) {
+    type = 'H';
+    BGPVIEW_IO_SERIALIZE_VAL(ptr, len, written, type);
+    BGPVIEW_IO_SERIALIZE_VAL(ptr, len, written, client->prod_state.path_epoch);
+  }
+
+  if (changed_only != 0) {
+    /* the view knows which prefixes have been touched since the parent was
+       published, so only those need to be diffed (this covers both added and
+       removed prefixes) */
+    assert(meta->type == 'D');
+    for (bgpview_iter_first_changed_pfx(it, 0);
+         bgpview_iter_has_more_changed_pfx(it);
+         bgpview_iter_next_changed_pfx(it)) {
+      pfx = bgpview_iter_changed_pfx_get_pfx(it);
+      exists = bgpview_iter_seek_pfx(it, pfx, BGPVIEW_FIELD_ACTIVE);
+      parent_exists =
+        bgpview_iter_seek_pfx(parent_view_it, pfx, BGPVIEW_FIELD_ACTIVE);
+
+      if ((s = diff_pfx(client, buf, &written, len, it, exists,
+                        parent_view_it, parent_exists, cb, cb_user)) < 0) {
+        goto err;
+      }
+      /* a cellular diff may have sent the pending bytes */
+      ptr = buf + written;
+      if (s > 0) {
+        written += s;
+        ptr += s;
+        SEND_IF_FULL(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
+                     BGPVIEW_IO_KAFKA_PFXS_PARTITION_DEFAULT, buf, written, ptr,
+                     len);
+        s = 0;
+        STAT(pfx_cnt)++;
+      }
+    }
+    goto end;
+  }
+
   /* for each prefix in new view */
   for (bgpview_iter_first_pfx(it, 0, BGPVIEW_FIELD_ACTIVE);
        bgpview_iter_has_more_pfx(it); bgpview_iter_next_pfx(it)) {
@@ -593,44 +887,16 @@ again:
     /* we are sending a diff */
     assert(meta->type == 'D');
 
-    bgpstream_pfx_t *pfx = bgpview_iter_pfx_get_pfx(it);
-    int parent_exists =
+    pfx = bgpview_iter_pfx_get_pfx(it);
+    parent_exists =
       bgpview_iter_seek_pfx(parent_view_it, pfx, BGPVIEW_FIELD_ACTIVE);
-    /* did we send this prefix last time? */
-    int parent_exists_sent =
-      parent_exists && cb(parent_view_it, BGPVIEW_IO_FILTER_PFX, cb_user);
-
-    /* does the user want this prefix sent? */
-    int send_this = cb(it, BGPVIEW_IO_FILTER_PFX, cb_user);
 
-    if (parent_exists_sent && send_this) {
-      /* cellular diff */
-      if (send_cells(client, it, parent_view_it, cb, cb_user) != 0) {
-        goto err;
-      }
-    } else if (parent_exists_sent && !send_this) {
-      /* remove row (parent cb) */
-      if ((s = pfx_row_serialize(client, ptr, len, 'R', parent_view_it, cb,
-                                 cb_user)) < 0) {
-        goto err;
-      }
-
-      if (s > 0) {
-        STAT(removed_pfxs_cnt)++;
-      }
-    } else if (!parent_exists_sent && send_this) {
-      /* update row (current cb) */
-      if ((s = pfx_row_serialize(client, ptr, len, 'U', it, cb, cb_user)) < 0) {
-        goto err;
-      }
-
-      if (s > 0) {
-        STAT(added_pfxs_cnt)++;
-      }
-    } else {
-      /* nothing to send */
-      continue;
+    if ((s = diff_pfx(client, buf, &written, len, it, 1, parent_view_it,
+                      parent_exists, cb, cb_user)) < 0) {
+      goto err;
     }
+    /* a cellular diff may have sent the pending bytes */
+    ptr = buf + written;
 
     /* if one of the above cases serialized something, send the message now */
     if (s > 0) {
@@ -651,12 +917,12 @@ again:
          bgpview_iter_has_more_pfx(parent_view_it);
          bgpview_iter_next_pfx(parent_view_it)) {
       /* was this prefix actually sent? */
-      if (cb(parent_view_it, BGPVIEW_IO_FILTER_PFX, cb_user) == 0) {
+      if (FILTER(cb, cb_user, parent_view_it, BGPVIEW_IO_FILTER_PFX) == 0) {
         /* no need to do anything */
         continue;
       }
 
-      bgpstream_pfx_t *pfx = bgpview_iter_pfx_get_pfx(parent_view_it);
+      pfx = bgpview_iter_pfx_get_pfx(parent_view_it);
       /* does this prefix exist in the new view? */
       if (bgpview_iter_seek_pfx(it, pfx, BGPVIEW_FIELD_ACTIVE) != 1) {
         /* does not exist, send a removal (parent iter) */
@@ -678,6 +944,7 @@ again:
     }
   }
 
+end:
   /* send whatever is left in the buffer */
   if (written > 0) {
     SEND_MSG(BGPVIEW_IO_KAFKA_TOPIC_ID_PFXS,
@@ -687,7 +954,7 @@ again:
 
   /* send the end-of-prefixes message */
   assert(ptr == buf);
-  char type = 'E';
+  type = 'E';
   BGPVIEW_IO_SERIALIZE_VAL(ptr, len, written, type);
   /* Time */
   BGPVIEW_IO_SERIALIZE_VAL(ptr, len, written, meta->time);
@@ -716,10 +983,15 @@ static int send_sync_view(bgpview_io_kafka_t *client, bgpview_t *view,
   meta.time = bgpview_get_time(view);
   meta.type = 'S';
 
+  /* a sync frame must be usable by consumers that have not seen any previous
+     view, so it re-publishes every path that it uses. consumers that already
+     know them keep their mapping since the epoch does not change. */
+  paths_reset(client, 0);
+
   if (send_peers(client, &meta, view, it, NULL, cb, cb_user) != 0) {
     goto err;
   }
-  if (send_pfxs(client, &meta, it, NULL, NULL, cb, cb_user) != 0) {
+  if (send_pfxs(client, &meta, it, NULL, NULL, 0, cb, cb_user) != 0) {
     goto err;
   }
 
@@ -751,6 +1023,7 @@ static int send_diff_view(bgpview_io_kafka_t *client, bgpview_t *view,
   bgpview_iter_t *it = NULL;
   bgpview_iter_t *parent_view_it = NULL;
   bgpview_io_kafka_md_t meta;
+  int changed_only;
 
   if ((it = bgpview_iter_create(view)) == NULL) {
     goto err;
@@ -771,8 +1044,14 @@ static int send_diff_view(bgpview_io_kafka_t *client, bgpview_t *view,
     goto err;
   }
 
-  if (send_pfxs(client, &meta, it, parent_view, parent_view_it, cb, cb_user) ==
-      -1) {
+  /* if the view has been tracking its changes since the parent was published,
+     and the filter still selects the same peers, then only the changed
+     prefixes need to be compared */
+  changed_only =
+    bgpview_has_changes_since(view, meta.parent_time) &&
+    !sent_peers_changed(it, parent_view_it, cb, cb_user);
+  if (send_pfxs(client, &meta, it, parent_view, parent_view_it, changed_only,
+                cb, cb_user) == -1) {
     goto err;
   }
 
@@ -872,9 +1151,22 @@ int bgpview_io_kafka_producer_send(bgpview_io_kafka_t *client, bgpview_t *view,
                                    bgpview_t *parent_view,
                                    bgpview_io_filter_cb_t *cb, void *cb_user)
 {
+  bgpstream_as_path_store_t *store = bgpview_get_as_path_store(view);
+
   /* reset the stats */
   memset(&client->prod_state.stats, 0, sizeof(bgpview_io_kafka_stats_t));
 
+  /* path indices are only stable within a single path store */
+  if (client->prod_state.path_store == NULL) {
+    struct timeval epoch_tv;
+    gettimeofday(&epoch_tv, NULL);
+    client->prod_state.path_epoch = epoch_tv.tv_sec;
+    client->prod_state.path_store = store;
+  } else if (client->prod_state.path_store != store) {
+    paths_reset(client, 1);
+    client->prod_state.path_store = store;
+  }
+
   // if it has been a while since we told the members topic about ourselves,
   // lets do that now
   struct timeval tv;
@@ -902,5 +1194,7 @@ int bgpview_io_kafka_producer_send(bgpview_io_kafka_t *client, bgpview_t *view,
   return 0;
 
 err:
+  /* some of the paths marked as published may never have been sent */
+  paths_reset(client, 1);
   return -1;
 }
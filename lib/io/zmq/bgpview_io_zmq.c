@@ -219,7 +219,7 @@ static int recv_pfxs(void *src, bgpview_iter_t *it,
 
     if ((read = bgpview_io_deserialize_pfx_row(
            buf, len, it, pfx_cb, pfx_peer_cb, peerid_map, peerid_map_cnt,
-           pathid_map, pathid_map_cnt, BGPVIEW_FIELD_ACTIVE)) == -1) {
+           pathid_map, NULL, pathid_map_cnt, BGPVIEW_FIELD_ACTIVE)) == -1) {
       goto err;
     }
 
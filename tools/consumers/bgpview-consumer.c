@@ -51,6 +51,14 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef WITH_BGPVIEW_IO_FILE
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+/** Maximum number of -c options */
+#define MAX_CONSUMER_CMDS 256
 
 static bgpview_consumer_manager_t *manager = NULL;
 static timeseries_t *timeseries = NULL;
@@ -103,6 +111,28 @@ static bgpview_io_test_t *test_generator = NULL;
 static bgpview_io_zmq_client_t *zmq_client = NULL;
 #endif
 
+#ifdef WITH_BGPVIEW_IO_FILE
+/** Maximum number of worker processes */
+#define MAX_WORKERS 32
+
+/** A worker process that runs a group of consumers on a copy of each view */
+typedef struct worker {
+
+  /** Process ID of the worker */
+  pid_t pid;
+
+  /** Write end of the pipe the views are sent to the worker over */
+  int fd;
+
+  /** wandio handle used to write to the pipe */
+  iow_t *outfile;
+
+} worker_t;
+
+static worker_t workers[MAX_WORKERS];
+static int workers_cnt = 0;
+#endif
+
 static int parse_pfx(char *value)
 {
   bgpstream_pfx_t pfx;
@@ -386,6 +416,16 @@ static void usage(const char *name)
   fprintf(stderr, "       -c\"<consumer> <opts>\" Consumer to activate (can be "
                   "used multiple times)\n");
   consumer_usage();
+#ifdef WITH_BGPVIEW_IO_FILE
+  fprintf(stderr,
+          "       -g                    Start a new consumer group: the "
+          "consumers\n"
+          "                               given after -g are run by a worker\n"
+          "                               process, which is sent each view\n"
+          "                               over a pipe (a group must include\n"
+          "                               the consumers that its consumers\n"
+          "                               depend on, e.g., visibility)\n");
+#endif
 
   /* Filter config */
   fprintf(stderr,
@@ -519,6 +559,9 @@ static void shutdown_io(void)
 #endif
 }
 
+/* returns 0 if a view was received, -1 if no more views can be received, or
+ * -2 if a view could not be read (only the file module can tell this apart
+ * from the end of the stream) */
 static int recv_view(char *io_module)
 {
   if (0) { /* just to simplify the if/else with macros */
@@ -526,10 +569,18 @@ static int recv_view(char *io_module)
 #ifdef WITH_BGPVIEW_IO_FILE
   else if (strcmp(io_module, "file") == 0) {
     bgpview_clear(view);
-    return bgpview_io_file_read(
+    /* returns 1 if a view was read, 0 on EOF, -1 on error */
+    switch (bgpview_io_file_read(
       file_handle, view, (peer_filters_cnt != 0) ? filter_peer : NULL,
       (pfx_filters_cnt != 0) ? filter_pfx : NULL,
-      (pfx_peer_filters_cnt != 0) ? filter_pfx_peer : NULL);
+      (pfx_peer_filters_cnt != 0) ? filter_pfx_peer : NULL)) {
+    case 1:
+      return 0;
+    case 0:
+      return -1;
+    default:
+      return -2;
+    }
   }
 #endif
 #ifdef WITH_BGPVIEW_IO_KAFKA
@@ -565,6 +616,115 @@ static int recv_view(char *io_module)
   return -1;
 }
 
+#ifdef WITH_BGPVIEW_IO_FILE
+/* fork a worker process for each consumer group but the first. returns the
+ * group that the calling process runs (0 for the coordinator), or -1 if an
+ * error occurred */
+static int start_workers(int groups_cnt, int *worker_fd)
+{
+  int fds[2];
+  pid_t pid;
+  int g, i;
+
+  /* a worker that exits early must not kill the coordinator */
+  signal(SIGPIPE, SIG_IGN);
+
+  for (g = 1; g < groups_cnt; g++) {
+    if (pipe(fds) != 0) {
+      fprintf(stderr, "ERROR: Could not create pipe for worker %d\n", g);
+      return -1;
+    }
+    if ((pid = fork()) < 0) {
+      fprintf(stderr, "ERROR: Could not start worker %d\n", g);
+      close(fds[0]);
+      close(fds[1]);
+      return -1;
+    }
+    if (pid == 0) {
+      /* worker: only keep the read end of our own pipe */
+      close(fds[1]);
+      for (i = 0; i < workers_cnt; i++) {
+        close(workers[i].fd);
+      }
+      workers_cnt = 0;
+      *worker_fd = fds[0];
+      return g;
+    }
+    close(fds[0]);
+    workers[workers_cnt].pid = pid;
+    workers[workers_cnt].fd = fds[1];
+    workers[workers_cnt].outfile = NULL;
+    workers_cnt++;
+    fprintf(stderr, "INFO: Started worker %d (pid %d)\n", g, (int)pid);
+  }
+
+  return 0;
+}
+
+static int open_workers(void)
+{
+  char name[64];
+  int i;
+
+  for (i = 0; i < workers_cnt; i++) {
+    snprintf(name, sizeof(name), "/dev/fd/%d", workers[i].fd);
+    if ((workers[i].outfile =
+           wandio_wcreate(name, WANDIO_COMPRESS_NONE, 0, O_CREAT)) == NULL) {
+      fprintf(stderr, "ERROR: Could not open pipe to worker %d\n", i + 1);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int send_view_to_workers(bgpview_t *view)
+{
+  int i;
+
+  for (i = 0; i < workers_cnt; i++) {
+    if (bgpview_io_file_write(workers[i].outfile, view, NULL, NULL) != 0) {
+      fprintf(stderr, "ERROR: Could not send view to worker %d\n", i + 1);
+      return -1;
+    }
+#ifdef HAVE_WANDIO_WFLUSH
+    /* don't hold the end of the view until the next one is written */
+    wandio_wflush(workers[i].outfile);
+#endif
+  }
+
+  return 0;
+}
+
+/* close the pipes (so the workers see EOF) and wait for the workers to exit.
+ * returns -1 if a worker failed */
+static int stop_workers(void)
+{
+  int status;
+  int ret = 0;
+  int i;
+
+  for (i = 0; i < workers_cnt; i++) {
+    if (workers[i].outfile != NULL) {
+      wandio_wdestroy(workers[i].outfile);
+      workers[i].outfile = NULL;
+    }
+    close(workers[i].fd);
+  }
+
+  for (i = 0; i < workers_cnt; i++) {
+    if (waitpid(workers[i].pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "ERROR: Worker %d failed\n", i + 1);
+      ret = -1;
+    }
+  }
+  workers_cnt = 0;
+
+  return ret;
+}
+#endif
+
 int main(int argc, char **argv)
 {
   /* for option parsing */
@@ -572,10 +732,21 @@ int main(int argc, char **argv)
   int prevoptind;
 
   /* to store command line argument values */
-  char *consumer_cmds[BVC_ID_LAST];
+  char *consumer_cmds[MAX_CONSUMER_CMDS];
+  int consumer_groups[MAX_CONSUMER_CMDS];
   int consumer_cmds_cnt = 0;
   int i;
 
+  /* consumer group that -c options are added to, and the group run by this
+     process (0 for the coordinator, >0 for a worker) */
+  int group = 0;
+  int my_group = 0;
+#ifdef WITH_BGPVIEW_IO_FILE
+  int group_cnts[MAX_WORKERS + 1] = {0};
+  int worker_fd = -1;
+  char worker_io[64];
+#endif
+
   char *metric_prefix = NULL;
 
   char *backends[TIMESERIES_BACKEND_ID_LAST];
@@ -586,6 +757,7 @@ int main(int argc, char **argv)
   int processed_view_limit = -1;
   int processed_view = 0;
   int view_is_borrowed = 0;
+  int recv_rc;
 
   char *io_module = NULL;
 
@@ -606,7 +778,7 @@ int main(int argc, char **argv)
   }
 
   while (prevoptind = optind,
-         (opt = getopt(argc, argv, "f:i:m:N:b:c:v?")) >= 0) {
+         (opt = getopt(argc, argv, "f:i:m:N:b:c:gv?")) >= 0) {
     if (optind == prevoptind + 2 && (optarg && *optarg == '-')) {
       fprintf(stderr, "ERROR: argument for %s looks like an option "
           "(remove the space after %s to force the argument)\n",
@@ -642,15 +814,31 @@ int main(int argc, char **argv)
       break;
 
     case 'c':
-      if (consumer_cmds_cnt >= BVC_ID_LAST) {
+      if (consumer_cmds_cnt >= MAX_CONSUMER_CMDS) {
         fprintf(stderr, "ERROR: At most %d consumers can be enabled\n",
-                BVC_ID_LAST);
+                MAX_CONSUMER_CMDS);
         usage(argv[0]);
         return -1;
       }
+      consumer_groups[consumer_cmds_cnt] = group;
       consumer_cmds[consumer_cmds_cnt++] = optarg;
       break;
 
+    case 'g':
+#ifdef WITH_BGPVIEW_IO_FILE
+      if (group >= MAX_WORKERS) {
+        fprintf(stderr, "ERROR: At most %d worker groups can be used\n",
+                MAX_WORKERS);
+        usage(argv[0]);
+        return -1;
+      }
+      group++;
+#else
+      fprintf(stderr, "ERROR: Consumer groups require the file IO module\n");
+      return -1;
+#endif
+      break;
+
     case 'v':
       fprintf(stderr, "bgpview version %d.%d.%d\n", BGPVIEW_MAJOR_VERSION,
               BGPVIEW_MID_VERSION, BGPVIEW_MINOR_VERSION);
@@ -689,6 +877,32 @@ int main(int argc, char **argv)
     goto err;
   }
 
+#ifdef WITH_BGPVIEW_IO_FILE
+  if (group > 0) {
+    for (i = 0; i < consumer_cmds_cnt; i++) {
+      group_cnts[consumer_groups[i]]++;
+    }
+    for (i = 1; i <= group; i++) {
+      if (group_cnts[i] == 0) {
+        fprintf(stderr, "ERROR: Consumer group %d has no consumers\n", i);
+        usage(argv[0]);
+        goto err;
+      }
+    }
+
+    /* start the workers before the timeseries backends and the consumers
+       are set up, so that each process has its own */
+    if ((my_group = start_workers(group + 1, &worker_fd)) < 0) {
+      goto err;
+    }
+    if (my_group > 0) {
+      /* workers read the views that the coordinator writes to the pipe */
+      snprintf(worker_io, sizeof(worker_io), "file /dev/fd/%d", worker_fd);
+      io_module = worker_io;
+    }
+  }
+#endif
+
   /* enable the backends that were requested */
   for (i = 0; i < backends_cnt; i++) {
     /* the string at backends[i] will contain the name of the plugin,
@@ -720,6 +934,9 @@ int main(int argc, char **argv)
 
   for (i = 0; i < consumer_cmds_cnt; i++) {
     assert(consumer_cmds[i] != NULL);
+    if (consumer_groups[i] != my_group) {
+      continue;
+    }
     if (bgpview_consumer_manager_enable_consumer_from_str(
           manager, consumer_cmds[i]) == NULL) {
       goto err;
@@ -731,6 +948,12 @@ int main(int argc, char **argv)
     goto err;
   }
 
+#ifdef WITH_BGPVIEW_IO_FILE
+  if (open_workers() != 0) {
+    goto err;
+  }
+#endif
+
   if (0) { /* just to simplify the if/else with macros */
   }
 #ifdef WITH_BGPVIEW_IO_BSRT
@@ -756,13 +979,26 @@ int main(int argc, char **argv)
     bgpview_disable_user_data(view);
   }
 
-  while (recv_view(io_module) == 0) {
+  while ((recv_rc = recv_view(io_module)) == 0) {
+#ifdef WITH_BGPVIEW_IO_FILE
+    /* the workers process the view while we run our own consumers */
+    if (send_view_to_workers(view) != 0) {
+      goto err;
+    }
+#endif
+
     if (bgpview_consumer_manager_process_view(manager, view) != 0) {
       fprintf(stderr, "ERROR: Failed to process view at %d\n",
               bgpview_get_time(view));
       goto err;
     }
 
+    /* bsrt writes its own metrics to the timeseries backends while it
+       builds the next view */
+    if (view_is_borrowed) {
+      bgpview_consumer_manager_wait_flush(manager);
+    }
+
     processed_view++;
 
     if (processed_view_limit > 0 && processed_view >= processed_view_limit) {
@@ -771,7 +1007,22 @@ int main(int argc, char **argv)
     }
   }
 
+  /* a truncated or corrupt stream must not look like a clean shutdown (the
+     coordinator relies on the exit status of its workers) */
+  if (recv_rc == -2) {
+    fprintf(stderr, "ERROR: Could not read view\n");
+    goto err;
+  }
+
   fprintf(stderr, "INFO: Shutting down...\n");
+#ifdef WITH_BGPVIEW_IO_FILE
+  if (workers_cnt > 0) {
+    fprintf(stderr, "INFO: Waiting for workers...\n");
+    if (stop_workers() != 0) {
+      goto err;
+    }
+  }
+#endif
   shutdown_io();
   fprintf(stderr, "INFO: Destroying filters...\n");
   filters_destroy();
@@ -786,6 +1037,9 @@ int main(int argc, char **argv)
   return 0;
 
 err:
+#ifdef WITH_BGPVIEW_IO_FILE
+  stop_workers();
+#endif
   shutdown_io();
   filters_destroy();
   if (!view_is_borrowed)